@@ -0,0 +1,257 @@
+#include "alloctracker.h"
+
+#ifdef BSPWALKER_ALLOC_TRACKING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <QStringList>
+
+#if defined(__GLIBC__)
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#define ALLOC_TRACKING_MALLOC
+#endif
+
+namespace {
+
+// Frames kept per call site, after skipping the tracker and the allocator itself
+const int SITE_DEPTH = 4;
+// Call sites in the table; further sites are merged into the last slot
+const int MAX_SITES = 1024;
+
+struct Site
+{
+    void *frames[SITE_DEPTH];
+    quint64 count;
+    quint64 bytes;
+};
+
+// Plain arrays, since the table is used from inside the allocator
+Site sites[MAX_SITES];
+int siteCount = 0;
+std::mutex siteMutex;
+
+thread_local bool counting = false;
+// Set while the tracker itself runs, so its own work (and backtrace's lazy initialization) is never counted
+thread_local bool inTracker = false;
+thread_local quint64 frameAllocations = 0;
+thread_local quint64 frameBytes = 0;
+
+quint64 lastFrameAllocations = 0;
+quint64 lastFrameBytes = 0;
+
+/**
+ * @brief Counts an allocation made by the calling thread, if it is inside a frame
+ * @param caller The call site, when the stack is not walked
+ */
+#ifdef ALLOC_TRACKING_MALLOC
+// Never inlined, so the number of frames to skip in the backtrace is fixed
+__attribute__((noinline))
+#endif
+void record(size_t size, void *caller)
+{
+    if (!counting || inTracker)
+        return;
+
+    inTracker = true;
+
+    ++frameAllocations;
+    frameBytes += size;
+
+    void *frames[SITE_DEPTH + 2] = {};
+#ifdef ALLOC_TRACKING_MALLOC
+    Q_UNUSED(caller);
+
+    // Skip record() and the intercepted allocation function
+    void *stack[SITE_DEPTH + 2];
+    int depth = backtrace(stack, SITE_DEPTH + 2);
+    for (int i = 2; i < depth; ++i)
+        frames[i - 2] = stack[i];
+#else
+    frames[0] = caller;
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(siteMutex);
+
+        int index = 0;
+        for (; index < siteCount; ++index) {
+            if (memcmp(sites[index].frames, frames, sizeof (sites[index].frames)) == 0)
+                break;
+        }
+
+        if (index == siteCount) {
+            if (siteCount < MAX_SITES) {
+                memcpy(sites[index].frames, frames, sizeof (sites[index].frames));
+                sites[index].count = sites[index].bytes = 0;
+                ++siteCount;
+            }
+            else
+                index = MAX_SITES - 1;
+        }
+
+        sites[index].count++;
+        sites[index].bytes += size;
+    }
+
+    inTracker = false;
+}
+
+QString describe(void *address)
+{
+    if (!address)
+        return QString();
+
+#ifdef ALLOC_TRACKING_MALLOC
+    Dl_info info;
+    if (dladdr(address, &info) && info.dli_sname) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        QString name = QString::fromLatin1(status == 0 && demangled ? demangled : info.dli_sname);
+        free(demangled);
+        return name;
+    }
+#endif
+
+    return QString("0x%1").arg((quintptr)address, 0, 16);
+}
+
+}
+
+#ifdef ALLOC_TRACKING_MALLOC
+
+// glibc exports its allocator under these names, so the public ones can be replaced and still forward to it
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    record(size, nullptr);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    record(count * size, nullptr);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    record(size, nullptr);
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    record(size, nullptr);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    record(size, nullptr);
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer ? 0 : ENOMEM;
+}
+}
+
+#else
+
+// Without malloc interposition, count what goes through operator new; array and nothrow forms use these by default
+void *operator new(size_t size)
+{
+    record(size, __builtin_return_address(0));
+    void *pointer = std::malloc(size ? size : 1);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+#endif
+
+void AllocationTracker::beginFrame()
+{
+#ifdef ALLOC_TRACKING_MALLOC
+    // backtrace loads libgcc the first time it is called, so make sure that happens outside a frame
+    static bool primed = false;
+    if (!primed) {
+        void *stack[1];
+        inTracker = true;
+        backtrace(stack, 1);
+        inTracker = false;
+        primed = true;
+    }
+#endif
+
+    frameAllocations = 0;
+    frameBytes = 0;
+    counting = true;
+}
+
+void AllocationTracker::endFrame()
+{
+    counting = false;
+
+    lastFrameAllocations = frameAllocations;
+    lastFrameBytes = frameBytes;
+}
+
+quint64 AllocationTracker::getFrameAllocations()
+{
+    return lastFrameAllocations;
+}
+
+quint64 AllocationTracker::getFrameBytes()
+{
+    return lastFrameBytes;
+}
+
+void AllocationTracker::reset()
+{
+    std::lock_guard<std::mutex> lock(siteMutex);
+    siteCount = 0;
+}
+
+QString AllocationTracker::report(int maxSites)
+{
+    std::vector<Site> sorted;
+    {
+        std::lock_guard<std::mutex> lock(siteMutex);
+        sorted.assign(sites, sites + siteCount);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const Site &a, const Site &b) {
+        return a.count > b.count;
+    });
+
+    QString text;
+    for (int i = 0; i < std::min((int)sorted.size(), maxSites); ++i) {
+        const Site &site = sorted[i];
+
+        QStringList frames;
+        for (int frame = 0; frame < SITE_DEPTH && site.frames[frame]; ++frame)
+            frames << describe(site.frames[frame]);
+
+        text += QString("%1 allocations, %2 bytes: %3\n").arg(site.count).arg(site.bytes).arg(frames.join(" <- "));
+    }
+
+    return text;
+}
+
+#endif // BSPWALKER_ALLOC_TRACKING
@@ -0,0 +1,56 @@
+#ifndef ALLOCTRACKER_H
+#define ALLOCTRACKER_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Counts the heap allocations made by a thread between beginFrame() and endFrame(), by call site
+ *
+ * Only available in builds configured with CONFIG+=alloc_tracking, which define BSPWALKER_ALLOC_TRACKING. On glibc every
+ * malloc is intercepted, so allocations made by Qt and the GL driver on behalf of the frame are counted too; elsewhere only
+ * operator new is. In regular builds every method is an empty inline function.
+ */
+class AllocationTracker
+{
+public:
+#ifdef BSPWALKER_ALLOC_TRACKING
+    static bool isAvailable() { return true; }
+
+    /**
+     * @brief Starts counting the allocations of the calling thread
+     */
+    static void beginFrame();
+
+    /**
+     * @brief Stops counting, and adds the counts of the frame to the call site table
+     */
+    static void endFrame();
+
+    /**
+     * @brief Returns the allocations of the last finished frame
+     */
+    static quint64 getFrameAllocations();
+    static quint64 getFrameBytes();
+
+    /**
+     * @brief Forgets the call site table
+     */
+    static void reset();
+
+    /**
+     * @brief Returns the call sites that allocated since the last reset, most frequent first, one per line
+     */
+    static QString report(int maxSites = 20);
+#else
+    static bool isAvailable() { return false; }
+    static void beginFrame() {}
+    static void endFrame() {}
+    static quint64 getFrameAllocations() { return 0; }
+    static quint64 getFrameBytes() { return 0; }
+    static void reset() {}
+    static QString report(int = 20) { return QString(); }
+#endif
+};
+
+#endif // ALLOCTRACKER_H
@@ -0,0 +1,275 @@
+#include "benchmarkrunner.h"
+
+#include "alloctracker.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+namespace {
+
+/**
+ * @brief Returns the value below which ''fraction'' of the values fall, using the nearest rank
+ */
+float percentile(std::vector<float> values, float fraction)
+{
+    if (values.empty())
+        return 0.0f;
+
+    std::sort(values.begin(), values.end());
+    size_t rank = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    return values[rank];
+}
+
+float average(const std::vector<float> &values)
+{
+    if (values.empty())
+        return 0.0f;
+
+    double total = 0.0;
+    for (auto value = values.begin(); value != values.end(); ++value)
+        total += *value;
+
+    return total / values.size();
+}
+
+}
+
+BenchmarkRunner::BenchmarkRunner(const BenchmarkOptions &options)
+    : options(options)
+{
+    firstMeasuredFrame = 0;
+    visibilityStalls = 0;
+}
+
+bool BenchmarkRunner::loadPath()
+{
+    if (!options.cameraPathFile.isEmpty()) {
+        if (!path.load(options.cameraPathFile)) {
+            qWarning() << "Unable to read the camera path" << options.cameraPathFile << endl;
+            return false;
+        }
+    }
+    else {
+        QVector3D position, angles;
+        renderer.getWorld()->getStartView(position, angles);
+        path.createTurnaround(position, angles, options.turnaroundFrames);
+    }
+
+    if (path.isEmpty()) {
+        qWarning() << "The camera path is empty" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+int BenchmarkRunner::run()
+{
+    if (options.checkAllocations && !AllocationTracker::isAvailable()) {
+        qWarning() << "Checking allocations requires a build configured with CONFIG+=alloc_tracking" << endl;
+        return 1;
+    }
+
+    renderer.setDrawOrder(options.drawOrder, options.depthPrePass);
+    renderer.setVisibilityLatency(options.visibilityLatency);
+    renderer.setCullingThreads(options.cullingThreads);
+    renderer.setClusterBatching(options.clusterBatching);
+
+    if (!renderer.create(options.size) || !renderer.loadMap(options.mapFile) || !loadPath())
+        return 1;
+
+    FrameProfiler &profiler = renderer.getProfiler();
+    profiler.setListener(this);
+
+    for (int i = 0; i < options.warmupFrames; ++i)
+        renderer.renderFrame(path.at(0).position, path.at(0).rotation);
+
+    firstMeasuredFrame = profiler.getFrameNumber() + 1;
+    results.assign(path.size(), FrameResult());
+
+    // Only call sites of the measured frames are reported
+    AllocationTracker::reset();
+    qint64 warmupStalls = renderer.getVisibilityStalls();
+
+    for (int i = 0; i < path.size(); ++i) {
+        renderer.renderFrame(path.at(i).position, path.at(i).rotation);
+
+        FrameResult &result = results[i];
+        result.stats = renderer.getRenderStats();
+        result.allocations = AllocationTracker::getFrameAllocations();
+        result.allocatedBytes = AllocationTracker::getFrameBytes();
+    }
+
+    profiler.flush();
+    profiler.setListener(nullptr);
+
+    visibilityStalls = renderer.getVisibilityStalls() - warmupStalls;
+
+    printSummary();
+
+    if (!options.outputFile.isEmpty()) {
+        bool written = options.outputFile.endsWith(".json", Qt::CaseInsensitive) ? writeJson(options.outputFile) : writeCsv(options.outputFile);
+        if (!written) {
+            qWarning() << "Unable to write the results to" << options.outputFile << endl;
+            return 1;
+        }
+    }
+
+    if (options.checkAllocations && !checkAllocations())
+        return 2;
+
+    return 0;
+}
+
+bool BenchmarkRunner::checkAllocations() const
+{
+    int allocatingFrames = 0;
+    for (auto result = results.begin(); result != results.end(); ++result) {
+        if (result->allocations > 0)
+            ++allocatingFrames;
+    }
+
+    if (allocatingFrames > 0) {
+        std::cerr << allocatingFrames << " of " << results.size() << " measured frames allocated memory, by call site:\n"
+                  << AllocationTracker::report().toLocal8Bit().data() << std::flush;
+        return false;
+    }
+
+    std::cout << "No allocations in " << results.size() << " measured frames" << std::endl;
+    return true;
+}
+
+void BenchmarkRunner::frameCollected(qint64 frame, const std::vector<ProfileSample> &samples)
+{
+    qint64 index = frame - firstMeasuredFrame;
+    if (index < 0 || index >= (qint64)results.size() || samples.empty())
+        return;
+
+    // The first scope is always "Frame", which encloses everything else
+    FrameResult &result = results[index];
+    result.cpu = samples[0].cpu;
+    result.gpu = samples[0].gpu;
+    result.collected = true;
+}
+
+bool BenchmarkRunner::writeCsv(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "frame,cpu_ms,gpu_ms,draw_calls,visible_surfaces,visible_leafs,triangles,shaded_samples";
+    if (AllocationTracker::isAvailable())
+        stream << ",allocations,allocated_bytes";
+    stream << '\n';
+
+    for (int i = 0; i < (int)results.size(); ++i) {
+        const FrameResult &result = results[i];
+        stream << i << ',';
+        if (result.collected)
+            stream << result.cpu << ',' << result.gpu << ',';
+        else
+            stream << ",,";
+        stream << result.stats.drawCalls << ',' << result.stats.visibleSurfaces << ',' << result.stats.visibleLeafs << ',' << result.stats.triangles << ',' << result.stats.shadedSamples;
+        if (AllocationTracker::isAvailable())
+            stream << ',' << result.allocations << ',' << result.allocatedBytes;
+        stream << '\n';
+    }
+
+    return stream.status() == QTextStream::Ok;
+}
+
+bool BenchmarkRunner::writeJson(const QString &fileName) const
+{
+    QJsonArray frames;
+    std::vector<float> cpu, gpu;
+
+    for (int i = 0; i < (int)results.size(); ++i) {
+        const FrameResult &result = results[i];
+
+        QJsonObject frame;
+        frame["frame"] = i;
+        if (result.collected) {
+            frame["cpu_ms"] = result.cpu;
+            frame["gpu_ms"] = result.gpu;
+            cpu.push_back(result.cpu);
+            gpu.push_back(result.gpu);
+        }
+        frame["draw_calls"] = result.stats.drawCalls;
+        frame["visible_surfaces"] = result.stats.visibleSurfaces;
+        frame["visible_leafs"] = result.stats.visibleLeafs;
+        frame["triangles"] = result.stats.triangles;
+        frame["shaded_samples"] = result.stats.shadedSamples;
+        if (AllocationTracker::isAvailable()) {
+            frame["allocations"] = (qint64)result.allocations;
+            frame["allocated_bytes"] = (qint64)result.allocatedBytes;
+        }
+        frames.append(frame);
+    }
+
+    QJsonObject summary;
+    summary["cpu_avg_ms"] = average(cpu);
+    summary["cpu_p50_ms"] = percentile(cpu, 0.50f);
+    summary["cpu_p99_ms"] = percentile(cpu, 0.99f);
+    summary["gpu_avg_ms"] = average(gpu);
+    summary["gpu_p50_ms"] = percentile(gpu, 0.50f);
+    summary["gpu_p99_ms"] = percentile(gpu, 0.99f);
+    summary["visibility_stalls"] = visibilityStalls;
+
+    QJsonObject root;
+    root["map"] = options.mapFile;
+    root["camera_path"] = options.cameraPathFile;
+    root["width"] = options.size.width();
+    root["height"] = options.size.height();
+    root["renderer"] = renderer.getRendererName();
+    root["draw_order"] = options.drawOrder == BSP::FrontToBack ? "front-to-back" : "leaf";
+    root["depth_prepass"] = options.depthPrePass;
+    root["visibility_latency"] = options.visibilityLatency;
+    root["culling_threads"] = options.cullingThreads;
+    root["cluster_batches"] = options.clusterBatching;
+    root["summary"] = summary;
+    root["frames"] = frames;
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    return file.write(QJsonDocument(root).toJson()) > 0;
+}
+
+void BenchmarkRunner::printSummary() const
+{
+    std::vector<float> cpu, gpu, samplesPerPixel;
+    int dropped = 0;
+    double pixels = qMax(1, options.size.width() * options.size.height());
+
+    for (auto result = results.begin(); result != results.end(); ++result) {
+        if (result->stats.shadedSamples >= 0)
+            samplesPerPixel.push_back((float)(result->stats.shadedSamples / pixels));
+
+        if (!result->collected) {
+            ++dropped;
+            continue;
+        }
+
+        cpu.push_back(result->cpu);
+        gpu.push_back(result->gpu);
+    }
+
+    std::cout << results.size() << " frames";
+    if (dropped)
+        std::cout << " (" << dropped << " without timings)";
+    std::cout << "\n";
+    std::cout << "CPU ms: avg " << average(cpu) << " p50 " << percentile(cpu, 0.50f) << " p99 " << percentile(cpu, 0.99f) << "\n";
+    std::cout << "GPU ms: avg " << average(gpu) << " p50 " << percentile(gpu, 0.50f) << " p99 " << percentile(gpu, 0.99f) << "\n";
+    std::cout << "Shaded samples per pixel: avg " << average(samplesPerPixel) << " p99 " << percentile(samplesPerPixel, 0.99f) << "\n";
+    std::cout << "Visibility stalls: " << visibilityStalls << std::endl;
+}
@@ -0,0 +1,94 @@
+#ifndef BENCHMARKRUNNER_H
+#define BENCHMARKRUNNER_H
+
+#include "camerapath.h"
+#include "frameprofiler.h"
+#include "offscreenrenderer.h"
+
+#include <vector>
+
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief Settings of a headless benchmark run
+ */
+struct BenchmarkOptions
+{
+    QString mapFile;
+    /// @brief Camera path to play back; if empty, the camera turns around at the start position
+    QString cameraPathFile;
+    /// @brief Where the results are written; a .json extension writes JSON, anything else CSV
+    QString outputFile;
+    QSize size;
+    /// @brief Frames rendered with the first camera sample before measuring
+    int warmupFrames;
+    /// @brief Length of the turnaround path, used when there is no camera path
+    int turnaroundFrames;
+    /// @brief Fails the run if any measured frame allocates; requires an alloc_tracking build
+    bool checkAllocations;
+    BSP::DrawOrder drawOrder;
+    bool depthPrePass;
+    /// @brief Frames the visible set trails the camera; 1 builds it on a worker thread
+    int visibilityLatency;
+    /// @brief Threads the culling is split over; 0 uses one per core
+    int cullingThreads;
+    /// @brief Draws the surfaces merged by cluster and material
+    bool clusterBatching;
+};
+
+/**
+ * @brief Renders a camera path into an offscreen framebuffer and records the cost of every frame
+ *
+ * Each camera sample is rendered exactly once, regardless of how long the frame takes, so runs are comparable between machines
+ * and with software rasterizers such as llvmpipe.
+ */
+class BenchmarkRunner : private FrameProfilerListener
+{
+public:
+    BenchmarkRunner(const BenchmarkOptions &options);
+
+    /**
+     * @brief Runs the benchmark and writes the results
+     * @return The process exit code; 0 on success, 2 if checking allocations and a measured frame allocated
+     */
+    int run();
+
+private:
+    struct FrameResult {
+        float cpu;
+        float gpu;
+        BSPRenderStats stats;
+        quint64 allocations;
+        quint64 allocatedBytes;
+        bool collected;
+    };
+
+    bool loadPath();
+
+    virtual void frameCollected(qint64 frame, const std::vector<ProfileSample> &samples);
+
+    bool writeCsv(const QString &fileName) const;
+    bool writeJson(const QString &fileName) const;
+    void printSummary() const;
+
+    /**
+     * @brief Reports the allocation call sites if any measured frame allocated
+     * @return false if some frame allocated
+     */
+    bool checkAllocations() const;
+
+    BenchmarkOptions options;
+
+    OffscreenRenderer renderer;
+
+    CameraPath path;
+
+    /// @brief Profiler frame number of the first measured frame; earlier frames are warmup
+    qint64 firstMeasuredFrame;
+    std::vector<FrameResult> results;
+    /// @brief Measured frames that waited for the visibility worker
+    qint64 visibilityStalls;
+};
+
+#endif // BENCHMARKRUNNER_H
@@ -0,0 +1,13 @@
+# Shared harness of the microbenchmarks; benchmarks link the map code directly, like the tools
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../bspcore.pri)
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += $$PWD/microbenchmark.cpp
+
+HEADERS += $$PWD/microbenchmark.h
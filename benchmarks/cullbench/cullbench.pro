@@ -0,0 +1,9 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = cullbench
+TEMPLATE = app
+
+include(../benchmarks.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,273 @@
+#include "bspculler.h"
+#include "bspvisibility.h"
+#include "bspworld.h"
+#include "microbenchmark.h"
+#include "threadpool.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+
+// Keeps the results of the measured calls alive so they are not optimized away
+static volatile unsigned sink;
+
+struct Viewpoint
+{
+    QVector3D position;
+    QMatrix4x4 viewProjection;
+};
+
+/**
+ * @brief Looks from the start position and from the centers of random leafs, in random directions, with the projection of the viewer
+ */
+static std::vector<Viewpoint> createViewpoints(const BSPWorld &world, int count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> yaw(0.0f, 360.0f);
+
+    QMatrix4x4 projection;
+    projection.perspective(45.0f, 16.0f / 9.0f, 0.1f, 2000.0f);
+
+    std::vector<int> leafs;
+    for (int i = 0; i < (int)world.getLeafs().size(); ++i) {
+        if (world.getLeafs()[i].cluster >= 0)
+            leafs.push_back(i);
+    }
+
+    std::vector<Viewpoint> viewpoints;
+    for (int i = 0; i < count; ++i) {
+        QVector3D position, angles;
+        world.getStartView(position, angles);
+
+        if (i > 0 && !leafs.empty()) {
+            const dleaf_t &leaf = world.getLeafs()[leafs[random() % leafs.size()]];
+            position = QVector3D(leaf.mins[0] + leaf.maxs[0], leaf.mins[1] + leaf.maxs[1], leaf.mins[2] + leaf.maxs[2]) * 0.5f;
+        }
+
+        // Quake maps are z up
+        float angle = yaw(random) * (float)M_PI / 180.0f;
+        QMatrix4x4 view;
+        view.lookAt(position, position + QVector3D(std::cos(angle), std::sin(angle), 0.0f), QVector3D(0.0f, 0.0f, 1.0f));
+
+        Viewpoint viewpoint;
+        viewpoint.position = position;
+        viewpoint.viewProjection = projection * view;
+        viewpoints.push_back(viewpoint);
+    }
+
+    return viewpoints;
+}
+
+/**
+ * @brief Returns the camera cluster of every frame of a walk through the viewpoints, as a flying camera crosses the map
+ */
+static std::vector<int> createWalk(const BSPWorld &world, const std::vector<Viewpoint> &viewpoints, int framesPerSegment)
+{
+    std::vector<int> clusters;
+
+    for (size_t i = 0; i + 1 < viewpoints.size(); ++i) {
+        QVector3D from = viewpoints[i].position;
+        QVector3D to = viewpoints[i + 1].position;
+
+        for (int frame = 0; frame < framesPerSegment; ++frame) {
+            QVector3D position = from + (to - from) * ((float)frame / framesPerSegment);
+            clusters.push_back(world.getLeafs()[world.findNodeForPosition(position)].cluster);
+        }
+    }
+
+    return clusters;
+}
+
+/**
+ * @brief Returns a run-length encoded copy of a PVS, whose rows go through PVSRowCache whatever the storage of the world
+ */
+static BSPVisibility *compressVisibility(const BSPVisibility &visibility)
+{
+    int count = visibility.getClusterCount();
+    int size = visibility.getClusterSize();
+
+    std::vector<char> lump(8 + (size_t)count * size);
+    int header[2] = { count, size };
+    memcpy(lump.data(), header, sizeof (header));
+
+    for (int cluster = 0; cluster < count; ++cluster)
+        visibility.decompressRow(cluster, reinterpret_cast<unsigned char*>(lump.data()) + 8 + (size_t)cluster * size);
+
+    BSPVisibility *compressed = new BSPVisibility;
+    compressed->load(lump.data(), (int)lump.size(), BSPVisibility::Compressed);
+    return compressed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("cullbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the culling of the given maps on 1 to N threads and reports the speedup");
+    parser.addHelpOption();
+    parser.addPositionalArgument("maps", "BSP files to cull; bspgen writes large synthetic ones", "maps...");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads", "Largest thread count; counts double up to it (default: one per core)", "count", "0");
+    parser.addOption(threadsOption);
+    QCommandLineOption viewpointsOption("viewpoints", "Viewpoints culled by each iteration (default: 16)", "count", "16");
+    parser.addOption(viewpointsOption);
+    QCommandLineOption orderOption("front-to-back", "Walks the BSP tree front to back instead of the leafs in index order");
+    parser.addOption(orderOption);
+    QCommandLineOption filterOption(QStringList() << "f" << "filter", "Only run the cases whose name contains <text>", "text");
+    parser.addOption(filterOption);
+    QCommandLineOption timeOption(QStringList() << "t" << "time", "Minimum time spent on each case, in milliseconds (default: 1000)", "ms", "1000");
+    parser.addOption(timeOption);
+    QCommandLineOption repetitionsOption(QStringList() << "r" << "repetitions", "Repetitions of each case; the median is reported (default: 5)", "count", "5");
+    parser.addOption(repetitionsOption);
+    parser.process(a);
+
+    const QStringList maps = parser.positionalArguments();
+    if (maps.isEmpty()) {
+        std::cerr << "No map given" << std::endl;
+        return 1;
+    }
+
+    int maxThreads = parser.value(threadsOption).toInt();
+    if (maxThreads <= 0)
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int viewpointCount = qMax(1, parser.value(viewpointsOption).toInt());
+    bool frontToBack = parser.isSet(orderOption);
+
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    MicroBenchmark benchmark;
+    benchmark.setFilter(parser.value(filterOption));
+    benchmark.setMinimumTime(qMax(1, parser.value(timeOption).toInt()));
+    benchmark.setRepetitions(qMax(1, parser.value(repetitionsOption).toInt()));
+
+    // Owned here, since the cases only keep pointers
+    std::vector<BSPWorld*> worlds;
+    std::vector<ThreadPool*> pools;
+    std::vector<BSPCuller*> cullers;
+    std::vector<std::vector<Viewpoint>*> viewpointSets;
+    std::vector<BSPVisibility*> compressedSets;
+    std::vector<PVSRowCache*> rowCaches;
+    // Hits and misses of one walk with an empty cache, for each map
+    std::vector<std::pair<int, int>> walkLookups;
+    BSPDrawList list, reference;
+
+    for (int threads : threadCounts)
+        pools.push_back(threads > 1 ? new ThreadPool(threads) : nullptr);
+
+    for (auto map = maps.begin(); map != maps.end(); ++map) {
+        BSPWorld *world = new BSPWorld;
+        if (!world->loadMap(*map)) {
+            std::cerr << "Unable to load " << map->toLocal8Bit().data() << std::endl;
+            return 1;
+        }
+        worlds.push_back(world);
+
+        std::vector<Viewpoint> *viewpoints = new std::vector<Viewpoint>(createViewpoints(*world, viewpointCount, 48));
+        viewpointSets.push_back(viewpoints);
+
+        QString name = QFileInfo(*map).fileName();
+        BSPCuller *single = nullptr;
+
+        for (size_t i = 0; i < threadCounts.size(); ++i) {
+            BSPCuller *culler = new BSPCuller;
+            culler->setWorld(world, nullptr);
+            culler->setThreadPool(pools[i]);
+            cullers.push_back(culler);
+            if (!single)
+                single = culler;
+
+            // The split must not change the result
+            for (const Viewpoint &viewpoint : *viewpoints) {
+                culler->build(viewpoint.position, viewpoint.viewProjection, frontToBack, false, list);
+                single->build(viewpoint.position, viewpoint.viewProjection, frontToBack, false, reference);
+                if (list.surfaces != reference.surfaces) {
+                    std::cerr << name.toLocal8Bit().data() << ": " << threadCounts[i] << " threads cull differently from 1" << std::endl;
+                    return 1;
+                }
+            }
+
+            benchmark.add(QString("%1 threads=%2").arg(name).arg(threadCounts[i]), [culler, viewpoints, frontToBack, &list]() {
+                for (const Viewpoint &viewpoint : *viewpoints)
+                    culler->build(viewpoint.position, viewpoint.viewProjection, frontToBack, false, list);
+            }, 0, viewpoints->size(), "views");
+        }
+
+        // The row of the camera cluster is fetched every frame, so it must come from the cache while the camera stays in or near a cluster
+        std::vector<int> walk = createWalk(*world, *viewpoints, 120);
+        BSPVisibility *compressed = compressVisibility(world->getVisibility());
+        compressedSets.push_back(compressed);
+        PVSRowCache *rowCache = new PVSRowCache;
+        rowCaches.push_back(rowCache);
+
+        for (int cluster : walk)
+            rowCache->getRow(*compressed, cluster);
+        walkLookups.push_back(std::make_pair(rowCache->getHits(), rowCache->getMisses()));
+
+        benchmark.add(QString("%1 PVS rows").arg(name), [compressed, rowCache, walk]() {
+            unsigned sum = 0;
+            for (int cluster : walk) {
+                const unsigned char *row = rowCache->getRow(*compressed, cluster);
+                sum += row ? row[0] : 0;
+            }
+            sink = sum;
+        }, 0, walk.size(), "frames");
+    }
+
+    if (benchmark.run() == 0) {
+        std::cerr << "No case matches the filter" << std::endl;
+        return 1;
+    }
+
+    printf("\n%-32s %8s %14s %10s %12s\n", "Map", "Threads", "Time/view", "Speedup", "Efficiency");
+    for (auto map = maps.begin(); map != maps.end(); ++map) {
+        QString name = QFileInfo(*map).fileName();
+        double baseline = benchmark.getTime(QString("%1 threads=1").arg(name));
+
+        for (int threads : threadCounts) {
+            double time = benchmark.getTime(QString("%1 threads=%2").arg(name).arg(threads));
+            if (time <= 0.0)
+                continue;
+
+            QString speedup = baseline > 0.0 ? QString::number(baseline / time, 'f', 2) : QString("-");
+            QString efficiency = baseline > 0.0 ? QString("%1%").arg(100.0 * baseline / time / threads, 0, 'f', 0) : QString("-");
+            printf("%-32s %8d %11.3f us %10s %12s\n", name.toLocal8Bit().constData(), threads, time / viewpointCount / 1e3,
+                   speedup.toLocal8Bit().constData(), efficiency.toLocal8Bit().constData());
+        }
+    }
+
+    printf("\n%-32s %12s %12s %10s\n", "Map", "Row hits", "Row misses", "Hit rate");
+    for (size_t i = 0; i < walkLookups.size(); ++i) {
+        int hits = walkLookups[i].first;
+        int misses = walkLookups[i].second;
+        if (hits + misses == 0)
+            continue;
+
+        printf("%-32s %12d %12d %9.1f%%\n", QFileInfo(maps[i]).fileName().toLocal8Bit().constData(), hits, misses, 100.0 * hits / (hits + misses));
+    }
+
+    for (auto rowCache : rowCaches)
+        delete rowCache;
+    for (auto compressed : compressedSets)
+        delete compressed;
+    for (auto culler : cullers)
+        delete culler;
+    for (auto pool : pools)
+        delete pool;
+    for (auto viewpoints : viewpointSets)
+        delete viewpoints;
+    for (auto world : worlds)
+        delete world;
+
+    return 0;
+}
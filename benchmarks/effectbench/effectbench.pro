@@ -0,0 +1,16 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = effectbench
+TEMPLATE = app
+
+include(../benchmarks.pri)
+
+SOURCES += main.cpp \
+    ../../postprocesseffect.cpp \
+    ../../rendertargetpool.cpp
+
+HEADERS += ../../postprocesseffect.h \
+    ../../rendertargetpool.h
+
+RESOURCES += ../../bspwalker.qrc
@@ -0,0 +1,151 @@
+#include "microbenchmark.h"
+#include "postprocesseffect.h"
+#include "rendertargetpool.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+
+/**
+ * @brief The targets the effects read and write at one resolution
+ */
+struct EffectTargets
+{
+    QSize size;
+    RenderTarget *color;
+    RenderTarget *depth;
+    RenderTarget *output;
+};
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication a(argc, argv);
+    QCoreApplication::setApplicationName("effectbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares the fragment and compute shader paths of the post-processing effects at common resolutions");
+    parser.addHelpOption();
+    QCommandLineOption filterOption(QStringList() << "f" << "filter", "Only run the cases whose name contains <text>", "text");
+    parser.addOption(filterOption);
+    QCommandLineOption timeOption(QStringList() << "t" << "time", "Minimum time spent on each case, in milliseconds (default: 1000)", "ms", "1000");
+    parser.addOption(timeOption);
+    QCommandLineOption repetitionsOption(QStringList() << "r" << "repetitions", "Repetitions of each case; the median is reported (default: 5)", "count", "5");
+    parser.addOption(repetitionsOption);
+    parser.process(a);
+
+    QSurfaceFormat format;
+    format.setVersion(4, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create() || !context.makeCurrent(&surface)) {
+        std::cerr << "Unable to create an OpenGL context" << std::endl;
+        return 1;
+    }
+
+    QOpenGLFunctions *gl = context.functions();
+
+    RenderTargetPool pool;
+    pool.initializeGL();
+
+    // Both paths run at the same size, so the blurs stay at full resolution
+    HorizontalGaussianBlurEffect horizontalBlur;
+    horizontalBlur.setSigma(2.5f);
+    horizontalBlur.setDownsample(0);
+    horizontalBlur.create();
+
+    VerticalGaussianBlurEffect verticalBlur;
+    verticalBlur.setSigma(2.5f);
+    verticalBlur.setDownsample(0);
+    verticalBlur.create();
+
+    EdgeDetectionEffect edgeDetection;
+    edgeDetection.setAdditive(true);
+    edgeDetection.setIntensity(0.2f);
+    edgeDetection.create();
+
+    PostProcessEffect *effects[] = { &horizontalBlur, &verticalBlur, &edgeDetection };
+    const char *effectNames[] = { "blur-horizontal", "blur-vertical", "edge-detection" };
+
+    if (!edgeDetection.hasComputePath())
+        std::cerr << "The context does not support compute shaders; only the fragment path runs" << std::endl;
+
+    static const QSize resolutions[] = { QSize(1280, 720), QSize(1920, 1080), QSize(2560, 1440), QSize(3840, 2160) };
+
+    // Noise, so no effect gets a uniform input
+    std::mt19937 random(1);
+    std::vector<EffectTargets> targets;
+    for (const QSize &size : resolutions) {
+        EffectTargets resolution;
+        resolution.size = size;
+        resolution.color = pool.acquire(size.width(), size.height());
+        resolution.depth = pool.acquire(size.width(), size.height(), GL_DEPTH_COMPONENT24);
+        resolution.output = pool.acquire(size.width(), size.height());
+
+        std::vector<quint32> noise((size_t)size.width() * size.height());
+        for (auto texel = noise.begin(); texel != noise.end(); ++texel)
+            *texel = random();
+
+        gl->glBindTexture(GL_TEXTURE_2D, resolution.color->texture);
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, noise.data());
+
+        targets.push_back(resolution);
+    }
+
+    MicroBenchmark benchmark;
+    benchmark.setFilter(parser.value(filterOption));
+    benchmark.setMinimumTime(qMax(1, parser.value(timeOption).toInt()));
+    benchmark.setRepetitions(qMax(1, parser.value(repetitionsOption).toInt()));
+
+    for (auto resolution = targets.begin(); resolution != targets.end(); ++resolution) {
+        for (size_t i = 0; i < sizeof (effects) / sizeof (effects[0]); ++i) {
+            for (int compute = 0; compute < 2; ++compute) {
+                PostProcessEffect *effect = effects[i];
+                if (compute && !effect->hasComputePath())
+                    continue;
+
+                EffectTargets t = *resolution;
+                QString name = QString("%1/%2/%3x%4").arg(effectNames[i]).arg(compute ? "compute" : "fragment")
+                        .arg(t.size.width()).arg(t.size.height());
+
+                auto run = [effect, t, compute, gl]() {
+                    if (compute) {
+                        effect->dispatch(t.color->texture, t.color->texture, t.depth->texture, t.output->texture, t.size.width(), t.size.height());
+                    } else {
+                        gl->glBindFramebuffer(GL_FRAMEBUFFER, t.output->fbo);
+                        gl->glViewport(0, 0, t.size.width(), t.size.height());
+                        effect->render(t.color->texture, t.color->texture, t.depth->texture);
+                    }
+
+                    // Times the work of the GPU, not only its submission
+                    gl->glFinish();
+                };
+
+                auto setup = [effect, t, compute]() {
+                    effect->setComputeEnabled(compute != 0);
+                    effect->setScreenDimentions(QVector2D(t.size.width(), t.size.height()));
+                };
+
+                benchmark.add(name, run, 0, (double)t.size.width() * t.size.height(), "pixels", setup);
+            }
+        }
+    }
+
+    if (benchmark.run() == 0) {
+        std::cerr << "No case matches the filter" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
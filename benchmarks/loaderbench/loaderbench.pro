@@ -0,0 +1,12 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = loaderbench
+TEMPLATE = app
+
+include(../benchmarks.pri)
+
+SOURCES += main.cpp \
+    loaderbenchmark.cpp
+
+HEADERS += loaderbenchmark.h
@@ -0,0 +1,412 @@
+#include "loaderbenchmark.h"
+
+#include "bspindexdata.h"
+#include "bspworld.h"
+#include "lightgrid.h"
+#include "q3parser.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QVector3D>
+
+// Keeps the results of the measured calls alive so they are not optimized away
+static volatile unsigned sink;
+
+LoaderBenchmark::LoaderBenchmark(MicroBenchmark &benchmark)
+    : benchmark(benchmark), random(46)
+{
+
+}
+
+void LoaderBenchmark::addSynthetic()
+{
+    QByteArray block(16 * 1024 * 1024, 0);
+    for (int i = 0; i < block.size(); ++i)
+        block[i] = (char)random();
+    addChecksum("synthetic 16MB", block);
+
+    QByteArray entities = createEntityString(MAX_MAP_ENTITIES);
+    addParser("synthetic entities", entities);
+    addEntities("synthetic", entities);
+
+    addShaders("synthetic", createTemporaryFile(createShaderScript(MAX_MAP_SHADERS)));
+
+    addVertices("synthetic", createVertices(MAX_MAP_DRAW_VERTS));
+
+    QByteArray sparse = createVisLump(4096, 0.05f);
+    addVisData("synthetic 4096 clusters 5%", createTemporaryFile(sparse), lump_t{0, sparse.size()});
+
+    QByteArray dense = createVisLump(4096, 0.5f);
+    addVisData("synthetic 4096 clusters 50%", createTemporaryFile(dense), lump_t{0, dense.size()});
+
+    // A large outdoor map: 8192 units across and 2048 high
+    dmodel_t worldModel = {{-4096, -4096, -1024}, {4096, 4096, 1024}, 0, 0, 0, 0};
+    std::shared_ptr<BSPLightGrid> grid = createLightGrid(worldModel);
+    addLightGrid("synthetic", grid, 256);
+    addLightGrid("synthetic", grid, 1024);
+}
+
+bool LoaderBenchmark::addMap(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QByteArray contents = file.readAll();
+    file.close();
+
+    if (contents.size() < (int)sizeof (dheader_t))
+        return false;
+
+    dheader_t header;
+    memcpy(&header, contents.constData(), sizeof (header));
+
+    QString name = QFileInfo(fileName).fileName();
+
+    // Whole lump loading, as done by loadMap before any parsing
+    std::shared_ptr<BSPWorld> world(new BSPWorld);
+    std::shared_ptr<QFile> mapFile(new QFile(fileName));
+    if (!mapFile->open(QFile::ReadOnly) || !world->internalLoadMap(*mapFile))
+        return false;
+
+    QByteArray entityString(world->entityString.data(), world->entityString.size());
+    std::vector<dvert_t> vertexData = world->vertexData;
+
+    benchmark.add("internalLoadMap/" + name, [world, mapFile]() {
+        world->internalLoadMap(*mapFile);
+    }, contents.size(), 0, QString(), [world]() {
+        world->destroyLumpData();
+        world->visibility.clear();
+    });
+
+    addChecksum(name, contents);
+
+    // The entity lump is null terminated in the file, but make sure of it
+    if (!entityString.endsWith('\0'))
+        entityString.append('\0');
+    addParser(name + " entities", entityString);
+    addEntities(name, entityString);
+
+    QString shaderScript = BSPWorld::findShaderScript(fileName);
+    if (shaderScript != fileName && QFile::exists(shaderScript))
+        addShaders(name, shaderScript);
+
+    addVertices(name, vertexData);
+
+    if (header.lumps[LUMP_VISIBILITY].filelen > 0)
+        addVisData(name, fileName, header.lumps[LUMP_VISIBILITY]);
+
+    addIndexData(name, world);
+
+    return true;
+}
+
+void LoaderBenchmark::addChecksum(const QString &name, const QByteArray &data)
+{
+    benchmark.add("blockChecksum/" + name, [data]() {
+        sink = BSPWorld::blockChecksum(data.constData(), data.size());
+    }, data.size(), 0, QString());
+}
+
+void LoaderBenchmark::addParser(const QString &name, const QByteArray &text)
+{
+    // Count the tokens once, so the rate is in tokens per second
+    int tokens = 0;
+    Q3Parser counter(text.constData());
+    while (counter.next() != Q3TOK_EOF)
+        ++tokens;
+
+    benchmark.add("Q3Parser::next/" + name, [text]() {
+        Q3Parser parser(text.constData());
+        unsigned count = 0;
+        while (parser.next() != Q3TOK_EOF)
+            ++count;
+        sink = count;
+    }, text.size(), tokens, "tokens/s");
+}
+
+void LoaderBenchmark::addEntities(const QString &name, const QByteArray &text)
+{
+    std::shared_ptr<BSPWorld> world(new BSPWorld);
+
+    world->entityString.assign(text.constData(), text.constData() + text.size());
+    world->parseEntities();
+    int count = world->entities.size();
+
+    benchmark.add("parseEntities/" + name, [world]() {
+        world->parseEntities();
+    }, text.size(), count, "entities/s", [world, text]() {
+        world->releaseMap();
+        world->entityString.assign(text.constData(), text.constData() + text.size());
+    });
+}
+
+void LoaderBenchmark::addShaders(const QString &name, const QString &fileName)
+{
+    std::shared_ptr<BSPWorld> world(new BSPWorld);
+
+    world->parseShaderData(fileName);
+    int count = world->shaderInfos.size();
+
+    benchmark.add("parseShaderData/" + name, [world, fileName]() {
+        world->parseShaderData(fileName);
+    }, QFileInfo(fileName).size(), count, "shaders/s", [world]() {
+        world->shaderInfos.clear();
+    });
+}
+
+void LoaderBenchmark::addVertices(const QString &name, const std::vector<dvert_t> &vertices)
+{
+    if (vertices.empty())
+        return;
+
+    std::shared_ptr<BSPWorld> world(new BSPWorld);
+
+    benchmark.add("convertVertices/" + name, [world]() {
+        world->convertVertices();
+    }, vertices.size() * sizeof (dvert_t), vertices.size(), "vertices/s", [world, vertices]() {
+        world->vertexData = vertices;
+    });
+}
+
+void LoaderBenchmark::addVisData(const QString &name, const QString &fileName, lump_t lump)
+{
+    static const BSPVisibility::Storage storages[] = { BSPVisibility::Uncompressed, BSPVisibility::Compressed };
+    static const char *storageNames[] = { "uncompressed", "compressed" };
+
+    for (int i = 0; i < 2; ++i) {
+        std::shared_ptr<BSPWorld> world(new BSPWorld);
+        std::shared_ptr<QFile> file(new QFile(fileName));
+        if (!file->open(QFile::ReadOnly))
+            return;
+
+        world->setVisibilityStorage(storages[i]);
+
+        // Loaded once ahead to measure the storage; the setup clears it before every iteration
+        if (storages[i] == BSPVisibility::Compressed && world->loadVisData(*file, lump)) {
+            VisibilitySize size;
+            size.name = name;
+            size.clusters = world->visibility.getClusterCount();
+            size.uncompressed = world->visibility.getUncompressedSize();
+            size.compressed = world->visibility.getMemoryUsage();
+            visibilitySizes.push_back(size);
+        }
+
+        benchmark.add(QString("loadVisData/%1 %2").arg(name, storageNames[i]), [world, file, lump]() {
+            world->loadVisData(*file, lump);
+        }, lump.filelen, 0, QString(), [world]() {
+            world->visibility.clear();
+        });
+    }
+}
+
+void LoaderBenchmark::printVisibilitySizes() const
+{
+    if (visibilitySizes.empty())
+        return;
+
+    printf("\n%-40s %8s %14s %14s %8s\n", "PVS", "Clusters", "Uncompressed", "Compressed", "Saved");
+    for (auto size = visibilitySizes.begin(); size != visibilitySizes.end(); ++size) {
+        double saved = size->uncompressed > 0 ? 100.0 * (1.0 - (double)size->compressed / size->uncompressed) : 0.0;
+        printf("%-40s %8d %11zu KB %11zu KB %7.1f%%\n", size->name.toLocal8Bit().constData(), size->clusters,
+               size->uncompressed / 1024, size->compressed / 1024, saved);
+    }
+}
+
+void LoaderBenchmark::printIndexData() const
+{
+    if (indexDataStats.empty())
+        return;
+
+    // ACMR: vertices transformed per triangle with a VERTEX_CACHE_SIZE FIFO
+    printf("\n%-40s %10s %11s %11s %6s %12s %11s %7s %8s\n", "Indexes", "Triangles", "32-bit", "Stored", "Wide", "ACMR before", "ACMR after",
+           "Groups", "Batches");
+    for (auto stats = indexDataStats.begin(); stats != indexDataStats.end(); ++stats) {
+        printf("%-40s %10d %8zu KB %8zu KB %6d %12.3f %11.3f %7d %8d\n", stats->name.toLocal8Bit().constData(), stats->triangles,
+               stats->wideSize / 1024, stats->size / 1024, stats->wideSurfaces, stats->missRatioBefore, stats->missRatioAfter,
+               stats->groups, stats->batches);
+    }
+}
+
+QByteArray LoaderBenchmark::createEntityString(int count)
+{
+    static const char *classnames[] = { "info_player_deathmatch", "light", "target_position", "item_armor_body", "weapon_rocketlauncher" };
+
+    std::uniform_int_distribution<int> coordinate(-4096, 4096);
+    std::uniform_int_distribution<int> classname(0, 4);
+
+    QByteArray text;
+    text += "{\n\"classname\" \"worldspawn\"\n\"message\" \"Synthetic\"\n\"gridsize\" \"64 64 128\"\n}\n";
+
+    for (int i = 1; i < count; ++i) {
+        text += "{\n";
+        text += QString("\"origin\" \"%1 %2 %3\"\n").arg(coordinate(random)).arg(coordinate(random)).arg(coordinate(random)).toLatin1();
+        text += QString("\"angle\" \"%1\"\n").arg(coordinate(random) % 360).toLatin1();
+        text += QString("\"classname\" \"%1\"\n").arg(classnames[classname(random)]).toLatin1();
+        text += "}\n";
+    }
+
+    text.append('\0');
+
+    return text;
+}
+
+QByteArray LoaderBenchmark::createShaderScript(int count)
+{
+    std::uniform_int_distribution<int> scroll(-100, 100);
+
+    QByteArray text;
+    text += "// Generated shader script\n";
+
+    for (int i = 0; i < count; ++i) {
+        text += QString("textures/synthetic/shader%1\n{\n").arg(i).toLatin1();
+        if (i == 0)
+            text += "\tq3map_sun 1 0.9 0.8 140 45 60\n";
+        text += "\t{\n\t\tmap $lightmap\n\t\trgbGen identity\n\t}\n";
+        text += QString("\t{\n\t\tmap textures/synthetic/image%1.tga\n").arg(i).toLatin1();
+        if (i % 4 == 0)
+            text += QString("\t\ttcMod scroll %1 %2\n").arg(scroll(random) / 100.0).arg(scroll(random) / 100.0).toLatin1();
+        text += "\t\tblendFunc filter\n\t}\n}\n";
+    }
+
+    return text;
+}
+
+std::vector<dvert_t> LoaderBenchmark::createVertices(int count)
+{
+    std::uniform_real_distribution<float> coordinate(-4096.0f, 4096.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<dvert_t> vertices(count);
+
+    for (auto vertex = vertices.begin(); vertex != vertices.end(); ++vertex) {
+        for (int i = 0; i < 3; ++i) {
+            vertex->position[i] = coordinate(random);
+            vertex->normal[i] = unit(random);
+        }
+        for (int i = 0; i < 2; ++i) {
+            vertex->textureCoords[i] = unit(random);
+            vertex->lightmap[i] = unit(random);
+        }
+        for (int i = 0; i < 4; ++i)
+            vertex->color[i] = (unsigned char)random();
+    }
+
+    return vertices;
+}
+
+QByteArray LoaderBenchmark::createVisLump(int clusters, float density)
+{
+    int clusterSize = (clusters + 7) / 8;
+
+    QByteArray lump(8 + clusters * clusterSize, 0);
+    int header[2] = { clusters, clusterSize };
+    memcpy(lump.data(), header, sizeof (header));
+
+    // Visibility in real maps is local, so make clusters see a contiguous band of neighbours around themselves
+    int reach = qMax(1, (int)(clusters * density / 2));
+    unsigned char *rows = (unsigned char*)lump.data() + 8;
+
+    for (int cluster = 0; cluster < clusters; ++cluster) {
+        unsigned char *row = rows + cluster * clusterSize;
+        for (int other = qMax(0, cluster - reach); other < qMin(clusters, cluster + reach + 1); ++other)
+            row[other >> 3] |= 1 << (other & 7);
+    }
+
+    return lump;
+}
+
+std::shared_ptr<BSPLightGrid> LoaderBenchmark::createLightGrid(const dmodel_t &worldModel)
+{
+    QVector3D gridSize(LIGHTGRID_SIZE_X, LIGHTGRID_SIZE_Y, LIGHTGRID_SIZE_Z);
+
+    int numPoints = 1;
+    for (int i = 0; i < 3; ++i)
+        numPoints *= (int)(floorf(worldModel.maxs[i] / gridSize[i]) - ceilf(worldModel.mins[i] / gridSize[i])) + 1;
+
+    std::vector<dlightgrid_t> cells(numPoints);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    for (auto cell = cells.begin(); cell != cells.end(); ++cell) {
+        // Cells inside walls are black, and skipped by the sampling
+        bool solid = unit(random) < 0.2f;
+        for (int i = 0; i < 3; ++i) {
+            cell->ambient[i] = solid ? 0 : (unsigned char)(1 + random() % 255);
+            cell->directed[i] = solid ? 0 : (unsigned char)random();
+        }
+        cell->latLong[0] = (unsigned char)random();
+        cell->latLong[1] = (unsigned char)random();
+    }
+
+    std::shared_ptr<BSPLightGrid> grid(new BSPLightGrid);
+    grid->create(worldModel, gridSize, cells);
+
+    return grid;
+}
+
+QString LoaderBenchmark::createTemporaryFile(const QByteArray &data)
+{
+    std::shared_ptr<QTemporaryFile> file(new QTemporaryFile(QDir::tempPath() + "/loaderbench-XXXXXX"));
+    if (!file->open())
+        return QString();
+
+    file->write(data);
+    file->flush();
+    temporaryFiles.push_back(file);
+
+    return file->fileName();
+}
+
+void LoaderBenchmark::addIndexData(const QString &name, std::shared_ptr<BSPWorld> world)
+{
+    std::shared_ptr<BSPIndexData> indexData(new BSPIndexData);
+
+    // Built once ahead for the report; every iteration builds it again from scratch
+    indexData->build(*world);
+
+    IndexDataStats stats;
+    stats.name = name;
+    stats.triangles = world->getIndexes().size() / 3;
+    stats.wideSize = world->getIndexes().size() * sizeof(int);
+    stats.size = indexData->getData().size();
+    stats.wideSurfaces = indexData->getWideSurfaces();
+    stats.missRatioBefore = indexData->getMissRatioBefore();
+    stats.missRatioAfter = indexData->getMissRatioAfter();
+    stats.groups = (int)indexData->getSurfaceGroups().groups.size();
+    stats.batches = (int)indexData->getSurfaceGroups().batches.size();
+    indexDataStats.push_back(stats);
+
+    benchmark.add("BSPIndexData::build/" + name, [world, indexData]() {
+        indexData->build(*world);
+        sink = indexData->getData().size();
+    }, world->getIndexes().size() * sizeof(int), world->getIndexes().size() / 3, "triangles/s");
+}
+
+void LoaderBenchmark::addLightGrid(const QString &name, std::shared_ptr<BSPLightGrid> grid, int positions)
+{
+    if (grid->isEmpty())
+        return;
+
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Positions spread over the whole grid, like entities scattered over a map
+    std::vector<QVector3D> points(positions);
+    for (auto point = points.begin(); point != points.end(); ++point) {
+        for (int i = 0; i < 3; ++i) {
+            float size = grid->getGridSize()[i] * (grid->getBounds(i) - 1);
+            (*point)[i] = grid->getOrigin()[i] + size * unit(random);
+        }
+    }
+
+    std::shared_ptr<std::vector<LightGridSample> > samples(new std::vector<LightGridSample>(positions));
+
+    benchmark.add(QString("BSPLightGrid::sample/%1 %2 positions").arg(name).arg(positions), [grid, points, samples]() {
+        grid->sample(points.data(), samples->data(), (int)points.size());
+        sink = (unsigned)(samples->back().ambient.x() * 255.0f);
+    }, 0, positions, "samples/s");
+}
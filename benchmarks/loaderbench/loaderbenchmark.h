@@ -0,0 +1,100 @@
+#ifndef LOADERBENCHMARK_H
+#define LOADERBENCHMARK_H
+
+#include "bspdefs.h"
+#include "microbenchmark.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+#include <QTemporaryFile>
+
+class BSPLightGrid;
+class BSPWorld;
+
+/**
+ * @brief Registers microbenchmarks for each stage of BSPWorld::loadMap
+ *
+ * Synthetic inputs are generated from a fixed seed, so their results are comparable between runs and machines.
+ * Real maps add the same stages on their own data, plus the whole lump loading.
+ */
+class LoaderBenchmark
+{
+public:
+    LoaderBenchmark(MicroBenchmark &benchmark);
+
+    /**
+     * @brief Adds the cases for generated inputs
+     */
+    void addSynthetic();
+
+    /**
+     * @brief Adds the cases for a map file
+     * @return false if the map cannot be loaded
+     */
+    bool addMap(const QString &fileName);
+
+    /**
+     * @brief Prints the memory used by the compressed PVS of every input, against the uncompressed rows
+     */
+    void printVisibilitySizes() const;
+
+    /**
+     * @brief Prints the size of the index data of every map against 32-bit indexes, the vertex cache misses before and after reordering,
+     * and the number of cluster batches
+     */
+    void printIndexData() const;
+
+private:
+    struct VisibilitySize {
+        QString name;
+        int clusters;
+        size_t uncompressed;
+        size_t compressed;
+    };
+
+    struct IndexDataStats {
+        QString name;
+        int triangles;
+        size_t wideSize;
+        size_t size;
+        int wideSurfaces;
+        float missRatioBefore;
+        float missRatioAfter;
+        int groups;
+        int batches;
+    };
+
+    void addChecksum(const QString &name, const QByteArray &data);
+    void addParser(const QString &name, const QByteArray &text);
+    void addEntities(const QString &name, const QByteArray &text);
+    void addShaders(const QString &name, const QString &fileName);
+    void addVertices(const QString &name, const std::vector<dvert_t> &vertices);
+    void addVisData(const QString &name, const QString &fileName, lump_t lump);
+    void addIndexData(const QString &name, std::shared_ptr<BSPWorld> world);
+    void addLightGrid(const QString &name, std::shared_ptr<BSPLightGrid> grid, int positions);
+
+    QByteArray createEntityString(int count);
+    QByteArray createShaderScript(int count);
+    std::vector<dvert_t> createVertices(int count);
+    QByteArray createVisLump(int clusters, float density);
+    std::shared_ptr<BSPLightGrid> createLightGrid(const dmodel_t &worldModel);
+
+    /**
+     * @brief Writes data to a file that lives as long as the benchmark
+     */
+    QString createTemporaryFile(const QByteArray &data);
+
+    MicroBenchmark &benchmark;
+    std::mt19937 random;
+
+    std::vector<std::shared_ptr<QTemporaryFile> > temporaryFiles;
+
+    std::vector<VisibilitySize> visibilitySizes;
+    std::vector<IndexDataStats> indexDataStats;
+};
+
+#endif // LOADERBENCHMARK_H
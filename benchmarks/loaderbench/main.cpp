@@ -0,0 +1,55 @@
+#include "loaderbenchmark.h"
+#include "microbenchmark.h"
+
+#include <iostream>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("loaderbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times each stage of the BSP loader on synthetic inputs and on the given maps");
+    parser.addHelpOption();
+    parser.addPositionalArgument("maps", "BSP files to benchmark, in addition to the synthetic inputs", "[maps...]");
+    QCommandLineOption filterOption(QStringList() << "f" << "filter", "Only run the cases whose name contains <text>", "text");
+    parser.addOption(filterOption);
+    QCommandLineOption timeOption(QStringList() << "t" << "time", "Minimum time spent on each case, in milliseconds (default: 1000)", "ms", "1000");
+    parser.addOption(timeOption);
+    QCommandLineOption repetitionsOption(QStringList() << "r" << "repetitions", "Repetitions of each case; the median is reported (default: 5)", "count", "5");
+    parser.addOption(repetitionsOption);
+    QCommandLineOption syntheticOption(QStringList() << "n" << "no-synthetic", "Skip the synthetic inputs");
+    parser.addOption(syntheticOption);
+    parser.process(a);
+
+    MicroBenchmark benchmark;
+    benchmark.setFilter(parser.value(filterOption));
+    benchmark.setMinimumTime(qMax(1, parser.value(timeOption).toInt()));
+    benchmark.setRepetitions(qMax(1, parser.value(repetitionsOption).toInt()));
+
+    LoaderBenchmark loader(benchmark);
+
+    if (!parser.isSet(syntheticOption))
+        loader.addSynthetic();
+
+    const QStringList maps = parser.positionalArguments();
+    for (auto map = maps.begin(); map != maps.end(); ++map) {
+        if (!loader.addMap(*map)) {
+            std::cerr << "Unable to load " << map->toLocal8Bit().data() << std::endl;
+            return 1;
+        }
+    }
+
+    if (benchmark.run() == 0) {
+        std::cerr << "No case matches the filter" << std::endl;
+        return 1;
+    }
+
+    loader.printVisibilitySizes();
+    loader.printIndexData();
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "microbenchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <QElapsedTimer>
+
+MicroBenchmark::MicroBenchmark()
+{
+    minimumTime = 1000;
+    repetitions = 5;
+}
+
+void MicroBenchmark::add(const QString &name, Function run, double bytes, double items, const QString &itemName, Function setup)
+{
+    Case benchmark;
+    benchmark.name = name;
+    benchmark.run = run;
+    benchmark.setup = setup;
+    benchmark.bytes = bytes;
+    benchmark.items = items;
+    benchmark.itemName = itemName;
+    benchmark.nanoseconds = 0.0;
+    cases.push_back(benchmark);
+}
+
+int MicroBenchmark::run()
+{
+    int count = 0;
+
+    printf("%-48s %10s %14s %12s %20s\n", "Case", "Iterations", "Time/iter", "MB/s", "Items/s");
+
+    for (auto benchmark = cases.begin(); benchmark != cases.end(); ++benchmark) {
+        if (!filter.isEmpty() && !benchmark->name.contains(filter, Qt::CaseInsensitive))
+            continue;
+
+        qint64 iterations = 0;
+        double nanoseconds = measure(*benchmark, iterations);
+        benchmark->nanoseconds = nanoseconds;
+        double seconds = nanoseconds / 1e9;
+
+        QString time;
+        if (nanoseconds >= 1e6)
+            time = QString("%1 ms").arg(nanoseconds / 1e6, 0, 'f', 3);
+        else
+            time = QString("%1 us").arg(nanoseconds / 1e3, 0, 'f', 3);
+
+        QString bandwidth = benchmark->bytes > 0 ? QString::number(benchmark->bytes / seconds / (1024.0 * 1024.0), 'f', 1) : QString("-");
+        QString rate = benchmark->items > 0 ? QString("%1 %2").arg(benchmark->items / seconds, 0, 'f', 0).arg(benchmark->itemName) : QString("-");
+
+        printf("%-48s %10lld %14s %12s %20s\n", benchmark->name.toLocal8Bit().constData(), iterations,
+               time.toLocal8Bit().constData(), bandwidth.toLocal8Bit().constData(), rate.toLocal8Bit().constData());
+        fflush(stdout);
+
+        ++count;
+    }
+
+    return count;
+}
+
+double MicroBenchmark::getTime(const QString &name) const
+{
+    for (auto benchmark = cases.begin(); benchmark != cases.end(); ++benchmark) {
+        if (benchmark->name == name)
+            return benchmark->nanoseconds;
+    }
+
+    return 0.0;
+}
+
+double MicroBenchmark::measure(const Case &benchmark, qint64 &iterations)
+{
+    // One untimed run to fault in the input and warm the caches
+    if (benchmark.setup)
+        benchmark.setup();
+    benchmark.run();
+
+    qint64 budget = (qint64)minimumTime * 1000000 / std::max(1, repetitions);
+    std::vector<double> times;
+    QElapsedTimer timer;
+
+    for (int repetition = 0; repetition < std::max(1, repetitions); ++repetition) {
+        qint64 elapsed = 0;
+        qint64 count = 0;
+
+        while (elapsed < budget || count == 0) {
+            if (benchmark.setup)
+                benchmark.setup();
+
+            timer.start();
+            benchmark.run();
+            elapsed += timer.nsecsElapsed();
+            ++count;
+        }
+
+        iterations += count;
+        times.push_back((double)elapsed / count);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
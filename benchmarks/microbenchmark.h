@@ -0,0 +1,77 @@
+#ifndef MICROBENCHMARK_H
+#define MICROBENCHMARK_H
+
+#include <functional>
+#include <vector>
+
+#include <QString>
+
+/**
+ * @brief Runs a list of timed cases and prints their time per iteration and throughput
+ *
+ * Each case runs for several repetitions of at least ''minimumTime / repetitions'' each, and the median repetition is reported,
+ * so a single slow repetition (a page fault storm, a context switch) does not skew the result.
+ * Only ''run'' is timed; ''setup'' is called before every iteration to restore the input.
+ */
+class MicroBenchmark
+{
+public:
+    typedef std::function<void()> Function;
+
+    MicroBenchmark();
+
+    /**
+     * @brief Only runs the cases whose name contains ''filter''
+     */
+    void setFilter(const QString &filter) { this->filter = filter; }
+
+    /**
+     * @brief Sets the minimum time spent on each case, in milliseconds
+     */
+    void setMinimumTime(int milliseconds) { minimumTime = milliseconds; }
+
+    void setRepetitions(int repetitions) { this->repetitions = repetitions; }
+
+    /**
+     * @brief Adds a case
+     * @param bytes Bytes processed by one iteration, or 0 if throughput in MB/s does not apply
+     * @param items Items processed by one iteration, or 0 if it does not apply
+     * @param itemName What an item is, used in the report
+     */
+    void add(const QString &name, Function run, double bytes, double items, const QString &itemName, Function setup = Function());
+
+    /**
+     * @brief Runs every selected case, printing one line for each
+     * @return The number of cases that ran
+     */
+    int run();
+
+    /**
+     * @brief Returns the median time per iteration of a case in the last run, in nanoseconds, or 0 if it did not run
+     */
+    double getTime(const QString &name) const;
+
+private:
+    struct Case {
+        QString name;
+        Function run;
+        Function setup;
+        double bytes;
+        double items;
+        QString itemName;
+        double nanoseconds;
+    };
+
+    /**
+     * @brief Runs a case and returns the median time per iteration, in nanoseconds
+     */
+    double measure(const Case &benchmark, qint64 &iterations);
+
+    std::vector<Case> cases;
+
+    QString filter;
+    int minimumTime;
+    int repetitions;
+};
+
+#endif // MICROBENCHMARK_H
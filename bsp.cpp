@@ -1,27 +1,42 @@
 #include "bsp.h"
 
-#include "bspdefs.h"
-#include "q3parser.h"
+#include "tracer.h"
 
-#include <algorithm>
-#include <iostream>
+#include <cstring>
 
-#include <QCryptographicHash>
-#include <QFile>
 #include <QOpenGLPixelTransferOptions>
-#include <QRegularExpression>
 
 BSP::BSP()
 {
+    world = nullptr;
+    profiler = nullptr;
+    stats = BSPRenderStats();
+    animatedShaders = false;
+
     vboIndexes = nullptr;
     vboVertices = nullptr;
     vertexInfo = nullptr;
 
-    vertexShader = nullptr;
-    fragmentShader = nullptr;
+    frameUniformBuffer = 0;
+    materialUniformBuffer = 0;
+    materialStride = 0;
+
     shaderProgram = nullptr;
+    depthProgram = nullptr;
+    overdrawProgram = nullptr;
 
-    visibilityData = nullptr;
+    drawOrder = LeafOrder;
+    depthPrePass = false;
+    clusterBatching = false;
+    overdrawVisualization = false;
+
+    for (int i = 0; i < FrameProfiler::FRAME_LATENCY; ++i) {
+        sampleQueries[i] = 0;
+        sampleQueryIssued[i] = false;
+    }
+    currentSampleQuery = 0;
+    shadedSamples = -1;
+    visibilityStale = false;
 
     initializeGL();
 }
@@ -39,82 +54,129 @@ void BSP::initializeGL()
         return;
     }
 
-    vertexShader = new QOpenGLShader(QOpenGLShader::Vertex);
-    if (!vertexShader->compileSourceFile(":/shaders/bsp.vert"))
-        qWarning() << vertexShader->log() << endl;
+    shaderProgram = createProgram(":/shaders/bsp.vert", ":/shaders/bsp.frag");
+    depthProgram = createProgram(":/shaders/bsp_depth.vert", ":/shaders/bsp_depth.frag");
+    overdrawProgram = createProgram(":/shaders/bsp_depth.vert", ":/shaders/bsp_overdraw.frag");
+
+    if (!shaderProgram)
+        return;
 
-    fragmentShader = new QOpenGLShader(QOpenGLShader::Fragment);
-    if (!fragmentShader->compileSourceFile(":/shaders/bsp.frag"))
-        qWarning() << fragmentShader->log() << endl;
+    // The samplers never change, so they are set once instead of every frame
+    shaderProgram->bind();
+    shaderProgram->setUniformValue("albedoTexture", 0);
+    shaderProgram->setUniformValue("lightmapTexture", 1);
+    shaderProgram->release();
 
-    shaderProgram = new QOpenGLShaderProgram;
-    shaderProgram->addShader(vertexShader);
-    shaderProgram->addShader(fragmentShader);
+    glGenBuffers(1, &frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    if (!shaderProgram->link())
-        qWarning() << shaderProgram->log() << endl;
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = qMax(alignment, 1);
+    materialStride = ((GLint)sizeof(MaterialUniforms) + alignment - 1) / alignment * alignment;
+
+    glGenQueries(FrameProfiler::FRAME_LATENCY, sampleQueries);
 }
 
-void BSP::releaseShaders()
+QOpenGLShaderProgram *BSP::createProgram(const QString &vertexFile, const QString &fragmentFile)
 {
-    delete vertexShader;
-    vertexShader = nullptr;
+    QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
 
-    delete fragmentShader;
-    fragmentShader = nullptr;
+    if (!program->addShaderFromSourceFile(QOpenGLShader::Vertex, vertexFile)
+            || !program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentFile)) {
+        qWarning() << program->log() << endl;
+        delete program;
+        return nullptr;
+    }
 
+    // The vertex array is set up with the locations of the main program; the position has the same one in every program
+    program->bindAttributeLocation("vPosition", 0);
+
+    if (!program->link()) {
+        qWarning() << program->log() << endl;
+        delete program;
+        return nullptr;
+    }
+
+    // Attach the blocks to fixed binding points; GLSL 4.00 cannot declare them in the shader.
+    // A block the shaders do not use is removed by the linker, and has no index
+    GLuint programId = program->programId();
+    GLuint frameBlock = glGetUniformBlockIndex(programId, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(programId, frameBlock, FrameBinding);
+    GLuint materialBlock = glGetUniformBlockIndex(programId, "MaterialData");
+    if (materialBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(programId, materialBlock, MaterialBinding);
+
+    return program;
+}
+
+void BSP::releaseShaders()
+{
     if (shaderProgram) {
         shaderProgram->release();
         delete shaderProgram;
         shaderProgram = nullptr;
     }
+
+    delete depthProgram;
+    depthProgram = nullptr;
+
+    delete overdrawProgram;
+    overdrawProgram = nullptr;
+
+    if (frameUniformBuffer) {
+        glDeleteBuffers(1, &frameUniformBuffer);
+        frameUniformBuffer = 0;
+    }
+
+    if (sampleQueries[0]) {
+        glDeleteQueries(FrameProfiler::FRAME_LATENCY, sampleQueries);
+        for (int i = 0; i < FrameProfiler::FRAME_LATENCY; ++i) {
+            sampleQueries[i] = 0;
+            sampleQueryIssued[i] = false;
+        }
+    }
 }
 
 void BSP::loadMap(const QString &file)
 {
-    QFile f(file);
-    if (!f.open(QIODevice::ReadOnly)) {
-        emit loadError(QString("Failed to open file %1s").arg(file));
-    }
+    TraceScope trace("load", "BSP::loadMap");
 
-    if (f.error() != QFile::NoError) {
-        emit loadError(QString("Error loading BSP file %1s: %2s").arg(file, f.errorString()));
+    releaseMap();
+
+    BSPWorld *newWorld = new BSPWorld;
+    connect(newWorld, SIGNAL(loadError(QString)), this, SIGNAL(loadError(QString)));
+
+    if (!newWorld->loadMap(file)) {
+        delete newWorld;
         return;
     }
 
-    releaseMap();
+    setWorld(newWorld);
+}
 
-    if (!internalLoadMap(f)) {
-        releaseMap();
+void BSP::setWorld(BSPWorld *world)
+{
+    if (world == this->world)
         return;
-    }
 
-    f.close();
+    releaseMap();
 
-    // Load shader data
-    QRegularExpression re("(.*)(\\\\|/)(maps)(\\\\|/)(.+)(\\.bsp)", QRegularExpression::CaseInsensitiveOption);
-    QString shaderFile = file;
-    shaderFile.replace(re, "\\1\\2scripts\\4\\5.shader");
+    this->world = world;
 
-    parseShaderData(shaderFile);
-    parseMapData();
+    if (world)
+        parseMapData();
 }
 
 void BSP::releaseMap()
 {
     destroyGPUObjects();
-    destroyLumpData();
 
-    for (auto i = entities.begin(); i != entities.end(); ++i) {
-        delete *i;
-    }
-    entities.clear();
-
-    if (visibilityData) {
-        delete[] visibilityData->bitset;
-        delete visibilityData;
-        visibilityData = nullptr;
-    }
+    delete world;
+    world = nullptr;
 }
 
 void BSP::destroyGPUObjects()
@@ -125,6 +187,7 @@ void BSP::destroyGPUObjects()
         delete vboIndexes;
         vboIndexes = nullptr;
     }
+    surfaceRanges.clear();
 
     if (vboVertices) {
         vboVertices->release();
@@ -140,11 +203,21 @@ void BSP::destroyGPUObjects()
         vertexInfo = nullptr;
     }
 
+    if (materialUniformBuffer) {
+        glDeleteBuffers(1, &materialUniformBuffer);
+        materialUniformBuffer = 0;
+    }
+
     for (auto i = shaders.begin(); i != shaders.end(); ++i) {
         delete *i;
     }
     shaders.clear();
-    drawnFaces.clear();
+    animatedShaders = false;
+    // The worker reads the groups, so they go once it has let go of them
+    visibilityWorker.setWorld(nullptr, nullptr);
+    visibilityStale = false;
+    surfaceGroups.clear();
+    shadedSamples = -1;
 
     for (auto i = lightmaps.begin(); i != lightmaps.end(); ++i) {
         (*i)->release();
@@ -154,330 +227,223 @@ void BSP::destroyGPUObjects()
     lightmaps.clear();
 }
 
-void BSP::destroyLumpData()
-{
-    lumpShaders.clear();
-    leafs.clear();
-    leafBrushes.clear();
-    leafSurfaces.clear();
-    planes.clear();
-    brushSides.clear();
-    brushes.clear();
-    models.clear();
-    nodes.clear();
-    entityString.clear();
-    surfaces.clear();
-    vertexData.clear();
-    indexes.clear();
-}
-
 void BSP::render(QMatrix4x4 modelView, QMatrix4x4 projection, QVector3D cameraPosition)
 {
-    if (!vboIndexes)
+    stats = BSPRenderStats();
+    stats.shadedSamples = shadedSamples;
+
+    if (!vboIndexes || !shaderProgram)
         return;
 
-    // Animate the shaders
-    for(auto shader = shaders.begin(); shader != shaders.end(); ++shader)
-        (*shader)->update();
+    FrameProfiler::Scope renderScope(profiler, QStringLiteral("BSP::render"));
 
-    // Resets the drawn faces bitset
-    for(auto i = drawnFaces.begin(); i != drawnFaces.end(); ++i) {
-       *i = false;
+    QMatrix4x4 viewProjection = projection * modelView;
+    const BSPDrawList *drawList;
+    {
+        // With a latency this only waits for the list the worker built during the previous frame, if it is not ready yet
+        FrameProfiler::Scope scope(profiler, QStringLiteral("Visibility"));
+        drawList = &visibilityWorker.update(cameraPosition, viewProjection, drawOrder == FrontToBack, clusterBatching);
     }
 
-    int currentLeafIndex = findNodeForPosition(cameraPosition);
-    int currentCluster = leafs[currentLeafIndex].cluster;
-    int i = (int)leafs.size();
+    const std::vector<int> &visibleSurfaces = drawList->surfaces;
+    const std::vector<int> &visibleGroups = drawList->groups;
+    stats.visibleClusters = drawList->visibleClusters;
+    stats.visibleLeafs = drawList->visibleLeafs;
+    stats.visibleSurfaces = (int)visibleSurfaces.size();
+    visibilityStale = drawList->cameraPosition != cameraPosition || drawList->viewProjection != viewProjection
+            || drawList->frontToBack != (drawOrder == FrontToBack) || drawList->clusterBatches != clusterBatching;
 
-    shaderProgram->bind();
-    shaderProgram->setUniformValue("modelView", modelView);
-    shaderProgram->setUniformValue("normalMatrix", modelView.normalMatrix());
-    shaderProgram->setUniformValue("projectionMatrix", projection);
-    shaderProgram->setUniformValue("albedoTexture", 0);
-    shaderProgram->setUniformValue("lightmapTexture", 1);
-    shaderProgram->setUniformValue("lightDirection", skyLight.direction);
-    shaderProgram->setUniformValue("lightColor", skyLight.color);
-    shaderProgram->setUniformValue("lightIntensity", skyLight.intensity);
+    uploadFrameUniforms(modelView, projection);
 
     vertexInfo->bind();
     vboIndexes->bind();
 
-    while (i --> 0) {
-        dleaf_t& drawLeaf = leafs[i];
+    bool prePass = depthPrePass && depthProgram;
+    if (prePass) {
+        renderDepthPrePass(*drawList);
 
-        if (!canSee(currentCluster, drawLeaf.cluster))
-            continue;
+        // Only the nearest fragment of each pixel matches the depth laid down by the pre-pass
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
-        int faceCount = drawLeaf.numLeafSurfaces;
+    FrameProfiler::Scope scope(profiler, QStringLiteral("Draw submission"));
 
-        while (faceCount --> 0) {
-            int surfaceIndex = leafSurfaces[drawLeaf.firstLeafSurface + faceCount];
-            dsurface_t &surface = surfaces[surfaceIndex];
+    const std::vector<dsurface_t> &surfaces = world->getSurfaces();
 
-            // Check if this surface is a polygon (plane)
-            if (surface.surfaceType != MST_PLANAR && surface.surfaceType != MST_PATCH) continue;
-            // Check if this surface was rendered
-            if (drawnFaces[surfaceIndex] == true) continue;
+    bool overdraw = overdrawVisualization && overdrawProgram;
+    if (overdraw) {
+        // Each fragment adds one step of the heat ramp
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        overdrawProgram->bind();
+    } else {
+        shaderProgram->bind();
+    }
 
-            drawnFaces[surfaceIndex] = true;
+    beginSampleQuery();
 
-            shaders[surface.shaderNum]->bind(shaderProgram);
+    int boundMaterial = -1;
 
-            if (surface.lightmapNum >= 0)
-                lightmaps[surface.lightmapNum]->bind(1);
+    for (auto surfaceIndex = visibleSurfaces.begin(); surfaceIndex != visibleSurfaces.end(); ++surfaceIndex) {
+        const dsurface_t &surface = surfaces[*surfaceIndex];
 
-            // Since BSP indices are relative to the first vertex of the surface, we use glDrawElementsBaseVertex
-            glDrawElementsBaseVertex(GL_TRIANGLES, surface.numIndexes, GL_UNSIGNED_INT, reinterpret_cast<void*>(surface.firstIndex * sizeof(GLuint)), surface.firstVert);
+        if (overdraw)
+            drawRange(surfaceRanges[*surfaceIndex]);
+        else
+            drawShaded(surface.shaderNum, surface.lightmapNum, surfaceRanges[*surfaceIndex], boundMaterial);
 
-            if (surface.lightmapNum >= 0)
-                lightmaps[surface.lightmapNum]->release(1);
-            shaders[surface.shaderNum]->release();
-        }
+        stats.triangles += surface.numIndexes / 3;
     }
 
-    vboIndexes->release();
-    vertexInfo->release();
+    stats.drawCalls += (int)visibleSurfaces.size();
 
-    shaderProgram->release();
-}
+    // One draw per material of each group, whatever the number of surfaces merged into it
+    for (auto groupIndex = visibleGroups.begin(); groupIndex != visibleGroups.end(); ++groupIndex) {
+        const BSPSurfaceGroups::Group &group = surfaceGroups.groups[*groupIndex];
 
-bool BSP::internalLoadMap(QFile &file)
-{
-    checksum = blockChecksum(file.readAll(), file.size());
+        for (int i = group.firstBatch; i < group.firstBatch + group.batchCount; ++i) {
+            const BSPMaterialBatch &batch = surfaceGroups.batches[i];
 
-    // readAll moves the pointer to the EOF, so reset it to the start
-    file.seek(0);
+            if (overdraw)
+                drawRange(batch.range);
+            else
+                drawShaded(batch.shaderNum, batch.lightmapNum, batch.range, boundMaterial);
 
-    QByteArray buffer = file.read(sizeof (dheader_t));
-    dheader_t *header = (dheader_t*)buffer.data();
+            stats.visibleSurfaces += batch.surfaceCount;
+            stats.triangles += batch.range.count / 3;
+            ++stats.drawCalls;
+        }
+    }
 
-    if (header->ident != BSP_IDENT) {
-        emit loadError(QString("Unsupported BSP identifier"));
-        return false;
+    endSampleQuery();
+
+    if (overdraw) {
+        glDisable(GL_BLEND);
+        overdrawProgram->release();
+    } else {
+        shaderProgram->release();
     }
 
-    if (header->version != BSP_VERSION) {
-        emit loadError(QString("Unsupported BSP version. Expecting %1d, got %2d").arg(BSP_VERSION).arg(header->version));
-        return false;
+    if (prePass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
     }
 
-    // Load all lumps
-    if (!loadNotEmptyLump<dshader_t>(file, header->lumps[LUMP_SHADERS], lumpShaders))
-        return false;
-    if (!loadNotEmptyLump<dleaf_t>(file, header->lumps[LUMP_LEAFS], leafs))
-        return false;
-    if (!loadLump<int>(file, header->lumps[LUMP_LEAFBRUSHES], leafBrushes))
-        return false;
-    if (!loadLump<int>(file, header->lumps[LUMP_LEAFSURFACES], leafSurfaces))
-        return false;
-    if (!loadNotEmptyLump<dplane_t>(file, header->lumps[LUMP_PLANES], planes))
-        return false;
-    if (!loadLump<dbrushside_t>(file, header->lumps[LUMP_BRUSHSIDES], brushSides))
-        return false;
-    if (!loadLump<dbrush_t>(file, header->lumps[LUMP_BRUSHES], brushes))
-        return false;
-    if (!loadNotEmptyLump<dmodel_t>(file, header->lumps[LUMP_MODELS], models))
-        return false;
-    if (!loadNotEmptyLump<dnode_t>(file, header->lumps[LUMP_NODES], nodes))
-        return false;
-    if (!loadLump<char>(file, header->lumps[LUMP_ENTITIES], entityString))
-        return false;
-    if (!loadLump<dsurface_t>(file, header->lumps[LUMP_SURFACES], surfaces))
-        return false;
-    if (!loadLump<dvert_t>(file, header->lumps[LUMP_DRAWVERTS], vertexData))
-        return false;
-    if (!loadLump<int>(file, header->lumps[LUMP_DRAWINDEXES], indexes))
-        return false;
-    if (!loadNotEmptyLump<dlightmap_t>(file, header->lumps[LUMP_LIGHTMAPS], lightmapImages))
-        return false;
-    if (!loadVisData(file, header->lumps[LUMP_VISIBILITY]))
-        return false;
-
-    return true;
+    vboIndexes->release();
+    vertexInfo->release();
 }
 
-void BSP::parseShaderData(QString fileName)
+void BSP::drawRange(const BSPIndexRange &range)
 {
-    QFile file(fileName);
-    if (!file.exists() || !file.open(QFile::ReadOnly))
-        return;
-
-    QByteArray data = file.readAll();
+    // Since the indexes are relative to the first vertex of the surface or batch, we use glDrawElementsBaseVertex
+    GLenum type = range.indexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.count, type, reinterpret_cast<void*>((size_t)range.offset), range.baseVertex);
+}
 
-    file.close();
+void BSP::drawShaded(int shaderNum, int lightmapNum, const BSPIndexRange &range, int &boundMaterial)
+{
+    // Select the range of the material instead of uploading its uniforms
+    if (shaderNum != boundMaterial) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, MaterialBinding, materialUniformBuffer, shaderNum * materialStride, sizeof(MaterialUniforms));
+        boundMaterial = shaderNum;
+    }
 
-    Q3Parser parser(data.data());
-    Q3TokenType tokenType;
+    BSPShader *shader = shaders[shaderNum];
+    shader->bind();
+    if (shader->hasAlbedo())
+        ++stats.textureBinds;
 
-    int nestLevel = 0;
-    BSPShader *currentShader;
+    if (lightmapNum >= 0) {
+        lightmaps[lightmapNum]->bind(1);
+        ++stats.textureBinds;
+    }
 
-    QString currentAlbedo = "";
-    QVector2D uvMod;
+    drawRange(range);
 
-    // Look for the sun color and direction
-    while ((tokenType = parser.next()) != Q3TOK_EOF) {
-        if (tokenType == Q3TOK_LITERAL || tokenType == Q3TOK_STRING) {
-            if (nestLevel == 0) {
-                // Root level, shader name
-                QString shaderName = parser.getCurrentToken();
-                currentShader = new BSPShader(shaderName);
-                namedShaders[shaderName] = currentShader;
-            }
-            else {
-                QString attributeName = parser.getCurrentToken();
-                //
-                if (attributeName == "q3map_sun") {
-                    parser.next();
-                    QString red = parser.getCurrentToken();
-                    parser.next();
-                    QString green = parser.getCurrentToken();
-                    parser.next();
-                    QString blue = parser.getCurrentToken();
-
-                    skyLight.color = QVector3D(atof(red.toLatin1().data()), atof(green.toLatin1().data()), atof(blue.toLatin1().data()));
-
-                    parser.next();
-                    QString intensity = parser.getCurrentToken();
-                    skyLight.intensity = atof(intensity.toLatin1().data());
-
-                    parser.next();
-                    QString zRotation = parser.getCurrentToken();
-                    parser.next();
-                    QString xRotation = parser.getCurrentToken();
-
-                    // Calculate the direction
-                    QVector3D direction(0, 1, 0);
-                    QQuaternion rotation = QQuaternion::fromAxisAndAngle(0, 0, 1, atof(zRotation.toLatin1().data()));
-                    rotation *= QQuaternion::fromAxisAndAngle(1, 0, 0, atof(xRotation.toLatin1().data()));
-                    skyLight.direction = rotation.rotatedVector(direction);
-                }
-                else if (attributeName == "map") {
-                    // Texture file
-                    parser.next();
-                    QString fileName = parser.getCurrentToken();
-                    if (fileName[0] == '$'){
-                        // Special name, ignore it
-                        continue;
-                    }
-                    currentAlbedo = fileName;
-                }
-                else if (attributeName == "tcMod") {
-                    // get mod type
-                    parser.next();
-                    QString modType = parser.getCurrentToken();
-                    if (modType.toLower() == "scroll") {
-                        // get mod values
-                        parser.next();
-                        QString xMod = parser.getCurrentToken();
-                        parser.next();
-                        QString yMod = parser.getCurrentToken();
-                        uvMod = QVector2D(atof(xMod.toLatin1().data()), atof(yMod.toLatin1().data()));
-                    }
-                }
-            }
-        }
-        else if (tokenType == Q3TOK_LIST_START) {
-            currentAlbedo.clear();
-            uvMod = QVector2D(0, 0);
-            nestLevel++;
-        }
-        else if (tokenType == Q3TOK_LIST_END) {
-            if (currentShader && !currentAlbedo.isNull()) {
-                currentShader->setAlbedo(currentAlbedo);
-                currentShader->setUVModValue(uvMod);
-            }
-            nestLevel--;
-        }
-    }
+    if (lightmapNum >= 0)
+        lightmaps[lightmapNum]->release(1);
+    shader->release();
 }
 
-bool BSP::loadVisData(QFile &file, lump_t &lump)
+void BSP::renderDepthPrePass(const BSPDrawList &drawList)
 {
-    if (lump.filelen == 0)
-        return true;
+    FrameProfiler::Scope scope(profiler, QStringLiteral("Depth pre-pass"));
 
-    file.seek(lump.fileofs);
+    depthProgram->bind();
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-    visibilityData = new dvisdata_t;
+    // Neither textures nor materials are needed for the positions
+    for (auto surfaceIndex = drawList.surfaces.begin(); surfaceIndex != drawList.surfaces.end(); ++surfaceIndex)
+        drawRange(surfaceRanges[*surfaceIndex]);
 
-    file.read((char*)&visibilityData->clusterNum, sizeof (int));
-    file.read((char*)&visibilityData->clusterSize, sizeof (int));
+    stats.drawCalls += (int)drawList.surfaces.size();
 
-    int totalSize = visibilityData->clusterNum * visibilityData->clusterSize;
+    for (auto groupIndex = drawList.groups.begin(); groupIndex != drawList.groups.end(); ++groupIndex) {
+        const BSPSurfaceGroups::Group &group = surfaceGroups.groups[*groupIndex];
 
-    visibilityData->bitset = new unsigned char[totalSize];
-    file.read((char*)visibilityData->bitset, totalSize);
+        for (int i = group.firstBatch; i < group.firstBatch + group.batchCount; ++i)
+            drawRange(surfaceGroups.batches[i].range);
 
-    return true;
+        stats.drawCalls += group.batchCount;
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    depthProgram->release();
 }
 
-void BSP::parseMapData()
+void BSP::beginSampleQuery()
 {
-    parseShaders();
+    GLuint query = sampleQueries[currentSampleQuery];
+    if (!query)
+        return;
 
-    createLightmaps();
+    // The query of this slot was issued FRAME_LATENCY frames ago; if it is still not ready, its count is dropped instead of waiting
+    if (sampleQueryIssued[currentSampleQuery]) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &samples);
+            shadedSamples = (qint64)samples;
+            stats.shadedSamples = shadedSamples;
+        }
+    }
 
-	createVBOs();
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    sampleQueryIssued[currentSampleQuery] = true;
+}
 
-    parseEntities();
+void BSP::endSampleQuery()
+{
+    if (!sampleQueries[currentSampleQuery])
+        return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    currentSampleQuery = (currentSampleQuery + 1) % FrameProfiler::FRAME_LATENCY;
 }
 
-void BSP::parseEntities()
+void BSP::parseMapData()
 {
-    Q3TokenType tokenType;
-    Q3Parser parser(entityString.data());
+    TraceScope trace("load", "BSP::parseMapData");
 
-    BSPEntity *entity = nullptr;
-    QString key;
+    parseShaders();
 
-    // Parsing entities is rather simple:
-    // They have no name definitions and the contents are always a K/V pair
-    while ((tokenType = parser.next()) != Q3TOK_EOF) {
-        if (tokenType == Q3TOK_LIST_START) { // Starting a new group, so create a new entity
-            entity = new BSPEntity;
-        }
-        else if (tokenType == Q3TOK_LIST_END) { // Ending a group, add the current entity to the entity list
-            if (entity != nullptr)
-                entities.push_back(entity);
+    createMaterials();
+    animationClock.start();
 
-            entity = nullptr;
-        }
-        else if (tokenType == Q3TOK_LITERAL || tokenType == Q3TOK_STRING) {
-            if (key.isNull()) {
-                key = parser.getCurrentToken();
-            }
-            else {
-                entity->addSetting(key, parser.getCurrentToken());
-                key.clear();
-            }
-        }
-    }
+    createLightmaps();
+
+    createVBOs();
 
-    entityString.clear();
+    visibilityWorker.setWorld(world, &surfaceGroups);
 }
 
 void BSP::createVBOs()
 {
-    int size = vertexData.size();
-    drawVert_t *vertices = new drawVert_t[size];
-    int i = 0;
-    QVector3D center;
-    // Convert from BSP dvert_t to a shader-friendly drawVert_t
-    std::for_each(vertexData.begin(), vertexData.end(), [&vertices, &i, size, &center](dvert_t &data) {
-        vertices[i].position = QVector3D(data.position[0], data.position[1], data.position[2]);
-        vertices[i].texCoord = QVector2D(data.textureCoords[0], data.textureCoords[1]);
-        vertices[i].lightmapCoord = QVector2D(data.lightmap[0], data.lightmap[1]);
-        vertices[i].normal = QVector3D(data.normal[0], data.normal[1], data.normal[2]);
-        vertices[i].color = QVector4D(data.color[0], data.color[1], data.color[2], data.color[3]) / 255;
-
-        center = center + (vertices[i].position / size);
-        ++i;
-    });
-    this->center = center;
-    vertexData.clear();
-
-    drawnFaces.resize(surfaces.size());
+    const std::vector<drawVert_t> &vertices = world->getVertices();
+
+    TraceScope trace("load", "BSP::createVBOs");
 
     vertexInfo = new QOpenGLVertexArrayObject;
     vertexInfo->create();
@@ -487,8 +453,11 @@ void BSP::createVBOs()
     vboVertices->create();
     vboVertices->bind();
     vboVertices->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    vboVertices->allocate(vertices, size * sizeof(drawVert_t));
-    delete[] vertices;
+    {
+        TraceScope uploadTrace("load", "upload vertices");
+        uploadTrace.setBytes(vertices.size() * sizeof(drawVert_t));
+        vboVertices->allocate(vertices.data(), vertices.size() * sizeof(drawVert_t));
+    }
 
     shaderProgram->bind();
 
@@ -520,86 +489,135 @@ void BSP::createVBOs()
     vboIndexes->create();
     vboIndexes->bind();
     vboIndexes->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    vboIndexes->allocate(indexes.data(), indexes.size() * sizeof(int));
+
+    // Reordered for the vertex cache and mostly 16-bit; only the ranges are kept once uploaded
+    BSPIndexData indexData;
+    indexData.build(*world);
+    surfaceRanges = indexData.getSurfaceRanges();
+    surfaceGroups = indexData.getSurfaceGroups();
+
+    TraceScope uploadTrace("load", "upload indexes");
+    uploadTrace.setBytes(indexData.getData().size());
+    uploadTrace.addArgument("wide_surfaces", indexData.getWideSurfaces());
+    uploadTrace.addArgument("acmr_before", QString::number(indexData.getMissRatioBefore(), 'f', 3));
+    uploadTrace.addArgument("acmr_after", QString::number(indexData.getMissRatioAfter(), 'f', 3));
+    uploadTrace.addArgument("groups", (qint64)surfaceGroups.groups.size());
+    uploadTrace.addArgument("batches", (qint64)surfaceGroups.batches.size());
+    uploadTrace.addArgument("wide_batches", indexData.getWideBatches());
+    vboIndexes->allocate(indexData.getData().data(), (int)indexData.getData().size());
 }
 
 void BSP::parseShaders()
 {
+    const std::vector<dshader_t> &lumpShaders = world->getLumpShaders();
+
+    TraceScope trace("load", "BSP::parseShaders");
+    trace.addArgument("shaders", lumpShaders.size());
+
     for (auto shader = lumpShaders.begin(); shader != lumpShaders.end(); ++shader) {
-        auto named = namedShaders.find(shader->shader);
-        if (named == namedShaders.end()) {
-            BSPShader *bspShader = new BSPShader(shader->shader);
+        BSPShader *bspShader = new BSPShader(shader->shader);
+
+        const BSPShaderInfo *info = world->findShaderInfo(shader->shader);
+        if (!info) {
             bspShader->create();
-            shaders.push_back(bspShader);
         }
         else {
-            shaders.push_back(named->second);
+            if (!info->albedo.isNull())
+                bspShader->setAlbedo(info->albedo);
+            bspShader->setTcMods(info->tcMods);
         }
-    }
 
-    // Free the BSP raw data
-    lumpShaders.clear();
+        if (bspShader->isAnimated())
+            animatedShaders = true;
+
+        shaders.push_back(bspShader);
+    }
 }
 
-void BSP::createLightmaps()
+void BSP::createMaterials()
 {
-    // Set the buffer alignment to 1 byte
-    QOpenGLPixelTransferOptions options;
-    options.setAlignment(1);
+    if (shaders.empty())
+        return;
 
-    for (auto img = lightmapImages.begin(); img != lightmapImages.end(); ++img) {
-        QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
-        texture->create();
-        texture->setSize(LIGHTMAP_WIDTH, LIGHTMAP_HEIGHT);
-        texture->setFormat(QOpenGLTexture::RGB8_UNorm);
-        texture->allocateStorage();
-        texture->setData(QOpenGLTexture::RGB, QOpenGLTexture::UInt8, img->data, &options);
-		// Mipmaps are be created by default, so enable their use
-        texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
-        lightmaps.push_back(texture);
+    // The materials never change, since the animations only depend on the time of the frame
+    std::vector<char> materialData(shaders.size() * materialStride, 0);
+
+    for (size_t i = 0; i < shaders.size(); ++i) {
+        MaterialUniforms *material = reinterpret_cast<MaterialUniforms*>(&materialData[i * materialStride]);
+        const std::vector<BSPTcMod> &tcMods = shaders[i]->getTcMods();
+
+        for (int j = 0; j < BSPTcMod::MAX_PER_STAGE; ++j) {
+            if (j < (int)tcMods.size()) {
+                material->tcModTypes[j] = tcMods[j].type;
+                memcpy(material->tcModParameters[j], tcMods[j].parameters, sizeof(material->tcModParameters[j]));
+            } else {
+                material->tcModTypes[j] = BSPTcMod::None;
+            }
+        }
     }
 
-    // Free BSP raw data
-    lightmapImages.clear();
+    glGenBuffers(1, &materialUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, materialData.size(), materialData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
-unsigned BSP::blockChecksum(const char *buffer, int length)
+void BSP::uploadFrameUniforms(const QMatrix4x4 &modelView, const QMatrix4x4 &projection)
 {
-    QCryptographicHash hash(QCryptographicHash::Md4);
-    hash.addData(buffer, length);
-    QByteArray result = hash.result();
-
-    unsigned* digest = (unsigned*)result.data();
-    unsigned val = digest[0] ^ digest[1] ^ digest[2] ^ digest[3];
+    const Light &skyLight = world->getSkyLight();
 
-    return val;
-}
+    FrameUniforms frame;
+    memcpy(frame.modelView, modelView.constData(), sizeof(frame.modelView));
+    memcpy(frame.projection, projection.constData(), sizeof(frame.projection));
 
-BSPEntity* BSP::findEntityByClassname(QString classname)
-{
-    for (auto entity = entities.begin(); entity != entities.end(); ++entity) {
-        QString entityClass = (*entity)->getSetting("classname");
-        if (!entityClass.isNull() && entityClass.compare(classname, Qt::CaseInsensitive) == 0) {
-            return *entity;
-        }
+    // std140 pads every column of a mat3 to a vec4
+    QMatrix3x3 normalMatrix = modelView.normalMatrix();
+    for (int column = 0; column < 3; ++column) {
+        memcpy(frame.normalMatrix + 4 * column, normalMatrix.constData() + 3 * column, 3 * sizeof(GLfloat));
+        frame.normalMatrix[4 * column + 3] = 0.0f;
     }
 
-    return nullptr;
+    frame.lightDirection[0] = skyLight.direction.x();
+    frame.lightDirection[1] = skyLight.direction.y();
+    frame.lightDirection[2] = skyLight.direction.z();
+    frame.lightDirection[3] = 0.0f;
+    frame.lightColor[0] = skyLight.color.x();
+    frame.lightColor[1] = skyLight.color.y();
+    frame.lightColor[2] = skyLight.color.z();
+    frame.lightIntensity = skyLight.intensity;
+    frame.time = animationClock.nsecsElapsed() / 1e9f;
+    frame.padding[0] = frame.padding[1] = frame.padding[2] = 0.0f;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, frameUniformBuffer);
 }
 
-int BSP::findNodeForPosition(const QVector3D &position)
+void BSP::createLightmaps()
 {
-    int nodeIndex = 0;
+    // Set the buffer alignment to 1 byte
+    QOpenGLPixelTransferOptions options;
+    options.setAlignment(1);
 
-    while (nodeIndex >= 0)
-    {
-        auto &node = nodes[nodeIndex];
-        auto &plane = planes[node.planeNum];
+    const std::vector<dlightmap_t> &lightmapImages = world->getLightmapImages();
 
-        float distance = plane.normal[0] * position.x() + plane.normal[1] * position.y() + plane.normal[2] * position.z() - plane.dist;
+    TraceScope trace("load", "BSP::createLightmaps");
+    trace.setBytes(lightmapImages.size() * sizeof(dlightmap_t));
 
-        nodeIndex = node.children[distance > 0 ? 1 : 0];
-    }
+    for (auto img = lightmapImages.begin(); img != lightmapImages.end(); ++img) {
+        TraceScope uploadTrace("load", "upload lightmap");
+        uploadTrace.setBytes(sizeof(dlightmap_t));
 
-    return ~nodeIndex;
+        QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        texture->create();
+        texture->setSize(LIGHTMAP_WIDTH, LIGHTMAP_HEIGHT);
+        texture->setFormat(QOpenGLTexture::RGB8_UNorm);
+        texture->allocateStorage();
+        texture->setData(QOpenGLTexture::RGB, QOpenGLTexture::UInt8, img->data, &options);
+		// Mipmaps are be created by default, so enable their use
+        texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+        lightmaps.push_back(texture);
+    }
 }
@@ -1,14 +1,15 @@
 #ifndef BSP_H
 #define BSP_H
 
-#include "bspdefs.h"
-#include "bspentity.h"
+#include "bspindexdata.h"
 #include "bspshader.h"
-#include "light.h"
+#include "bspworld.h"
+#include "frameprofiler.h"
+#include "visibilityworker.h"
 
 #include <vector>
 
-#include <QFile>
+#include <QElapsedTimer>
 #include <QMatrix4x4>
 #include <QObject>
 #include <QOpenGLBuffer>
@@ -19,12 +20,46 @@
 #include <QOpenGLVertexArrayObject>
 #include <QString>
 
+/**
+ * @brief Counters of the last rendered frame
+ */
+struct BSPRenderStats
+{
+    /// @brief Clusters visible from the camera cluster; every cluster without a PVS row
+    int visibleClusters;
+    /// @brief Leafs that passed the PVS and frustum tests; 0 with cluster batches
+    int visibleLeafs;
+    /// @brief Surfaces selected for drawing, after the frustum test of their bounds, or of the bounds of their group with cluster batches
+    int visibleSurfaces;
+    int drawCalls;
+    /// @brief Albedo and lightmap textures bound for drawing
+    int textureBinds;
+    int triangles;
+    /// @brief Fragments that passed the depth test in the shading pass of a recent frame, or -1 before the first result
+    /// @remarks Read back FrameProfiler::FRAME_LATENCY frames late, so counting never waits for the GPU
+    qint64 shadedSamples;
+};
+
 class BSP : public QObject, private QOpenGLFunctions_4_0_Core
 {
     Q_OBJECT
 
 public:
+    /**
+     * @brief Order in which the visible surfaces are submitted
+     */
+    enum DrawOrder {
+        /// @brief Leaf index order, which has no relation to the distance from the camera
+        LeafOrder,
+        /// @brief Approximately front to back, from a walk of the BSP tree that visits the side of the camera first
+        FrontToBack
+    };
+
     BSP();
+
+    /**
+     * @remarks Deletes the GL objects of the map, the uniform buffers and the sample queries, so the context must be current
+     */
     ~BSP();
 
     /**
@@ -32,6 +67,17 @@ public:
      */
     void loadMap(const QString& file);
 
+    /**
+     * @brief Uses an already loaded world for rendering
+     * @remarks The renderer takes the ownership of the world
+     */
+    void setWorld(BSPWorld *world);
+
+    /**
+     * @brief Returns the world being rendered, or nullptr if none
+     */
+    const BSPWorld *getWorld() const { return world; }
+
     /**
      * @brief Unloads the BSP map and release all associated resources
      */
@@ -43,195 +89,212 @@ public:
     void render(QMatrix4x4 modelView, QMatrix4x4 projection, QVector3D cameraPosition);
 
     /**
-     * @brief Returns the center of the level
+     * @brief Sets the profiler used to time the render phases, or nullptr to disable it
      */
-    QVector3D getCenter() { return center; }
+    void setProfiler(FrameProfiler *profiler) { this->profiler = profiler; }
 
-    BSPEntity *findEntityByClassname(QString classname);
-
-private:
     /**
-     * @brief Releases all allocated VBOs, VAOs and textures
+     * @brief Returns the counters of the last call to render
      */
-    void destroyGPUObjects();
+    const BSPRenderStats& getRenderStats() const { return stats; }
 
     /**
-     * @brief Releases all allocated data related to BSP
+     * @brief Returns whether any shader of the map changes from frame to frame
      */
-    void destroyLumpData();
+    bool hasAnimatedShaders() const { return animatedShaders; }
+
+    void setDrawOrder(DrawOrder order) { drawOrder = order; }
+    DrawOrder getDrawOrder() const { return drawOrder; }
 
     /**
-     * @brief Calculates the checksum of the block having the specified length
+     * @brief Enables a depth only pass before shading, so every pixel is shaded at most once whatever the draw order
      */
-    unsigned blockChecksum(const char *buffer, int length);
+    void setDepthPrePass(bool enabled) { depthPrePass = enabled; }
+    bool isDepthPrePassEnabled() const { return depthPrePass; }
 
     /**
-     * @brief Loads data from the file into the vectors
+     * @brief Draws the surfaces merged at load time by cluster and material, with one draw per material of each visible group
+     * @remarks Trades the frustum test of each surface for far fewer draws
      */
-    bool internalLoadMap(QFile &file);
-    
-    void parseShaderData(QString fileName);
+    void setClusterBatching(bool enabled) { clusterBatching = enabled; }
+    bool isClusterBatchingEnabled() const { return clusterBatching; }
 
     /**
-     * @brief Parses the map data and frees unused resources
+     * @brief Replaces the shading with the number of fragments drawn on each pixel: one is dark red, four orange, eight yellow and sixteen white
      */
-    void parseMapData();
+    void setOverdrawVisualization(bool enabled) { overdrawVisualization = enabled; }
+    bool isOverdrawVisualizationEnabled() const { return overdrawVisualization; }
 
     /**
-     * @brief Allocates all GPU resources for vertices and indexes
+     * @brief Sets how many frames the visible set trails the camera: 0 finds it before drawing, 1 finds it on a worker thread while the previous frame is drawn
      */
-    void createVBOs();
+    void setVisibilityLatency(int frames) { visibilityWorker.setLatency(frames); }
+    int getVisibilityLatency() const { return visibilityWorker.getLatency(); }
 
     /**
-     * @brief Loads textures and associated resources
+     * @brief Sets the threads the culling is split over; 0 uses one per core
      */
-    void parseShaders();
+    void setCullingThreads(int threads) { visibilityWorker.setThreadCount(threads); }
+    int getCullingThreads() const { return visibilityWorker.getThreadCount(); }
 
     /**
-     * @brief Loads the entities information from the lump data
+     * @brief Returns the number of frames that had to wait for the worker thread to finish their visible set
      */
-    void parseEntities();
+    qint64 getVisibilityStalls() const { return visibilityWorker.getStalls(); }
 
     /**
-     * @brief Initializes all lightmap textures
+     * @brief Returns whether the last frame was drawn with a visible set of another camera position, so another frame is needed to catch up
      */
-    void createLightmaps();
+    bool isVisibilityPending() const { return visibilityStale; }
 
+private:
     /**
-     * @brief Loads data from a lump and fills a vector
+     * @brief Releases all allocated VBOs, VAOs and textures
      */
-    template <class T>
-    bool loadLump(QFile &file, lump_t &lump, std::vector<T> &vec)
-    {
-        if (lump.filelen % sizeof(T) != 0) {
-            emit loadError(QString("Invalid lump size, expected multiple of %1d, got %2d (remaining %3d bytes)").arg(sizeof(T)).arg(lump.filelen).arg(lump.filelen % sizeof(T)));
-            return false;
-        }
-
-        int count = lump.filelen / sizeof(T);
-
-        // If the lump is empty, exit silently
-        if (count == 0)
-            return true;
-
-        file.seek(lump.fileofs);
-        QByteArray data = file.read(lump.filelen);
-
-        if (file.error() != QFile::NoError) {
-            emit loadError(QString("Error loading BSP file: %1s").arg(file.errorString()));
-            return false;
-        }
-
-        vec.resize(count);
-
-        memcpy(vec.data(), data.data(), data.length());
-
-        return true;
-    }
+    void destroyGPUObjects();
 
     /**
-     * @brief Loads data from a lump and fills a vector
-     * @remarks Throws an error when the lump is empty
+     * @brief Creates the GPU resources for the current world
      */
-    template <class T>
-    bool loadNotEmptyLump(QFile &file, lump_t &lump, std::vector<T> &vec)
-    {
-        if (lump.filelen % sizeof(T) != 0) {
-            emit loadError(QString("Invalid lump size, expected multiple of %1d, got %2d (remaining %3d bytes)").arg(sizeof(T)).arg(lump.filelen).arg(lump.filelen % sizeof(T)));
-            return false;
-        }
-
-        file.seek(lump.fileofs);
-        QByteArray data = file.read(lump.filelen);
-
-        if (file.error() != QFile::NoError) {
-            emit loadError(QString("Error loading BSP file: %1s").arg(file.errorString()));
-            return false;
-        }
+    void parseMapData();
 
-        int count = lump.filelen / sizeof(T);
+    /**
+     * @brief Allocates all GPU resources for vertices and indexes
+     */
+    void createVBOs();
 
-        if (count < 1) {
-            emit loadError(QString("Empty lump"));
-            return false;
-        }
+    /**
+     * @brief Loads textures and associated resources
+     */
+    void parseShaders();
 
-        vec.resize(count);
+    /**
+     * @brief Initializes all lightmap textures
+     */
+    void createLightmaps();
 
-        memcpy(vec.data(), data.data(), data.length());
+    /**
+     * @brief Creates the material uniform buffer, with one aligned range per shader holding its texture coordinate modifiers
+     */
+    void createMaterials();
 
-        return true;
-    }
+    /**
+     * @brief Writes the per-frame uniform buffer
+     */
+    void uploadFrameUniforms(const QMatrix4x4 &modelView, const QMatrix4x4 &projection);
 
-    bool loadVisData(QFile &file, lump_t &lump);
+    /**
+     * @brief Draws the visible surfaces or groups into the depth buffer only
+     */
+    void renderDepthPrePass(const BSPDrawList &drawList);
 
     /**
-     * @brief Initializes the OpenGL functions
+     * @brief Draws a range of the index buffer, with the index type it was stored with
      */
-    void initializeGL();
+    void drawRange(const BSPIndexRange &range);
 
     /**
-     * @brief Release all used shaders
+     * @brief Binds the material and the lightmap, counting the texture binds, and draws a range with them
+     * @param boundMaterial The material whose uniform range is bound, updated when it changes
      */
-    void releaseShaders();
+    void drawShaded(int shaderNum, int lightmapNum, const BSPIndexRange &range, int &boundMaterial);
 
     /**
-     * @brief Returns which node the specified position belongs to
+     * @brief Starts counting the shaded samples, collecting the count of the oldest query in flight if it is ready
      */
-    int findNodeForPosition(const QVector3D& position);
+    void beginSampleQuery();
+    void endSampleQuery();
 
     /**
-     * @brief Returns if node ''current'' can see node ''test''
+     * @brief Compiles and links a program, attaching its uniform blocks to their binding points
+     * @return nullptr if the program cannot be built
      */
-    inline bool canSee(int current, int test) {
-        if (!visibilityData || current < 0) return true;
+    QOpenGLShaderProgram *createProgram(const QString &vertexFile, const QString &fragmentFile);
 
-        // Look for the byte containing the data
-        unsigned char set = visibilityData->bitset[current * visibilityData->clusterSize + (test / 8)];
+    /**
+     * @brief Initializes the OpenGL functions
+     */
+    void initializeGL();
 
-        // Returns whether the bit is set or not
-        return !(set & (1 << (test & 7)));
-    }
+    /**
+     * @brief Release all used shaders, the frame uniform buffer and the sample queries
+     * @remarks The raw GL deletes are not guarded against a missing context, unlike QOpenGLBuffer::destroy
+     */
+    void releaseShaders();
 
-    std::vector<dshader_t> lumpShaders;
-    std::vector<dleaf_t> leafs;
-    std::vector<int> leafBrushes;
-    std::vector<int> leafSurfaces;
-    std::vector<dplane_t> planes;
-    std::vector<dbrushside_t> brushSides;
-    std::vector<dbrush_t> brushes;
-    std::vector<dmodel_t> models;
-    std::vector<dnode_t> nodes;
-    std::vector<char> entityString;
-    std::vector<dsurface_t> surfaces;
-    std::vector<dvert_t> vertexData;
-    std::vector<int> indexes;
-    std::vector<dlightmap_t> lightmapImages;
+    /// @brief Uniform buffer binding points of the blocks in bsp.vert and bsp.frag
+    enum UniformBinding {
+        FrameBinding,
+        MaterialBinding
+    };
+
+    /// @brief std140 layout of the FrameData block; the mat3 takes three vec4 columns
+    struct FrameUniforms {
+        GLfloat modelView[16];
+        GLfloat projection[16];
+        GLfloat normalMatrix[12];
+        GLfloat lightDirection[4];
+        GLfloat lightColor[3];
+        GLfloat lightIntensity;
+        /// @brief Seconds since the map was loaded, for the texture coordinate modifiers
+        GLfloat time;
+        GLfloat padding[3];
+    };
+
+    /// @brief std140 layout of the MaterialData block
+    struct MaterialUniforms {
+        /// @brief The type of each modifier, BSPTcMod::None after the last one
+        GLint tcModTypes[BSPTcMod::MAX_PER_STAGE];
+        /// @brief Two vec4 of parameters per modifier
+        GLfloat tcModParameters[BSPTcMod::MAX_PER_STAGE][8];
+    };
+
+    BSPWorld *world;
 
     QOpenGLShaderProgram *shaderProgram;
-    QOpenGLShader *vertexShader;
-    QOpenGLShader *fragmentShader;
+    /// @brief Transforms the positions only; shared by the depth pre-pass and the overdraw visualization
+    QOpenGLShaderProgram *depthProgram;
+    QOpenGLShaderProgram *overdrawProgram;
+
+    DrawOrder drawOrder;
+    bool depthPrePass;
+    bool clusterBatching;
+    bool overdrawVisualization;
 
     /**
-     * @brief Stores the rendered faces
-     * This is used to optimize the rendering process. During the BSP rendering, a face might be rendered twice. Needed for VIS
+     * @brief Builds the list of surfaces to draw, on the render thread or one frame ahead on its own
      */
-    std::vector<bool> drawnFaces;
+    VisibilityWorker visibilityWorker;
+    bool visibilityStale;
+
     std::vector<BSPShader*> shaders;
     std::vector<QOpenGLTexture*> lightmaps;
-    std::vector<BSPEntity*> entities;
-    dvisdata_t *visibilityData;
+    bool animatedShaders;
 
     QOpenGLVertexArrayObject *vertexInfo;
     QOpenGLBuffer *vboVertices;
     QOpenGLBuffer *vboIndexes;
-
-    std::map<QString, BSPShader*> namedShaders;
-
-    Light skyLight;
-
-    QVector3D center;
-    unsigned checksum;
+    /// @brief The range of every surface in ''vboIndexes''
+    std::vector<BSPIndexRange> surfaceRanges;
+    /// @brief The surfaces merged by cluster and material, with their ranges in ''vboIndexes''; read by the visibility worker
+    BSPSurfaceGroups surfaceGroups;
+
+    /// @brief QOpenGLBuffer has no uniform buffer type, so these are plain buffer names
+    GLuint frameUniformBuffer;
+    GLuint materialUniformBuffer;
+    /// @brief Distance between the materials in the buffer, rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GLint materialStride;
+    /// @brief Started when the map is loaded; the animations are evaluated on the GPU from its time
+    QElapsedTimer animationClock;
+
+    FrameProfiler *profiler;
+    BSPRenderStats stats;
+
+    /// @brief GL_SAMPLES_PASSED queries of the last frames, used round robin
+    GLuint sampleQueries[FrameProfiler::FRAME_LATENCY];
+    bool sampleQueryIssued[FrameProfiler::FRAME_LATENCY];
+    int currentSampleQuery;
+    qint64 shadedSamples;
 
 signals:
     void loadError(QString error);
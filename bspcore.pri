@@ -0,0 +1,31 @@
+# Context-free map loading and queries, shared by the viewer and the headless tools
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += $$PWD/bspworld.cpp \
+    $$PWD/bspvisibility.cpp \
+    $$PWD/bspculler.cpp \
+    $$PWD/visibilityworker.cpp \
+    $$PWD/threadpool.cpp \
+    $$PWD/vertexcache.cpp \
+    $$PWD/bspindexdata.cpp \
+    $$PWD/bspentity.cpp \
+    $$PWD/q3parser.cpp \
+    $$PWD/light.cpp \
+    $$PWD/lightgrid.cpp \
+    $$PWD/tracer.cpp
+
+HEADERS += $$PWD/bspdefs.h \
+    $$PWD/bspworld.h \
+    $$PWD/bspvisibility.h \
+    $$PWD/bspculler.h \
+    $$PWD/visibilityworker.h \
+    $$PWD/threadpool.h \
+    $$PWD/vertexcache.h \
+    $$PWD/bspindexdata.h \
+    $$PWD/bspentity.h \
+    $$PWD/q3parser.h \
+    $$PWD/light.h \
+    $$PWD/lightgrid.h \
+    $$PWD/tracer.h
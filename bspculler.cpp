@@ -0,0 +1,369 @@
+#include "bspculler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstring>
+
+void BSPFrustum::setMatrix(const QMatrix4x4 &viewProjection)
+{
+    // Gribb and Hartmann: a point is inside when -w <= x, y, z <= w in clip space
+    QVector4D x = viewProjection.row(0);
+    QVector4D y = viewProjection.row(1);
+    QVector4D z = viewProjection.row(2);
+    QVector4D w = viewProjection.row(3);
+
+    planes[0] = w + x;
+    planes[1] = w - x;
+    planes[2] = w + y;
+    planes[3] = w - y;
+    planes[4] = w + z;
+    planes[5] = w - z;
+}
+
+bool BSPFrustum::intersects(const QVector3D &mins, const QVector3D &maxs) const
+{
+    for (int i = 0; i < 6; ++i) {
+        const QVector4D &plane = planes[i];
+
+        // The corner furthest along the normal of the plane
+        float x = plane.x() >= 0.0f ? maxs.x() : mins.x();
+        float y = plane.y() >= 0.0f ? maxs.y() : mins.y();
+        float z = plane.z() >= 0.0f ? maxs.z() : mins.z();
+
+        if (plane.x() * x + plane.y() * y + plane.z() * z + plane.w() < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+void BSPDrawList::clear()
+{
+    surfaces.clear();
+    groups.clear();
+    visibleClusters = 0;
+    visibleLeafs = 0;
+}
+
+template<typename Body>
+void BSPCuller::forEachChunk(int count, int grain, Body &body)
+{
+    if (pool) {
+        pool->parallelFor(count, grain, body);
+        return;
+    }
+
+    for (int begin = 0; begin < count; begin += grain)
+        body(begin, std::min(count, begin + grain), 0);
+}
+
+BSPCuller::BSPCuller()
+{
+    world = nullptr;
+    groups = nullptr;
+    pool = nullptr;
+    visibleRow = nullptr;
+    clusterCount = 0;
+    buildNumber = 0;
+}
+
+void BSPCuller::setWorld(const BSPWorld *world, const BSPSurfaceGroups *groups)
+{
+    this->world = world;
+    this->groups = groups;
+
+    groupBuilds.assign(groups ? groups->groups.size() : 0, 0);
+    groupDistances.clear();
+    groupDistances.reserve(groupBuilds.size());
+    buildNumber = 0;
+
+    surfaceBounds.clear();
+    surfaceOwners = std::vector<std::atomic<int>>();
+    selectedLeafs.clear();
+    nodeStack.clear();
+    visibilityCache.clear();
+
+    if (!world)
+        return;
+
+    const std::vector<dsurface_t> &surfaces = world->getSurfaces();
+    const std::vector<drawVert_t> &vertices = world->getVertices();
+
+    surfaceBounds.resize(surfaces.size());
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        const dsurface_t &surface = surfaces[i];
+        Bounds &bounds = surfaceBounds[i];
+
+        if (surface.numVerts <= 0) {
+            // Nothing to test; never culled by the frustum
+            bounds.mins = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            bounds.maxs = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+            continue;
+        }
+
+        bounds.mins = bounds.maxs = vertices[surface.firstVert].position;
+        for (int vertex = surface.firstVert + 1; vertex < surface.firstVert + surface.numVerts; ++vertex) {
+            const QVector3D &position = vertices[vertex].position;
+            bounds.mins = QVector3D(qMin(bounds.mins.x(), position.x()), qMin(bounds.mins.y(), position.y()), qMin(bounds.mins.z(), position.z()));
+            bounds.maxs = QVector3D(qMax(bounds.maxs.x(), position.x()), qMax(bounds.maxs.y(), position.y()), qMax(bounds.maxs.z(), position.z()));
+        }
+    }
+
+    surfaceOwners = std::vector<std::atomic<int>>(surfaces.size());
+    for (auto owner = surfaceOwners.begin(); owner != surfaceOwners.end(); ++owner)
+        owner->store(INT_MAX, std::memory_order_relaxed);
+
+    selectedLeafs.reserve(world->getLeafs().size());
+    // The walk holds at most one pending sibling per level, plus the node being expanded
+    nodeStack.reserve(world->getNodes().size() + 1);
+}
+
+void BSPCuller::build(const QVector3D &cameraPosition, const QMatrix4x4 &viewProjection, bool frontToBack, bool clusterBatches, BSPDrawList &list)
+{
+    list.clear();
+    list.cameraPosition = cameraPosition;
+    list.viewProjection = viewProjection;
+    list.frontToBack = frontToBack;
+    list.clusterBatches = clusterBatches && groups;
+
+    if (!world)
+        return;
+
+    frustum.setMatrix(viewProjection);
+
+    const std::vector<dleaf_t> &leafs = world->getLeafs();
+
+    int currentLeafIndex = world->findNodeForPosition(cameraPosition);
+    int currentCluster = leafs[currentLeafIndex].cluster;
+
+    // Fetch the PVS row once per frame. Without a row (no VIS data, or the camera is outside the map), everything is drawn
+    const BSPVisibility &visibility = world->getVisibility();
+    visibleRow = visibilityCache.getRow(visibility, currentCluster);
+    clusterCount = visibility.getClusterCount();
+
+    if (visibleRow) {
+        for (int cluster = 0; cluster < clusterCount; ++cluster) {
+            if (BSPVisibility::testRow(visibleRow, cluster))
+                ++list.visibleClusters;
+        }
+    } else {
+        list.visibleClusters = clusterCount;
+    }
+
+    if (list.clusterBatches) {
+        collectGroups(cameraPosition, frontToBack, list);
+        return;
+    }
+
+    if (frontToBack)
+        selectLeafsFrontToBack(cameraPosition);
+    else
+        selectLeafs();
+
+    list.visibleLeafs = (int)selectedLeafs.size();
+
+    collectSurfaces(list);
+}
+
+bool BSPCuller::isLeafVisible(const dleaf_t &leaf) const
+{
+    if (visibleRow && (leaf.cluster < 0 || leaf.cluster >= clusterCount || !BSPVisibility::testRow(visibleRow, leaf.cluster)))
+        return false;
+
+    return frustum.intersects(QVector3D(leaf.mins[0], leaf.mins[1], leaf.mins[2]), QVector3D(leaf.maxs[0], leaf.maxs[1], leaf.maxs[2]));
+}
+
+void BSPCuller::selectLeafs()
+{
+    const std::vector<dleaf_t> &leafs = world->getLeafs();
+    int leafCount = (int)leafs.size();
+    int chunks = (leafCount + LEAF_GRAIN - 1) / LEAF_GRAIN;
+
+    if ((int)chunkLeafs.size() < chunks)
+        chunkLeafs.resize(chunks);
+
+    // Position i stands for leaf leafCount - 1 - i, so the chunks come out from the last leaf down, as always
+    auto select = [&](int begin, int end, int) {
+        std::vector<int> &selected = chunkLeafs[begin / LEAF_GRAIN];
+        selected.clear();
+
+        for (int i = begin; i < end; ++i) {
+            int leafIndex = leafCount - 1 - i;
+            if (isLeafVisible(leafs[leafIndex]))
+                selected.push_back(leafIndex);
+        }
+    };
+    forEachChunk(leafCount, LEAF_GRAIN, select);
+
+    selectedLeafs.clear();
+    for (int chunk = 0; chunk < chunks; ++chunk)
+        selectedLeafs.insert(selectedLeafs.end(), chunkLeafs[chunk].begin(), chunkLeafs[chunk].end());
+}
+
+void BSPCuller::selectLeafsFrontToBack(const QVector3D &cameraPosition)
+{
+    const std::vector<dleaf_t> &leafs = world->getLeafs();
+    const std::vector<dnode_t> &nodes = world->getNodes();
+    const std::vector<dplane_t> &planes = world->getPlanes();
+
+    selectedLeafs.clear();
+
+    // Depth first, visiting the child on the side of the camera before the other one, so the leafs come out near to far.
+    // The order depends on the whole path, so this walk stays on one thread; it only touches the nodes, and prunes those outside the frustum
+    nodeStack.clear();
+    nodeStack.push_back(0);
+
+    while (!nodeStack.empty()) {
+        int nodeIndex = nodeStack.back();
+        nodeStack.pop_back();
+
+        // Negative indices are leafs
+        if (nodeIndex < 0) {
+            int leafIndex = ~nodeIndex;
+            if (isLeafVisible(leafs[leafIndex]))
+                selectedLeafs.push_back(leafIndex);
+            continue;
+        }
+
+        const dnode_t &node = nodes[nodeIndex];
+        if (!frustum.intersects(QVector3D(node.mins[0], node.mins[1], node.mins[2]), QVector3D(node.maxs[0], node.maxs[1], node.maxs[2])))
+            continue;
+
+        const dplane_t &plane = planes[node.planeNum];
+
+        float distance = plane.normal[0] * cameraPosition.x() + plane.normal[1] * cameraPosition.y() + plane.normal[2] * cameraPosition.z() - plane.dist;
+
+        // children[0] is in front of the plane; the near child is pushed last so it is visited first
+        int nearChild = distance >= 0 ? 0 : 1;
+        nodeStack.push_back(node.children[1 - nearChild]);
+        nodeStack.push_back(node.children[nearChild]);
+    }
+}
+
+void BSPCuller::collectSurfaces(BSPDrawList &list)
+{
+    const std::vector<dleaf_t> &leafs = world->getLeafs();
+    const std::vector<int> &leafSurfaces = world->getLeafSurfaces();
+    const std::vector<dsurface_t> &surfaces = world->getSurfaces();
+
+    int leafCount = (int)selectedLeafs.size();
+    int chunks = (leafCount + SURFACE_GRAIN - 1) / SURFACE_GRAIN;
+
+    if ((int)chunkSurfaces.size() < chunks)
+        chunkSurfaces.resize(chunks);
+    if ((int)chunkOffsets.size() < chunks + 1)
+        chunkOffsets.resize(chunks + 1);
+
+    // Claim: every surface keeps the smallest position of the leafs that have it
+    auto claim = [&](int begin, int end, int) {
+        for (int position = begin; position < end; ++position) {
+            const dleaf_t &leaf = leafs[selectedLeafs[position]];
+
+            for (int i = 0; i < leaf.numLeafSurfaces; ++i) {
+                int surfaceIndex = leafSurfaces[leaf.firstLeafSurface + i];
+                const dsurface_t &surface = surfaces[surfaceIndex];
+
+                // Check if this surface is a polygon (plane)
+                if (surface.surfaceType != MST_PLANAR && surface.surfaceType != MST_PATCH) continue;
+
+                std::atomic<int> &owner = surfaceOwners[surfaceIndex];
+                int current = owner.load(std::memory_order_relaxed);
+                while (position < current && !owner.compare_exchange_weak(current, position, std::memory_order_relaxed)) {
+                }
+            }
+        }
+    };
+    forEachChunk(leafCount, SURFACE_GRAIN, claim);
+
+    // Emit: the owner of each surface tests its bounds and releases it. The pool returning orders this after every claim
+    auto emitOwned = [&](int begin, int end, int) {
+        std::vector<int> &emitted = chunkSurfaces[begin / SURFACE_GRAIN];
+        emitted.clear();
+
+        for (int position = begin; position < end; ++position) {
+            const dleaf_t &leaf = leafs[selectedLeafs[position]];
+
+            // Backwards within the leaf, as the leaf surfaces always were
+            for (int i = leaf.numLeafSurfaces - 1; i >= 0; --i) {
+                int surfaceIndex = leafSurfaces[leaf.firstLeafSurface + i];
+
+                std::atomic<int> &owner = surfaceOwners[surfaceIndex];
+                if (owner.load(std::memory_order_relaxed) != position)
+                    continue;
+                owner.store(INT_MAX, std::memory_order_relaxed);
+
+                const Bounds &bounds = surfaceBounds[surfaceIndex];
+                if (frustum.intersects(bounds.mins, bounds.maxs))
+                    emitted.push_back(surfaceIndex);
+            }
+        }
+    };
+    forEachChunk(leafCount, SURFACE_GRAIN, emitOwned);
+
+    // Merge: each chunk copies its list to its own range of the output
+    chunkOffsets[0] = 0;
+    for (int chunk = 0; chunk < chunks; ++chunk)
+        chunkOffsets[chunk + 1] = chunkOffsets[chunk] + (int)chunkSurfaces[chunk].size();
+
+    list.surfaces.resize(chunkOffsets[chunks]);
+
+    auto merge = [&](int begin, int end, int) {
+        for (int chunk = begin; chunk < end; ++chunk) {
+            const std::vector<int> &emitted = chunkSurfaces[chunk];
+            if (!emitted.empty())
+                memcpy(list.surfaces.data() + chunkOffsets[chunk], emitted.data(), emitted.size() * sizeof(int));
+        }
+    };
+    forEachChunk(chunks, 16, merge);
+}
+
+void BSPCuller::collectGroups(const QVector3D &cameraPosition, bool frontToBack, BSPDrawList &list)
+{
+    // Wrapping around would let a stale entry match, so start over from a clean array instead
+    if (++buildNumber == 0) {
+        std::fill(groupBuilds.begin(), groupBuilds.end(), 0);
+        buildNumber = 1;
+    }
+
+    auto take = [&](int groupIndex) {
+        if (groupBuilds[groupIndex] == buildNumber)
+            return;
+        groupBuilds[groupIndex] = buildNumber;
+
+        const BSPSurfaceGroups::Group &group = groups->groups[groupIndex];
+        if (frustum.intersects(group.mins, group.maxs))
+            list.groups.push_back(groupIndex);
+    };
+
+    if (visibleRow) {
+        for (int cluster = 0; cluster < clusterCount && cluster + 1 < (int)groups->clusterOffsets.size(); ++cluster) {
+            if (!BSPVisibility::testRow(visibleRow, cluster))
+                continue;
+
+            for (int i = groups->clusterOffsets[cluster]; i < groups->clusterOffsets[cluster + 1]; ++i)
+                take(groups->clusterGroups[i]);
+        }
+    } else {
+        for (int groupIndex = 0; groupIndex < (int)groups->groups.size(); ++groupIndex)
+            take(groupIndex);
+    }
+
+    if (!frontToBack)
+        return;
+
+    // By the distance to the nearest point of the bounds, which is 0 for the groups around the camera
+    groupDistances.clear();
+    for (auto groupIndex = list.groups.begin(); groupIndex != list.groups.end(); ++groupIndex) {
+        const BSPSurfaceGroups::Group &group = groups->groups[*groupIndex];
+        QVector3D nearest(qBound(group.mins.x(), cameraPosition.x(), group.maxs.x()),
+                          qBound(group.mins.y(), cameraPosition.y(), group.maxs.y()),
+                          qBound(group.mins.z(), cameraPosition.z(), group.maxs.z()));
+        groupDistances.push_back(std::make_pair((nearest - cameraPosition).lengthSquared(), *groupIndex));
+    }
+
+    std::sort(groupDistances.begin(), groupDistances.end());
+
+    for (size_t i = 0; i < groupDistances.size(); ++i)
+        list.groups[i] = groupDistances[i].second;
+}
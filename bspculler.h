@@ -0,0 +1,196 @@
+#ifndef BSPCULLER_H
+#define BSPCULLER_H
+
+#include "bspindexdata.h"
+#include "bspvisibility.h"
+#include "bspworld.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+/**
+ * @brief The six planes of a view volume, pointing inwards
+ */
+class BSPFrustum
+{
+public:
+    /**
+     * @brief Extracts the planes of the clip space volume of ''viewProjection''
+     */
+    void setMatrix(const QMatrix4x4 &viewProjection);
+
+    /**
+     * @brief Returns false if the box is entirely outside one of the planes; boxes near a corner may pass while being outside
+     */
+    bool intersects(const QVector3D &mins, const QVector3D &maxs) const;
+
+private:
+    QVector4D planes[6];
+};
+
+/**
+ * @brief The surfaces to draw from one camera, with the counters of the walk that found them
+ */
+struct BSPDrawList
+{
+    /// @brief Empty when the list holds surface groups instead
+    std::vector<int> surfaces;
+    /// @brief Indexes in BSPSurfaceGroups::groups, when built with cluster batches
+    std::vector<int> groups;
+
+    /// @brief The camera and order the list was built for
+    QVector3D cameraPosition;
+    QMatrix4x4 viewProjection;
+    bool frontToBack;
+    bool clusterBatches;
+
+    /// @brief Clusters visible from the camera cluster; every cluster without a PVS row
+    int visibleClusters;
+    /// @brief Leafs that passed the PVS and frustum tests; not counted with cluster batches, which never look at the leafs
+    int visibleLeafs;
+
+    BSPDrawList() : frontToBack(false), clusterBatches(false), visibleClusters(0), visibleLeafs(0) {}
+
+    /**
+     * @brief Empties the list, keeping its capacity
+     */
+    void clear();
+};
+
+/**
+ * @brief Finds the surfaces in the PVS of a camera position and inside its view frustum
+ *
+ * Only reads the world, so it needs no GL context. A culler keeps scratch state between calls and must only be used by one thread at a time;
+ * threads building lists concurrently each need their own.
+ *
+ * With a thread pool the work is split over ranges of leafs. The leafs are first selected by their cluster and bounds, then every
+ * chunk of leafs claims its surfaces by writing its position into a per-surface owner with an atomic minimum, and then emits the
+ * surfaces it owns into its own list. The surface of several leafs thus goes to the first of them in draw order, exactly as
+ * a sequential walk would, and the chunk lists are concatenated in order at offsets from a prefix sum, without locks.
+ *
+ * With cluster batches the leafs are skipped altogether: the surface groups of the clusters in the PVS row are tested against the
+ * frustum by their bounds, which is coarser than the bounds of each surface, but leaves far fewer draws.
+ */
+class BSPCuller
+{
+public:
+    BSPCuller();
+
+    /**
+     * @brief Sets the world to cull, sizing the scratch state and computing the bounds of its surfaces
+     * @param groups The surfaces of the world merged by cluster, or nullptr to only cull surfaces
+     * @remarks The culler does not take the ownership of the world or of the groups
+     */
+    void setWorld(const BSPWorld *world, const BSPSurfaceGroups *groups);
+
+    /**
+     * @brief Sets the threads the culling is split over, or nullptr to cull on the calling thread
+     * @remarks The culler does not take the ownership of the pool
+     */
+    void setThreadPool(ThreadPool *pool) { this->pool = pool; }
+
+    /**
+     * @brief Fills ''list'' with the planar and patch surfaces visible from the camera, each one once
+     * @param frontToBack Whether to walk the BSP tree from the camera outwards, instead of the leafs in index order
+     * @param clusterBatches Whether to fill the groups of the visible clusters instead of the surfaces; ignored without groups
+     */
+    void build(const QVector3D &cameraPosition, const QMatrix4x4 &viewProjection, bool frontToBack, bool clusterBatches, BSPDrawList &list);
+
+private:
+    BSPCuller(const BSPCuller&);
+    BSPCuller& operator=(const BSPCuller&);
+
+    struct Bounds {
+        QVector3D mins;
+        QVector3D maxs;
+    };
+
+    /// @brief Leafs selected by each parallel chunk of the leaf order
+    static const int LEAF_GRAIN = 256;
+    /// @brief Selected leafs whose surfaces one parallel chunk handles
+    static const int SURFACE_GRAIN = 32;
+
+    /**
+     * @brief Runs ''body'' over chunks of [0, count), on the pool if there is one
+     */
+    template<typename Body>
+    void forEachChunk(int count, int grain, Body &body);
+
+    /**
+     * @brief Returns whether a leaf passes the PVS and frustum tests
+     */
+    bool isLeafVisible(const dleaf_t &leaf) const;
+
+    /**
+     * @brief Fills ''selectedLeafs'' with the visible leafs in index order, from the last one down
+     */
+    void selectLeafs();
+
+    /**
+     * @brief Fills ''selectedLeafs'' with the visible leafs from a walk of the BSP tree that visits the side of the camera first
+     */
+    void selectLeafsFrontToBack(const QVector3D &cameraPosition);
+
+    /**
+     * @brief Gives each surface of the selected leafs to the first leaf that has it, and collects them in order into ''list''
+     */
+    void collectSurfaces(BSPDrawList &list);
+
+    /**
+     * @brief Collects into ''list'' the groups of the visible clusters that pass the frustum test, sorted by distance if ''frontToBack''
+     *
+     * There are a few hundred groups at most, against thousands of leafs and surfaces, so this stays on the calling thread.
+     */
+    void collectGroups(const QVector3D &cameraPosition, bool frontToBack, BSPDrawList &list);
+
+    const BSPWorld *world;
+    const BSPSurfaceGroups *groups;
+    ThreadPool *pool;
+
+    /// @brief State of the build in progress
+    BSPFrustum frustum;
+    const unsigned char *visibleRow;
+    int clusterCount;
+
+    std::vector<Bounds> surfaceBounds;
+
+    /**
+     * @brief Position in ''selectedLeafs'' of the first leaf that has each surface, INT_MAX when unclaimed
+     * @remarks The owner resets the entry when emitting the surface, so the array is clean again after every build
+     */
+    std::vector<std::atomic<int>> surfaceOwners;
+
+    /// @brief Leafs that passed the tests, in draw order
+    std::vector<int> selectedLeafs;
+
+    /// @brief Output of each chunk; kept between builds so the culling does not allocate
+    std::vector<std::vector<int>> chunkLeafs;
+    std::vector<std::vector<int>> chunkSurfaces;
+    std::vector<int> chunkOffsets;
+
+    /**
+     * @brief The build in which each group was last collected, so a group of several visible clusters is only taken once
+     */
+    std::vector<unsigned> groupBuilds;
+    unsigned buildNumber;
+
+    /// @brief Squared distance from the camera of each collected group, for sorting them front to back
+    std::vector<std::pair<float, int>> groupDistances;
+
+    /**
+     * @brief Nodes left to visit by the front to back walk
+     */
+    std::vector<int> nodeStack;
+
+    /**
+     * @brief Decompressed PVS rows of the clusters the camera was recently in
+     */
+    PVSRowCache visibilityCache;
+};
+
+#endif // BSPCULLER_H
@@ -52,6 +52,11 @@
 #define	LIGHTMAP_WIDTH		128
 #define	LIGHTMAP_HEIGHT		128
 
+// default light grid spacing, overridden by the worldspawn "gridsize" key
+#define LIGHTGRID_SIZE_X	64
+#define LIGHTGRID_SIZE_Y	64
+#define LIGHTGRID_SIZE_Z	128
+
 #define MAX_WORLD_COORD		( 128*1024 )
 #define MIN_WORLD_COORD		( -128*1024 )
 #define WORLD_SIZE			( MAX_WORLD_COORD - MIN_WORLD_COORD )
@@ -166,6 +171,12 @@ typedef struct {
     unsigned char data[LIGHTMAP_WIDTH][LIGHTMAP_HEIGHT][3];
 } dlightmap_t;
 
+typedef struct {
+    unsigned char ambient[3];
+    unsigned char directed[3];
+    unsigned char latLong[2];   // direction of the directed light (longitude, latitude), in 256ths of a full turn
+} dlightgrid_t;
+
 #define drawVert_t_cleared(x) drawVert_t (x) = {{0, 0, 0}, {0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0, 0}}
 
 typedef enum {
@@ -5,7 +5,7 @@ BSPEntity::BSPEntity()
 
 }
 
-QString BSPEntity::getSetting(QString key)
+QString BSPEntity::getSetting(QString key) const
 {
     auto i = settings.find(key);
     if (i == settings.end())
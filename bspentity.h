@@ -10,7 +10,7 @@ class BSPEntity
 public:
     BSPEntity();
 
-    QString getSetting(QString key);
+    QString getSetting(QString key) const;
     void addSetting(QString key, QString value);
 
 private:
@@ -0,0 +1,275 @@
+#include "bspindexdata.h"
+
+#include "tracer.h"
+#include "vertexcache.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+
+void BSPSurfaceGroups::clear()
+{
+    groups.clear();
+    batches.clear();
+    clusterOffsets.clear();
+    clusterGroups.clear();
+}
+
+BSPIndexData::BSPIndexData()
+{
+    clear();
+}
+
+void BSPIndexData::clear()
+{
+    data.clear();
+    surfaceRanges.clear();
+    surfaceGroups.clear();
+    missRatioBefore = 0.0f;
+    missRatioAfter = 0.0f;
+    wideSurfaces = 0;
+    wideBatches = 0;
+}
+
+void BSPIndexData::build(const BSPWorld &world)
+{
+    TraceScope trace("load", "BSPIndexData::build");
+
+    clear();
+
+    const std::vector<dsurface_t> &surfaces = world.getSurfaces();
+    const std::vector<int> &indexes = world.getIndexes();
+
+    surfaceRanges.resize(surfaces.size());
+    // Each index is stored once per surface and once in a batch
+    data.reserve(2 * indexes.size() * sizeof(unsigned short));
+
+    std::vector<int> surfaceIndexes;
+    std::vector<int> reordered(indexes);
+    double missesBefore = 0.0, missesAfter = 0.0;
+    int triangles = 0;
+
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        const dsurface_t &surface = surfaces[i];
+        BSPIndexRange &range = surfaceRanges[i];
+
+        range.offset = 0;
+        range.count = 0;
+        range.baseVertex = surface.firstVert;
+        range.indexSize = sizeof(unsigned short);
+
+        if (surface.numIndexes <= 0 || surface.firstIndex < 0 || surface.firstIndex + surface.numIndexes > (int)indexes.size())
+            continue;
+
+        surfaceIndexes.assign(indexes.begin() + surface.firstIndex, indexes.begin() + surface.firstIndex + surface.numIndexes);
+
+        // The largest index decides the size, whatever numVerts says
+        int vertexCount = *std::max_element(surfaceIndexes.begin(), surfaceIndexes.end()) + 1;
+        if (vertexCount <= 0 || *std::min_element(surfaceIndexes.begin(), surfaceIndexes.end()) < 0)
+            continue;
+
+        int surfaceTriangles = surface.numIndexes / 3;
+        missesBefore += averageCacheMissRatio(surfaceIndexes.data(), surface.numIndexes, vertexCount) * surfaceTriangles;
+        optimizeVertexCache(surfaceIndexes.data(), surface.numIndexes, vertexCount);
+        missesAfter += averageCacheMissRatio(surfaceIndexes.data(), surface.numIndexes, vertexCount) * surfaceTriangles;
+        triangles += surfaceTriangles;
+
+        if (vertexCount > 65536) {
+            range.indexSize = sizeof(unsigned);
+            ++wideSurfaces;
+        }
+
+        range.count = surface.numIndexes;
+        range.offset = append(surfaceIndexes.data(), surface.numIndexes, range.indexSize);
+
+        std::copy(surfaceIndexes.begin(), surfaceIndexes.end(), reordered.begin() + surface.firstIndex);
+    }
+
+    buildSurfaceGroups(world, reordered);
+
+    if (triangles > 0) {
+        missRatioBefore = (float)(missesBefore / triangles);
+        missRatioAfter = (float)(missesAfter / triangles);
+    }
+
+    trace.setBytes(data.size());
+}
+
+void BSPIndexData::buildSurfaceGroups(const BSPWorld &world, const std::vector<int> &reordered)
+{
+    const std::vector<dsurface_t> &surfaces = world.getSurfaces();
+    const std::vector<drawVert_t> &vertices = world.getVertices();
+    const std::vector<dleaf_t> &leafs = world.getLeafs();
+    const std::vector<int> &leafSurfaces = world.getLeafSurfaces();
+    int clusterCount = world.getVisibility().getClusterCount();
+
+    // Every surface with the clusters of the leafs that have it; -1 stands for the leafs outside every cluster
+    std::vector<std::pair<int, int>> memberships;
+    for (auto leaf = leafs.begin(); leaf != leafs.end(); ++leaf) {
+        int cluster = leaf->cluster >= 0 && leaf->cluster < clusterCount ? leaf->cluster : -1;
+
+        for (int i = 0; i < leaf->numLeafSurfaces; ++i) {
+            int surfaceIndex = leafSurfaces[leaf->firstLeafSurface + i];
+            const dsurface_t &surface = surfaces[surfaceIndex];
+
+            // The same surfaces as the culler draws
+            if (surface.surfaceType != MST_PLANAR && surface.surfaceType != MST_PATCH) continue;
+            if (surfaceRanges[surfaceIndex].count == 0) continue;
+
+            memberships.push_back(std::make_pair(surfaceIndex, cluster));
+        }
+    }
+
+    std::sort(memberships.begin(), memberships.end());
+    memberships.erase(std::unique(memberships.begin(), memberships.end()), memberships.end());
+
+    // Surfaces with the same set of clusters go to the same group. A leaf outside the clusters is never visible with a PVS row,
+    // so it only counts for the surfaces in no cluster at all; those are drawn without a row, like everything else
+    std::map<std::vector<int>, std::vector<int>> surfacesByClusters;
+    std::vector<int> clusters;
+    for (size_t i = 0; i < memberships.size(); ) {
+        int surfaceIndex = memberships[i].first;
+
+        clusters.clear();
+        for (; i < memberships.size() && memberships[i].first == surfaceIndex; ++i) {
+            if (memberships[i].second >= 0)
+                clusters.push_back(memberships[i].second);
+        }
+
+        surfacesByClusters[clusters].push_back(surfaceIndex);
+    }
+
+    std::vector<int> clusterGroupCounts(clusterCount, 0);
+    std::vector<const std::vector<int>*> groupClusters;
+    std::vector<int> merged;
+
+    for (auto entry = surfacesByClusters.begin(); entry != surfacesByClusters.end(); ++entry) {
+        std::vector<int> &groupSurfaces = entry->second;
+
+        // Grouped by material, then by lightmap, the state bound for each draw
+        std::sort(groupSurfaces.begin(), groupSurfaces.end(), [&](int a, int b) {
+            const dsurface_t &first = surfaces[a];
+            const dsurface_t &second = surfaces[b];
+            if (first.shaderNum != second.shaderNum)
+                return first.shaderNum < second.shaderNum;
+            if (first.lightmapNum != second.lightmapNum)
+                return first.lightmapNum < second.lightmapNum;
+            return a < b;
+        });
+
+        BSPSurfaceGroups::Group group;
+        group.firstBatch = (int)surfaceGroups.batches.size();
+        group.batchCount = 0;
+        bool bounded = false;
+
+        for (size_t begin = 0; begin < groupSurfaces.size(); ) {
+            const dsurface_t &first = surfaces[groupSurfaces[begin]];
+
+            size_t end = begin + 1;
+            while (end < groupSurfaces.size() && surfaces[groupSurfaces[end]].shaderNum == first.shaderNum
+                   && surfaces[groupSurfaces[end]].lightmapNum == first.lightmapNum)
+                ++end;
+
+            // The surface indexes become absolute, then relative to the lowest vertex of the batch
+            merged.clear();
+            int surfaceCount = 0;
+            int lowest = INT_MAX, highest = -1;
+
+            for (size_t i = begin; i < end; ++i) {
+                const dsurface_t &surface = surfaces[groupSurfaces[i]];
+                const int *surfaceIndexes = reordered.data() + surface.firstIndex;
+
+                int surfaceLowest = INT_MAX, surfaceHighest = -1;
+                for (int index = 0; index < surface.numIndexes; ++index) {
+                    surfaceLowest = std::min(surfaceLowest, surface.firstVert + surfaceIndexes[index]);
+                    surfaceHighest = std::max(surfaceHighest, surface.firstVert + surfaceIndexes[index]);
+                }
+                if (surfaceLowest < 0 || surfaceHighest >= (int)vertices.size())
+                    continue;
+
+                for (int index = 0; index < surface.numIndexes; ++index) {
+                    int vertex = surface.firstVert + surfaceIndexes[index];
+                    merged.push_back(vertex);
+
+                    const QVector3D &position = vertices[vertex].position;
+                    if (!bounded) {
+                        group.mins = group.maxs = position;
+                        bounded = true;
+                    }
+                    group.mins = QVector3D(qMin(group.mins.x(), position.x()), qMin(group.mins.y(), position.y()), qMin(group.mins.z(), position.z()));
+                    group.maxs = QVector3D(qMax(group.maxs.x(), position.x()), qMax(group.maxs.y(), position.y()), qMax(group.maxs.z(), position.z()));
+                }
+
+                lowest = std::min(lowest, surfaceLowest);
+                highest = std::max(highest, surfaceHighest);
+                ++surfaceCount;
+            }
+
+            begin = end;
+
+            if (merged.empty())
+                continue;
+
+            for (auto index = merged.begin(); index != merged.end(); ++index)
+                *index -= lowest;
+
+            BSPMaterialBatch batch;
+            batch.shaderNum = first.shaderNum;
+            batch.lightmapNum = first.lightmapNum;
+            batch.surfaceCount = surfaceCount;
+            batch.range.count = (int)merged.size();
+            batch.range.baseVertex = lowest;
+            batch.range.indexSize = highest - lowest < 65536 ? sizeof(unsigned short) : sizeof(unsigned);
+            batch.range.offset = append(merged.data(), batch.range.count, batch.range.indexSize);
+
+            if (batch.range.indexSize != sizeof(unsigned short))
+                ++wideBatches;
+
+            surfaceGroups.batches.push_back(batch);
+            ++group.batchCount;
+        }
+
+        if (group.batchCount == 0)
+            continue;
+
+        surfaceGroups.groups.push_back(group);
+
+        // The keys of the map stay in place, so they can be pointed at
+        groupClusters.push_back(&entry->first);
+        for (auto cluster = entry->first.begin(); cluster != entry->first.end(); ++cluster)
+            ++clusterGroupCounts[*cluster];
+    }
+
+    // The groups of each cluster, in group order
+    surfaceGroups.clusterOffsets.resize(clusterCount + 1);
+    surfaceGroups.clusterOffsets[0] = 0;
+    for (int cluster = 0; cluster < clusterCount; ++cluster)
+        surfaceGroups.clusterOffsets[cluster + 1] = surfaceGroups.clusterOffsets[cluster] + clusterGroupCounts[cluster];
+
+    surfaceGroups.clusterGroups.resize(surfaceGroups.clusterOffsets[clusterCount]);
+    std::vector<int> next(surfaceGroups.clusterOffsets.begin(), surfaceGroups.clusterOffsets.end() - 1);
+
+    for (size_t groupIndex = 0; groupIndex < groupClusters.size(); ++groupIndex) {
+        const std::vector<int> &groupClusterList = *groupClusters[groupIndex];
+        for (auto cluster = groupClusterList.begin(); cluster != groupClusterList.end(); ++cluster)
+            surfaceGroups.clusterGroups[next[*cluster]++] = (int)groupIndex;
+    }
+}
+
+unsigned BSPIndexData::append(const int *indexes, int count, int indexSize)
+{
+    size_t offset = (data.size() + indexSize - 1) / indexSize * indexSize;
+    data.resize(offset + (size_t)count * indexSize);
+
+    unsigned char *destination = data.data() + offset;
+    if (indexSize == sizeof(unsigned short)) {
+        unsigned short *shorts = reinterpret_cast<unsigned short*>(destination);
+        for (int i = 0; i < count; ++i)
+            shorts[i] = (unsigned short)indexes[i];
+    } else {
+        memcpy(destination, indexes, (size_t)count * sizeof(int));
+    }
+
+    return (unsigned)offset;
+}
@@ -0,0 +1,136 @@
+#ifndef BSPINDEXDATA_H
+#define BSPINDEXDATA_H
+
+#include "bspworld.h"
+
+#include <vector>
+
+/**
+ * @brief Where the indexes of one draw are in the index data
+ */
+struct BSPIndexRange
+{
+    /// @brief Bytes from the start of the index data
+    unsigned offset;
+    int count;
+    /// @brief Added to every index when drawing, as by glDrawElementsBaseVertex
+    int baseVertex;
+    /// @brief 2 or 4 bytes per index
+    int indexSize;
+};
+
+/**
+ * @brief One draw of the surfaces of a group that share a material and a lightmap
+ */
+struct BSPMaterialBatch
+{
+    int shaderNum;
+    int lightmapNum;
+    int surfaceCount;
+    BSPIndexRange range;
+};
+
+/**
+ * @brief The surfaces of the world merged by the clusters they are in, so a visible cluster costs one draw per material
+ *
+ * A surface spanning several clusters would be drawn once per visible cluster if it were merged into each of them. Instead every
+ * group holds the surfaces in exactly the same set of clusters, and is drawn once if any of them is visible: most groups belong
+ * to a single cluster, and the few others to the boundaries between clusters.
+ */
+struct BSPSurfaceGroups
+{
+    struct Group {
+        /// @brief Bounds of the vertices of the surfaces, for the frustum test
+        QVector3D mins;
+        QVector3D maxs;
+        int firstBatch;
+        int batchCount;
+    };
+
+    std::vector<Group> groups;
+    std::vector<BSPMaterialBatch> batches;
+
+    /// @brief The groups in cluster c are clusterGroups[clusterOffsets[c]] to clusterGroups[clusterOffsets[c + 1] - 1]
+    /// @remarks Groups of surfaces only in leafs outside every cluster are in no list; they are only drawn without a PVS row
+    std::vector<int> clusterOffsets;
+    std::vector<int> clusterGroups;
+
+    bool isEmpty() const { return groups.empty(); }
+
+    void clear();
+};
+
+/**
+ * @brief Builds the contents of the index buffer from the indexes of the map
+ *
+ * The indexes of each surface are relative to its first vertex. Every surface gets its triangles reordered for the post-transform
+ * vertex cache, and is stored with 16-bit indexes unless it uses more than 65536 vertices, which halves the index bandwidth of
+ * practically every map. Only reads the world, so it needs no GL context.
+ *
+ * The same triangles are then stored a second time, merged into the batches of BSPSurfaceGroups. The indexes of a batch are
+ * relative to its lowest vertex, and only need 32 bits when its surfaces are more than 65536 vertices apart.
+ */
+class BSPIndexData
+{
+public:
+    BSPIndexData();
+
+    /**
+     * @brief Builds the index data and the range of every surface of the world
+     */
+    void build(const BSPWorld &world);
+
+    const std::vector<unsigned char>& getData() const { return data; }
+
+    /**
+     * @brief Returns the range of each surface, in the order of BSPWorld::getSurfaces; surfaces without indexes have an empty one
+     */
+    const std::vector<BSPIndexRange>& getSurfaceRanges() const { return surfaceRanges; }
+
+    /**
+     * @brief Returns the surfaces merged by cluster and material, with their ranges in the same data
+     */
+    const BSPSurfaceGroups& getSurfaceGroups() const { return surfaceGroups; }
+
+    /**
+     * @brief Returns the vertices transformed per triangle with a VERTEX_CACHE_SIZE FIFO, in the order of the map and after reordering
+     */
+    float getMissRatioBefore() const { return missRatioBefore; }
+    float getMissRatioAfter() const { return missRatioAfter; }
+
+    /**
+     * @brief Returns the number of surfaces that needed 32-bit indexes
+     */
+    int getWideSurfaces() const { return wideSurfaces; }
+
+    /**
+     * @brief Returns the number of batches that needed 32-bit indexes
+     */
+    int getWideBatches() const { return wideBatches; }
+
+    void clear();
+
+private:
+    /**
+     * @brief Merges the planar and patch surfaces by the set of clusters of the leafs that have them, then by material
+     * @param reordered The indexes of every surface after reordering, at the same positions as in the world
+     */
+    void buildSurfaceGroups(const BSPWorld &world, const std::vector<int> &reordered);
+
+    /**
+     * @brief Appends indexes with the given size, aligned to it
+     * @return The offset of the first one, in bytes
+     */
+    unsigned append(const int *indexes, int count, int indexSize);
+
+    std::vector<unsigned char> data;
+    std::vector<BSPIndexRange> surfaceRanges;
+    BSPSurfaceGroups surfaceGroups;
+
+    float missRatioBefore;
+    float missRatioAfter;
+    int wideSurfaces;
+    int wideBatches;
+};
+
+#endif // BSPINDEXDATA_H
@@ -1,6 +1,9 @@
 #include "bspshader.h"
 
+#include "tracer.h"
+
 #include <QFile>
+#include <QImage>
 
 BSPShader::BSPShader(const QString &name)
     : name(name)
@@ -35,18 +38,27 @@ bool BSPShader::create()
 
 void BSPShader::setAlbedo(const QString &file)
 {
-    QImage texImage(file);
+    QImage texImage;
+    {
+        TraceScope trace("load", "decode texture");
+        trace.addArgument("file", file);
+
+        texImage.load(file);
+        trace.setBytes(texImage.byteCount());
+    }
+
+    TraceScope trace("load", "upload texture");
+    trace.addArgument("file", file);
+    trace.setBytes(texImage.byteCount());
 
     albedo = new QOpenGLTexture(texImage);
     albedo->create();
 }
 
-void BSPShader::bind(QOpenGLShaderProgram *shaderProgram)
+void BSPShader::bind()
 {
     if (albedo)
         albedo->bind(0);
-
-    shaderProgram->setUniformValue("uvMod", uvMod);
 }
 
 void BSPShader::destroy()
@@ -65,12 +77,13 @@ void BSPShader::release()
     }
 }
 
-void BSPShader::update()
+bool BSPShader::isAnimated() const
 {
-    uvMod += uvModValue;
-}
+    // Scaling is the only modifier that does not depend on time
+    for (auto tcMod = tcMods.begin(); tcMod != tcMods.end(); ++tcMod) {
+        if (tcMod->type != BSPTcMod::None && tcMod->type != BSPTcMod::Scale)
+            return true;
+    }
 
-void BSPShader::setUVModValue(QVector2D uvModValue)
-{
-    this->uvModValue = uvModValue;
+    return false;
 }
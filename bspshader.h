@@ -1,7 +1,10 @@
 #ifndef BSPSHADER_H
 #define BSPSHADER_H
 
-#include <QOpenGLShaderProgram>
+#include "bspworld.h"
+
+#include <vector>
+
 #include <QOpenGLTexture>
 #include <QString>
 
@@ -23,9 +26,11 @@ public:
     /**
      * @brief Binds the GPU resources for use
      *
-     * @remarks Albedo texture goes to texture unit 0
+     * @remarks Albedo texture goes to texture unit 0; the texture coordinate modifiers are read by the renderer through getTcMods
      */
-    void bind(QOpenGLShaderProgram *shaderProgram);
+    void bind();
+
+    bool hasAlbedo() const { return albedo != nullptr; }
 
     /**
      * @brief Destroys all GPU resources
@@ -37,17 +42,21 @@ public:
      */
     void release();
 
-    void update();
+    /**
+     * @brief Returns whether the shader changes with time, so frames must keep being drawn while it is visible
+     */
+    bool isAnimated() const;
 
     void setAlbedo(const QString &file);
-    void setUVModValue(QVector2D uvModValue);
+
+    void setTcMods(const std::vector<BSPTcMod> &tcMods) { this->tcMods = tcMods; }
+    const std::vector<BSPTcMod>& getTcMods() const { return tcMods; }
 
 private:
     QOpenGLTexture *albedo;
     QString name;
 
-    QVector2D uvMod;
-    QVector2D uvModValue;
+    std::vector<BSPTcMod> tcMods;
 };
 
 #endif // BSPSHADER_H
@@ -0,0 +1,314 @@
+#include "bspvisibility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+BSPVisibility::BSPVisibility()
+{
+    storage = Uncompressed;
+    clusterCount = 0;
+    clusterSize = 0;
+}
+
+bool BSPVisibility::load(const char *data, int length, Storage storage)
+{
+    clear();
+
+    if (length < (int)(2 * sizeof (int)))
+        return false;
+
+    int count, size;
+    memcpy(&count, data, sizeof (int));
+    memcpy(&size, data + sizeof (int), sizeof (int));
+
+    // Each row must hold one bit per cluster, and all rows must fit in the lump
+    if (count <= 0 || size < (count + 7) / 8)
+        return false;
+    if ((long long)count * size > length - (long long)(2 * sizeof (int)))
+        return false;
+
+    assign(count, size, (const unsigned char*)data + 2 * sizeof (int), storage);
+
+    return true;
+}
+
+void BSPVisibility::assign(int count, int size, const unsigned char *rows, Storage storage)
+{
+    this->storage = storage;
+    clusterCount = count;
+    clusterSize = size;
+
+    if (storage == Compressed)
+        compress(rows);
+    else
+        bitset.assign(rows, rows + (size_t)count * size);
+}
+
+/**
+ * @brief Returns the index of the lowest set bit of a non-zero word
+ */
+static inline int lowestBit(uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+bool BSPVisibility::buildHearable(const BSPVisibility &visible, int threadCount)
+{
+    clear();
+
+    if (visible.isEmpty())
+        return false;
+
+    const int count = visible.clusterCount;
+    const int size = visible.clusterSize;
+    const int words = (size + 7) / 8;
+
+    // Expand the PVS to rows padded to whole 64 bit words; on little endian machines, bit N of the row is bit N % 64 of word N / 64
+    std::vector<uint64_t> pvs((size_t)count * words, 0);
+    for (int cluster = 0; cluster < count; ++cluster)
+        visible.decompressRow(cluster, (unsigned char*)&pvs[(size_t)cluster * words]);
+
+    std::vector<uint64_t> phs((size_t)count * words, 0);
+
+    // Clusters are handed out in small chunks, so threads that get sparse rows pick up more work
+    const int chunkSize = 16;
+    std::atomic<int> nextCluster(0);
+
+    auto worker = [&]() {
+        int first;
+        while ((first = nextCluster.fetch_add(chunkSize)) < count) {
+            int last = std::min(first + chunkSize, count);
+
+            for (int cluster = first; cluster < last; ++cluster) {
+                const uint64_t *row = &pvs[(size_t)cluster * words];
+                uint64_t *out = &phs[(size_t)cluster * words];
+
+                for (int word = 0; word < words; ++word) {
+                    uint64_t bits = row[word];
+
+                    while (bits) {
+                        int other = word * 64 + lowestBit(bits);
+                        bits &= bits - 1;
+
+                        if (other >= count)
+                            break;
+
+                        const uint64_t *otherRow = &pvs[(size_t)other * words];
+                        for (int i = 0; i < words; ++i)
+                            out[i] |= otherRow[i];
+                    }
+                }
+            }
+        }
+    };
+
+    if (threadCount <= 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, (count + chunkSize - 1) / chunkSize);
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i)
+        threads.push_back(std::thread(worker));
+
+    worker();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    // Drop the padding before storing the rows
+    std::vector<unsigned char> rows((size_t)count * size);
+    for (int cluster = 0; cluster < count; ++cluster)
+        memcpy(&rows[(size_t)cluster * size], &phs[(size_t)cluster * words], size);
+
+    assign(count, size, rows.data(), visible.storage);
+
+    return true;
+}
+
+void BSPVisibility::compress(const unsigned char *rows)
+{
+    rowOffsets.resize(clusterCount + 1);
+
+    for (int cluster = 0; cluster < clusterCount; ++cluster) {
+        const unsigned char *row = rows + (size_t)cluster * clusterSize;
+        rowOffsets[cluster] = bitset.size();
+
+        for (int i = 0; i < clusterSize; ++i) {
+            if (row[i]) {
+                bitset.push_back(row[i]);
+                continue;
+            }
+
+            int zeros = 1;
+            while (i + 1 < clusterSize && row[i + 1] == 0 && zeros < 255) {
+                ++zeros;
+                ++i;
+            }
+
+            bitset.push_back(0);
+            bitset.push_back(zeros);
+        }
+    }
+
+    rowOffsets[clusterCount] = bitset.size();
+    bitset.shrink_to_fit();
+}
+
+void BSPVisibility::clear()
+{
+    std::vector<unsigned char>().swap(bitset);
+    std::vector<unsigned>().swap(rowOffsets);
+    clusterCount = 0;
+    clusterSize = 0;
+}
+
+bool BSPVisibility::canSee(int current, int test) const
+{
+    if (clusterCount == 0 || current < 0 || current >= clusterCount) return true;
+    if (test < 0 || test >= clusterCount) return false;
+
+    if (storage == Uncompressed)
+        return testRow(&bitset[(size_t)current * clusterSize], test);
+
+    // Walk the runs until the byte holding the bit is reached
+    int target = test >> 3;
+    int position = 0;
+    const unsigned char *data = &bitset[rowOffsets[current]];
+
+    while (true) {
+        if (*data) {
+            if (position == target)
+                return (*data & (1 << (test & 7))) != 0;
+            ++position;
+            ++data;
+        }
+        else {
+            position += data[1];
+            if (position > target)
+                return false;
+            data += 2;
+        }
+    }
+}
+
+const unsigned char *BSPVisibility::getRow(int cluster) const
+{
+    if (storage != Uncompressed || cluster < 0 || cluster >= clusterCount)
+        return nullptr;
+
+    return &bitset[(size_t)cluster * clusterSize];
+}
+
+void BSPVisibility::decompressRow(int cluster, unsigned char *row) const
+{
+    if (storage == Uncompressed) {
+        memcpy(row, &bitset[(size_t)cluster * clusterSize], clusterSize);
+        return;
+    }
+
+    const unsigned char *data = &bitset[rowOffsets[cluster]];
+    const unsigned char *end = &bitset[0] + rowOffsets[cluster + 1];
+
+    while (data < end) {
+        if (*data) {
+            *row++ = *data++;
+        }
+        else {
+            memset(row, 0, data[1]);
+            row += data[1];
+            data += 2;
+        }
+    }
+}
+
+size_t BSPVisibility::getMemoryUsage() const
+{
+    return bitset.capacity() + rowOffsets.capacity() * sizeof (unsigned);
+}
+
+PVSRowCache::PVSRowCache(int capacity)
+    : capacity(capacity > 0 ? capacity : 1)
+{
+    useCounter = 0;
+    hits = misses = 0;
+    owner = nullptr;
+    rowSize = 0;
+
+    entries.reserve(this->capacity);
+}
+
+void PVSRowCache::clear()
+{
+    entries.clear();
+    owner = nullptr;
+    rowSize = 0;
+    hits = misses = 0;
+}
+
+const unsigned char *PVSRowCache::getRow(const BSPVisibility &visibility, int cluster)
+{
+    if (cluster < 0 || cluster >= visibility.getClusterCount())
+        return nullptr;
+
+    // Uncompressed rows can be used directly
+    const unsigned char *row = visibility.getRow(cluster);
+    if (row)
+        return row;
+
+    if (owner != &visibility || rowSize != visibility.getClusterSize()) {
+        entries.clear();
+        owner = &visibility;
+        rowSize = visibility.getClusterSize();
+        rows.resize((size_t)capacity * rowSize);
+    }
+
+    ++useCounter;
+
+    int victim = 0;
+    for (int i = 0; i < (int)entries.size(); ++i) {
+        if (entries[i].cluster == cluster) {
+            entries[i].lastUse = useCounter;
+            ++hits;
+            return &rows[(size_t)i * rowSize];
+        }
+
+        if (entries[i].lastUse < entries[victim].lastUse)
+            victim = i;
+    }
+
+    ++misses;
+
+    if ((int)entries.size() < capacity) {
+        victim = entries.size();
+        entries.push_back(Entry());
+    }
+
+    entries[victim].cluster = cluster;
+    entries[victim].lastUse = useCounter;
+
+    unsigned char *target = &rows[(size_t)victim * rowSize];
+    visibility.decompressRow(cluster, target);
+
+    return target;
+}
+
+bool PVSRowCache::canSee(const BSPVisibility &visibility, int current, int test)
+{
+    if (visibility.isEmpty() || current < 0 || current >= visibility.getClusterCount()) return true;
+    if (test < 0 || test >= visibility.getClusterCount()) return false;
+
+    return BSPVisibility::testRow(getRow(visibility, current), test);
+}
@@ -0,0 +1,155 @@
+#ifndef BSPVISIBILITY_H
+#define BSPVISIBILITY_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief The potentially visible set (PVS) of a map
+ *
+ * Each cluster has a row of ''clusterSize'' bytes, where bit N is set when cluster N may be visible from it.
+ * Rows can be kept as in the lump or run-length encoded, since on large maps they are mostly zeros.
+ * In the compressed form, each zero byte is followed by the count of zeros it stands for (1 to 255), and any other byte is stored as is.
+ */
+class BSPVisibility
+{
+public:
+    enum Storage {
+        Uncompressed,
+        Compressed
+    };
+
+    BSPVisibility();
+
+    /**
+     * @brief Loads the visibility lump
+     * @param data The lump contents, starting with the cluster count and size
+     * @return false if the lump is malformed; the visibility is left empty in that case
+     */
+    bool load(const char *data, int length, Storage storage);
+
+    /**
+     * @brief Builds the potentially hearable set (PHS) from a PVS
+     *
+     * The row of a cluster becomes the union of the PVS rows of every cluster visible from it.
+     * Rows are combined 64 bits at a time, and clusters are split among ''threadCount'' threads (0 uses one per core).
+     * The result uses the same storage as ''visible''.
+     * @return false if ''visible'' is empty
+     */
+    bool buildHearable(const BSPVisibility &visible, int threadCount = 0);
+
+    /**
+     * @brief Releases all rows
+     */
+    void clear();
+
+    bool isEmpty() const { return clusterCount == 0; }
+
+    int getClusterCount() const { return clusterCount; }
+    int getClusterSize() const { return clusterSize; }
+    Storage getStorage() const { return storage; }
+
+    /**
+     * @brief Returns whether cluster ''current'' can see cluster ''test''
+     *
+     * Without visibility data, or from outside the map (negative cluster), everything is visible.
+     * Opaque leafs (negative ''test'' cluster) are never visible.
+     * @remarks For compressed storage this scans the row; use PVSRowCache for repeated tests from the same cluster
+     */
+    bool canSee(int current, int test) const;
+
+    /**
+     * @brief Returns the row of a cluster, or nullptr if the rows are compressed
+     */
+    const unsigned char *getRow(int cluster) const;
+
+    /**
+     * @brief Writes the uncompressed row of a cluster to ''row'', which must hold getClusterSize() bytes
+     */
+    void decompressRow(int cluster, unsigned char *row) const;
+
+    /**
+     * @brief Returns the number of bytes used by the rows, including the row index of the compressed storage
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * @brief Returns the number of bytes the rows take when uncompressed
+     */
+    size_t getUncompressedSize() const { return (size_t)clusterCount * clusterSize; }
+
+    /**
+     * @brief Tests the bit of cluster ''test'' in an uncompressed row
+     */
+    static inline bool testRow(const unsigned char *row, int test) {
+        return (row[test >> 3] & (1 << (test & 7))) != 0;
+    }
+
+private:
+    /**
+     * @brief Takes ''count'' uncompressed rows of ''size'' bytes
+     */
+    void assign(int count, int size, const unsigned char *rows, Storage storage);
+
+    void compress(const unsigned char *rows);
+
+    Storage storage;
+
+    int clusterCount;
+    int clusterSize;
+
+    /// @brief The rows, either uncompressed or run-length encoded
+    std::vector<unsigned char> bitset;
+
+    /// @brief Offset of each compressed row in ''bitset'', plus the end of the last one
+    std::vector<unsigned> rowOffsets;
+};
+
+/**
+ * @brief A small least-recently-used cache of decompressed PVS rows
+ *
+ * Each thread that queries the visibility should own its own cache.
+ */
+class PVSRowCache
+{
+public:
+    PVSRowCache(int capacity = 8);
+
+    /**
+     * @brief Returns the uncompressed row of a cluster, decompressing it if needed
+     * @remarks The pointer is valid until the next call
+     */
+    const unsigned char *getRow(const BSPVisibility &visibility, int cluster);
+
+    /**
+     * @brief Same as BSPVisibility::canSee, served from the cache
+     */
+    bool canSee(const BSPVisibility &visibility, int current, int test);
+
+    /**
+     * @brief Forgets all cached rows
+     */
+    void clear();
+
+    int getHits() const { return hits; }
+    int getMisses() const { return misses; }
+
+private:
+    struct Entry {
+        int cluster;
+        unsigned lastUse;
+    };
+
+    int capacity;
+    unsigned useCounter;
+    int hits, misses;
+
+    /// @brief The visibility the rows belong to, so the cache is flushed when it changes
+    const BSPVisibility *owner;
+    int rowSize;
+
+    std::vector<Entry> entries;
+    std::vector<unsigned char> rows;
+};
+
+#endif // BSPVISIBILITY_H
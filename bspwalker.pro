@@ -13,32 +13,54 @@ TEMPLATE = app
 
 CONFIG += c++11
 
+include(bspcore.pri)
+
 SOURCES += main.cpp\
         mainwindow.cpp \
     openglwidget.cpp \
     bsp.cpp \
     camera.cpp \
     bspshader.cpp \
-    q3parser.cpp \
-    bspentity.cpp \
     postprocesseffect.cpp \
     postprocesseffectchain.cpp \
-    light.cpp
+    frameprofiler.cpp \
+    camerapath.cpp \
+    benchmarkrunner.cpp \
+    offscreenrenderer.cpp \
+    heatmapanalyzer.cpp \
+    alloctracker.cpp \
+    framestatspublisher.cpp \
+    framescheduler.cpp \
+    rendertargetpool.cpp
 
 HEADERS  += mainwindow.h \
     openglwidget.h \
-    bspdefs.h \
     bsp.h \
     camera.h \
     bspshader.h \
-    q3parser.h \
-    bspentity.h \
     postprocesseffect.h \
     postprocesseffectchain.h \
-    light.h
+    frameprofiler.h \
+    camerapath.h \
+    benchmarkrunner.h \
+    offscreenrenderer.h \
+    heatmapanalyzer.h \
+    alloctracker.h \
+    framestatsprotocol.h \
+    framestatspublisher.h \
+    framescheduler.h \
+    rendertargetpool.h
 
 FORMS    += mainwindow.ui
 
+# Counts the heap allocations of every frame by call site: qmake CONFIG+=alloc_tracking
+alloc_tracking {
+    DEFINES += BSPWALKER_ALLOC_TRACKING
+    # Exports the symbols of the executable, so call sites can be named
+    linux: QMAKE_LFLAGS += -rdynamic
+    linux: LIBS += -ldl
+}
+
 RESOURCES += \
     bspwalker.qrc
 
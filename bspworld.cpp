@@ -0,0 +1,534 @@
+#include "bspworld.h"
+
+#include "q3parser.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QQuaternion>
+#include <QRegularExpression>
+
+BSPWorld::BSPWorld()
+{
+    visibilityStorage = BSPVisibility::Uncompressed;
+    buildHearability = false;
+    checksum = 0;
+}
+
+BSPWorld::~BSPWorld()
+{
+    releaseMap();
+}
+
+bool BSPWorld::loadMap(const QString &file)
+{
+    TraceScope trace("load", "BSPWorld::loadMap");
+    trace.addArgument("file", file);
+
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        emit loadError(QString("Failed to open file %1s").arg(file));
+        return false;
+    }
+
+    if (f.error() != QFile::NoError) {
+        emit loadError(QString("Error loading BSP file %1s: %2s").arg(file, f.errorString()));
+        return false;
+    }
+
+    releaseMap();
+
+    trace.setBytes(f.size());
+
+    if (!internalLoadMap(f)) {
+        releaseMap();
+        return false;
+    }
+
+    f.close();
+
+    // Load shader data
+    parseShaderData(findShaderScript(file));
+
+    convertVertices();
+
+    parseEntities();
+
+    createLightGrid();
+
+    return true;
+}
+
+const char *BSPWorld::getLumpName(int lump)
+{
+    static const char *names[HEADER_LUMPS] = {
+        "entities", "shaders", "planes", "nodes", "leafs", "leafsurfaces", "leafbrushes", "models", "brushes",
+        "brushsides", "drawverts", "drawindexes", "fogs", "surfaces", "lightmaps", "lightgrid", "visibility"
+    };
+
+    if (lump < 0 || lump >= HEADER_LUMPS)
+        return "unknown";
+
+    return names[lump];
+}
+
+QString BSPWorld::findShaderScript(const QString &mapFile)
+{
+    QRegularExpression re("(.*)(\\\\|/)(maps)(\\\\|/)(.+)(\\.bsp)", QRegularExpression::CaseInsensitiveOption);
+    QString shaderFile = mapFile;
+    shaderFile.replace(re, "\\1\\2scripts\\4\\5.shader");
+
+    return shaderFile;
+}
+
+void BSPWorld::releaseMap()
+{
+    destroyLumpData();
+
+    for (auto i = entities.begin(); i != entities.end(); ++i) {
+        delete *i;
+    }
+    entities.clear();
+
+    visibility.clear();
+    hearability.clear();
+
+    shaderInfos.clear();
+    skyLight = Light();
+}
+
+void BSPWorld::destroyLumpData()
+{
+    lumpShaders.clear();
+    leafs.clear();
+    leafBrushes.clear();
+    leafSurfaces.clear();
+    planes.clear();
+    brushSides.clear();
+    brushes.clear();
+    models.clear();
+    nodes.clear();
+    entityString.clear();
+    surfaces.clear();
+    vertexData.clear();
+    vertices.clear();
+    indexes.clear();
+    lightmapImages.clear();
+    lightGridData.clear();
+    lightGrid.clear();
+}
+
+bool BSPWorld::internalLoadMap(QFile &file)
+{
+    TraceScope trace("load", "BSPWorld::internalLoadMap");
+
+    {
+        TraceScope checksumTrace("load", "checksum");
+        checksumTrace.setBytes(file.size());
+        checksum = blockChecksum(file.readAll(), file.size());
+    }
+
+    // readAll moves the pointer to the EOF, so reset it to the start
+    file.seek(0);
+
+    QByteArray buffer = file.read(sizeof (dheader_t));
+    dheader_t *header = (dheader_t*)buffer.data();
+
+    if (buffer.size() != sizeof (dheader_t)) {
+        emit loadError(QString("Truncated BSP header"));
+        return false;
+    }
+
+    if (header->ident != BSP_IDENT) {
+        emit loadError(QString("Unsupported BSP identifier"));
+        return false;
+    }
+
+    if (header->version != BSP_VERSION) {
+        emit loadError(QString("Unsupported BSP version. Expecting %1d, got %2d").arg(BSP_VERSION).arg(header->version));
+        return false;
+    }
+
+    // Load all lumps
+    if (!loadNotEmptyLump<dshader_t>(file, *header, LUMP_SHADERS, lumpShaders))
+        return false;
+    if (!loadNotEmptyLump<dleaf_t>(file, *header, LUMP_LEAFS, leafs))
+        return false;
+    if (!loadLump<int>(file, *header, LUMP_LEAFBRUSHES, leafBrushes))
+        return false;
+    if (!loadLump<int>(file, *header, LUMP_LEAFSURFACES, leafSurfaces))
+        return false;
+    if (!loadNotEmptyLump<dplane_t>(file, *header, LUMP_PLANES, planes))
+        return false;
+    if (!loadLump<dbrushside_t>(file, *header, LUMP_BRUSHSIDES, brushSides))
+        return false;
+    if (!loadLump<dbrush_t>(file, *header, LUMP_BRUSHES, brushes))
+        return false;
+    if (!loadNotEmptyLump<dmodel_t>(file, *header, LUMP_MODELS, models))
+        return false;
+    if (!loadNotEmptyLump<dnode_t>(file, *header, LUMP_NODES, nodes))
+        return false;
+    if (!loadLump<char>(file, *header, LUMP_ENTITIES, entityString))
+        return false;
+    if (!loadLump<dsurface_t>(file, *header, LUMP_SURFACES, surfaces))
+        return false;
+    if (!loadLump<dvert_t>(file, *header, LUMP_DRAWVERTS, vertexData))
+        return false;
+    if (!loadLump<int>(file, *header, LUMP_DRAWINDEXES, indexes))
+        return false;
+    if (!loadNotEmptyLump<dlightmap_t>(file, *header, LUMP_LIGHTMAPS, lightmapImages))
+        return false;
+    if (!loadLump<dlightgrid_t>(file, *header, LUMP_LIGHTGRID, lightGridData))
+        return false;
+    if (!loadVisData(file, header->lumps[LUMP_VISIBILITY]))
+        return false;
+
+    return true;
+}
+
+void BSPWorld::parseShaderData(QString fileName)
+{
+    TraceScope trace("load", "BSPWorld::parseShaderData");
+    trace.addArgument("file", fileName);
+
+    QFile file(fileName);
+    if (!file.exists() || !file.open(QFile::ReadOnly))
+        return;
+
+    QByteArray data = file.readAll();
+    trace.setBytes(data.size());
+
+    file.close();
+
+    Q3Parser parser(data.data());
+    Q3TokenType tokenType;
+
+    int nestLevel = 0;
+    BSPShaderInfo *currentShader = nullptr;
+
+    QString currentAlbedo = "";
+    std::vector<BSPTcMod> tcMods;
+
+    auto nextFloat = [&parser]() -> float {
+        parser.next();
+        return atof(parser.getCurrentToken().toLatin1().data());
+    };
+
+    // Look for the sun color and direction
+    while ((tokenType = parser.next()) != Q3TOK_EOF) {
+        if (tokenType == Q3TOK_LITERAL || tokenType == Q3TOK_STRING) {
+            if (nestLevel == 0) {
+                // Root level, shader name
+                QString shaderName = parser.getCurrentToken();
+                currentShader = &shaderInfos[shaderName];
+                currentShader->name = shaderName;
+            }
+            else {
+                QString attributeName = parser.getCurrentToken();
+                //
+                if (attributeName == "q3map_sun") {
+                    parser.next();
+                    QString red = parser.getCurrentToken();
+                    parser.next();
+                    QString green = parser.getCurrentToken();
+                    parser.next();
+                    QString blue = parser.getCurrentToken();
+
+                    skyLight.color = QVector3D(atof(red.toLatin1().data()), atof(green.toLatin1().data()), atof(blue.toLatin1().data()));
+
+                    parser.next();
+                    QString intensity = parser.getCurrentToken();
+                    skyLight.intensity = atof(intensity.toLatin1().data());
+
+                    parser.next();
+                    QString zRotation = parser.getCurrentToken();
+                    parser.next();
+                    QString xRotation = parser.getCurrentToken();
+
+                    // Calculate the direction
+                    QVector3D direction(0, 1, 0);
+                    QQuaternion rotation = QQuaternion::fromAxisAndAngle(0, 0, 1, atof(zRotation.toLatin1().data()));
+                    rotation *= QQuaternion::fromAxisAndAngle(1, 0, 0, atof(xRotation.toLatin1().data()));
+                    skyLight.direction = rotation.rotatedVector(direction);
+                }
+                else if (attributeName == "map") {
+                    // Texture file
+                    parser.next();
+                    QString fileName = parser.getCurrentToken();
+                    if (fileName[0] == '$'){
+                        // Special name, ignore it
+                        continue;
+                    }
+                    currentAlbedo = fileName;
+                }
+                else if (attributeName == "tcMod") {
+                    // get mod type
+                    parser.next();
+                    QString modType = parser.getCurrentToken().toLower();
+
+                    BSPTcMod tcMod;
+                    tcMod.type = BSPTcMod::None;
+                    std::fill(tcMod.parameters, tcMod.parameters + 8, 0.0f);
+
+                    int count = 0;
+                    if (modType == "scroll") {
+                        tcMod.type = BSPTcMod::Scroll;
+                        count = 2;
+                    }
+                    else if (modType == "scale") {
+                        tcMod.type = BSPTcMod::Scale;
+                        count = 2;
+                    }
+                    else if (modType == "rotate") {
+                        tcMod.type = BSPTcMod::Rotate;
+                        count = 1;
+                    }
+                    else if (modType == "turb") {
+                        tcMod.type = BSPTcMod::Turbulent;
+                        count = 4;
+                    }
+                    else if (modType == "stretch") {
+                        tcMod.type = BSPTcMod::Stretch;
+                        parser.next();
+                        tcMod.parameters[0] = parseWave(parser.getCurrentToken());
+                        for (int i = 1; i < 5; ++i)
+                            tcMod.parameters[i] = nextFloat();
+                    }
+
+                    for (int i = 0; i < count; ++i)
+                        tcMod.parameters[i] = nextFloat();
+
+                    if (tcMod.type != BSPTcMod::None && (int)tcMods.size() < BSPTcMod::MAX_PER_STAGE)
+                        tcMods.push_back(tcMod);
+                }
+            }
+        }
+        else if (tokenType == Q3TOK_LIST_START) {
+            currentAlbedo.clear();
+            tcMods.clear();
+            nestLevel++;
+        }
+        else if (tokenType == Q3TOK_LIST_END) {
+            if (currentShader && !currentAlbedo.isNull()) {
+                currentShader->albedo = currentAlbedo;
+                currentShader->tcMods = tcMods;
+            }
+            nestLevel--;
+        }
+    }
+}
+
+float BSPWorld::parseWave(const QString &name)
+{
+    QString wave = name.toLower();
+    if (wave == "triangle")
+        return BSPTcMod::Triangle;
+    if (wave == "square")
+        return BSPTcMod::Square;
+    if (wave == "sawtooth")
+        return BSPTcMod::Sawtooth;
+    if (wave == "inversesawtooth")
+        return BSPTcMod::InverseSawtooth;
+
+    return BSPTcMod::Sin;
+}
+
+bool BSPWorld::loadVisData(QFile &file, const lump_t &lump)
+{
+    TraceScope trace("load", "visibility");
+    trace.setBytes(lump.filelen);
+
+    if (lump.filelen == 0)
+        return true;
+
+    file.seek(lump.fileofs);
+    QByteArray data = file.read(lump.filelen);
+
+    if (file.error() != QFile::NoError || data.size() != lump.filelen) {
+        emit loadError(QString("Error loading BSP visibility data: %1s").arg(file.errorString()));
+        return false;
+    }
+
+    if (!visibility.load(data.constData(), data.size(), visibilityStorage)) {
+        emit loadError(QString("Invalid visibility lump"));
+        return false;
+    }
+
+    if (buildHearability) {
+        TraceScope trace("load", "buildHearable");
+        trace.addArgument("clusters", visibility.getClusterCount());
+
+        hearability.buildHearable(visibility);
+
+        trace.setBytes(hearability.getMemoryUsage());
+    }
+
+    return true;
+}
+
+void BSPWorld::parseEntities()
+{
+    TraceScope trace("load", "BSPWorld::parseEntities");
+    trace.setBytes(entityString.size());
+
+    Q3TokenType tokenType;
+    Q3Parser parser(entityString.data());
+
+    BSPEntity *entity = nullptr;
+    QString key;
+
+    // Parsing entities is rather simple:
+    // They have no name definitions and the contents are always a K/V pair
+    while ((tokenType = parser.next()) != Q3TOK_EOF) {
+        if (tokenType == Q3TOK_LIST_START) { // Starting a new group, so create a new entity
+            entity = new BSPEntity;
+        }
+        else if (tokenType == Q3TOK_LIST_END) { // Ending a group, add the current entity to the entity list
+            if (entity != nullptr)
+                entities.push_back(entity);
+
+            entity = nullptr;
+        }
+        else if (tokenType == Q3TOK_LITERAL || tokenType == Q3TOK_STRING) {
+            if (key.isNull()) {
+                key = parser.getCurrentToken();
+            }
+            else {
+                entity->addSetting(key, parser.getCurrentToken());
+                key.clear();
+            }
+        }
+    }
+
+    trace.addArgument("entities", entities.size());
+
+    entityString.clear();
+}
+
+void BSPWorld::createLightGrid()
+{
+    TraceScope trace("load", "BSPWorld::createLightGrid");
+    trace.addArgument("cells", lightGridData.size());
+
+    if (lightGridData.empty())
+        return;
+
+    QVector3D gridSize(LIGHTGRID_SIZE_X, LIGHTGRID_SIZE_Y, LIGHTGRID_SIZE_Z);
+
+    const BSPEntity *worldspawn = findEntityByClassname("worldspawn");
+    if (worldspawn) {
+        QString value = worldspawn->getSetting("gridsize");
+        if (!value.isNull()) {
+            std::istringstream iss(value.toLatin1().data());
+            float x, y, z;
+            if (iss >> x >> y >> z)
+                gridSize = QVector3D(x, y, z);
+        }
+    }
+
+    if (!lightGrid.create(models[0], gridSize, lightGridData))
+        qWarning() << "Light grid lump does not match the world bounds, ignoring it" << endl;
+
+    lightGridData.clear();
+}
+
+void BSPWorld::convertVertices()
+{
+    TraceScope trace("load", "BSPWorld::convertVertices");
+    trace.addArgument("vertices", vertexData.size());
+
+    int size = vertexData.size();
+    vertices.resize(size);
+    int i = 0;
+    QVector3D center;
+    drawVert_t *out = vertices.data();
+    // Convert from BSP dvert_t to a shader-friendly drawVert_t
+    std::for_each(vertexData.begin(), vertexData.end(), [out, &i, size, &center](dvert_t &data) {
+        out[i].position = QVector3D(data.position[0], data.position[1], data.position[2]);
+        out[i].texCoord = QVector2D(data.textureCoords[0], data.textureCoords[1]);
+        out[i].lightmapCoord = QVector2D(data.lightmap[0], data.lightmap[1]);
+        out[i].normal = QVector3D(data.normal[0], data.normal[1], data.normal[2]);
+        out[i].color = QVector4D(data.color[0], data.color[1], data.color[2], data.color[3]) / 255;
+
+        center = center + (out[i].position / size);
+        ++i;
+    });
+    this->center = center;
+    vertexData.clear();
+}
+
+const BSPShaderInfo *BSPWorld::findShaderInfo(const QString &name) const
+{
+    auto i = shaderInfos.find(name);
+    if (i == shaderInfos.end())
+        return nullptr;
+
+    return &i->second;
+}
+
+unsigned BSPWorld::blockChecksum(const char *buffer, int length)
+{
+    QCryptographicHash hash(QCryptographicHash::Md4);
+    hash.addData(buffer, length);
+    QByteArray result = hash.result();
+
+    unsigned* digest = (unsigned*)result.data();
+    unsigned val = digest[0] ^ digest[1] ^ digest[2] ^ digest[3];
+
+    return val;
+}
+
+const BSPEntity* BSPWorld::findEntityByClassname(const QString &classname) const
+{
+    for (auto entity = entities.begin(); entity != entities.end(); ++entity) {
+        QString entityClass = (*entity)->getSetting("classname");
+        if (!entityClass.isNull() && entityClass.compare(classname, Qt::CaseInsensitive) == 0) {
+            return *entity;
+        }
+    }
+
+    return nullptr;
+}
+
+void BSPWorld::getStartView(QVector3D &position, QVector3D &angles) const
+{
+    // Try to find the entity that holds the position and angles for the initial camera position
+    const BSPEntity *entity = findEntityByClassname("info_player_intermission");
+    if (!entity) {
+        position = center;
+        angles = QVector3D();
+        return;
+    }
+
+    std::istringstream iss(entity->getSetting("origin").toLatin1().data());
+    float x, y, z;
+
+    iss >> x >> y >> z;
+    position = QVector3D(x, y, z);
+
+    iss.clear();
+    iss.str(entity->getSetting("angles").toLatin1().data());
+    iss >> x >> y >> z;
+
+    angles = QVector3D(x, y, z);
+}
+
+int BSPWorld::findNodeForPosition(const QVector3D &position) const
+{
+    int nodeIndex = 0;
+
+    while (nodeIndex >= 0)
+    {
+        auto &node = nodes[nodeIndex];
+        auto &plane = planes[node.planeNum];
+
+        float distance = plane.normal[0] * position.x() + plane.normal[1] * position.y() + plane.normal[2] * position.z() - plane.dist;
+
+        // children[0] is in front of the plane
+        nodeIndex = node.children[distance >= 0 ? 0 : 1];
+    }
+
+    return ~nodeIndex;
+}
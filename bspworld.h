@@ -0,0 +1,336 @@
+#ifndef BSPWORLD_H
+#define BSPWORLD_H
+
+#include "bspdefs.h"
+#include "bspentity.h"
+#include "bspvisibility.h"
+#include "light.h"
+#include "lightgrid.h"
+#include "tracer.h"
+
+#include <map>
+#include <vector>
+
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <QVector2D>
+#include <QVector3D>
+
+/**
+ * @brief A texture coordinate modifier (tcMod) of a shader stage
+ *
+ * The modifiers are evaluated in the vertex shader from the time since the map was loaded; the values of Type and Wave
+ * must match the TCMOD_ and WAVE_ constants of bsp.vert.
+ */
+struct BSPTcMod
+{
+    enum Type {
+        None,
+        Scroll,     // s speed, t speed, in repeats per second
+        Scale,      // s scale, t scale
+        Rotate,     // degrees per second, around the center of the texture
+        Turbulent,  // base (unused), amplitude, phase, frequency
+        Stretch     // wave, base, amplitude, phase, frequency
+    };
+
+    enum Wave {
+        Sin,
+        Triangle,
+        Square,
+        Sawtooth,
+        InverseSawtooth
+    };
+
+    /// @brief Modifiers kept per stage; further ones are ignored
+    static const int MAX_PER_STAGE = 4;
+
+    Type type;
+    float parameters[8];
+};
+
+/**
+ * @brief Describes a shader parsed from the map's shader script
+ *
+ * This holds only the information needed to build the GPU resources later, so it can be parsed without a GL context
+ */
+struct BSPShaderInfo
+{
+    QString name;
+    QString albedo;
+    /// @brief The modifiers of the stage the albedo comes from, in the order they are applied
+    std::vector<BSPTcMod> tcMods;
+};
+
+/**
+ * @brief Holds the immutable data of a BSP map
+ *
+ * The world does not depend on an OpenGL context, so it can be loaded in any thread.
+ * After loadMap() returns, all const methods are safe to be called concurrently.
+ */
+class BSPWorld : public QObject
+{
+    Q_OBJECT
+
+public:
+    BSPWorld();
+    ~BSPWorld();
+
+    /**
+     * @brief Loads a BSP map from the specified filename
+     * @return true if the map was loaded successfully
+     */
+    bool loadMap(const QString& file);
+
+    /**
+     * @brief Unloads the BSP map and release all associated resources
+     */
+    void releaseMap();
+
+    /**
+     * @brief Returns whether a map is currently loaded
+     */
+    bool isLoaded() const { return !nodes.empty(); }
+
+    /**
+     * @brief Returns the center of the level
+     */
+    QVector3D getCenter() const { return center; }
+
+    /**
+     * @brief Returns the checksum of the loaded file
+     */
+    unsigned getChecksum() const { return checksum; }
+
+    /**
+     * @brief Returns the sun light parsed from the shader script
+     */
+    const Light& getSkyLight() const { return skyLight; }
+
+    const BSPEntity *findEntityByClassname(const QString &classname) const;
+
+    /**
+     * @brief Returns the initial camera position and angles (pitch, yaw and roll, in degrees)
+     *
+     * Uses the info_player_intermission entity if there is one, otherwise the center of the level, with no rotation.
+     */
+    void getStartView(QVector3D &position, QVector3D &angles) const;
+
+    /**
+     * @brief Returns which leaf the specified position belongs to
+     */
+    int findNodeForPosition(const QVector3D& position) const;
+
+    /**
+     * @brief Returns if cluster ''current'' can see cluster ''test''
+     * @remarks With compressed visibility, prefer a PVSRowCache when testing many clusters from the same one
+     */
+    inline bool canSee(int current, int test) const {
+        return visibility.canSee(current, test);
+    }
+
+    /**
+     * @brief Returns if a sound in cluster ''test'' can be heard from cluster ''current''
+     * @remarks Without a PHS (see setBuildHearability), everything is hearable
+     */
+    inline bool canHear(int current, int test) const {
+        return hearability.canSee(current, test);
+    }
+
+    /**
+     * @brief Selects whether the potentially hearable set is built when the next map is loaded
+     */
+    void setBuildHearability(bool value) { buildHearability = value; }
+
+    /**
+     * @brief Selects how the visibility rows of the next loaded map are stored
+     */
+    void setVisibilityStorage(BSPVisibility::Storage storage) { visibilityStorage = storage; }
+
+    /**
+     * @brief Returns the shader information from the shader script, or nullptr if the shader was not declared there
+     */
+    const BSPShaderInfo *findShaderInfo(const QString &name) const;
+
+    const std::vector<dshader_t>& getLumpShaders() const { return lumpShaders; }
+    const std::vector<dleaf_t>& getLeafs() const { return leafs; }
+    const std::vector<int>& getLeafBrushes() const { return leafBrushes; }
+    const std::vector<int>& getLeafSurfaces() const { return leafSurfaces; }
+    const std::vector<dplane_t>& getPlanes() const { return planes; }
+    const std::vector<dbrushside_t>& getBrushSides() const { return brushSides; }
+    const std::vector<dbrush_t>& getBrushes() const { return brushes; }
+    const std::vector<dmodel_t>& getModels() const { return models; }
+    const std::vector<dnode_t>& getNodes() const { return nodes; }
+    const std::vector<dsurface_t>& getSurfaces() const { return surfaces; }
+    const std::vector<drawVert_t>& getVertices() const { return vertices; }
+    const std::vector<int>& getIndexes() const { return indexes; }
+    const std::vector<dlightmap_t>& getLightmapImages() const { return lightmapImages; }
+    const std::vector<BSPEntity*>& getEntities() const { return entities; }
+    const BSPVisibility& getVisibility() const { return visibility; }
+    const BSPVisibility& getHearability() const { return hearability; }
+    const BSPLightGrid& getLightGrid() const { return lightGrid; }
+
+    /**
+     * @brief Calculates the checksum of the block having the specified length
+     */
+    static unsigned blockChecksum(const char *buffer, int length);
+
+private:
+    // The loader microbenchmarks time the private load stages in isolation
+    friend class LoaderBenchmark;
+
+    /**
+     * @brief Returns the shader script of a map, scripts/<name>.shader next to its maps directory
+     */
+    static QString findShaderScript(const QString &mapFile);
+
+    /**
+     * @brief Releases all allocated data related to BSP
+     */
+    void destroyLumpData();
+
+    /**
+     * @brief Loads data from the file into the vectors
+     */
+    bool internalLoadMap(QFile &file);
+
+    void parseShaderData(QString fileName);
+
+    /**
+     * @brief Returns the BSPTcMod::Wave of a waveform name, as a tcMod parameter; unknown names are sine waves
+     */
+    static float parseWave(const QString &name);
+
+    /**
+     * @brief Loads the entities information from the lump data
+     */
+    void parseEntities();
+
+    /**
+     * @brief Sets up the light grid from the lump data, using the grid size of the worldspawn entity
+     */
+    void createLightGrid();
+
+    /**
+     * @brief Converts the BSP vertices to a shader-friendly format
+     */
+    void convertVertices();
+
+    /**
+     * @brief Returns the name of a lump, for diagnostics
+     */
+    static const char *getLumpName(int lump);
+
+    /**
+     * @brief Loads data from a lump and fills a vector
+     */
+    template <class T>
+    bool loadLump(QFile &file, const dheader_t &header, int lumpIndex, std::vector<T> &vec)
+    {
+        TraceScope trace("load", getLumpName(lumpIndex));
+        const lump_t &lump = header.lumps[lumpIndex];
+        trace.setBytes(lump.filelen);
+
+        if (lump.filelen % sizeof(T) != 0) {
+            emit loadError(QString("Invalid lump size, expected multiple of %1d, got %2d (remaining %3d bytes)").arg(sizeof(T)).arg(lump.filelen).arg(lump.filelen % sizeof(T)));
+            return false;
+        }
+
+        int count = lump.filelen / sizeof(T);
+
+        // If the lump is empty, exit silently
+        if (count == 0)
+            return true;
+
+        file.seek(lump.fileofs);
+        QByteArray data = file.read(lump.filelen);
+
+        if (file.error() != QFile::NoError) {
+            emit loadError(QString("Error loading BSP file: %1s").arg(file.errorString()));
+            return false;
+        }
+
+        vec.resize(count);
+
+        memcpy(vec.data(), data.data(), data.length());
+
+        return true;
+    }
+
+    /**
+     * @brief Loads data from a lump and fills a vector
+     * @remarks Throws an error when the lump is empty
+     */
+    template <class T>
+    bool loadNotEmptyLump(QFile &file, const dheader_t &header, int lumpIndex, std::vector<T> &vec)
+    {
+        TraceScope trace("load", getLumpName(lumpIndex));
+        const lump_t &lump = header.lumps[lumpIndex];
+        trace.setBytes(lump.filelen);
+
+        if (lump.filelen % sizeof(T) != 0) {
+            emit loadError(QString("Invalid lump size, expected multiple of %1d, got %2d (remaining %3d bytes)").arg(sizeof(T)).arg(lump.filelen).arg(lump.filelen % sizeof(T)));
+            return false;
+        }
+
+        file.seek(lump.fileofs);
+        QByteArray data = file.read(lump.filelen);
+
+        if (file.error() != QFile::NoError) {
+            emit loadError(QString("Error loading BSP file: %1s").arg(file.errorString()));
+            return false;
+        }
+
+        int count = lump.filelen / sizeof(T);
+
+        if (count < 1) {
+            emit loadError(QString("Empty lump"));
+            return false;
+        }
+
+        vec.resize(count);
+
+        memcpy(vec.data(), data.data(), data.length());
+
+        return true;
+    }
+
+    bool loadVisData(QFile &file, const lump_t &lump);
+
+    std::vector<dshader_t> lumpShaders;
+    std::vector<dleaf_t> leafs;
+    std::vector<int> leafBrushes;
+    std::vector<int> leafSurfaces;
+    std::vector<dplane_t> planes;
+    std::vector<dbrushside_t> brushSides;
+    std::vector<dbrush_t> brushes;
+    std::vector<dmodel_t> models;
+    std::vector<dnode_t> nodes;
+    std::vector<char> entityString;
+    std::vector<dsurface_t> surfaces;
+    std::vector<dvert_t> vertexData;
+    std::vector<drawVert_t> vertices;
+    std::vector<int> indexes;
+    std::vector<dlightmap_t> lightmapImages;
+    std::vector<dlightgrid_t> lightGridData;
+
+    BSPLightGrid lightGrid;
+
+    std::vector<BSPEntity*> entities;
+    BSPVisibility visibility;
+    BSPVisibility hearability;
+    BSPVisibility::Storage visibilityStorage;
+    bool buildHearability;
+
+    std::map<QString, BSPShaderInfo> shaderInfos;
+
+    Light skyLight;
+
+    QVector3D center;
+    unsigned checksum;
+
+signals:
+    void loadError(QString error);
+};
+
+#endif // BSPWORLD_H
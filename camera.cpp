@@ -28,6 +28,11 @@ void Camera::setRotation(float pitch, float yaw, float roll)
     update();
 }
 
+QVector3D Camera::getRotation() const
+{
+    return QVector3D(qRadiansToDegrees(pitch), qRadiansToDegrees(yaw), qRadiansToDegrees(roll));
+}
+
 void Camera::beginMouseTrack(const QPointF &pos)
 {
     mouseClickPos = pos;
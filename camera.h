@@ -15,6 +15,11 @@ public:
     void setPosition(QVector3D pos) { position = pos; }
     void setRotation(float pitch, float yaw, float roll);
 
+    /**
+     * @brief Returns the pitch, yaw and roll, in the same units as setRotation
+     */
+    QVector3D getRotation() const;
+
     void beginMouseTrack(const QPointF &pos);
     void endMouseTrack();
     void mouseMove(const QPointF &pos);
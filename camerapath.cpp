@@ -0,0 +1,66 @@
+#include "camerapath.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+CameraPath::CameraPath()
+{
+
+}
+
+bool CameraPath::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return false;
+
+    samples.clear();
+
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList values = line.split(' ', QString::SkipEmptyParts);
+        if (values.size() != 6)
+            return false;
+
+        CameraPathSample sample;
+        sample.position = QVector3D(values[0].toFloat(), values[1].toFloat(), values[2].toFloat());
+        sample.rotation = QVector3D(values[3].toFloat(), values[4].toFloat(), values[5].toFloat());
+        samples.push_back(sample);
+    }
+
+    return true;
+}
+
+bool CameraPath::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "# x y z pitch yaw roll\n";
+
+    for (auto sample = samples.begin(); sample != samples.end(); ++sample) {
+        stream << sample->position.x() << ' ' << sample->position.y() << ' ' << sample->position.z() << ' '
+               << sample->rotation.x() << ' ' << sample->rotation.y() << ' ' << sample->rotation.z() << '\n';
+    }
+
+    return stream.status() == QTextStream::Ok;
+}
+
+void CameraPath::createTurnaround(const QVector3D &position, const QVector3D &rotation, int frames)
+{
+    samples.clear();
+
+    for (int i = 0; i < frames; ++i) {
+        CameraPathSample sample;
+        sample.position = position;
+        sample.rotation = QVector3D(rotation.x(), rotation.y() + 360.0f * i / frames, rotation.z());
+        samples.push_back(sample);
+    }
+}
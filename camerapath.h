@@ -0,0 +1,47 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <vector>
+
+#include <QString>
+#include <QVector3D>
+
+/**
+ * @brief A camera position and rotation (pitch, yaw and roll, in degrees)
+ */
+struct CameraPathSample
+{
+    QVector3D position;
+    QVector3D rotation;
+};
+
+/**
+ * @brief A sequence of camera samples, one per frame
+ *
+ * The file format is plain text, with one sample per line: "x y z pitch yaw roll". Empty lines and lines starting with # are ignored.
+ */
+class CameraPath
+{
+public:
+    CameraPath();
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+
+    void clear() { samples.clear(); }
+    void append(const CameraPathSample &sample) { samples.push_back(sample); }
+
+    /**
+     * @brief Builds a path that turns the camera a full circle around the yaw axis at a fixed position
+     */
+    void createTurnaround(const QVector3D &position, const QVector3D &rotation, int frames);
+
+    int size() const { return samples.size(); }
+    bool isEmpty() const { return samples.empty(); }
+    const CameraPathSample& at(int index) const { return samples[index]; }
+
+private:
+    std::vector<CameraPathSample> samples;
+};
+
+#endif // CAMERAPATH_H
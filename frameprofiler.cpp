@@ -0,0 +1,234 @@
+#include "frameprofiler.h"
+
+#include <algorithm>
+
+#include <QDebug>
+
+FrameProfiler::FrameProfiler()
+{
+    enabled = true;
+    initialized = false;
+    recording = false;
+    currentFrame = 0;
+    frameNumber = -1;
+    depth = 0;
+    listener = nullptr;
+
+    for (int i = 0; i < FRAME_LATENCY; ++i) {
+        frames[i].scopes.reserve(MAX_SCOPES);
+        frames[i].pending = false;
+    }
+
+    // A frame never has more than MAX_SCOPES distinct scopes, so after this the steady state does not allocate
+    collectedSamples.reserve(MAX_SCOPES);
+    statistics.reserve(MAX_SCOPES);
+    histories.reserve(MAX_SCOPES);
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    destroy();
+}
+
+void FrameProfiler::initializeGL()
+{
+    if (initialized)
+        return;
+
+    if (!initializeOpenGLFunctions()) {
+        qWarning() << "Unable to initialize OpenGL 4.0 Core profile, GPU times will not be available" << endl;
+        return;
+    }
+
+    for (int i = 0; i < FRAME_LATENCY; ++i) {
+        frames[i].queries.resize(2 * MAX_SCOPES);
+        glGenQueries(2 * MAX_SCOPES, frames[i].queries.data());
+    }
+
+    clock.start();
+    initialized = true;
+}
+
+void FrameProfiler::destroy()
+{
+    if (!initialized)
+        return;
+
+    for (int i = 0; i < FRAME_LATENCY; ++i) {
+        glDeleteQueries(frames[i].queries.size(), frames[i].queries.data());
+        frames[i].queries.clear();
+        frames[i].scopes.clear();
+        frames[i].pending = false;
+    }
+
+    initialized = false;
+}
+
+void FrameProfiler::beginFrame()
+{
+    if (!enabled || !initialized)
+        return;
+
+    currentFrame = (currentFrame + 1) % FRAME_LATENCY;
+
+    FrameRecord &frame = frames[currentFrame];
+    if (frame.pending)
+        collect(frame);
+
+    frame.scopes.clear();
+    frame.number = ++frameNumber;
+    frame.pending = false;
+    depth = 0;
+    recording = true;
+}
+
+void FrameProfiler::endFrame()
+{
+    if (!recording)
+        return;
+
+    frames[currentFrame].pending = true;
+    recording = false;
+}
+
+void FrameProfiler::flush()
+{
+    if (!initialized)
+        return;
+
+    glFinish();
+
+    // The oldest frame is the one right after the current one in the ring
+    for (int i = 1; i <= FRAME_LATENCY; ++i) {
+        FrameRecord &frame = frames[(currentFrame + i) % FRAME_LATENCY];
+        if (frame.pending)
+            collect(frame);
+    }
+}
+
+int FrameProfiler::beginScope(const QString &name)
+{
+    if (!recording)
+        return -1;
+
+    FrameRecord &frame = frames[currentFrame];
+    if ((int)frame.scopes.size() >= MAX_SCOPES)
+        return -1;
+
+    int index = frame.scopes.size();
+
+    ScopeRecord record;
+    record.name = name;
+    record.depth = depth++;
+    record.cpuBegin = clock.nsecsElapsed();
+    record.cpuEnd = record.cpuBegin;
+    frame.scopes.push_back(record);
+
+    glQueryCounter(frame.queries[2 * index], GL_TIMESTAMP);
+
+    return index;
+}
+
+void FrameProfiler::endScope(int scope)
+{
+    if (!recording || scope < 0)
+        return;
+
+    FrameRecord &frame = frames[currentFrame];
+
+    glQueryCounter(frame.queries[2 * scope + 1], GL_TIMESTAMP);
+    frame.scopes[scope].cpuEnd = clock.nsecsElapsed();
+
+    --depth;
+}
+
+void FrameProfiler::collect(FrameRecord &frame)
+{
+    frame.pending = false;
+
+    if (frame.scopes.empty())
+        return;
+
+    // The last query issued is the end of the outermost scope; if it is not ready after FRAME_LATENCY frames, drop the frame instead of waiting
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    collectedSamples.resize(frame.scopes.size());
+
+    for (int i = 0; i < (int)frame.scopes.size(); ++i) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+
+        const ScopeRecord &scope = frame.scopes[i];
+        float cpu = (scope.cpuEnd - scope.cpuBegin) / 1e6f;
+        float gpu = (end - begin) / 1e6f;
+        addSample(scope, cpu, gpu);
+
+        ProfileSample &sample = collectedSamples[i];
+        sample.name = scope.name;
+        sample.depth = scope.depth;
+        sample.cpu = cpu;
+        sample.gpu = gpu;
+    }
+
+    if (listener)
+        listener->frameCollected(frame.number, collectedSamples);
+}
+
+void FrameProfiler::addSample(const ScopeRecord &scope, float cpu, float gpu)
+{
+    int index = 0;
+    for (; index < (int)statistics.size(); ++index) {
+        if (statistics[index].name == scope.name)
+            break;
+    }
+
+    if (index == (int)statistics.size()) {
+        ProfileStats stats;
+        stats.name = scope.name;
+        stats.depth = scope.depth;
+        statistics.push_back(stats);
+
+        ScopeHistory history;
+        history.next = 0;
+        history.count = 0;
+        histories.push_back(history);
+    }
+
+    ScopeHistory &history = histories[index];
+    history.cpu[history.next] = cpu;
+    history.gpu[history.next] = gpu;
+    history.next = (history.next + 1) % HISTORY_SIZE;
+    history.count = std::min(history.count + 1, (int)HISTORY_SIZE);
+
+    ProfileStats &stats = statistics[index];
+    stats.depth = scope.depth;
+    stats.samples = history.count;
+    stats.cpuLast = cpu;
+    stats.gpuLast = gpu;
+    stats.cpuAverage = stats.gpuAverage = 0.0f;
+    stats.cpuMax = stats.gpuMax = 0.0f;
+
+    for (int i = 0; i < history.count; ++i) {
+        stats.cpuAverage += history.cpu[i];
+        stats.gpuAverage += history.gpu[i];
+        stats.cpuMax = std::max(stats.cpuMax, history.cpu[i]);
+        stats.gpuMax = std::max(stats.gpuMax, history.gpu[i]);
+    }
+
+    stats.cpuAverage /= history.count;
+    stats.gpuAverage /= history.count;
+}
+
+const ProfileStats *FrameProfiler::findStatistics(const QString &name) const
+{
+    for (auto stats = statistics.begin(); stats != statistics.end(); ++stats) {
+        if (stats->name == name)
+            return &(*stats);
+    }
+
+    return nullptr;
+}
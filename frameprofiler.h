@@ -0,0 +1,194 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QOpenGLFunctions_4_0_Core>
+#include <QString>
+
+/**
+ * @brief Rolling statistics of a profiled scope, in milliseconds
+ */
+struct ProfileStats
+{
+    QString name;
+    int depth;
+    int samples;
+    float cpuLast, cpuAverage, cpuMax;
+    float gpuLast, gpuAverage, gpuMax;
+};
+
+/**
+ * @brief Times of a single scope of a single frame, in milliseconds
+ */
+struct ProfileSample
+{
+    QString name;
+    int depth;
+    float cpu;
+    float gpu;
+};
+
+/**
+ * @brief Receives the times of every frame once its GPU queries are read back
+ */
+class FrameProfilerListener
+{
+public:
+    virtual ~FrameProfilerListener() {}
+
+    /**
+     * @param frame The number of the frame, counting from the first beginFrame
+     * @param samples One sample per scope, in the order they were opened
+     */
+    virtual void frameCollected(qint64 frame, const std::vector<ProfileSample> &samples) = 0;
+};
+
+/**
+ * @brief Measures the CPU and GPU time of nested scopes of each frame
+ *
+ * The GPU time comes from a pair of GL timestamp queries per scope. Queries are kept in a ring of frames and only read
+ * FRAME_LATENCY frames later, so collecting them never waits for the GPU.
+ */
+class FrameProfiler : private QOpenGLFunctions_4_0_Core
+{
+public:
+    /// @brief Frames between issuing the queries of a frame and reading them back
+    static const int FRAME_LATENCY = 4;
+    /// @brief Maximum number of scopes recorded in a frame; further scopes are ignored
+    static const int MAX_SCOPES = 64;
+    /// @brief Number of frames used for the rolling statistics
+    static const int HISTORY_SIZE = 120;
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    /**
+     * @brief Creates the query objects
+     * @remarks Must be called with the GL context current
+     */
+    void initializeGL();
+
+    /**
+     * @brief Releases the query objects
+     */
+    void destroy();
+
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
+
+    /**
+     * @brief Starts recording a frame, collecting the results of the frame recorded FRAME_LATENCY frames ago
+     */
+    void beginFrame();
+
+    /**
+     * @brief Finishes recording the current frame
+     */
+    void endFrame();
+
+    /**
+     * @brief Waits for the GPU and collects every frame still pending, oldest first
+     * @remarks Use when the frame times must all be accounted for, such as at the end of a benchmark
+     */
+    void flush();
+
+    /**
+     * @brief Sets the listener notified as frames are collected
+     * @remarks The profiler does not take the ownership of the listener
+     */
+    void setListener(FrameProfilerListener *listener) { this->listener = listener; }
+
+    /**
+     * @brief Returns the number of the frame being recorded
+     */
+    qint64 getFrameNumber() const { return frameNumber; }
+
+    /**
+     * @brief Opens a scope; scopes must be closed in the reverse order they were opened
+     * @return The scope handle to be passed to endScope, or -1 if it is not being recorded
+     */
+    int beginScope(const QString &name);
+
+    void endScope(int scope);
+
+    /**
+     * @brief Returns the statistics of every scope seen, in the order they were first opened
+     */
+    const std::vector<ProfileStats>& getStatistics() const { return statistics; }
+
+    /**
+     * @brief Returns the statistics of a scope by name, or nullptr if it was never recorded
+     */
+    const ProfileStats *findStatistics(const QString &name) const;
+
+    /**
+     * @brief Opens a scope on construction and closes it on destruction
+     * @remarks Does nothing if the profiler is null
+     */
+    class Scope
+    {
+    public:
+        Scope(FrameProfiler *profiler, const QString &name)
+            : profiler(profiler), scope(profiler ? profiler->beginScope(name) : -1) {}
+        ~Scope() { if (profiler) profiler->endScope(scope); }
+
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+        FrameProfiler *profiler;
+        int scope;
+    };
+
+private:
+    struct ScopeRecord {
+        QString name;
+        int depth;
+        qint64 cpuBegin;
+        qint64 cpuEnd;
+    };
+
+    struct FrameRecord {
+        std::vector<ScopeRecord> scopes;
+        /// @brief Two timestamp queries per scope, begin and end
+        std::vector<GLuint> queries;
+        qint64 number;
+        bool pending;
+    };
+
+    struct ScopeHistory {
+        float cpu[HISTORY_SIZE];
+        float gpu[HISTORY_SIZE];
+        int next;
+        int count;
+    };
+
+    /**
+     * @brief Reads the queries of a recorded frame, if they are available, and adds them to the statistics
+     */
+    void collect(FrameRecord &frame);
+
+    void addSample(const ScopeRecord &scope, float cpu, float gpu);
+
+    bool enabled;
+    bool initialized;
+    bool recording;
+
+    QElapsedTimer clock;
+
+    FrameRecord frames[FRAME_LATENCY];
+    int currentFrame;
+    qint64 frameNumber;
+    int depth;
+
+    FrameProfilerListener *listener;
+    /// @brief Reused for every collected frame that is passed to the listener
+    std::vector<ProfileSample> collectedSamples;
+
+    std::vector<ProfileStats> statistics;
+    std::vector<ScopeHistory> histories;
+};
+
+#endif // FRAMEPROFILER_H
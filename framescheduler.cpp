@@ -0,0 +1,63 @@
+#include "framescheduler.h"
+
+FrameScheduler::FrameScheduler(QWidget *target, QObject *parent)
+    : QObject(parent), target(target)
+{
+    mode = OnDemand;
+    frameRateCap = 0;
+    minimumInterval = 0;
+    lastFrameStart = 0;
+    pending = false;
+
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(timeout()));
+
+    clock.start();
+}
+
+void FrameScheduler::setMode(Mode mode)
+{
+    this->mode = mode;
+
+    if (mode == Continuous)
+        requestFrame();
+}
+
+void FrameScheduler::setFrameRateCap(int framesPerSecond)
+{
+    frameRateCap = qMax(0, framesPerSecond);
+    minimumInterval = frameRateCap > 0 ? 1000000000LL / frameRateCap : 0;
+}
+
+void FrameScheduler::requestFrame()
+{
+    if (pending)
+        return;
+
+    pending = true;
+
+    qint64 wait = minimumInterval - (clock.nsecsElapsed() - lastFrameStart);
+    if (wait <= 0) {
+        target->update();
+        return;
+    }
+
+    // Round up, so the frame never starts before the cap allows
+    timer.start((int)((wait + 999999) / 1000000));
+}
+
+void FrameScheduler::frameStarted()
+{
+    timer.stop();
+    pending = false;
+    lastFrameStart = clock.nsecsElapsed();
+
+    if (mode == Continuous)
+        requestFrame();
+}
+
+void FrameScheduler::timeout()
+{
+    target->update();
+}
@@ -0,0 +1,70 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QWidget>
+
+/**
+ * @brief Decides when a widget repaints
+ *
+ * In the on demand mode a frame is only scheduled when something asks for it, so an idle view costs nothing.
+ * In the continuous mode a new frame is scheduled as soon as one starts, which is what profiling wants.
+ * Either way, frames can be capped to a maximum rate; pacing to the display refresh comes from the swap interval of the surface format.
+ */
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        OnDemand,
+        Continuous
+    };
+
+    /**
+     * @remarks The scheduler does not take the ownership of the target
+     */
+    FrameScheduler(QWidget *target, QObject *parent = 0);
+
+    void setMode(Mode mode);
+    Mode getMode() const { return mode; }
+
+    /**
+     * @brief Sets the maximum number of frames per second, or 0 for no limit
+     */
+    void setFrameRateCap(int framesPerSecond);
+    int getFrameRateCap() const { return frameRateCap; }
+
+    /**
+     * @brief Schedules a repaint of the target, respecting the frame rate cap
+     * @remarks Requests made before the scheduled frame starts are merged into it
+     */
+    void requestFrame();
+
+    /**
+     * @brief Must be called when the target starts painting, whether the frame was requested or not
+     */
+    void frameStarted();
+
+private slots:
+    void timeout();
+
+private:
+    QWidget *target;
+
+    Mode mode;
+    int frameRateCap;
+    /// @brief Minimum time between the start of two frames, from the cap
+    qint64 minimumInterval;
+
+    QTimer timer;
+    QElapsedTimer clock;
+    qint64 lastFrameStart;
+
+    /// @brief Whether a frame was requested and has not started yet
+    bool pending;
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,96 @@
+#ifndef FRAMESTATSPROTOCOL_H
+#define FRAMESTATSPROTOCOL_H
+
+#include <atomic>
+#include <cstddef>
+
+#include <QtGlobal>
+
+/*
+ * Layout of the shared memory segment where the viewer publishes the statistics of every frame.
+ *
+ * The segment is a FrameStatsHeader (128 bytes) followed by ''capacity'' FrameStatsSlot (320 bytes each), used as a ring:
+ * record N (counting from 0) goes to slot N % capacity. There is a single writer, the viewer, which never waits for the readers,
+ * and any number of readers. Readers must not take the QSharedMemory lock, since the writer does not use it.
+ *
+ * Writing record N:
+ *   1. slot.sequence = 2N + 1 (odd: the slot is being written)
+ *   2. the record is written
+ *   3. slot.sequence = 2N + 2 (release)
+ *   4. header.published = N + 1 (release)
+ *
+ * Reading record N, for N < published:
+ *   1. if N + capacity <= published the record was already overwritten
+ *   2. s1 = slot.sequence (acquire); the record is not available if s1 != 2N + 2
+ *   3. copy the record, then an acquire fence
+ *   4. s2 = slot.sequence; the copy is valid only if s2 == s1, otherwise the writer overwrote it meanwhile
+ *
+ * The 64-bit counters are plain little-endian integers accessed atomically, so readers written in other languages
+ * only need 8-byte atomic loads. All other values use the host byte order, since both ends run on the same machine.
+ * Times are in milliseconds.
+ */
+
+#define FRAMESTATS_MAGIC (('S'<<24)+('T'<<16)+('S'<<8)+'B')
+
+#define FRAMESTATS_VERSION 1
+
+#define FRAMESTATS_DEFAULT_KEY "bspwalker-stats"
+
+// Must be a power of two; at 60 frames per second the ring holds about 4 seconds
+#define FRAMESTATS_CAPACITY 256
+
+// Post-process effects reported per frame; further effects are dropped
+#define FRAMESTATS_MAX_EFFECTS 8
+
+// Including the terminator; longer effect names are truncated
+#define FRAMESTATS_MAX_NAME 24
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The frame statistics segment requires lock free 64-bit atomics");
+
+typedef struct {
+    char        name[FRAMESTATS_MAX_NAME];
+    float       cpuTime;
+    float       gpuTime;
+} FrameStatsEffect;
+
+typedef struct {
+    quint64     frame;              // number of the frame since the viewer started
+    qint64      timestamp;          // milliseconds since the epoch when the times were read back
+    float       cpuTime;            // whole frame
+    float       gpuTime;
+    qint32      visibleClusters;
+    qint32      visibleLeafs;
+    qint32      visibleSurfaces;
+    qint32      drawCalls;
+    qint32      textureBinds;
+    qint32      triangles;
+    quint32     effectCount;
+    quint32     reserved;
+    FrameStatsEffect effects[FRAMESTATS_MAX_EFFECTS];   // in the order they are applied
+} FrameStatsRecord;
+
+typedef struct {
+    std::atomic<quint64> sequence;
+    FrameStatsRecord record;
+} FrameStatsSlot;
+
+typedef struct {
+    quint32     magic;
+    quint32     version;
+    quint32     headerSize;         // offset of the first slot
+    quint32     slotSize;
+    quint32     capacity;
+    quint32     maxEffects;
+    qint64      publisherPid;
+    char        reserved0[32];
+    std::atomic<quint64> published; // records written so far; on its own cache line, apart from the read-only fields
+    char        reserved1[56];
+} FrameStatsHeader;
+
+static_assert(sizeof (FrameStatsRecord) == 312, "FrameStatsRecord does not match the documented layout");
+static_assert(sizeof (FrameStatsSlot) == 320, "FrameStatsSlot does not match the documented layout");
+static_assert(sizeof (FrameStatsHeader) == 128 && offsetof(FrameStatsHeader, published) == 64, "FrameStatsHeader does not match the documented layout");
+
+#define FRAMESTATS_SEGMENT_SIZE (sizeof (FrameStatsHeader) + FRAMESTATS_CAPACITY * sizeof (FrameStatsSlot))
+
+#endif // FRAMESTATSPROTOCOL_H
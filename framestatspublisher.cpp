@@ -0,0 +1,135 @@
+#include "framestatspublisher.h"
+
+#include <cstring>
+#include <new>
+
+#include <QCoreApplication>
+#include <QDateTime>
+
+/**
+ * @brief Copies an effect name, replacing anything outside ASCII, without going through a temporary QByteArray
+ */
+static void copyName(const QString &name, char *destination)
+{
+    int length = qMin(name.size(), FRAMESTATS_MAX_NAME - 1);
+    for (int i = 0; i < length; ++i) {
+        ushort c = name.at(i).unicode();
+        destination[i] = c < 128 ? (char)c : '?';
+    }
+    destination[length] = '\0';
+}
+
+FrameStatsPublisher::FrameStatsPublisher()
+{
+    header = nullptr;
+    ring = nullptr;
+    published = 0;
+
+    for (int i = 0; i < RENDERED_FRAMES; ++i)
+        renderedFrames[i].frame = -1;
+}
+
+FrameStatsPublisher::~FrameStatsPublisher()
+{
+    if (memory.isAttached())
+        memory.detach();
+}
+
+bool FrameStatsPublisher::create(const QString &key)
+{
+    memory.setKey(key);
+
+    // On Unix a segment outlives a crashed process; detaching the last attachment removes it
+    if (memory.attach())
+        memory.detach();
+
+    if (!memory.create(FRAMESTATS_SEGMENT_SIZE))
+        return false;
+
+    char *data = static_cast<char*>(memory.data());
+    memset(data, 0, FRAMESTATS_SEGMENT_SIZE);
+
+    header = reinterpret_cast<FrameStatsHeader*>(data);
+    ring = reinterpret_cast<FrameStatsSlot*>(data + sizeof (FrameStatsHeader));
+
+    new (&header->published) std::atomic<quint64>(0);
+    for (int i = 0; i < FRAMESTATS_CAPACITY; ++i)
+        new (&ring[i].sequence) std::atomic<quint64>(0);
+
+    header->version = FRAMESTATS_VERSION;
+    header->headerSize = sizeof (FrameStatsHeader);
+    header->slotSize = sizeof (FrameStatsSlot);
+    header->capacity = FRAMESTATS_CAPACITY;
+    header->maxEffects = FRAMESTATS_MAX_EFFECTS;
+    header->publisherPid = QCoreApplication::applicationPid();
+
+    // The magic goes last, so a reader never accepts a half initialized header
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = FRAMESTATS_MAGIC;
+
+    published = 0;
+    return true;
+}
+
+void FrameStatsPublisher::frameRendered(qint64 frame, const BSPRenderStats &stats)
+{
+    if (frame < 0)
+        return;
+
+    RenderedFrame &rendered = renderedFrames[frame % RENDERED_FRAMES];
+    rendered.frame = frame;
+    rendered.stats = stats;
+}
+
+void FrameStatsPublisher::frameCollected(qint64 frame, const std::vector<ProfileSample> &samples)
+{
+    if (!header || samples.empty())
+        return;
+
+    FrameStatsSlot &slot = ring[published % FRAMESTATS_CAPACITY];
+    slot.sequence.store(2 * published + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    FrameStatsRecord &record = slot.record;
+    record.frame = frame;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    // The first scope is always "Frame", which encloses everything else
+    record.cpuTime = samples[0].cpu;
+    record.gpuTime = samples[0].gpu;
+
+    const RenderedFrame &rendered = renderedFrames[frame % RENDERED_FRAMES];
+    BSPRenderStats stats = rendered.frame == frame ? rendered.stats : BSPRenderStats();
+    record.visibleClusters = stats.visibleClusters;
+    record.visibleLeafs = stats.visibleLeafs;
+    record.visibleSurfaces = stats.visibleSurfaces;
+    record.drawCalls = stats.drawCalls;
+    record.textureBinds = stats.textureBinds;
+    record.triangles = stats.triangles;
+
+    // The effects are the direct children of the "Post-process" scope
+    record.effectCount = 0;
+    int chainDepth = -1;
+    for (auto sample = samples.begin(); sample != samples.end(); ++sample) {
+        if (chainDepth < 0) {
+            if (sample->name == QLatin1String("Post-process"))
+                chainDepth = sample->depth;
+            continue;
+        }
+
+        if (sample->depth <= chainDepth)
+            break;
+
+        if (sample->depth != chainDepth + 1 || record.effectCount == FRAMESTATS_MAX_EFFECTS)
+            continue;
+
+        FrameStatsEffect &effect = record.effects[record.effectCount++];
+        copyName(sample->name, effect.name);
+        effect.cpuTime = sample->cpu;
+        effect.gpuTime = sample->gpu;
+    }
+
+    ++published;
+    slot.sequence.store(2 * published, std::memory_order_release);
+    header->published.store(published, std::memory_order_release);
+}
@@ -0,0 +1,65 @@
+#ifndef FRAMESTATSPUBLISHER_H
+#define FRAMESTATSPUBLISHER_H
+
+#include "bsp.h"
+#include "frameprofiler.h"
+#include "framestatsprotocol.h"
+
+#include <QSharedMemory>
+#include <QString>
+
+/**
+ * @brief Publishes the statistics of every frame to a shared memory ring, for monitoring from other processes
+ *
+ * The layout is described in framestatsprotocol.h. Publishing never waits for the readers. The times of a frame are only known once
+ * the profiler reads its queries back, so each record is written FrameProfiler::FRAME_LATENCY frames after the frame was drawn,
+ * together with the counters saved for it by frameRendered.
+ */
+class FrameStatsPublisher : public FrameProfilerListener
+{
+public:
+    FrameStatsPublisher();
+    ~FrameStatsPublisher();
+
+    /**
+     * @brief Creates the shared memory segment, replacing a stale one left by a crashed viewer
+     * @return false if the segment cannot be created; the publisher stays inactive in that case
+     */
+    bool create(const QString &key);
+
+    bool isActive() const { return header != nullptr; }
+
+    QString errorString() const { return memory.errorString(); }
+
+    /**
+     * @brief Saves the counters of a frame until its times are collected
+     * @param frame The profiler frame number
+     */
+    void frameRendered(qint64 frame, const BSPRenderStats &stats);
+
+    virtual void frameCollected(qint64 frame, const std::vector<ProfileSample> &samples);
+
+private:
+    FrameStatsPublisher(const FrameStatsPublisher&);
+    FrameStatsPublisher& operator=(const FrameStatsPublisher&);
+
+    struct RenderedFrame {
+        qint64 frame;
+        BSPRenderStats stats;
+    };
+
+    /// @brief Enough frames to cover the ones whose queries are in flight
+    static const int RENDERED_FRAMES = 2 * FrameProfiler::FRAME_LATENCY;
+
+    QSharedMemory memory;
+
+    FrameStatsHeader *header;
+    FrameStatsSlot *ring;
+
+    /// @brief Records published so far; only this thread writes the counter in the header
+    quint64 published;
+
+    RenderedFrame renderedFrames[RENDERED_FRAMES];
+};
+
+#endif // FRAMESTATSPUBLISHER_H
@@ -0,0 +1,336 @@
+#include "heatmapanalyzer.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <QDebug>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QTextStream>
+
+// Attempts at finding a point of a cluster before giving up on a sample
+static const int POSITION_ATTEMPTS = 16;
+
+// Longest side of the heatmap image, in pixels
+static const int IMAGE_SIZE = 1024;
+
+HeatmapAnalyzer::HeatmapAnalyzer(const HeatmapOptions &options)
+    : options(options), random(options.seed)
+{
+    firstFrame = 0;
+}
+
+int HeatmapAnalyzer::run()
+{
+    if (!renderer.create(options.size) || !renderer.loadMap(options.mapFile))
+        return 1;
+
+    createViewpoints();
+    if (viewpoints.empty()) {
+        qWarning() << "No viewpoint could be placed inside a cluster" << endl;
+        return 1;
+    }
+
+    std::cout << "Rendering " << viewpoints.size() << " viewpoints" << std::endl;
+
+    FrameProfiler &profiler = renderer.getProfiler();
+    profiler.setListener(this);
+
+    // Warm up with the first viewpoint, so shader compilation and uploads are not charged to it
+    for (int i = 0; i < 2 * FrameProfiler::FRAME_LATENCY; ++i)
+        renderer.renderFrame(viewpoints[0].position, viewpoints[0].rotation);
+
+    firstFrame = profiler.getFrameNumber() + 1;
+
+    for (auto viewpoint = viewpoints.begin(); viewpoint != viewpoints.end(); ++viewpoint) {
+        renderer.renderFrame(viewpoint->position, viewpoint->rotation);
+        viewpoint->stats = renderer.getRenderStats();
+    }
+
+    profiler.flush();
+    profiler.setListener(nullptr);
+
+    aggregate();
+
+    bool written = writeClusters(options.outputPrefix + "-clusters.csv")
+            && writeWorst(options.outputPrefix + "-worst.csv")
+            && writeImage(options.outputPrefix + "-heatmap.png");
+
+    if (!written) {
+        qWarning() << "Unable to write the results to" << options.outputPrefix << endl;
+        return 1;
+    }
+
+    std::cout << "Worst viewpoints:" << std::endl;
+    for (int i = 0; i < std::min((int)ranking.size(), 5); ++i) {
+        const Viewpoint &viewpoint = viewpoints[ranking[i]];
+        std::cout << "  cluster " << viewpoint.cluster << " at (" << viewpoint.position.x() << ", " << viewpoint.position.y() << ", " << viewpoint.position.z()
+                  << ") yaw " << viewpoint.rotation.y() << ": " << getCost(viewpoint) << " ms, " << viewpoint.stats.visibleSurfaces << " surfaces" << std::endl;
+    }
+
+    return 0;
+}
+
+void HeatmapAnalyzer::createViewpoints()
+{
+    const BSPWorld *world = renderer.getWorld();
+    const std::vector<dleaf_t> &leafs = world->getLeafs();
+
+    int clusterCount = world->getVisibility().getClusterCount();
+    for (auto leaf = leafs.begin(); leaf != leafs.end(); ++leaf)
+        clusterCount = std::max(clusterCount, leaf->cluster + 1);
+
+    std::vector<std::vector<int> > leafsByCluster(clusterCount);
+    for (int i = 0; i < (int)leafs.size(); ++i) {
+        if (leafs[i].cluster >= 0)
+            leafsByCluster[leafs[i].cluster].push_back(i);
+    }
+
+    std::uniform_real_distribution<float> jitter(0.0f, 360.0f / std::max(1, options.directions));
+    std::uniform_real_distribution<float> pitch(-15.0f, 15.0f);
+
+    viewpoints.clear();
+
+    for (int cluster = 0; cluster < clusterCount; ++cluster) {
+        if (leafsByCluster[cluster].empty())
+            continue;
+
+        for (int i = 0; i < options.positionsPerCluster; ++i) {
+            QVector3D position;
+            if (!findPosition(cluster, leafsByCluster[cluster], position))
+                break;
+
+            float yaw = jitter(random);
+            for (int direction = 0; direction < options.directions; ++direction) {
+                Viewpoint viewpoint;
+                viewpoint.cluster = cluster;
+                viewpoint.position = position;
+                viewpoint.rotation = QVector3D(pitch(random), yaw + 360.0f * direction / options.directions, 0.0f);
+                viewpoint.stats = BSPRenderStats();
+                viewpoint.cpu = viewpoint.gpu = 0.0f;
+                viewpoint.collected = false;
+                viewpoints.push_back(viewpoint);
+            }
+        }
+    }
+}
+
+bool HeatmapAnalyzer::findPosition(int cluster, const std::vector<int> &leafs, QVector3D &position)
+{
+    const BSPWorld *world = renderer.getWorld();
+    const std::vector<dleaf_t> &allLeafs = world->getLeafs();
+
+    std::uniform_int_distribution<int> leafDistribution(0, leafs.size() - 1);
+    std::uniform_real_distribution<float> unit(0.1f, 0.9f);
+
+    for (int attempt = 0; attempt < POSITION_ATTEMPTS; ++attempt) {
+        const dleaf_t &leaf = allLeafs[leafs[leafDistribution(random)]];
+
+        // Stay away from the bounds, where the point is most likely to be in a wall
+        position = QVector3D(leaf.mins[0] + (leaf.maxs[0] - leaf.mins[0]) * unit(random),
+                             leaf.mins[1] + (leaf.maxs[1] - leaf.mins[1]) * unit(random),
+                             leaf.mins[2] + (leaf.maxs[2] - leaf.mins[2]) * unit(random));
+
+        if (allLeafs[world->findNodeForPosition(position)].cluster == cluster)
+            return true;
+    }
+
+    return false;
+}
+
+void HeatmapAnalyzer::frameCollected(qint64 frame, const std::vector<ProfileSample> &samples)
+{
+    qint64 index = frame - firstFrame;
+    if (index < 0 || index >= (qint64)viewpoints.size() || samples.empty())
+        return;
+
+    // The first scope is always "Frame", which encloses everything else
+    Viewpoint &viewpoint = viewpoints[index];
+    viewpoint.cpu = samples[0].cpu;
+    viewpoint.gpu = samples[0].gpu;
+    viewpoint.collected = true;
+}
+
+float HeatmapAnalyzer::getCost(const Viewpoint &viewpoint)
+{
+    return viewpoint.gpu > 0.0f ? viewpoint.gpu : viewpoint.cpu;
+}
+
+void HeatmapAnalyzer::aggregate()
+{
+    const std::vector<dleaf_t> &leafs = renderer.getWorld()->getLeafs();
+
+    int clusterCount = 0;
+    for (auto viewpoint = viewpoints.begin(); viewpoint != viewpoints.end(); ++viewpoint)
+        clusterCount = std::max(clusterCount, viewpoint->cluster + 1);
+
+    std::vector<int> clusterIndex(clusterCount, -1);
+    clusters.clear();
+
+    for (int i = 0; i < (int)viewpoints.size(); ++i) {
+        const Viewpoint &viewpoint = viewpoints[i];
+        if (!viewpoint.collected)
+            continue;
+
+        int &index = clusterIndex[viewpoint.cluster];
+        if (index < 0) {
+            index = clusters.size();
+
+            ClusterCost cost;
+            cost.cluster = viewpoint.cluster;
+            cost.samples = 0;
+            cost.averageCost = cost.maxCost = 0.0f;
+            cost.averageSurfaces = 0.0f;
+            cost.maxSurfaces = cost.maxDrawCalls = cost.maxVisibleLeafs = 0;
+            cost.worst = i;
+            clusters.push_back(cost);
+        }
+
+        ClusterCost &cost = clusters[index];
+        float value = getCost(viewpoint);
+
+        cost.samples++;
+        cost.averageCost += value;
+        cost.averageSurfaces += viewpoint.stats.visibleSurfaces;
+        cost.maxSurfaces = std::max(cost.maxSurfaces, viewpoint.stats.visibleSurfaces);
+        cost.maxDrawCalls = std::max(cost.maxDrawCalls, viewpoint.stats.drawCalls);
+        cost.maxVisibleLeafs = std::max(cost.maxVisibleLeafs, viewpoint.stats.visibleLeafs);
+
+        if (value >= cost.maxCost) {
+            cost.maxCost = value;
+            cost.worst = i;
+        }
+    }
+
+    for (auto cost = clusters.begin(); cost != clusters.end(); ++cost) {
+        cost->averageCost /= cost->samples;
+        cost->averageSurfaces /= cost->samples;
+    }
+
+    // Bounds of each cluster, to place it on the map
+    for (auto cost = clusters.begin(); cost != clusters.end(); ++cost) {
+        bool first = true;
+        for (auto leaf = leafs.begin(); leaf != leafs.end(); ++leaf) {
+            if (leaf->cluster != cost->cluster)
+                continue;
+
+            QVector3D mins(leaf->mins[0], leaf->mins[1], leaf->mins[2]);
+            QVector3D maxs(leaf->maxs[0], leaf->maxs[1], leaf->maxs[2]);
+            if (first) {
+                cost->mins = mins;
+                cost->maxs = maxs;
+                first = false;
+            }
+            else {
+                cost->mins = QVector3D(std::min(cost->mins.x(), mins.x()), std::min(cost->mins.y(), mins.y()), std::min(cost->mins.z(), mins.z()));
+                cost->maxs = QVector3D(std::max(cost->maxs.x(), maxs.x()), std::max(cost->maxs.y(), maxs.y()), std::max(cost->maxs.z(), maxs.z()));
+            }
+        }
+    }
+
+    std::sort(clusters.begin(), clusters.end(), [](const ClusterCost &a, const ClusterCost &b) {
+        return a.maxCost > b.maxCost;
+    });
+
+    ranking.clear();
+    for (int i = 0; i < (int)viewpoints.size(); ++i) {
+        if (viewpoints[i].collected)
+            ranking.push_back(i);
+    }
+
+    std::sort(ranking.begin(), ranking.end(), [this](int a, int b) {
+        return getCost(viewpoints[a]) > getCost(viewpoints[b]);
+    });
+}
+
+bool HeatmapAnalyzer::writeClusters(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "cluster,samples,avg_ms,max_ms,avg_surfaces,max_surfaces,max_draw_calls,max_visible_leafs,"
+              "mins_x,mins_y,mins_z,maxs_x,maxs_y,maxs_z\n";
+
+    for (auto cost = clusters.begin(); cost != clusters.end(); ++cost) {
+        stream << cost->cluster << ',' << cost->samples << ',' << cost->averageCost << ',' << cost->maxCost << ','
+               << cost->averageSurfaces << ',' << cost->maxSurfaces << ',' << cost->maxDrawCalls << ',' << cost->maxVisibleLeafs << ','
+               << cost->mins.x() << ',' << cost->mins.y() << ',' << cost->mins.z() << ','
+               << cost->maxs.x() << ',' << cost->maxs.y() << ',' << cost->maxs.z() << '\n';
+    }
+
+    return stream.status() == QTextStream::Ok;
+}
+
+bool HeatmapAnalyzer::writeWorst(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    // Position and rotation are in the same units as camera paths, so a viewpoint can be replayed with the benchmark mode
+    stream << "rank,cluster,cpu_ms,gpu_ms,visible_surfaces,draw_calls,visible_leafs,x,y,z,pitch,yaw,roll\n";
+
+    int count = std::min((int)ranking.size(), options.worstCount);
+    for (int i = 0; i < count; ++i) {
+        const Viewpoint &viewpoint = viewpoints[ranking[i]];
+        stream << i + 1 << ',' << viewpoint.cluster << ',' << viewpoint.cpu << ',' << viewpoint.gpu << ','
+               << viewpoint.stats.visibleSurfaces << ',' << viewpoint.stats.drawCalls << ',' << viewpoint.stats.visibleLeafs << ','
+               << viewpoint.position.x() << ',' << viewpoint.position.y() << ',' << viewpoint.position.z() << ','
+               << viewpoint.rotation.x() << ',' << viewpoint.rotation.y() << ',' << viewpoint.rotation.z() << '\n';
+    }
+
+    return stream.status() == QTextStream::Ok;
+}
+
+bool HeatmapAnalyzer::writeImage(const QString &fileName) const
+{
+    const dmodel_t &model = renderer.getWorld()->getModels()[0];
+
+    float width = model.maxs[0] - model.mins[0];
+    float height = model.maxs[1] - model.mins[1];
+    if (width <= 0.0f || height <= 0.0f || clusters.empty())
+        return false;
+
+    float scale = IMAGE_SIZE / std::max(width, height);
+    QImage image(std::max(1, (int)(width * scale)), std::max(1, (int)(height * scale)), QImage::Format_RGB32);
+    image.fill(Qt::black);
+
+    float maxCost = clusters.front().maxCost;
+
+    // Top-down view; the image Y axis points down, the map Y axis up
+    auto toImage = [&](float x, float y) {
+        return QPointF((x - model.mins[0]) * scale, (model.maxs[1] - y) * scale);
+    };
+
+    QPainter painter(&image);
+
+    // Cheapest first, so the expensive clusters stay visible where clusters overlap in the view
+    for (auto cost = clusters.rbegin(); cost != clusters.rend(); ++cost) {
+        float t = maxCost > 0.0f ? cost->maxCost / maxCost : 0.0f;
+        QColor color = QColor::fromHsvF((1.0f - t) * 0.66f, 1.0f, 0.4f + 0.6f * t);
+
+        QRectF rect(toImage(cost->mins.x(), cost->maxs.y()), toImage(cost->maxs.x(), cost->mins.y()));
+        painter.fillRect(rect, color);
+    }
+
+    // Mark the worst viewpoints with their rank
+    painter.setPen(Qt::white);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    int count = std::min((int)ranking.size(), 10);
+    for (int i = 0; i < count; ++i) {
+        const Viewpoint &viewpoint = viewpoints[ranking[i]];
+        QPointF point = toImage(viewpoint.position.x(), viewpoint.position.y());
+
+        painter.drawEllipse(point, 4.0, 4.0);
+        painter.drawText(point + QPointF(6.0, -6.0), QString::number(i + 1));
+    }
+
+    painter.end();
+
+    return image.save(fileName);
+}
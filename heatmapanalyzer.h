@@ -0,0 +1,108 @@
+#ifndef HEATMAPANALYZER_H
+#define HEATMAPANALYZER_H
+
+#include "frameprofiler.h"
+#include "offscreenrenderer.h"
+
+#include <random>
+#include <vector>
+
+#include <QSize>
+#include <QString>
+#include <QVector3D>
+
+/**
+ * @brief Settings of a render-cost analysis run
+ */
+struct HeatmapOptions
+{
+    QString mapFile;
+    /// @brief Prefix of the output files: <prefix>-clusters.csv, <prefix>-worst.csv and <prefix>-heatmap.png
+    QString outputPrefix;
+    QSize size;
+    /// @brief Camera positions sampled in each cluster
+    int positionsPerCluster;
+    /// @brief Directions rendered from each position, evenly spread around the yaw axis
+    int directions;
+    /// @brief Length of the ranked list of worst viewpoints
+    int worstCount;
+    unsigned seed;
+};
+
+/**
+ * @brief Samples viewpoints in every cluster of a map and reports which ones are the most expensive to render
+ *
+ * Positions are picked at random inside the bounds of the cluster's leafs, and kept only if the BSP tree places them back in the
+ * same cluster, so they are never inside solid space.
+ */
+class HeatmapAnalyzer : private FrameProfilerListener
+{
+public:
+    HeatmapAnalyzer(const HeatmapOptions &options);
+
+    /**
+     * @brief Runs the analysis and writes the results
+     * @return The process exit code; 0 on success
+     */
+    int run();
+
+private:
+    struct Viewpoint {
+        int cluster;
+        QVector3D position;
+        QVector3D rotation;
+        BSPRenderStats stats;
+        float cpu;
+        float gpu;
+        bool collected;
+    };
+
+    struct ClusterCost {
+        int cluster;
+        int samples;
+        QVector3D mins, maxs;
+        float averageCost, maxCost;
+        float averageSurfaces;
+        int maxSurfaces;
+        int maxDrawCalls;
+        int maxVisibleLeafs;
+        /// @brief Index of the most expensive viewpoint
+        int worst;
+    };
+
+    /**
+     * @brief Picks the camera positions of every cluster
+     */
+    void createViewpoints();
+
+    /**
+     * @brief Returns a random point of a cluster, or false if none of the attempts landed in it
+     */
+    bool findPosition(int cluster, const std::vector<int> &leafs, QVector3D &position);
+
+    void aggregate();
+
+    /**
+     * @brief Returns the cost used for ranking: the GPU time when available, otherwise the CPU time
+     */
+    static float getCost(const Viewpoint &viewpoint);
+
+    virtual void frameCollected(qint64 frame, const std::vector<ProfileSample> &samples);
+
+    bool writeClusters(const QString &fileName) const;
+    bool writeWorst(const QString &fileName) const;
+    bool writeImage(const QString &fileName) const;
+
+    HeatmapOptions options;
+    OffscreenRenderer renderer;
+    std::mt19937 random;
+
+    std::vector<Viewpoint> viewpoints;
+    std::vector<ClusterCost> clusters;
+    /// @brief Viewpoint indices, from the most to the least expensive
+    std::vector<int> ranking;
+
+    qint64 firstFrame;
+};
+
+#endif // HEATMAPANALYZER_H
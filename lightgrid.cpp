@@ -0,0 +1,298 @@
+#include "lightgrid.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Sine and cosine of the 256 angles that can be stored in a light grid cell
+ */
+struct AngleTables
+{
+    AngleTables() {
+        for (int i = 0; i < 256; ++i) {
+            float angle = i * (2.0f * 3.14159265358979f / 256.0f);
+            sine[i] = sinf(angle);
+            cosine[i] = cosf(angle);
+        }
+    }
+
+    float sine[256];
+    float cosine[256];
+};
+
+const AngleTables& angleTables()
+{
+    static const AngleTables tables;
+    return tables;
+}
+
+}
+
+BSPLightGrid::BSPLightGrid()
+{
+    bounds[0] = bounds[1] = bounds[2] = 0;
+    steps[0] = steps[1] = steps[2] = 0;
+}
+
+bool BSPLightGrid::create(const dmodel_t &worldModel, const QVector3D &gridSize, std::vector<dlightgrid_t> &cells)
+{
+    clear();
+
+    if (cells.empty() || gridSize.x() <= 0 || gridSize.y() <= 0 || gridSize.z() <= 0)
+        return false;
+
+    // The grid starts at the first grid point inside the world bounds, as q3map does
+    int numPoints = 1;
+    for (int i = 0; i < 3; ++i) {
+        origin[i] = gridSize[i] * ceilf(worldModel.mins[i] / gridSize[i]);
+        float maxs = gridSize[i] * floorf(worldModel.maxs[i] / gridSize[i]);
+        bounds[i] = (int)((maxs - origin[i]) / gridSize[i]) + 1;
+
+        if (bounds[i] < 1)
+            return false;
+
+        numPoints *= bounds[i];
+    }
+
+    if ((int)cells.size() != numPoints) {
+        bounds[0] = bounds[1] = bounds[2] = 0;
+        return false;
+    }
+
+    this->gridSize = gridSize;
+    inverseGridSize = QVector3D(1.0f / gridSize.x(), 1.0f / gridSize.y(), 1.0f / gridSize.z());
+
+    steps[0] = 1;
+    steps[1] = bounds[0];
+    steps[2] = bounds[0] * bounds[1];
+
+    this->cells.swap(cells);
+
+    return true;
+}
+
+void BSPLightGrid::clear()
+{
+    cells.clear();
+    bounds[0] = bounds[1] = bounds[2] = 0;
+    steps[0] = steps[1] = steps[2] = 0;
+}
+
+LightGridSample BSPLightGrid::sample(const QVector3D &position) const
+{
+    LightGridSample result;
+    sample(&position, &result, 1);
+    return result;
+}
+
+#ifdef __SSE2__
+
+/**
+ * @brief Widens the first three bytes at ''data'' to floats; the fourth lane holds garbage
+ */
+static inline __m128 unpackColor(const unsigned char *data)
+{
+    int bits;
+    memcpy(&bits, data, sizeof (bits));
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i value = _mm_cvtsi32_si128(bits);
+    value = _mm_unpacklo_epi8(value, zero);
+    value = _mm_unpacklo_epi16(value, zero);
+
+    return _mm_cvtepi32_ps(value);
+}
+
+void BSPLightGrid::sample(const QVector3D *positions, LightGridSample *samples, int count) const
+{
+    if (cells.empty()) {
+        for (int i = 0; i < count; ++i)
+            samples[i] = LightGridSample();
+        return;
+    }
+
+    const AngleTables &tables = angleTables();
+
+    const __m128 origin4 = _mm_set_ps(0.0f, origin.z(), origin.y(), origin.x());
+    const __m128 inverse4 = _mm_set_ps(0.0f, inverseGridSize.z(), inverseGridSize.y(), inverseGridSize.x());
+    const __m128 maxCell4 = _mm_set_ps(0.0f, bounds[2] - 1, bounds[1] - 1, bounds[0] - 1);
+    const __m128 zero4 = _mm_setzero_ps();
+
+    for (int i = 0; i < count; ++i) {
+        const QVector3D &position = positions[i];
+
+        __m128 v = _mm_mul_ps(_mm_sub_ps(_mm_set_ps(0.0f, position.z(), position.y(), position.x()), origin4), inverse4);
+
+        // Clamping before splitting off the fraction keeps positions outside the grid on its border cells.
+        // v is then positive, so truncating floors it
+        v = _mm_min_ps(_mm_max_ps(v, zero4), maxCell4);
+        __m128 cell = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        __m128 frac4 = _mm_sub_ps(v, cell);
+
+        int pos[4];
+        float frac[4];
+        _mm_storeu_si128((__m128i*)pos, _mm_cvttps_epi32(cell));
+        _mm_storeu_ps(frac, frac4);
+
+        int base = pos[0] * steps[0] + pos[1] * steps[1] + pos[2] * steps[2];
+
+        __m128 ambient = zero4;
+        __m128 directed = zero4;
+        __m128 direction = zero4;
+        float totalFactor = 0.0f;
+
+        // Trilinear interpolation of the eight surrounding cells
+        for (int corner = 0; corner < 8; ++corner) {
+            float factor = 1.0f;
+            int offset = base;
+            int j;
+
+            for (j = 0; j < 3; ++j) {
+                if (corner & (1 << j)) {
+                    // Ignore cells outside the grid
+                    if (pos[j] + 1 > bounds[j] - 1)
+                        break;
+                    factor *= frac[j];
+                    offset += steps[j];
+                }
+                else {
+                    factor *= 1.0f - frac[j];
+                }
+            }
+
+            if (j != 3)
+                continue;
+
+            const dlightgrid_t &data = cells[offset];
+
+            // Cells inside walls are black, so they must not darken the result
+            if (!(data.ambient[0] + data.ambient[1] + data.ambient[2]))
+                continue;
+
+            totalFactor += factor;
+
+            // The fourth lane of the weight is zero, discarding the garbage of the unpacked colors
+            __m128 weight = _mm_set_ps(0.0f, factor, factor, factor);
+
+            ambient = _mm_add_ps(ambient, _mm_mul_ps(weight, unpackColor(data.ambient)));
+            directed = _mm_add_ps(directed, _mm_mul_ps(weight, unpackColor(data.directed)));
+
+            int lng = data.latLong[0];
+            int lat = data.latLong[1];
+            __m128 normal = _mm_set_ps(0.0f,
+                                       tables.cosine[lng],
+                                       tables.sine[lat] * tables.sine[lng],
+                                       tables.cosine[lat] * tables.sine[lng]);
+            direction = _mm_add_ps(direction, _mm_mul_ps(weight, normal));
+        }
+
+        // Renormalize when some of the cells were ignored, and bring the colors to [0, 1]
+        float scale = 1.0f / 255.0f;
+        if (totalFactor > 0.0f && totalFactor < 0.99f)
+            scale /= totalFactor;
+
+        __m128 scale4 = _mm_set1_ps(scale);
+        ambient = _mm_mul_ps(ambient, scale4);
+        directed = _mm_mul_ps(directed, scale4);
+
+        float out[3][4];
+        _mm_storeu_ps(out[0], ambient);
+        _mm_storeu_ps(out[1], directed);
+        _mm_storeu_ps(out[2], direction);
+
+        LightGridSample &result = samples[i];
+        result.ambient = QVector3D(out[0][0], out[0][1], out[0][2]);
+        result.directed = QVector3D(out[1][0], out[1][1], out[1][2]);
+        result.direction = QVector3D(out[2][0], out[2][1], out[2][2]).normalized();
+    }
+}
+
+#else
+
+void BSPLightGrid::sample(const QVector3D *positions, LightGridSample *samples, int count) const
+{
+    if (cells.empty()) {
+        for (int i = 0; i < count; ++i)
+            samples[i] = LightGridSample();
+        return;
+    }
+
+    const AngleTables &tables = angleTables();
+
+    for (int i = 0; i < count; ++i) {
+        QVector3D v = (positions[i] - origin) * inverseGridSize;
+
+        int pos[3];
+        float frac[3];
+        for (int j = 0; j < 3; ++j) {
+            // Clamping before splitting off the fraction keeps positions outside the grid on its border cells
+            float coordinate = qBound(0.0f, v[j], (float)(bounds[j] - 1));
+            float cell = floorf(coordinate);
+            frac[j] = coordinate - cell;
+            pos[j] = (int)cell;
+        }
+
+        int base = pos[0] * steps[0] + pos[1] * steps[1] + pos[2] * steps[2];
+
+        QVector3D ambient, directed, direction;
+        float totalFactor = 0.0f;
+
+        // Trilinear interpolation of the eight surrounding cells
+        for (int corner = 0; corner < 8; ++corner) {
+            float factor = 1.0f;
+            int offset = base;
+            int j;
+
+            for (j = 0; j < 3; ++j) {
+                if (corner & (1 << j)) {
+                    // Ignore cells outside the grid
+                    if (pos[j] + 1 > bounds[j] - 1)
+                        break;
+                    factor *= frac[j];
+                    offset += steps[j];
+                }
+                else {
+                    factor *= 1.0f - frac[j];
+                }
+            }
+
+            if (j != 3)
+                continue;
+
+            const dlightgrid_t &data = cells[offset];
+
+            // Cells inside walls are black, so they must not darken the result
+            if (!(data.ambient[0] + data.ambient[1] + data.ambient[2]))
+                continue;
+
+            totalFactor += factor;
+
+            ambient += factor * QVector3D(data.ambient[0], data.ambient[1], data.ambient[2]);
+            directed += factor * QVector3D(data.directed[0], data.directed[1], data.directed[2]);
+
+            int lng = data.latLong[0];
+            int lat = data.latLong[1];
+            direction += factor * QVector3D(tables.cosine[lat] * tables.sine[lng],
+                                            tables.sine[lat] * tables.sine[lng],
+                                            tables.cosine[lng]);
+        }
+
+        // Renormalize when some of the cells were ignored, and bring the colors to [0, 1]
+        float scale = 1.0f / 255.0f;
+        if (totalFactor > 0.0f && totalFactor < 0.99f)
+            scale /= totalFactor;
+
+        LightGridSample &result = samples[i];
+        result.ambient = ambient * scale;
+        result.directed = directed * scale;
+        result.direction = direction.normalized();
+    }
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include "bspdefs.h"
+
+#include <vector>
+
+#include <QVector3D>
+
+/**
+ * @brief The light at a point of the light grid, with colors in the [0, 1] range
+ */
+struct LightGridSample
+{
+    QVector3D ambient;
+    QVector3D directed;
+    /// @brief Normalized direction pointing towards the directed light
+    QVector3D direction;
+};
+
+/**
+ * @brief The volumetric light grid of a map, used to light anything that has no lightmap
+ *
+ * The cells are kept in the compact 8 byte format of the lump, laid out X first, then Y, then Z.
+ */
+class BSPLightGrid
+{
+public:
+    BSPLightGrid();
+
+    /**
+     * @brief Sets up the grid for the world model bounds, taking over the cells
+     * @return false if the number of cells does not match the bounds; the grid is left empty in that case
+     */
+    bool create(const dmodel_t &worldModel, const QVector3D &gridSize, std::vector<dlightgrid_t> &cells);
+
+    /**
+     * @brief Releases all cells
+     */
+    void clear();
+
+    bool isEmpty() const { return cells.empty(); }
+
+    /**
+     * @brief Samples the grid with trilinear interpolation at ''count'' positions
+     *
+     * Cells inside solid geometry (black ambient) are ignored and the remaining weights renormalized, as Quake 3 does.
+     * Positions outside the grid are clamped to its border. If the grid is empty, all samples are black.
+     */
+    void sample(const QVector3D *positions, LightGridSample *samples, int count) const;
+
+    /**
+     * @brief Samples the grid at a single position
+     */
+    LightGridSample sample(const QVector3D &position) const;
+
+    const QVector3D& getOrigin() const { return origin; }
+    const QVector3D& getGridSize() const { return gridSize; }
+    int getBounds(int axis) const { return bounds[axis]; }
+
+private:
+    std::vector<dlightgrid_t> cells;
+
+    QVector3D origin;
+    QVector3D gridSize;
+    QVector3D inverseGridSize;
+
+    int bounds[3];
+    /// @brief Distance, in cells, between two neighbours on each axis
+    int steps[3];
+};
+
+#endif // LIGHTGRID_H
@@ -1,19 +1,169 @@
+#include "benchmarkrunner.h"
+#include "framestatsprotocol.h"
+#include "heatmapanalyzer.h"
 #include "mainwindow.h"
+#include "tracer.h"
+
+#include <cstring>
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
 #include <QSurfaceFormat>
 
+/**
+ * @brief Writes the recorded trace when it goes out of scope, so every exit path of main is covered
+ */
+struct TraceWriter
+{
+    QString fileName;
+
+    ~TraceWriter() {
+        if (!fileName.isEmpty() && !Tracer::instance().writeChromeTrace(fileName))
+            qWarning("Unable to write the trace to %s", qPrintable(fileName));
+    }
+};
+
 int main(int argc, char *argv[])
 {
+    // The default format must be set before the application exists, so this option cannot wait for the parser
+    bool vsync = true;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--no-vsync") == 0)
+            vsync = false;
+    }
+
     QSurfaceFormat format;
     format.setSamples(4);
     format.setDepthBufferSize(24);
     format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setSwapInterval(vsync ? 1 : 0);
     QSurfaceFormat::setDefaultFormat(format);
 
     QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
 
-    return a.exec();
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Quake 3 BSP viewer");
+    parser.addHelpOption();
+
+    QCommandLineOption benchmarkOption(QStringList() << "b" << "benchmark", "Renders <map> offscreen along a camera path and exits.", "map");
+    QCommandLineOption pathOption(QStringList() << "p" << "camera-path", "Camera path recorded with F5; without it the camera turns around at the start position.", "file");
+    QCommandLineOption heatmapOption("heatmap", "Samples viewpoints in every cluster of <map> offscreen, writes the render cost of each cluster and exits.", "map");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Benchmark: writes the per-frame results to <file>, as JSON if it ends with .json, otherwise as CSV. "
+                                    "Heatmap: prefix of the output files.", "file");
+    QCommandLineOption sizeOption("size", "Size of the offscreen framebuffer.", "WxH", "1280x720");
+    QCommandLineOption warmupOption("warmup", "Frames rendered before measuring.", "frames", "30");
+    QCommandLineOption framesOption("frames", "Length of the turnaround path.", "frames", "600");
+    QCommandLineOption checkAllocationsOption("check-allocations", "Benchmark: fails if any measured frame allocates memory. Requires a build with CONFIG+=alloc_tracking.");
+    QCommandLineOption positionsOption("positions", "Heatmap: camera positions sampled in each cluster.", "count", "2");
+    QCommandLineOption directionsOption("directions", "Heatmap: directions rendered from each position.", "count", "4");
+    QCommandLineOption worstOption("worst", "Heatmap: length of the list of worst viewpoints.", "count", "50");
+    QCommandLineOption seedOption("seed", "Heatmap: random seed for the sampled viewpoints.", "value", "1");
+    QCommandLineOption publishStatsOption("publish-stats", "Publishes the statistics of every frame to the shared memory segment <key>, for bspstats and other monitors (bspstats reads " FRAMESTATS_DEFAULT_KEY " by default).", "key");
+    QCommandLineOption continuousOption("continuous", "Draws frames continuously instead of only when the view changes.");
+    QCommandLineOption fpsCapOption("fps-cap", "Limits the viewer to <fps> frames per second; 0 for no limit.", "fps", "0");
+    QCommandLineOption renderScaleOption("render-scale", "Renders the scene and the effects at <scale> times the window size, from 0.25 to 2.", "scale", "1");
+    QCommandLineOption drawOrderOption("draw-order", "Order of the surfaces: leaf (index order) or front-to-back (from the BSP tree).", "order", "leaf");
+    QCommandLineOption depthPrePassOption("depth-prepass", "Fills the depth buffer before shading, so each pixel is shaded once.");
+    QCommandLineOption visibilityLatencyOption("visibility-latency", "Frames the visible set trails the camera: 0, or 1 to find it on a worker thread while the previous frame is drawn.", "frames", "0");
+    QCommandLineOption cullThreadsOption("cull-threads", "Threads the visibility and frustum culling is split over; 0 uses one per core.", "count", "1");
+    QCommandLineOption clusterBatchesOption("cluster-batches", "Draws the surfaces merged at load time by cluster and material, one draw per material of each visible cluster.");
+    QCommandLineOption noVsyncOption("no-vsync", "Does not wait for the display refresh when presenting frames.");
+    QCommandLineOption traceOption("trace", "Records the map loading phases and writes them to <file> on exit, in the Chrome trace format.", "file");
+    parser.addOption(benchmarkOption);
+    parser.addOption(pathOption);
+    parser.addOption(outputOption);
+    parser.addOption(sizeOption);
+    parser.addOption(warmupOption);
+    parser.addOption(framesOption);
+    parser.addOption(checkAllocationsOption);
+    parser.addOption(heatmapOption);
+    parser.addOption(positionsOption);
+    parser.addOption(directionsOption);
+    parser.addOption(worstOption);
+    parser.addOption(seedOption);
+    parser.addOption(traceOption);
+    parser.addOption(publishStatsOption);
+    parser.addOption(continuousOption);
+    parser.addOption(fpsCapOption);
+    parser.addOption(noVsyncOption);
+    parser.addOption(renderScaleOption);
+    parser.addOption(drawOrderOption);
+    parser.addOption(depthPrePassOption);
+    parser.addOption(visibilityLatencyOption);
+    parser.addOption(cullThreadsOption);
+    parser.addOption(clusterBatchesOption);
+
+    parser.process(a);
+
+    QString drawOrderName = parser.value(drawOrderOption);
+    if (drawOrderName != "leaf" && drawOrderName != "front-to-back") {
+        qWarning("Invalid draw order %s", qPrintable(drawOrderName));
+        return 1;
+    }
+    BSP::DrawOrder drawOrder = drawOrderName == "front-to-back" ? BSP::FrontToBack : BSP::LeafOrder;
+    bool depthPrePass = parser.isSet(depthPrePassOption);
+    int visibilityLatency = qBound(0, parser.value(visibilityLatencyOption).toInt(), 1);
+    int cullingThreads = qMax(0, parser.value(cullThreadsOption).toInt());
+    bool clusterBatching = parser.isSet(clusterBatchesOption);
+
+    TraceWriter traceWriter;
+    if (parser.isSet(traceOption)) {
+        traceWriter.fileName = parser.value(traceOption);
+        Tracer::instance().setThreadName("main");
+        Tracer::instance().setEnabled(true);
+    }
+
+    if (!parser.isSet(benchmarkOption) && !parser.isSet(heatmapOption)) {
+        MainWindow w;
+        w.setFramePacing(parser.isSet(continuousOption) ? FrameScheduler::Continuous : FrameScheduler::OnDemand, qMax(0, parser.value(fpsCapOption).toInt()));
+        w.setRenderScale(parser.value(renderScaleOption).toFloat());
+        w.setDrawOrder(drawOrder, depthPrePass);
+        w.setVisibilityLatency(visibilityLatency);
+        w.setCullingThreads(cullingThreads);
+        w.setClusterBatching(clusterBatching);
+        if (parser.isSet(publishStatsOption) && !w.publishStatistics(parser.value(publishStatsOption)))
+            return 1;
+        w.show();
+
+        return a.exec();
+    }
+
+    QStringList sizeValues = parser.value(sizeOption).split('x');
+    QSize size = sizeValues.size() == 2 ? QSize(sizeValues[0].toInt(), sizeValues[1].toInt()) : QSize();
+    if (size.isEmpty()) {
+        qWarning("Invalid framebuffer size %s", qPrintable(parser.value(sizeOption)));
+        return 1;
+    }
+
+    if (parser.isSet(heatmapOption)) {
+        HeatmapOptions options;
+        options.mapFile = parser.value(heatmapOption);
+        options.outputPrefix = parser.isSet(outputOption) ? parser.value(outputOption) : QFileInfo(options.mapFile).completeBaseName();
+        options.size = size;
+        options.positionsPerCluster = qMax(1, parser.value(positionsOption).toInt());
+        options.directions = qMax(1, parser.value(directionsOption).toInt());
+        options.worstCount = qMax(1, parser.value(worstOption).toInt());
+        options.seed = parser.value(seedOption).toUInt();
+
+        HeatmapAnalyzer analyzer(options);
+        return analyzer.run();
+    }
+
+    BenchmarkOptions options;
+    options.mapFile = parser.value(benchmarkOption);
+    options.cameraPathFile = parser.value(pathOption);
+    options.outputFile = parser.value(outputOption);
+    options.size = size;
+    options.warmupFrames = qMax(0, parser.value(warmupOption).toInt());
+    options.turnaroundFrames = qMax(1, parser.value(framesOption).toInt());
+    options.checkAllocations = parser.isSet(checkAllocationsOption);
+    options.drawOrder = drawOrder;
+    options.depthPrePass = depthPrePass;
+    options.visibilityLatency = visibilityLatency;
+    options.cullingThreads = cullingThreads;
+    options.clusterBatching = clusterBatching;
+
+    BenchmarkRunner runner(options);
+    return runner.run();
 }
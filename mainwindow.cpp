@@ -13,6 +13,41 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+bool MainWindow::publishStatistics(const QString &key)
+{
+    return ui->openGLWidget->publishStatistics(key);
+}
+
+void MainWindow::setFramePacing(FrameScheduler::Mode mode, int frameRateCap)
+{
+    ui->openGLWidget->setFramePacing(mode, frameRateCap);
+}
+
+void MainWindow::setRenderScale(float scale)
+{
+    ui->openGLWidget->setRenderScale(scale);
+}
+
+void MainWindow::setDrawOrder(BSP::DrawOrder order, bool depthPrePass)
+{
+    ui->openGLWidget->setDrawOrder(order, depthPrePass);
+}
+
+void MainWindow::setVisibilityLatency(int frames)
+{
+    ui->openGLWidget->setVisibilityLatency(frames);
+}
+
+void MainWindow::setCullingThreads(int threads)
+{
+    ui->openGLWidget->setCullingThreads(threads);
+}
+
+void MainWindow::setClusterBatching(bool enabled)
+{
+    ui->openGLWidget->setClusterBatching(enabled);
+}
+
 void MainWindow::toggleFullscreen()
 {
     if (this->isFullScreen())
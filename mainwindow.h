@@ -1,7 +1,11 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "bsp.h"
+#include "framescheduler.h"
+
 #include <QMainWindow>
+#include <QString>
 
 namespace Ui {
 class MainWindow;
@@ -15,6 +19,42 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+    /**
+     * @brief Publishes the statistics of every frame to the shared memory segment ''key''
+     * @return false if the segment cannot be created
+     */
+    bool publishStatistics(const QString &key);
+
+    /**
+     * @brief Sets when the view draws frames, and the maximum frame rate (0 for no limit)
+     */
+    void setFramePacing(FrameScheduler::Mode mode, int frameRateCap);
+
+    /**
+     * @brief Sets the size of the rendered scene relative to the view
+     */
+    void setRenderScale(float scale);
+
+    /**
+     * @brief Sets the order of the surfaces and whether a depth pre-pass precedes shading
+     */
+    void setDrawOrder(BSP::DrawOrder order, bool depthPrePass);
+
+    /**
+     * @brief Sets how many frames the visible set trails the camera, 0 or 1
+     */
+    void setVisibilityLatency(int frames);
+
+    /**
+     * @brief Sets the threads the culling is split over; 0 uses one per core
+     */
+    void setCullingThreads(int threads);
+
+    /**
+     * @brief Sets whether the surfaces are drawn merged by cluster and material
+     */
+    void setClusterBatching(bool enabled);
+
 public slots:
     void toggleFullscreen();
 
@@ -0,0 +1,191 @@
+#include "offscreenrenderer.h"
+
+#include "alloctracker.h"
+#include "camera.h"
+
+#include <iostream>
+
+#include <QDebug>
+#include <QOpenGLFunctions>
+
+OffscreenRenderer::OffscreenRenderer()
+{
+    fbo = nullptr;
+    bsp = nullptr;
+    drawOrder = BSP::LeafOrder;
+    depthPrePass = false;
+    visibilityLatency = 0;
+    cullingThreads = 1;
+    clusterBatching = false;
+    postProcessChain = nullptr;
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+    if (!context.isValid())
+        return;
+
+    // GL objects must be released with their context current
+    context.makeCurrent(&surface);
+
+    delete bsp;
+
+    if (postProcessChain) {
+        postProcessChain->clear();
+        delete postProcessChain;
+    }
+
+    profiler.destroy();
+
+    delete fbo;
+
+    context.doneCurrent();
+}
+
+bool OffscreenRenderer::create(const QSize &size)
+{
+    this->size = size;
+
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    // Software implementations only expose core profiles when a version is requested explicitly
+    format.setVersion(4, 0);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    surface.setFormat(format);
+    surface.create();
+    if (!surface.isValid()) {
+        qWarning() << "Unable to create an offscreen surface" << endl;
+        return false;
+    }
+
+    context.setFormat(format);
+    if (!context.create() || !context.makeCurrent(&surface)) {
+        qWarning() << "Unable to create an OpenGL 4.0 Core profile context" << endl;
+        return false;
+    }
+
+    rendererName = QString((const char*)context.functions()->glGetString(GL_RENDERER));
+
+    std::cout << "GL Version " << context.functions()->glGetString(GL_VERSION) << "\n";
+    std::cout << "GL Renderer " << rendererName.toLocal8Bit().data() << std::endl;
+
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo = new QOpenGLFramebufferObject(size, fboFormat);
+    if (!fbo->isValid()) {
+        qWarning() << "Unable to create the offscreen framebuffer" << endl;
+        return false;
+    }
+
+    postProcessChain = new PostProcessEffectChain;
+    postProcessChain->initializeGL();
+    postProcessChain->setProfiler(&profiler);
+    postProcessChain->resize(QVector2D(size.width(), size.height()));
+
+    profiler.initializeGL();
+
+    projection.setToIdentity();
+    projection.perspective(45.0f, (float)size.width() / (float)size.height(), 0.1f, 2000.0f);
+
+    return true;
+}
+
+bool OffscreenRenderer::loadMap(const QString &fileName)
+{
+    BSPWorld *world = new BSPWorld;
+    QObject::connect(world, &BSPWorld::loadError, [](QString error) {
+        qWarning() << error << endl;
+    });
+
+    if (!world->loadMap(fileName)) {
+        qWarning() << "Unable to load" << fileName << endl;
+        delete world;
+        return false;
+    }
+
+    delete bsp;
+    bsp = new BSP;
+    bsp->setProfiler(&profiler);
+    bsp->setDrawOrder(drawOrder);
+    bsp->setDepthPrePass(depthPrePass);
+    bsp->setVisibilityLatency(visibilityLatency);
+    bsp->setCullingThreads(cullingThreads);
+    bsp->setClusterBatching(clusterBatching);
+    bsp->setWorld(world);
+
+    return true;
+}
+
+void OffscreenRenderer::setDrawOrder(BSP::DrawOrder order, bool depthPrePass)
+{
+    drawOrder = order;
+    this->depthPrePass = depthPrePass;
+
+    if (bsp) {
+        bsp->setDrawOrder(order);
+        bsp->setDepthPrePass(depthPrePass);
+    }
+}
+
+qint64 OffscreenRenderer::renderFrame(const QVector3D &position, const QVector3D &rotation)
+{
+    Camera camera;
+    camera.setPosition(position);
+    camera.setRotation(rotation.x(), rotation.y(), rotation.z());
+
+    fbo->bind();
+
+    AllocationTracker::beginFrame();
+
+    profiler.beginFrame();
+    qint64 frame = profiler.getFrameNumber();
+
+    {
+        FrameProfiler::Scope frameScope(&profiler, QStringLiteral("Frame"));
+
+        {
+            FrameProfiler::Scope sceneScope(&profiler, QStringLiteral("Scene"));
+
+            postProcessChain->beginScene();
+
+            bsp->render(camera.getView(), projection, camera.getPosition());
+
+            postProcessChain->endScene();
+        }
+
+        postProcessChain->render();
+    }
+
+    profiler.endFrame();
+
+    AllocationTracker::endFrame();
+
+    // Nothing is presented, so flush to keep the driver from queueing an unbounded number of frames
+    context.functions()->glFlush();
+
+    return frame;
+}
+
+void OffscreenRenderer::setVisibilityLatency(int frames)
+{
+    visibilityLatency = frames;
+
+    if (bsp)
+        bsp->setVisibilityLatency(frames);
+}
+
+void OffscreenRenderer::setCullingThreads(int threads)
+{
+    cullingThreads = threads;
+
+    if (bsp)
+        bsp->setCullingThreads(threads);
+}
+
+void OffscreenRenderer::setClusterBatching(bool enabled)
+{
+    clusterBatching = enabled;
+
+    if (bsp)
+        bsp->setClusterBatching(enabled);
+}
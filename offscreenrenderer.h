@@ -0,0 +1,108 @@
+#ifndef OFFSCREENRENDERER_H
+#define OFFSCREENRENDERER_H
+
+#include "bsp.h"
+#include "frameprofiler.h"
+#include "postprocesseffectchain.h"
+
+#include <QMatrix4x4>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief Renders a map without a window, into a framebuffer object of a fixed size
+ *
+ * Frames go through the same BSP and post-processing path as the viewer, timed by the profiler.
+ */
+class OffscreenRenderer
+{
+public:
+    OffscreenRenderer();
+    ~OffscreenRenderer();
+
+    /**
+     * @brief Creates the context, the surface and the framebuffer
+     */
+    bool create(const QSize &size);
+
+    /**
+     * @brief Loads the map to be rendered
+     */
+    bool loadMap(const QString &fileName);
+
+    /**
+     * @brief Returns the loaded world, or nullptr if none
+     */
+    const BSPWorld *getWorld() const { return bsp ? bsp->getWorld() : nullptr; }
+
+    /**
+     * @brief Sets the order of the surfaces and whether a depth pre-pass precedes shading, for this and later maps
+     */
+    void setDrawOrder(BSP::DrawOrder order, bool depthPrePass);
+
+    /**
+     * @brief Sets how many frames the visible set trails the camera, 0 or 1, for this and later maps
+     * @remarks Anything rendering unrelated viewpoints, like the heatmap, needs 0
+     */
+    void setVisibilityLatency(int frames);
+
+    /**
+     * @brief Sets the threads the culling is split over, for this and later maps; 0 uses one per core
+     */
+    void setCullingThreads(int threads);
+
+    /**
+     * @brief Sets whether the surfaces are drawn merged by cluster and material, for this and later maps
+     */
+    void setClusterBatching(bool enabled);
+
+    /**
+     * @brief Renders one frame from a camera position and rotation (pitch, yaw and roll, in degrees)
+     * @return The profiler number of the frame, which identifies it when its times are collected
+     */
+    qint64 renderFrame(const QVector3D &position, const QVector3D &rotation);
+
+    /**
+     * @brief Returns the counters of the last rendered frame
+     */
+    const BSPRenderStats& getRenderStats() const { return bsp->getRenderStats(); }
+
+    /**
+     * @brief Returns the number of frames of the current map that had to wait for their visible set
+     */
+    qint64 getVisibilityStalls() const { return bsp->getVisibilityStalls(); }
+
+    FrameProfiler& getProfiler() { return profiler; }
+
+    /**
+     * @brief Returns the GL renderer string, such as "llvmpipe"
+     */
+    QString getRendererName() const { return rendererName; }
+
+private:
+    OffscreenRenderer(const OffscreenRenderer&);
+    OffscreenRenderer& operator=(const OffscreenRenderer&);
+
+    QSize size;
+
+    QOffscreenSurface surface;
+    QOpenGLContext context;
+    QOpenGLFramebufferObject *fbo;
+
+    BSP *bsp;
+    BSP::DrawOrder drawOrder;
+    bool depthPrePass;
+    int visibilityLatency;
+    int cullingThreads;
+    bool clusterBatching;
+    PostProcessEffectChain *postProcessChain;
+    FrameProfiler profiler;
+
+    QMatrix4x4 projection;
+    QString rendererName;
+};
+
+#endif // OFFSCREENRENDERER_H
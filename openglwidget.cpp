@@ -1,16 +1,96 @@
 #include "openglwidget.h"
 
+#include "alloctracker.h"
+
 #include <iostream>
-#include <sstream>
 
+#include <QDebug>
 #include <QFileDialog>
 #include <QKeyEvent>
 #include <QMouseEvent>
+#include <QPainter>
 
 OpenGLWidget::OpenGLWidget(QWidget *parent)
-    : QOpenGLWidget(parent)
+    : QOpenGLWidget(parent), scheduler(this)
 {
     bsp = nullptr;
+    sceneChanged = true;
+    showProfiler = false;
+    recordingPath = false;
+    drawOrder = BSP::LeafOrder;
+    depthPrePass = false;
+    showOverdraw = false;
+    visibilityLatency = 0;
+    cullingThreads = 1;
+    clusterBatching = false;
+}
+
+void OpenGLWidget::setFramePacing(FrameScheduler::Mode mode, int frameRateCap)
+{
+    scheduler.setMode(mode);
+    scheduler.setFrameRateCap(frameRateCap);
+}
+
+void OpenGLWidget::setRenderScale(float scale)
+{
+    postProcessChain.setRenderScale(scale);
+
+    if (isValid()) {
+        makeCurrent();
+        postProcessChain.resize(QVector2D(width(), height()));
+        doneCurrent();
+        requestRender();
+    }
+}
+
+void OpenGLWidget::setDrawOrder(BSP::DrawOrder order, bool depthPrePass)
+{
+    drawOrder = order;
+    this->depthPrePass = depthPrePass;
+    applyDrawSettings();
+}
+
+void OpenGLWidget::setVisibilityLatency(int frames)
+{
+    visibilityLatency = frames;
+    applyDrawSettings();
+}
+
+void OpenGLWidget::setCullingThreads(int threads)
+{
+    cullingThreads = threads;
+    applyDrawSettings();
+}
+
+void OpenGLWidget::setClusterBatching(bool enabled)
+{
+    clusterBatching = enabled;
+    applyDrawSettings();
+}
+
+void OpenGLWidget::applyDrawSettings()
+{
+    if (bsp) {
+        bsp->setDrawOrder(drawOrder);
+        bsp->setDepthPrePass(depthPrePass);
+        bsp->setOverdrawVisualization(showOverdraw);
+        bsp->setVisibilityLatency(visibilityLatency);
+        bsp->setCullingThreads(cullingThreads);
+        bsp->setClusterBatching(clusterBatching);
+    }
+
+    requestRender();
+}
+
+bool OpenGLWidget::publishStatistics(const QString &key)
+{
+    if (!statsPublisher.create(key)) {
+        qWarning() << "Unable to create the statistics segment" << key << ":" << statsPublisher.errorString() << endl;
+        return false;
+    }
+
+    profiler.setListener(&statsPublisher);
+    return true;
 }
 
 void OpenGLWidget::initializeGL()
@@ -20,10 +100,10 @@ void OpenGLWidget::initializeGL()
     std::cout << "GL Version " << glGetString(GL_VERSION) << "\n";
     std::cout << "GLSL " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
-    connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
-    timer.start(0);
-
     postProcessChain.initializeGL();
+
+    profiler.initializeGL();
+    postProcessChain.setProfiler(&profiler);
 }
 
 void OpenGLWidget::resizeGL(int w, int h)
@@ -35,23 +115,135 @@ void OpenGLWidget::resizeGL(int w, int h)
 
     postProcessChain.resize(QVector2D(w, h));
 
-    update();
+    requestRender();
+}
+
+void OpenGLWidget::requestRender()
+{
+    sceneChanged = true;
+    scheduler.requestFrame();
 }
 
 void OpenGLWidget::paintGL()
 {
+    scheduler.frameStarted();
+
     if (!bsp)
         return;
 
     makeCurrent();
 
-    postProcessChain.beginScene();
+    // Draw the scene only when something in it changed; otherwise the cached output of the chain is presented again
+    bool renderScene = sceneChanged || scheduler.getMode() == FrameScheduler::Continuous;
+    sceneChanged = false;
+
+    AllocationTracker::beginFrame();
+
+    profiler.beginFrame();
 
-    bsp->render(camera.getView(), projection, camera.getPosition());
+    {
+        FrameProfiler::Scope frameScope(&profiler, QStringLiteral("Frame"));
 
-    postProcessChain.endScene();
+        if (renderScene) {
+            {
+                FrameProfiler::Scope sceneScope(&profiler, QStringLiteral("Scene"));
 
-    postProcessChain.render();
+                postProcessChain.beginScene();
+
+                bsp->render(camera.getView(), projection, camera.getPosition());
+
+                postProcessChain.endScene();
+            }
+
+            postProcessChain.render();
+        } else if (!postProcessChain.isOutputCurrent()) {
+            postProcessChain.rerender();
+        } else {
+            postProcessChain.present();
+        }
+    }
+
+    if (statsPublisher.isActive())
+        statsPublisher.frameRendered(profiler.getFrameNumber(), renderScene ? bsp->getRenderStats() : BSPRenderStats());
+
+    profiler.endFrame();
+
+    AllocationTracker::endFrame();
+
+    if (renderScene && recordingPath) {
+        CameraPathSample sample;
+        sample.position = camera.getPosition();
+        sample.rotation = camera.getRotation();
+        cameraPath.append(sample);
+    }
+
+    // Animated shaders change every frame, so keep drawing while the map has any.
+    // A frame drawn with the visible set of an older camera needs one more to catch up
+    if (bsp->hasAnimatedShaders() || bsp->isVisibilityPending())
+        requestRender();
+
+    if (showProfiler)
+        drawProfilerOverlay();
+}
+
+void OpenGLWidget::drawProfilerOverlay()
+{
+    const std::vector<ProfileStats> &statistics = profiler.getStatistics();
+
+    QPainter painter(this);
+    painter.setFont(QFont("Monospace", 9));
+
+    QFontMetrics metrics = painter.fontMetrics();
+    int lineHeight = metrics.height();
+
+    int lines = statistics.size() + 4 + (AllocationTracker::isAvailable() ? 1 : 0);
+    painter.fillRect(QRect(4, 4, 460, lineHeight * lines + 8), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+
+    int y = 8 + metrics.ascent();
+    painter.drawText(8, y, QString("%1 %2 %3 %4 %5").arg("Scope", -24).arg("CPU avg", 8).arg("CPU max", 8).arg("GPU avg", 8).arg("GPU max", 8));
+
+    for (auto stats = statistics.begin(); stats != statistics.end(); ++stats) {
+        y += lineHeight;
+
+        QString name = QString(stats->depth * 2, ' ') + stats->name;
+        painter.drawText(8, y, QString("%1 %2 %3 %4 %5")
+                         .arg(name.left(24), -24)
+                         .arg(stats->cpuAverage, 8, 'f', 3)
+                         .arg(stats->cpuMax, 8, 'f', 3)
+                         .arg(stats->gpuAverage, 8, 'f', 3)
+                         .arg(stats->gpuMax, 8, 'f', 3));
+    }
+
+    y += lineHeight;
+    painter.drawText(8, y, QString("Effects: %1 in %2 passes (fusion saves %3, %4 KB)")
+                     .arg(postProcessChain.getActiveEffects().size())
+                     .arg(postProcessChain.getPassCount())
+                     .arg(postProcessChain.getPassesSaved())
+                     .arg(postProcessChain.getBytesSaved() / 1024));
+
+    y += lineHeight;
+    painter.drawText(8, y, QString("Render targets: %1 at %2x%3 (%4 KB)")
+                     .arg(postProcessChain.getTargetPool().getTargetCount())
+                     .arg(postProcessChain.getRenderSize().width())
+                     .arg(postProcessChain.getRenderSize().height())
+                     .arg(postProcessChain.getTargetPool().getMemoryUsage() / 1024));
+
+    // Shaded samples per pixel: 1 is no overdraw at all; the count is read back a few frames late
+    y += lineHeight;
+    const BSPRenderStats &renderStats = bsp->getRenderStats();
+    QSize renderSize = postProcessChain.getRenderSize();
+    double pixels = qMax(1, renderSize.width() * renderSize.height());
+    painter.drawText(8, y, QString("Draw order: %1%2%3, %4 samples per pixel")
+                     .arg(drawOrder == BSP::FrontToBack ? "front to back" : "leaf order")
+                     .arg(clusterBatching ? " by cluster batches" : "")
+                     .arg(depthPrePass ? " with depth pre-pass" : "")
+                     .arg(renderStats.shadedSamples >= 0 ? QString::number(renderStats.shadedSamples / pixels, 'f', 2) : QString("-")));
+
+    if (AllocationTracker::isAvailable()) {
+        y += lineHeight;
+        painter.drawText(8, y, QString("Allocations: %1 (%2 bytes)").arg(AllocationTracker::getFrameAllocations()).arg(AllocationTracker::getFrameBytes()));
+    }
 }
 
 void OpenGLWidget::mouseMoveEvent(QMouseEvent *event)
@@ -60,6 +252,7 @@ void OpenGLWidget::mouseMoveEvent(QMouseEvent *event)
         return;
 
     camera.mouseMove(event->localPos());
+    requestRender();
 
     QCursor::setPos(this->mapToGlobal(QPoint(width() / 2, height() / 2)));
 }
@@ -69,18 +262,38 @@ void OpenGLWidget::keyPressEvent(QKeyEvent *event)
     switch (event->key()) {
     case Qt::Key_Up:
     case Qt::Key_W:
-        camera.walk( 32.0f); break;
+        camera.walk( 32.0f); requestRender(); break;
     case Qt::Key_Down:
     case Qt::Key_S:
-        camera.walk(-32.0f); break;
+        camera.walk(-32.0f); requestRender(); break;
     case Qt::Key_Left:
     case Qt::Key_A:
-        camera.strafe(-32.0f); break;
+        camera.strafe(-32.0f); requestRender(); break;
     case Qt::Key_Right:
     case Qt::Key_D:
-        camera.strafe( 32.0f); break;
+        camera.strafe( 32.0f); requestRender(); break;
     case Qt::Key_Escape:
         this->clearFocus(); break;
+    case Qt::Key_F3:
+        showProfiler = !showProfiler; scheduler.requestFrame(); break;
+    case Qt::Key_F5:
+        toggleRecording(); break;
+    case Qt::Key_F6:
+        drawOrder = drawOrder == BSP::LeafOrder ? BSP::FrontToBack : BSP::LeafOrder;
+        emit setStatusBarMessage(drawOrder == BSP::FrontToBack ? "Drawing front to back" : "Drawing in leaf order");
+        applyDrawSettings(); break;
+    case Qt::Key_F7:
+        depthPrePass = !depthPrePass;
+        emit setStatusBarMessage(depthPrePass ? "Depth pre-pass enabled" : "Depth pre-pass disabled");
+        applyDrawSettings(); break;
+    case Qt::Key_F8:
+        showOverdraw = !showOverdraw;
+        emit setStatusBarMessage(showOverdraw ? "Showing overdraw: red 1 layer, yellow 8, white 16" : "");
+        applyDrawSettings(); break;
+    case Qt::Key_F9:
+        clusterBatching = !clusterBatching;
+        emit setStatusBarMessage(clusterBatching ? "Drawing cluster batches" : "Drawing individual surfaces");
+        applyDrawSettings(); break;
     }
 }
 
@@ -102,6 +315,29 @@ void OpenGLWidget::focusOutEvent(QFocusEvent *)
     emit setStatusBarMessage("");
 }
 
+void OpenGLWidget::toggleRecording()
+{
+    if (!recordingPath) {
+        cameraPath.clear();
+        recordingPath = true;
+        emit setStatusBarMessage("Recording camera path, press F5 to stop");
+        return;
+    }
+
+    recordingPath = false;
+
+    // Saving opens a dialog, so the mouse must be released first
+    clearFocus();
+    emit setStatusBarMessage(QString("Recorded %1 frames").arg(cameraPath.size()));
+
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Camera Path", QString(), QString("Camera Paths (*.path)"));
+    if (fileName.isEmpty())
+        return;
+
+    if (!cameraPath.save(fileName))
+        emit setStatusBarMessage("Unable to save the camera path to " + fileName);
+}
+
 void OpenGLWidget::loadBSP()
 {
     QString fileName = QFileDialog::getOpenFileName(this, "Select BSP File", QString(), QString("BSP Files (*.bsp)"));
@@ -109,31 +345,29 @@ void OpenGLWidget::loadBSP()
     if (fileName.isEmpty())
         return;
 
+    // The map releases its GL objects, so the context must be current, which the file dialog does not guarantee
+    makeCurrent();
+
     if (bsp)
         delete bsp;
 
-    makeCurrent();
     bsp = new BSP();
+    bsp->setProfiler(&profiler);
     connect(bsp, SIGNAL(loadError(QString)), this, SLOT(bspError(QString)));
     bsp->loadMap(fileName);
+    applyDrawSettings();
 
-    // Try to find the entity that holds the position and angles for the initial camera position
-    BSPEntity *entity = bsp->findEntityByClassname("info_player_intermission");
-    if (!entity)
-        camera.setPosition(bsp->getCenter());
-    else {
-        std::istringstream iss(entity->getSetting("origin").toLatin1().data());
-        float x, y, z;
+    const BSPWorld *world = bsp->getWorld();
+    if (!world)
+        return;
 
-        iss >> x >> y >> z;
-        camera.setPosition(QVector3D(x, y, z));
+    QVector3D position, angles;
+    world->getStartView(position, angles);
 
-        iss.seekg(0);
-        iss.str(entity->getSetting("angles").toLatin1().data());
-        iss >> x >> y >> z;
+    camera.setPosition(position);
+    camera.setRotation(angles.x(), angles.y(), angles.z());
 
-        camera.setRotation(x, y, z);
-    }
+    requestRender();
 }
 
 void OpenGLWidget::bspError(QString error)
@@ -3,12 +3,15 @@
 
 #include "bsp.h"
 #include "camera.h"
+#include "camerapath.h"
+#include "frameprofiler.h"
+#include "framescheduler.h"
+#include "framestatspublisher.h"
 #include "postprocesseffectchain.h"
 
 #include <QMatrix4x4>
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
-#include <QTimer>
 
 class OpenGLWidget : public QOpenGLWidget, private QOpenGLFunctions
 {
@@ -17,6 +20,47 @@ class OpenGLWidget : public QOpenGLWidget, private QOpenGLFunctions
 public:
     OpenGLWidget(QWidget *parent = 0);
 
+    /**
+     * @brief Returns the profiler holding the rolling frame statistics
+     */
+    const FrameProfiler& getProfiler() const { return profiler; }
+
+    /**
+     * @brief Sets when frames are drawn, and the maximum frame rate (0 for no limit)
+     */
+    void setFramePacing(FrameScheduler::Mode mode, int frameRateCap);
+
+    /**
+     * @brief Publishes the statistics of every frame to the shared memory segment ''key''
+     * @return false if the segment cannot be created
+     */
+    bool publishStatistics(const QString &key);
+
+    /**
+     * @brief Sets the size of the rendered scene relative to the widget
+     */
+    void setRenderScale(float scale);
+
+    /**
+     * @brief Sets the order of the surfaces and whether a depth pre-pass precedes shading
+     */
+    void setDrawOrder(BSP::DrawOrder order, bool depthPrePass);
+
+    /**
+     * @brief Sets how many frames the visible set trails the camera, 0 or 1
+     */
+    void setVisibilityLatency(int frames);
+
+    /**
+     * @brief Sets the threads the culling is split over; 0 uses one per core
+     */
+    void setCullingThreads(int threads);
+
+    /**
+     * @brief Sets whether the surfaces are drawn merged by cluster and material
+     */
+    void setClusterBatching(bool enabled);
+
 protected:
     void initializeGL();
     void resizeGL(int w, int h);
@@ -29,14 +73,54 @@ protected:
     virtual void focusOutEvent(QFocusEvent *event);
 
 private:
+    /**
+     * @brief Draws the profiler statistics on top of the frame
+     */
+    void drawProfilerOverlay();
+
+    /**
+     * @brief Starts recording the camera path, or stops and asks where to save it
+     */
+    void toggleRecording();
+
+    /**
+     * @brief Schedules a frame that draws the scene again, instead of presenting the last one
+     */
+    void requestRender();
+
+    /**
+     * @brief Passes the draw order, pre-pass and overdraw settings to the renderer
+     */
+    void applyDrawSettings();
+
     BSP *bsp;
-    QTimer timer;
     Camera camera;
     QMatrix4x4 modelView;
     QMatrix4x4 projection;
 
     PostProcessEffectChain postProcessChain;
 
+    FrameScheduler scheduler;
+    /// @brief Whether the camera or the map changed since the scene was last drawn
+    bool sceneChanged;
+
+    FrameProfiler profiler;
+    bool showProfiler;
+
+    FrameStatsPublisher statsPublisher;
+
+    /// @brief Kept here so they survive loading another map
+    BSP::DrawOrder drawOrder;
+    bool depthPrePass;
+    bool showOverdraw;
+    int visibilityLatency;
+    int cullingThreads;
+    bool clusterBatching;
+
+    /// @brief Camera of every frame drawn while recording, for playback by the benchmark mode
+    CameraPath cameraPath;
+    bool recordingPath;
+
 public slots:
     void loadBSP();
     void bspError(QString error);
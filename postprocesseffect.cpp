@@ -1,16 +1,32 @@
 #include "postprocesseffect.h"
 
+#include <QDebug>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QStringList>
+
 PostProcessEffect::PostProcessEffect()
 {
     vertexShader = nullptr;
     fragmentShader = nullptr;
     shaderProgram = nullptr;
+    uniformProgram = nullptr;
+
+    computeProgram = nullptr;
+    computeFunctions = nullptr;
+    computeEnabled = false;
 
     vao = nullptr;
     vboVertices = nullptr;
     vboTextureCoords = nullptr;
     vboIndices = nullptr;
 
+    revision = 0;
+    downsample = 0;
+
+    screenDimentionsLocation = -1;
+    texelSizeLocation = -1;
+
     initializeOpenGLFunctions();
 }
 
@@ -22,6 +38,21 @@ PostProcessEffect::~PostProcessEffect()
 void PostProcessEffect::setScreenDimentions(const QVector2D &dimentions)
 {
     screenDimentions = dimentions;
+    parametersChanged();
+}
+
+void PostProcessEffect::setDownsample(int level)
+{
+    downsample = qBound(0, level, MAX_DOWNSAMPLE);
+    parametersChanged();
+}
+
+const QString& PostProcessEffect::getProfileName() const
+{
+    if (profileName.isNull())
+        profileName = toString().section(';', 0, 0);
+
+    return profileName;
 }
 
 void PostProcessEffect::render(GLuint original, GLuint input, GLuint depth)
@@ -31,11 +62,8 @@ void PostProcessEffect::render(GLuint original, GLuint input, GLuint depth)
 
     setEffectUniforms();
 
-    shaderProgram->setUniformValue("originalTexture", 0);
-    shaderProgram->setUniformValue("chainedTexture", 1);
-    shaderProgram->setUniformValue("depthTexture", 2);
-    shaderProgram->setUniformValue("screenDimentions", screenDimentions);
-    shaderProgram->setUniformValue("texelSize", QVector2D(1.0 / screenDimentions.x(), 1.0 / screenDimentions.y()));
+    shaderProgram->setUniformValue(screenDimentionsLocation, screenDimentions);
+    shaderProgram->setUniformValue(texelSizeLocation, QVector2D(1.0 / screenDimentions.x(), 1.0 / screenDimentions.y()));
 
     vao->bind();
     vboIndices->bind();
@@ -71,6 +99,105 @@ void PostProcessEffect::createEffect(const QString &fragmentShaderFile, const QS
     if (!fragmentShader->compileSourceFile(fragmentShaderFile))
         qWarning() << fragmentShader->log() << endl;
 
+    linkEffect();
+}
+
+void PostProcessEffect::createEffectFromSource(const QString &fragmentShaderSource, const QString &vertexShaderFile)
+{
+    destroyEffect();
+
+    vertexShader = new QOpenGLShader(QOpenGLShader::Vertex);
+    if (!vertexShader->compileSourceFile(vertexShaderFile))
+        qWarning() << vertexShader->log() << endl;
+
+    fragmentShader = new QOpenGLShader(QOpenGLShader::Fragment);
+    if (!fragmentShader->compileSourceCode(fragmentShaderSource))
+        qWarning() << fragmentShader->log() << endl;
+
+    linkEffect();
+}
+
+void PostProcessEffect::createComputeEffect(const QString &computeShaderFile)
+{
+    // Compute shaders need OpenGL 4.3
+    computeFunctions = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_3_Core>();
+    if (!computeFunctions || !QOpenGLShader::hasOpenGLShaders(QOpenGLShader::Compute)) {
+        computeFunctions = nullptr;
+        return;
+    }
+
+    computeFunctions->initializeOpenGLFunctions();
+
+    computeProgram = new QOpenGLShaderProgram;
+    if (!computeProgram->addShaderFromSourceFile(QOpenGLShader::Compute, computeShaderFile) || !computeProgram->link()) {
+        qWarning() << computeProgram->log() << endl;
+        delete computeProgram;
+        computeProgram = nullptr;
+        return;
+    }
+
+    computeProgram->bind();
+    computeProgram->setUniformValue("originalTexture", 0);
+    computeProgram->setUniformValue("chainedTexture", 1);
+    computeProgram->setUniformValue("depthTexture", 2);
+    computeProgram->setUniformValue("outputImage", 0);
+    computeProgram->release();
+
+    detachUniforms();
+}
+
+void PostProcessEffect::setComputeEnabled(bool enabled)
+{
+    computeEnabled = enabled && computeProgram != nullptr;
+    detachUniforms();
+}
+
+void PostProcessEffect::detachUniforms()
+{
+    if (computeEnabled)
+        attachUniforms(computeProgram, QString());
+    else
+        attachUniforms(shaderProgram, shaderPrefix);
+}
+
+void PostProcessEffect::dispatch(GLuint original, GLuint input, GLuint depth, GLuint output, int width, int height)
+{
+    computeProgram->bind();
+
+    setEffectUniforms();
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, input);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, original);
+
+    computeFunctions->glBindImageTexture(0, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    QSize groups = getWorkGroupCount(width, height);
+    computeFunctions->glDispatchCompute(groups.width(), groups.height(), 1);
+
+    // The next pass samples the output
+    computeFunctions->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    computeProgram->release();
+}
+
+void PostProcessEffect::createPointwiseEffect()
+{
+    createEffectFromSource(FusedEffect::generateSource(std::vector<PostProcessEffect*>(1, this)));
+}
+
+void PostProcessEffect::attachUniforms(QOpenGLShaderProgram *program, const QString &prefix)
+{
+    uniformProgram = program;
+    uniformPrefix = prefix;
+    findEffectUniforms();
+}
+
+void PostProcessEffect::linkEffect()
+{
     shaderProgram = new QOpenGLShaderProgram;
     shaderProgram->addShader(vertexShader);
     shaderProgram->addShader(fragmentShader);
@@ -78,6 +205,20 @@ void PostProcessEffect::createEffect(const QString &fragmentShaderFile, const QS
     if (!shaderProgram->link())
         qWarning() << shaderProgram->log() << endl;
 
+    // The texture units never change, so they are set once; everything else is set through locations looked up here
+    shaderProgram->bind();
+    shaderProgram->setUniformValue("originalTexture", 0);
+    shaderProgram->setUniformValue("chainedTexture", 1);
+    shaderProgram->setUniformValue("depthTexture", 2);
+    shaderProgram->release();
+
+    screenDimentionsLocation = shaderProgram->uniformLocation("screenDimentions");
+    texelSizeLocation = shaderProgram->uniformLocation("texelSize");
+
+    // A point-wise effect is alone in a generated shader, as the first effect
+    shaderPrefix = isPointwise() ? FusedEffect::prefix(0) : QString();
+    attachUniforms(shaderProgram, shaderPrefix);
+
     vertices = new QVector4D[4];
     vertices[0] = QVector4D(-1.0f, -1.0f, 0, 1);
     vertices[1] = QVector4D( 1.0f, -1.0f, 0, 1);
@@ -136,6 +277,10 @@ void PostProcessEffect::createEffect(const QString &fragmentShaderFile, const QS
 
 void PostProcessEffect::destroyEffect()
 {
+    delete computeProgram;
+    computeProgram = nullptr;
+    computeEnabled = false;
+
     delete vertexShader;
     vertexShader = nullptr;
 
@@ -146,6 +291,7 @@ void PostProcessEffect::destroyEffect()
         shaderProgram->release();
         delete shaderProgram;
         shaderProgram = nullptr;
+        uniformProgram = nullptr;
     }
 
     if (vao) {
@@ -183,31 +329,135 @@ QString PassthroughEffect::toString() const
     return QString("Passthrough Effect");
 }
 
+DownsampleEffect::DownsampleEffect()
+{
+    level = 1;
+    sourceSize = QSize(1, 1);
+
+    factorLocation = -1;
+    sourceTexelSizeLocation = -1;
+}
+
+void DownsampleEffect::setLevel(int level)
+{
+    this->level = qBound(1, level, MAX_DOWNSAMPLE);
+    parametersChanged();
+}
+
+void DownsampleEffect::setSourceSize(const QSize &size)
+{
+    sourceSize = size;
+    parametersChanged();
+}
+
+void DownsampleEffect::create()
+{
+    createEffect(":/shaders/effects/downsample.glsl");
+}
+
+void DownsampleEffect::findEffectUniforms()
+{
+    factorLocation = findUniform("factor");
+    sourceTexelSizeLocation = findUniform("sourceTexelSize");
+}
+
+void DownsampleEffect::setEffectUniforms()
+{
+    uniformProgram->setUniformValue(factorLocation, 1 << level);
+    uniformProgram->setUniformValue(sourceTexelSizeLocation, QVector2D(1.0f / sourceSize.width(), 1.0f / sourceSize.height()));
+}
+
+QString DownsampleEffect::toString() const
+{
+    return QString("Downsample; 1/%1").arg(1 << level);
+}
+
+BilateralUpsampleEffect::BilateralUpsampleEffect()
+{
+    sourceSize = QSize(1, 1);
+
+    sourceSizeLocation = -1;
+}
+
+void BilateralUpsampleEffect::setSourceSize(const QSize &size)
+{
+    sourceSize = size;
+    parametersChanged();
+}
+
+void BilateralUpsampleEffect::create()
+{
+    createEffect(":/shaders/effects/bilateral_upsample.glsl");
+}
+
+void BilateralUpsampleEffect::findEffectUniforms()
+{
+    sourceSizeLocation = findUniform("sourceSize");
+}
+
+void BilateralUpsampleEffect::setEffectUniforms()
+{
+    uniformProgram->setUniformValue(sourceSizeLocation, QVector2D(sourceSize.width(), sourceSize.height()));
+}
+
+QString BilateralUpsampleEffect::toString() const
+{
+    return QString("Upsample");
+}
+
 EdgeDetectionEffect::EdgeDetectionEffect()
 {
     addOriginal = false;
     intensity = 1.0f;
+
+    addOriginalLocation = -1;
+    intensityLocation = -1;
 }
 
 void EdgeDetectionEffect::create()
 {
-    createEffect(":/shaders/effects/edge_detection.glsl");
+    createPointwiseEffect();
+    createComputeEffect(":/shaders/effects/edge_detection_compute.glsl");
+}
+
+bool EdgeDetectionEffect::hasComputePath() const
+{
+    return PostProcessEffect::hasComputePath() && getDownsample() == 0;
+}
+
+QSize EdgeDetectionEffect::getWorkGroupCount(int width, int height) const
+{
+    // 16x16 tiles
+    return QSize((width + 15) / 16, (height + 15) / 16);
+}
+
+QString EdgeDetectionEffect::getPointwiseSourceFile() const
+{
+    return QString(":/shaders/effects/edge_detection.glsl");
 }
 
 void EdgeDetectionEffect::setIntensity(float value)
 {
     intensity = value;
+    parametersChanged();
 }
 
 void EdgeDetectionEffect::setAdditive(bool value)
 {
     addOriginal = value;
+    parametersChanged();
+}
+
+void EdgeDetectionEffect::findEffectUniforms()
+{
+    addOriginalLocation = findUniform("addOriginal");
+    intensityLocation = findUniform("intensity");
 }
 
 void EdgeDetectionEffect::setEffectUniforms()
 {
-    shaderProgram->setUniformValue("addOriginal", addOriginal);
-    shaderProgram->setUniformValue("intensity", intensity);
+    uniformProgram->setUniformValue(addOriginalLocation, addOriginal);
+    uniformProgram->setUniformValue(intensityLocation, intensity);
 }
 
 QString EdgeDetectionEffect::toString() const
@@ -219,6 +469,9 @@ CrossStitchEffect::CrossStitchEffect()
 {
     inverted = 0;
     stitchSize = 6.0f;
+
+    invertedLocation = -1;
+    stitchSizeLocation = -1;
 }
 
 void CrossStitchEffect::create()
@@ -229,17 +482,25 @@ void CrossStitchEffect::create()
 void CrossStitchEffect::setStitchSize(float value)
 {
     stitchSize = value;
+    parametersChanged();
 }
 
 void CrossStitchEffect::setInverted(bool value)
 {
     inverted = value ? 1 : 0;
+    parametersChanged();
+}
+
+void CrossStitchEffect::findEffectUniforms()
+{
+    stitchSizeLocation = findUniform("stitchSize");
+    invertedLocation = findUniform("inverted");
 }
 
 void CrossStitchEffect::setEffectUniforms()
 {
-    shaderProgram->setUniformValue("stitchSize", stitchSize);
-    shaderProgram->setUniformValue("inverted", inverted);
+    uniformProgram->setUniformValue(stitchSizeLocation, stitchSize);
+    uniformProgram->setUniformValue(invertedLocation, inverted);
 }
 
 QString CrossStitchEffect::toString() const
@@ -247,14 +508,108 @@ QString CrossStitchEffect::toString() const
     return QString("%1 Cross Stitch; Size %2").arg(inverted ? "Inverted" : "Normal").arg(stitchSize, 1, 'f', 1, '0');
 }
 
+GaussianBlurEffect::GaussianBlurEffect(const QVector2D &axis) : axis(axis)
+{
+    sigma = 1.0f;
+    calculatedDownsample = -1;
+
+    blurDirectionLocation = -1;
+    blurAxisLocation = -1;
+    offsetsLocation = -1;
+    weightsLocation = -1;
+
+    setDownsample(1);
+}
+
+void GaussianBlurEffect::setSigma(float value)
+{
+    sigma = value;
+    calculatedDownsample = -1;
+    parametersChanged();
+}
+
+void GaussianBlurEffect::calculateValues()
+{
+    // The taps are target texels, which cover more pixels at a lower resolution
+    float scaledSigma = sigma / (1 << getDownsample());
+
+    auto g = [scaledSigma](float x) -> float {
+        // Square root of 2 PI
+        static float sqrt_2pi = 2.50662827463f;
+        return 1.0 / (scaledSigma * sqrt_2pi) * expf(-0.5 * x * x / (scaledSigma * scaledSigma));
+    };
+
+    // Weights of the taps at 0 to 7 texels from the center, normalized over both sides
+    float weights[8];
+    float weightSum = 0.0f;
+    int i;
+    for (i = 0; i < 8; ++i) {
+        weights[i] = g(i);
+        weightSum += i == 0 ? weights[i] : 2.0f * weights[i];
+    }
+
+    for (i = 0; i < 8; ++i) {
+        weights[i] /= weightSum;
+        tapWeights[i] = weights[i];
+    }
+
+    offsets[0] = 0.0f;
+    values[0] = weights[0];
+
+    // Merge the taps 1 and 2, 3 and 4, 5 and 6, and take 7 alone; a fetch between two texels weighs them by its distance to each
+    for (i = 1; i < 5; ++i) {
+        int first = 2 * i - 1;
+        int second = 2 * i;
+        float secondWeight = second < 8 ? weights[second] : 0.0f;
+
+        values[i] = weights[first] + secondWeight;
+        offsets[i] = values[i] > 0.0f ? (first * weights[first] + second * secondWeight) / values[i] : first;
+    }
+
+    calculatedDownsample = getDownsample();
+}
+
+void GaussianBlurEffect::findEffectUniforms()
+{
+    blurDirectionLocation = findUniform("blurDirection");
+    blurAxisLocation = findUniform("blurAxis");
+    offsetsLocation = findUniform("gaussianOffsets");
+    weightsLocation = findUniform("gaussianWeights");
+}
+
 void GaussianBlurEffect::setEffectUniforms()
 {
-    shaderProgram->setUniformValueArray("gaussianWeights", values, 15, 1);
+    if (calculatedDownsample != getDownsample())
+        calculateValues();
+
+    if (isComputeEnabled()) {
+        uniformProgram->setUniformValue(blurAxisLocation, QPoint(axis.x(), axis.y()));
+        uniformProgram->setUniformValueArray(weightsLocation, tapWeights, 8, 1);
+        return;
+    }
+
+    // One texel of the reduced target, in texture coordinates
+    float scale = 1 << getDownsample();
+    QVector2D direction(axis.x() * scale / getScreenDimentions().x(), axis.y() * scale / getScreenDimentions().y());
+
+    uniformProgram->setUniformValue(blurDirectionLocation, direction);
+    uniformProgram->setUniformValueArray(offsetsLocation, offsets, 5, 1);
+    uniformProgram->setUniformValueArray(weightsLocation, values, 5, 1);
+}
+
+QSize GaussianBlurEffect::getWorkGroupCount(int width, int height) const
+{
+    // A group of 128 texels along the axis, for each line across it
+    if (axis.x() != 0.0f)
+        return QSize((width + 127) / 128, height);
+
+    return QSize((height + 127) / 128, width);
 }
 
 void HorizontalGaussianBlurEffect::create()
 {
-    createEffect(":/shaders/effects/gaussian_blur_frag.glsl", ":/shaders/effects/horizontal_gaussian_blur_vertex.glsl");
+    createEffect(":/shaders/effects/gaussian_blur_frag.glsl");
+    createComputeEffect(":/shaders/effects/gaussian_blur_compute.glsl");
 }
 
 QString HorizontalGaussianBlurEffect::toString() const
@@ -264,7 +619,8 @@ QString HorizontalGaussianBlurEffect::toString() const
 
 void VerticalGaussianBlurEffect::create()
 {
-    createEffect(":/shaders/effects/gaussian_blur_frag.glsl", ":/shaders/effects/vertical_gaussian_blur_vertex.glsl");
+    createEffect(":/shaders/effects/gaussian_blur_frag.glsl");
+    createComputeEffect(":/shaders/effects/gaussian_blur_compute.glsl");
 }
 
 QString VerticalGaussianBlurEffect::toString() const
@@ -275,21 +631,34 @@ QString VerticalGaussianBlurEffect::toString() const
 GammaCorrectionEffect::GammaCorrectionEffect()
 {
     gammaFactor = QVector3D(1.0f, 1.0f, 1.0f);
+
+    gammaFactorLocation = -1;
 }
 
 void GammaCorrectionEffect::create()
 {
-    createEffect(":/shaders/effects/gamma_correction.glsl");
+    createPointwiseEffect();
+}
+
+QString GammaCorrectionEffect::getPointwiseSourceFile() const
+{
+    return QString(":/shaders/effects/gamma_correction.glsl");
 }
 
 void GammaCorrectionEffect::setGammaFactor(QVector3D value)
 {
     gammaFactor = value;
+    parametersChanged();
+}
+
+void GammaCorrectionEffect::findEffectUniforms()
+{
+    gammaFactorLocation = findUniform("gammaFactor");
 }
 
 void GammaCorrectionEffect::setEffectUniforms()
 {
-    shaderProgram->setUniformValue("gammaFactor", gammaFactor);
+    uniformProgram->setUniformValue(gammaFactorLocation, gammaFactor);
 }
 
 QString GammaCorrectionEffect::toString() const
@@ -303,39 +672,61 @@ BloomEffect::BloomEffect()
     bloomSaturation = 1.0f;
     originalIntensity = 1.0f;
     originalSaturation = 1.0f;
+
+    bloomIntensityLocation = -1;
+    bloomSaturationLocation = -1;
+    originalIntensityLocation = -1;
+    originalSaturationLocation = -1;
 }
 
 void BloomEffect::setBloomIntensity(float intensity)
 {
     bloomIntensity = intensity;
+    parametersChanged();
 }
 
 void BloomEffect::setBloomSaturation(float saturation)
 {
     bloomSaturation = saturation;
+    parametersChanged();
 }
 
 void BloomEffect::setOriginalIntensity(float intensity)
 {
     originalIntensity = intensity;
+    parametersChanged();
 }
 
 void BloomEffect::setOriginalSaturation(float saturation)
 {
     originalSaturation = saturation;
+    parametersChanged();
+}
+
+void BloomEffect::findEffectUniforms()
+{
+    bloomIntensityLocation = findUniform("bloomIntensity");
+    bloomSaturationLocation = findUniform("bloomSaturation");
+    originalIntensityLocation = findUniform("originalIntensity");
+    originalSaturationLocation = findUniform("originalSaturation");
 }
 
 void BloomEffect::setEffectUniforms()
 {
-    shaderProgram->setUniformValue("bloomIntensity", bloomIntensity);
-    shaderProgram->setUniformValue("bloomSaturation", bloomSaturation);
-    shaderProgram->setUniformValue("originalIntensity", originalIntensity);
-    shaderProgram->setUniformValue("originalSaturation", originalSaturation);
+    uniformProgram->setUniformValue(bloomIntensityLocation, bloomIntensity);
+    uniformProgram->setUniformValue(bloomSaturationLocation, bloomSaturation);
+    uniformProgram->setUniformValue(originalIntensityLocation, originalIntensity);
+    uniformProgram->setUniformValue(originalSaturationLocation, originalSaturation);
 }
 
 void BloomEffect::create()
 {
-    createEffect(":/shaders/effects/bloom.glsl");
+    createPointwiseEffect();
+}
+
+QString BloomEffect::getPointwiseSourceFile() const
+{
+    return QString(":/shaders/effects/bloom.glsl");
 }
 
 QString BloomEffect::toString() const
@@ -351,12 +742,21 @@ DepthOfFieldEffect::DepthOfFieldEffect()
 {
     fStop = 22.0f;
     focalLength = 10.0f;
+
+    fStopLocation = -1;
+    focalLengthLocation = -1;
+}
+
+void DepthOfFieldEffect::findEffectUniforms()
+{
+    focalLengthLocation = findUniform("focalLength");
+    fStopLocation = findUniform("fstop");
 }
 
 void DepthOfFieldEffect::setEffectUniforms()
 {
-    shaderProgram->setUniformValue("focalLength", focalLength);
-    shaderProgram->setUniformValue("fstop", fStop);
+    uniformProgram->setUniformValue(focalLengthLocation, focalLength);
+    uniformProgram->setUniformValue(fStopLocation, fStop);
 }
 
 void DepthOfFieldEffect::create()
@@ -370,3 +770,74 @@ QString DepthOfFieldEffect::toString() const
             .arg(fStop, 1, 'f', 2, '0')
             .arg(focalLength, 1, 'f', 2, '0');
 }
+
+FusedEffect::FusedEffect(const std::vector<PostProcessEffect*> &effects) : effects(effects)
+{
+}
+
+FusedEffect::~FusedEffect()
+{
+    for (auto effect = effects.begin(); effect != effects.end(); ++effect)
+        (*effect)->detachUniforms();
+}
+
+void FusedEffect::create()
+{
+    createEffectFromSource(generateSource(effects));
+}
+
+QString FusedEffect::generateSource(const std::vector<PostProcessEffect*> &effects)
+{
+    QString source = QStringLiteral(
+                "#version 400\n"
+                "\n"
+                "uniform sampler2D originalTexture;\n"
+                "uniform sampler2D chainedTexture;\n"
+                "uniform sampler2D depthTexture;\n"
+                "\n"
+                "uniform vec2 screenDimentions;\n"
+                "uniform vec2 texelSize;\n"
+                "\n"
+                "in vec2 texCoord;\n"
+                "out vec4 myfragcolor;\n");
+
+    QString main = QStringLiteral("\nvoid main(void)\n{\n    vec4 color = texture2D(chainedTexture, texCoord);\n");
+
+    for (size_t i = 0; i < effects.size(); ++i) {
+        QFile file(effects[i]->getPointwiseSourceFile());
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            qWarning() << "Cannot read" << file.fileName() << endl;
+            continue;
+        }
+
+        source += QString("\n// %1\n").arg(effects[i]->getProfileName());
+        source += QString::fromUtf8(file.readAll()).replace('$', prefix(i));
+
+        main += QString("    color = %1apply(color);\n").arg(prefix(i));
+    }
+
+    main += QStringLiteral("\n    myfragcolor = color;\n}\n");
+
+    return source + main;
+}
+
+void FusedEffect::findEffectUniforms()
+{
+    for (size_t i = 0; i < effects.size(); ++i)
+        effects[i]->attachUniforms(shaderProgram, prefix(i));
+}
+
+void FusedEffect::setEffectUniforms()
+{
+    for (auto effect = effects.begin(); effect != effects.end(); ++effect)
+        (*effect)->setEffectUniforms();
+}
+
+QString FusedEffect::toString() const
+{
+    QStringList names;
+    for (auto effect = effects.begin(); effect != effects.end(); ++effect)
+        names << (*effect)->getProfileName();
+
+    return names.join(" + ");
+}
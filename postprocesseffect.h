@@ -5,8 +5,12 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_3_Core>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
+#include <QSize>
+
+#include <vector>
 
 /// @brief Base class for all post-processing effects
 /// @remarks This is an abstract class, meaning that all effects must override at least the `create` and `setEffectUniforms` methods
@@ -30,21 +34,98 @@ public:
     /// @brief Converts this effect to a description string
     virtual QString toString() const = 0;
 
+    /// @brief Returns the name used to identify this effect in the frame profiler
+    const QString& getProfileName() const;
+
+    /// @brief Returns a counter that changes whenever a parameter that affects the output changes
+    unsigned int getRevision() const { return revision; }
+
+    /// @brief The smallest resolution effects can run at is the chain resolution halved this many times
+    static const int MAX_DOWNSAMPLE = 2;
+
+    /// @brief Sets the resolution the effect runs at, as the number of times the chain resolution is halved
+    /// @remarks Only worth it for effects with a low frequency output everywhere, such as blurs; the chain upsamples the result preserving depth edges
+    void setDownsample(int level);
+    int getDownsample() const { return downsample; }
+
+    /// @brief Returns whether the effect has a compute shader variant that the context can run
+    virtual bool hasComputePath() const { return computeProgram != nullptr; }
+
+    /// @brief Selects the compute shader variant instead of the fragment shader, if there is one
+    void setComputeEnabled(bool enabled);
+    bool isComputeEnabled() const { return computeEnabled; }
+
+    /// @brief Runs the compute shader variant, writing the output texture
+    /// @remarks The output must be a GL_RGBA8 texture of the given size, which is also the size of the input
+    void dispatch(GLuint original, GLuint input, GLuint depth, GLuint output, int width, int height);
+
+    /// @brief Returns whether the output at a pixel only depends on the chained color at that same pixel
+    /// @remarks Runs of point-wise effects are fused into a single pass by the chain
+    bool isPointwise() const { return !getPointwiseSourceFile().isEmpty(); }
+
 protected:
     /// @brief Creates the shaders
     void createEffect(const QString &fragmentShaderFile, const QString &vertexShaderFile = ":/shaders/effects/vshader.glsl");
+    /// @brief Creates the shaders from the source of a fragment shader
+    void createEffectFromSource(const QString &fragmentShaderSource, const QString &vertexShaderFile = ":/shaders/effects/vshader.glsl");
+    /// @brief Creates a point-wise effect alone in the shader generated for fused effects, so both use the same source
+    void createPointwiseEffect();
+    /// @brief Creates the compute shader variant, if the context supports compute shaders
+    /// @remarks Must be called after the fragment shader was created
+    void createComputeEffect(const QString &computeShaderFile);
     /// @brief Destroys the shaders
     void destroyEffect();
 
-    /// @brief Defines the effect uniforms
+    /// @brief Returns the number of work groups the compute shader needs for an output size
+    virtual QSize getWorkGroupCount(int width, int height) const { Q_UNUSED(width); Q_UNUSED(height); return QSize(); }
+
+    /// @brief Returns the file with the function of a point-wise effect, or an empty string if the effect needs a pass of its own
+    ///
+    /// The file defines `vec4 $apply(vec4 color)`, which receives the chained color at texCoord and returns the output color.
+    /// It may sample originalTexture and depthTexture anywhere, since those do not change along the chain.
+    /// Every global name starts with `$`, which is replaced by a prefix unique to each effect of the generated shader.
+    virtual QString getPointwiseSourceFile() const { return QString(); }
+
+    /// @brief Looks up the locations of the effect uniforms, once the program is linked
+    /// @remarks Use findUniform, so the locations are also found when the effect is part of a fused program
+    virtual void findEffectUniforms() {}
+
+    /// @brief Defines the effect uniforms in uniformProgram, using the locations found by findEffectUniforms
     virtual void setEffectUniforms() {}
 
+    /// @brief Returns the location of an uniform of this effect in uniformProgram
+    int findUniform(const char *name) const { return uniformProgram->uniformLocation(uniformPrefix + name); }
+
+    /// @brief Must be called by every setter, so a cached output of the chain is not presented after a parameter changes
+    void parametersChanged() { ++revision; }
+
+    /// @brief Returns the full resolution screen dimentions, whatever the downsampling of the effect
+    const QVector2D& getScreenDimentions() const { return screenDimentions; }
+
     QOpenGLShaderProgram *shaderProgram;
 
+    /// @brief The program that receives the effect uniforms: shaderProgram, or a fused program while the effect is part of one
+    QOpenGLShaderProgram *uniformProgram;
+
 private:
+    friend class FusedEffect;
+
+    /// @brief Links the compiled shaders and creates the full-screen quad
+    void linkEffect();
+
+    /// @brief Sends the effect uniforms to another program, under a prefix, and looks up their locations there
+    void attachUniforms(QOpenGLShaderProgram *program, const QString &prefix);
+
+    /// @brief Sends the effect uniforms back to its own program, the compute one if it is enabled
+    void detachUniforms();
+
     QOpenGLShader *vertexShader;
     QOpenGLShader *fragmentShader;
 
+    QOpenGLShaderProgram *computeProgram;
+    QOpenGLFunctions_4_3_Core *computeFunctions;
+    bool computeEnabled;
+
     QOpenGLVertexArrayObject *vao;
     QOpenGLBuffer *vboVertices;
     QOpenGLBuffer *vboIndices;
@@ -55,6 +136,21 @@ private:
     unsigned int *indices;
 
     QVector2D screenDimentions;
+
+    /// @brief The prefix of the effect uniforms in its own program
+    QString shaderPrefix;
+    /// @brief The prefix of the effect uniforms in uniformProgram
+    QString uniformPrefix;
+
+    int screenDimentionsLocation;
+    int texelSizeLocation;
+
+    /// @brief Cached profiler name, built on first use
+    mutable QString profileName;
+
+    unsigned int revision;
+
+    int downsample;
 };
 
 class PassthroughEffect : public PostProcessEffect
@@ -65,6 +161,62 @@ public:
     virtual QString toString() const;
 };
 
+/// @brief Reduces the chained texture for the effects that run at a lower resolution
+/// @remarks Used by the chain, which renders it at the reduced resolution
+class DownsampleEffect : public PostProcessEffect
+{
+public:
+    DownsampleEffect();
+
+    /// @brief Sets the number of times the source is halved, up to MAX_DOWNSAMPLE
+    void setLevel(int level);
+
+    /// @brief Sets the size in texels of the full resolution source
+    void setSourceSize(const QSize &size);
+
+    virtual void create();
+
+    virtual QString toString() const;
+
+protected:
+    virtual void findEffectUniforms();
+    virtual void setEffectUniforms();
+
+private:
+    int level;
+    QSize sourceSize;
+
+    int factorLocation;
+    int sourceTexelSizeLocation;
+};
+
+/// @brief Brings the output of reduced resolution effects back to full resolution
+///
+/// Each pixel weighs the four nearest reduced texels by their distance, as linear filtering would, and by how close their depth is to
+/// its own, so a blurred background does not bleed over a sharp foreground.
+/// @remarks Used by the chain
+class BilateralUpsampleEffect : public PostProcessEffect
+{
+public:
+    BilateralUpsampleEffect();
+
+    /// @brief Sets the size in texels of the reduced resolution source
+    void setSourceSize(const QSize &size);
+
+    virtual void create();
+
+    virtual QString toString() const;
+
+protected:
+    virtual void findEffectUniforms();
+    virtual void setEffectUniforms();
+
+private:
+    QSize sourceSize;
+
+    int sourceSizeLocation;
+};
+
 class EdgeDetectionEffect : public PostProcessEffect
 {
 public:
@@ -80,12 +232,22 @@ public:
 
     virtual QString toString() const;
 
+    /// @remarks The compute shader reads the original texture at the output size, so it is only used at full resolution
+    virtual bool hasComputePath() const;
+
 protected:
+    virtual QString getPointwiseSourceFile() const;
+    virtual void findEffectUniforms();
     virtual void setEffectUniforms();
 
+    virtual QSize getWorkGroupCount(int width, int height) const;
+
 private:
     bool addOriginal;
     float intensity;
+
+    int addOriginalLocation;
+    int intensityLocation;
 };
 
 class CrossStitchEffect : public PostProcessEffect
@@ -104,61 +266,64 @@ public:
     virtual QString toString() const;
 
 protected:
+    virtual void findEffectUniforms();
     virtual void setEffectUniforms();
 
 private:
     int inverted;
     float stitchSize;
+
+    int invertedLocation;
+    int stitchSizeLocation;
 };
 
 /// @brief This class defines a gaussian used for probability density function
 /// @remarks Since this is a PDF, the MI parameter is always set to zero.
-/// @remarks The sample count is hardcoded to 15.
+/// @remarks The sample count is hardcoded to 15, taken with 9 fetches by merging adjacent taps.
+/// @remarks Sigma is in full resolution pixels, so the blur looks the same at any resolution; it runs at half resolution by default.
 class GaussianBlurEffect : public PostProcessEffect
 {
 public:
-    GaussianBlurEffect() {
-        sigma = 1.0f;
-    }
-
-    void setSigma(float value) {
-        sigma = value;
-        calculateValues();
-    }
+    GaussianBlurEffect(const QVector2D &axis);
 
+    void setSigma(float value);
     float getSigma() const { return sigma; }
 
 protected:
-    float values[15];
+    /// @brief Offsets from the center, in target texels, and weights of the merged taps; index 0 is the center
+    float offsets[5];
+    float values[5];
+
+    /// @brief Weights of the taps at 0 to 7 texels from the center, used by the compute shader
+    float tapWeights[8];
 
+    virtual void findEffectUniforms();
     virtual void setEffectUniforms();
 
+    virtual QSize getWorkGroupCount(int width, int height) const;
+
 private:
-    void calculateValues() {
-        auto g = [this](float x) -> float {
-            // Square root of 2 PI
-            static float sqrt_2pi = 2.50662827463f;
-            return 1.0 / (sigma * sqrt_2pi) * expf(-0.5 * x * x / (sigma * sigma));
-        };
-
-        float weightSum = 0.0f;
-        int i;
-        for (i = 0; i < 15; ++i) {
-            values[i] = g(i - 7);
-            weightSum += values[i];
-        }
-
-        // Normalize the weights
-        for (i = 0; i < 15; ++i)
-            values[i] /= weightSum;
-    }
+    void calculateValues();
 
     float sigma;
+
+    /// @brief The blur axis, in texels
+    QVector2D axis;
+
+    /// @brief The downsampling the values were calculated for
+    int calculatedDownsample;
+
+    int blurDirectionLocation;
+    int blurAxisLocation;
+    int offsetsLocation;
+    int weightsLocation;
 };
 
 class HorizontalGaussianBlurEffect : public GaussianBlurEffect
 {
 public:
+    HorizontalGaussianBlurEffect() : GaussianBlurEffect(QVector2D(1.0f, 0.0f)) {}
+
     virtual void create();
 
     virtual QString toString() const;
@@ -167,6 +332,8 @@ public:
 class VerticalGaussianBlurEffect : public GaussianBlurEffect
 {
 public:
+    VerticalGaussianBlurEffect() : GaussianBlurEffect(QVector2D(0.0f, 1.0f)) {}
+
     virtual void create();
 
     virtual QString toString() const;
@@ -185,10 +352,14 @@ public:
     virtual QString toString() const;
 
 protected:
+    virtual QString getPointwiseSourceFile() const;
+    virtual void findEffectUniforms();
     virtual void setEffectUniforms();
 
 private:
     QVector3D gammaFactor;
+
+    int gammaFactorLocation;
 };
 
 class BloomEffect : public PostProcessEffect
@@ -213,6 +384,8 @@ public:
     virtual QString toString() const;
 
 protected:
+    virtual QString getPointwiseSourceFile() const;
+    virtual void findEffectUniforms();
     virtual void setEffectUniforms();
 
 private:
@@ -220,17 +393,23 @@ private:
     float bloomIntensity;
     float originalSaturation;
     float originalIntensity;
+
+    int bloomSaturationLocation;
+    int bloomIntensityLocation;
+    int originalSaturationLocation;
+    int originalIntensityLocation;
 };
 
+/// @remarks Runs at full resolution: the upsampled output of a reduced level replaces the whole frame, which would blur the in-focus areas too
 class DepthOfFieldEffect : public PostProcessEffect
 {
 public:
     DepthOfFieldEffect();
 
-    void setFStop(float fStop) { this->fStop = fStop; }
+    void setFStop(float fStop) { this->fStop = fStop; parametersChanged(); }
     float getFStop() const { return fStop; }
 
-    void setFocalLength(float length) { this->focalLength = length; }
+    void setFocalLength(float length) { this->focalLength = length; parametersChanged(); }
     float getFocalLength() const { return focalLength; }
 
     virtual void create();
@@ -238,11 +417,46 @@ public:
     virtual QString toString() const;
 
 protected:
+    virtual void findEffectUniforms();
     virtual void setEffectUniforms();
 
 private:
     float fStop;
     float focalLength;
+
+    int fStopLocation;
+    int focalLengthLocation;
+};
+
+/// @brief A single pass running a run of point-wise effects at the same resolution, built by the chain
+///
+/// The generated fragment shader reads the chained texture once and passes the color through the `apply` function of each effect in turn,
+/// so the intermediate colors never go through memory.
+/// @remarks The fused effect does not take the ownership of the effects; their uniforms go to the fused program until it is deleted
+class FusedEffect : public PostProcessEffect
+{
+public:
+    FusedEffect(const std::vector<PostProcessEffect*> &effects);
+    virtual ~FusedEffect();
+
+    virtual void create();
+
+    virtual QString toString() const;
+
+    const std::vector<PostProcessEffect*>& getEffects() const { return effects; }
+
+    /// @brief Generates a fragment shader that applies the point-wise effects in order
+    static QString generateSource(const std::vector<PostProcessEffect*> &effects);
+
+    /// @brief Returns the prefix given to the global names of the effect at an index of a generated shader
+    static QString prefix(int index) { return QString("e%1_").arg(index); }
+
+protected:
+    virtual void findEffectUniforms();
+    virtual void setEffectUniforms();
+
+private:
+    std::vector<PostProcessEffect*> effects;
 };
 
 #endif // POSTPROCESSEFFECT_H
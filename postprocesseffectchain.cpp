@@ -2,102 +2,117 @@
 
 #include <cassert>
 
+#include <QDebug>
+
 PostProcessEffectChain::PostProcessEffectChain()
 {
-    currentFbo = 0;
-
-    fbo = 0;
     oldFbo = 0;
-    fboSize = 0;
-    textures[0] = textures[1] = textures[2] = textures[3] = 0;
+    sceneFbo = 0;
+    sceneColor = nullptr;
+    sceneDepth = nullptr;
+    output = nullptr;
+    renderScale = 1.0f;
+
     final = nullptr;
+    downsampleEffect = nullptr;
+    upsampleEffect = nullptr;
+    profiler = nullptr;
+
+    structureRevision = 0;
+    renderedRevision = 0;
+    outputValid = false;
+
+    passesPlanned = false;
+    fusionEnabled = true;
+    computeEnabled = true;
 }
 
 PostProcessEffectChain::~PostProcessEffectChain()
 {
+    releasePasses();
     delete final;
+    delete downsampleEffect;
+    delete upsampleEffect;
 
     destroy();
+    targetPool.clear();
 }
 
-void PostProcessEffectChain::create(int size)
+void PostProcessEffectChain::create(const QSize &size)
 {
-    if (fboSize == size) return;
+    if (renderSize == size) return;
 
     destroy();
 
-    fboSize = size;
-
-    // Create the FBO
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER_EXT, fbo);
-
-    // Create the FBO textures
-    glGenTextures(4, textures);
-
-    for (int i = 0; i < 3; ++i) {
-        glBindTexture(GL_TEXTURE_2D, textures[i]);
-        // If wrapping, repeat the texture in both S and T coordinates
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set linear interpolation on the texture sampling
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // Create the texture
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        // And attach it to the framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT + i, GL_TEXTURE_2D, textures[i], 0);
-    }
+    renderSize = size;
+    outputValid = false;
+
+    // The scene is kept between frames, so it can be post-processed again without drawing it
+    sceneColor = targetPool.acquire(size.width(), size.height(), GL_RGBA8);
+    sceneDepth = targetPool.acquire(size.width(), size.height(), GL_DEPTH_COMPONENT24);
 
-    // Create a texture for depth buffer
-    glBindTexture(GL_TEXTURE_2D, textures[3]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    // Create the texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL);
-    // Attach it to the FBO
-    glFramebufferTexture2D(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[3], 0);
+    glGenFramebuffers(1, &sceneFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor->texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth->texture, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER_EXT, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        qWarning() << "Incomplete FBO; status " << status;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void PostProcessEffectChain::destroy()
 {
-    if (textures[0] != 0) {
-        glDeleteTextures(4, textures);
-        textures[0] = textures[1] = textures[2] = textures[3] = 0;
+    releaseOutput();
+
+    // The pool deletes them once they stay unused, unless a window of the same size comes back first
+    if (sceneColor) {
+        targetPool.release(sceneColor);
+        sceneColor = nullptr;
+    }
+
+    if (sceneDepth) {
+        targetPool.release(sceneDepth);
+        sceneDepth = nullptr;
     }
 
-    if (fbo != 0) {
-        glDeleteFramebuffers(1, &fbo);
-        fbo = 0;
+    if (sceneFbo != 0) {
+        glDeleteFramebuffers(1, &sceneFbo);
+        sceneFbo = 0;
     }
+
+    renderSize = QSize();
 }
 
 void PostProcessEffectChain::resize(QVector2D screenDimentions)
 {
-    // Find the largest potency-of-two dimention
-    int size = 1;
-    for (; size < screenDimentions.x(); size <<= 1) {}
-    for (; size < screenDimentions.y(); size <<= 1) {}
-
     this->screenDimentions = screenDimentions;
 
-    // And recreate the FBOs
+    QSize size(qMax(1, qRound(screenDimentions.x() * renderScale)), qMax(1, qRound(screenDimentions.y() * renderScale)));
+
+    // And recreate the scene targets
     create(size);
 
-    // And forward this new size to the effects
+    // And forward this new size to the effects, which run at the render size
+    QVector2D dimentions(size.width(), size.height());
     for (auto &effect : activeEffects)
-        effect->setScreenDimentions(screenDimentions);
+        effect->setScreenDimentions(dimentions);
+    for (auto &effect : fusedEffects)
+        effect->setScreenDimentions(dimentions);
+}
+
+void PostProcessEffectChain::setRenderScale(float scale)
+{
+    renderScale = qBound(0.25f, scale, 2.0f);
 }
 
 void PostProcessEffectChain::addEffect(PostProcessEffect *effect)
 {
     activeEffects.push_back(effect);
+    ++structureRevision;
+    passesPlanned = false;
 }
 
 void PostProcessEffectChain::insert(unsigned int index, PostProcessEffect *effect)
@@ -105,23 +120,34 @@ void PostProcessEffectChain::insert(unsigned int index, PostProcessEffect *effec
     assert(index <= activeEffects.size() && "Index out of bounds");
 
     activeEffects.insert(activeEffects.begin() + index, effect);
+    ++structureRevision;
+    passesPlanned = false;
 }
 
 void PostProcessEffectChain::clear()
 {
+    releasePasses();
+
     for (auto i = activeEffects.begin(); i != activeEffects.end(); ++i) {
+        // Keep the revision of the removed effects, so getRevision never goes back to an earlier value
+        structureRevision += (*i)->getRevision();
         delete *i;
     }
 
     activeEffects.clear();
+    ++structureRevision;
 }
 
 void PostProcessEffectChain::remove(int index)
 {
     assert(index < activeEffects.size() && "Index out of bounds");
 
+    releasePasses();
+
     auto i = activeEffects.begin() + index;
 
+    structureRevision += (*i)->getRevision() + 1;
+
     delete *i;
 
     activeEffects.erase(i);
@@ -140,23 +166,15 @@ void PostProcessEffectChain::beginScene()
 
     glEnable(GL_DEPTH_TEST);
 
-    // Set the viewport size as the FBO's size
-    glViewport(0, 0, fboSize, fboSize);
+    // Set the viewport size as the render size
+    glViewport(0, 0, renderSize.width(), renderSize.height());
 
     // Render to our framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER_EXT, fbo);
-
-    GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
-    if (status != GL_FRAMEBUFFER_COMPLETE)
-        qWarning() << "Incomplete FBO; status " << status;
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
 
-    GLenum attachment = GL_COLOR_ATTACHMENT0_EXT;
+    GLenum attachment = GL_COLOR_ATTACHMENT0;
     glDrawBuffers(1, &attachment);
 
-    status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
-    if (status != GL_FRAMEBUFFER_COMPLETE)
-        qWarning() << "Incomplete FBO; status " << status;
-
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
@@ -167,48 +185,232 @@ void PostProcessEffectChain::endScene()
 
 void PostProcessEffectChain::render()
 {
-    assert(fbo != 0 && "Effect chain FBO uninitialized");
+    assert(sceneFbo != 0 && "Effect chain FBO uninitialized");
 
-    currentFbo = 0;
+    if (!passesPlanned || downsampleChanged())
+        planPasses();
 
-    GLenum attachment;
+    FrameProfiler::Scope chainScope(profiler, QStringLiteral("Post-process"));
 
-    attachment = GL_COLOR_ATTACHMENT1_EXT;
-    glDrawBuffers(1, &attachment);
-    final->render(textures[0], textures[0], textures[0]);
-
-    // Iterate through all effects
-    for (auto &effect : activeEffects) {
-        // If the current effect is at an odd index, write to texture#1, else, to texture#2
-        attachment = GL_COLOR_ATTACHMENT2_EXT - (currentFbo % 2);
-        glDrawBuffers(1, &attachment);
-        // Use the texture#0 as the original texture and, if the current effect is at an odd index, use texture #2 as input, else, use texture #1
-        effect->render(textures[0], textures[currentFbo % 2 + 1], textures[3]);
-        ++currentFbo;
+    // The previous output was only kept for present
+    releaseOutput();
+
+    // The first pass reads the scene directly
+    RenderTarget *current = sceneColor;
+
+    // The downsampling level of the last pass; consecutive passes at the same level stay at its size
+    int level = 0;
+
+    // Iterate through all passes
+    for (auto &effect : passes) {
+        if (effect->getDownsample() != level) {
+            if (level > 0) {
+                upsampleEffect->setSourceSize(getLevelSize(level));
+                current = runPass(upsampleEffect, QStringLiteral("Upsample"), current, 0);
+            }
+
+            level = effect->getDownsample();
+
+            if (level > 0) {
+                downsampleEffect->setLevel(level);
+                downsampleEffect->setSourceSize(renderSize);
+                current = runPass(downsampleEffect, QStringLiteral("Downsample"), current, level);
+            }
+        }
+
+        current = runPass(effect, effect->getProfileName(), current, level);
+    }
+
+    if (level > 0) {
+        upsampleEffect->setSourceSize(getLevelSize(level));
+        current = runPass(upsampleEffect, QStringLiteral("Upsample"), current, 0);
     }
 
+    output = current;
+
     // Reset our state
-    attachment = GL_COLOR_ATTACHMENT0_EXT;
-    glDrawBuffers(1, &attachment);
-    glBindFramebuffer(GL_FRAMEBUFFER_EXT, oldFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, oldFbo);
+
+    targetPool.endFrame();
+
+    renderedRevision = getRevision();
+    outputValid = true;
+
+    present();
+}
+
+RenderTarget *PostProcessEffectChain::runPass(PostProcessEffect *effect, const QString &name, RenderTarget *input, int level)
+{
+    FrameProfiler::Scope scope(profiler, name);
+
+    QSize size = getLevelSize(level);
+    RenderTarget *target = targetPool.acquire(size.width(), size.height());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glViewport(0, 0, size.width(), size.height());
+
+    if (effect->isComputeEnabled())
+        effect->dispatch(sceneColor->texture, input->texture, sceneDepth->texture, target->texture, size.width(), size.height());
+    else
+        effect->render(sceneColor->texture, input->texture, sceneDepth->texture);
+
+    // The input was only needed by this pass, unless it is the scene
+    if (input != sceneColor)
+        targetPool.release(input);
+
+    return target;
+}
+
+void PostProcessEffectChain::releaseOutput()
+{
+    if (output && output != sceneColor)
+        targetPool.release(output);
+
+    output = nullptr;
+}
+
+void PostProcessEffectChain::rerender()
+{
+    assert(sceneFbo != 0 && "Effect chain FBO uninitialized");
+
+    // The scene is kept in its target, so only the framebuffer to restore is needed
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &oldFbo);
+
+    render();
+}
+
+void PostProcessEffectChain::present()
+{
+    if (!output)
+        return;
+
+    FrameProfiler::Scope presentScope(profiler, QStringLiteral("Present"));
 
     glViewport(0, 0, screenDimentions.x(), screenDimentions.y());
+    final->render(output->texture, output->texture, output->texture);
+}
+
+void PostProcessEffectChain::setFusionEnabled(bool enabled)
+{
+    if (fusionEnabled == enabled)
+        return;
+
+    fusionEnabled = enabled;
+    releasePasses();
+}
+
+void PostProcessEffectChain::setComputeEnabled(bool enabled)
+{
+    if (computeEnabled == enabled)
+        return;
+
+    computeEnabled = enabled;
+    releasePasses();
+}
 
-    final->render(getOutputTexture(), getOutputTexture(), getOutputTexture());
+void PostProcessEffectChain::planPasses()
+{
+    releasePasses();
+
+    for (auto effect = activeEffects.begin(); effect != activeEffects.end();) {
+        int level = (*effect)->getDownsample();
+
+        // A run must stay at the same resolution
+        auto runEnd = effect;
+        if (fusionEnabled) {
+            while (runEnd != activeEffects.end() && (*runEnd)->isPointwise() && (*runEnd)->getDownsample() == level)
+                ++runEnd;
+        }
+
+        // A single effect, or a run of one, keeps its own program, the compute one if it has it
+        if (runEnd - effect < 2) {
+            (*effect)->setComputeEnabled(computeEnabled && (*effect)->hasComputePath());
+            passes.push_back(*effect);
+            ++effect;
+            continue;
+        }
+
+        // Fusing saves a whole pass, which is worth more than the compute variant of one of the effects
+        for (auto member = effect; member != runEnd; ++member)
+            (*member)->setComputeEnabled(false);
+
+        FusedEffect *fused = new FusedEffect(std::vector<PostProcessEffect*>(effect, runEnd));
+        fused->create();
+        fused->setScreenDimentions(QVector2D(renderSize.width(), renderSize.height()));
+        fused->setDownsample(level);
+
+        fusedEffects.push_back(fused);
+        passes.push_back(fused);
+        effect = runEnd;
+    }
+
+    for (auto effect = activeEffects.begin(); effect != activeEffects.end(); ++effect)
+        plannedDownsample.push_back((*effect)->getDownsample());
+
+    passesPlanned = true;
+}
+
+bool PostProcessEffectChain::downsampleChanged() const
+{
+    for (size_t i = 0; i < activeEffects.size(); ++i) {
+        if (activeEffects[i]->getDownsample() != plannedDownsample[i])
+            return true;
+    }
+
+    return false;
+}
+
+qint64 PostProcessEffectChain::getBytesSaved() const
+{
+    qint64 bytes = 0;
+    for (auto fused = fusedEffects.begin(); fused != fusedEffects.end(); ++fused) {
+        QSize size = getLevelSize((*fused)->getDownsample());
+        bytes += (qint64)((*fused)->getEffects().size() - 1) * 2 * 4 * size.width() * size.height();
+    }
+
+    return bytes;
+}
+
+void PostProcessEffectChain::releasePasses()
+{
+    for (auto fused = fusedEffects.begin(); fused != fusedEffects.end(); ++fused)
+        delete *fused;
+
+    fusedEffects.clear();
+    passes.clear();
+    plannedDownsample.clear();
+    passesPlanned = false;
+}
+
+unsigned int PostProcessEffectChain::getRevision() const
+{
+    // Revisions only grow, so the sum changes whenever any of them does
+    unsigned int revision = structureRevision;
+    for (auto effect = activeEffects.begin(); effect != activeEffects.end(); ++effect)
+        revision += (*effect)->getRevision();
+
+    return revision;
 }
 
 GLuint PostProcessEffectChain::getOutputTexture()
 {
-    return textures[currentFbo % 2 + 1];
+    return output ? output->texture : 0;
 }
 
 void PostProcessEffectChain::initializeGL()
 {
     initializeOpenGLFunctions();
+    targetPool.initializeGL();
 
     final = new PassthroughEffect;
     final->create();
 
+    downsampleEffect = new DownsampleEffect;
+    downsampleEffect->create();
+
+    upsampleEffect = new BilateralUpsampleEffect;
+    upsampleEffect->create();
+
     // Add some effects to test
     EdgeDetectionEffect *edgeEffect = new EdgeDetectionEffect;
     edgeEffect->setAdditive(true);
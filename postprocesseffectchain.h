@@ -1,11 +1,14 @@
 #ifndef POSTPROCESSEFFECTCHAIN_H
 #define POSTPROCESSEFFECTCHAIN_H
 
+#include "frameprofiler.h"
 #include "postprocesseffect.h"
+#include "rendertargetpool.h"
 
 #include <QOpenGLFunctions_4_0_Core>
 
 #include <deque>
+#include <vector>
 
 /// @brief Defines a chain of post-processing effects
 class PostProcessEffectChain : private QOpenGLFunctions_4_0_Core
@@ -14,19 +17,22 @@ public:
     PostProcessEffectChain();
     ~PostProcessEffectChain();
 
-    /// @brief Initializes the effect chain's Framebuffer Objects
-    ///
-    /// This will allocate the Framebuffer Objects with the specified square dimention
-    void create(int size);
+    /// @brief Initializes the render targets of the scene with the specified size
+    void create(const QSize &size);
 
-    /// @brief Destroys the effect chain's Framebuffer Objects
+    /// @brief Gives the render targets of the scene back to the pool
     void destroy();
 
-    /// @brief Resizes the FBOs
+    /// @brief Resizes the render targets
     ///
-    /// This will get the largest dimention and round up to a potency of two
+    /// The scene and the effects are rendered at the screen dimentions multiplied by the render scale
     void resize(QVector2D screenDimentions);
 
+    /// @brief Sets the size of the rendered scene relative to the screen, from 0.25 to 2
+    /// @remarks Takes effect at the next resize
+    void setRenderScale(float scale);
+    float getRenderScale() const { return renderScale; }
+
     /// @brief Adds an already created effect to the end of the chain
     void addEffect(PostProcessEffect *effect);
 
@@ -45,7 +51,7 @@ public:
     PostProcessEffect *at(int index);
 
     /// @brief Prepares to render to the ''original'' FBO
-    /// @remarks This will call ''glViewport'' to the FBO size, so it must be reset to the window dimentions later.
+    /// @remarks This will call ''glViewport'' to the render size, so it must be reset to the window dimentions later.
     void beginScene();
 
     /// @brief Finishes the rendering to the ''original'' FBO
@@ -54,6 +60,16 @@ public:
     /// @brief Renders the effect chain
     void render();
 
+    /// @brief Renders the effect chain again over the scene of the last frame, without beginScene and endScene
+    /// @remarks Use when only the effects changed; the scene is kept in the ''original'' texture
+    void rerender();
+
+    /// @brief Draws the output of the last render to the current framebuffer, without running the effects
+    void present();
+
+    /// @brief Returns whether the output of the last render is still valid for the current effects and size
+    bool isOutputCurrent() const { return outputValid && renderedRevision == getRevision(); }
+
     /// @brief Returns the output of the chain
     GLuint getOutputTexture();
 
@@ -64,32 +80,110 @@ public:
     /// @remarks Useable only to view the effects
     const std::deque<PostProcessEffect*>& getActiveEffects() const { return activeEffects; }
 
-    /// @brief Returns the size of the textures
-    int getTextureSize() const { return fboSize; }
+    /// @brief Returns the size of the scene and of the full resolution effects
+    const QSize& getRenderSize() const { return renderSize; }
+
+    /// @brief Returns the pool the render targets of the effects come from
+    const RenderTargetPool& getTargetPool() const { return targetPool; }
+
+    /// @brief Sets the profiler used to time each effect, or nullptr to disable it
+    void setProfiler(FrameProfiler *profiler) { this->profiler = profiler; }
+
+    /// @brief Enables or disables fusing runs of point-wise effects into a single pass (enabled by default)
+    void setFusionEnabled(bool enabled);
+    bool isFusionEnabled() const { return fusionEnabled; }
+
+    /// @brief Enables or disables the compute shader variants of the effects that have them (enabled by default)
+    /// @remarks The variants are only used when the context supports compute shaders
+    void setComputeEnabled(bool enabled);
+    bool isComputeEnabled() const { return computeEnabled; }
+
+    /// @brief Returns the number of passes the effects took in the last render, not counting resampling and the presentation
+    int getPassCount() const { return passesPlanned ? passes.size() : activeEffects.size(); }
+
+    /// @brief Returns the number of passes saved by fusion in the last render
+    int getPassesSaved() const { return passesPlanned ? activeEffects.size() - passes.size() : 0; }
+
+    /// @brief Returns the texture bandwidth saved by fusion in every frame
+    /// @remarks Each saved pass would have written a texture and read it back in the next pass
+    qint64 getBytesSaved() const;
 
 private:
-    /// @brief The framebuffer object used for ''input'', ''output'', ''original'' and ''depth''
-    GLuint fbo;
+    /// @brief Groups the active effects into passes, fusing runs of point-wise effects
+    void planPasses();
+
+    /// @brief Deletes the fused effects, so the active effects use their own programs again
+    void releasePasses();
+
+    /// @brief Returns whether an effect changed its resolution since the passes were planned
+    bool downsampleChanged() const;
+
+    /// @brief Returns the size of the targets of a downsampling level
+    QSize getLevelSize(int level) const
+    {
+        int round = (1 << level) - 1;
+        return QSize(qMax(1, (renderSize.width() + round) >> level), qMax(1, (renderSize.height() + round) >> level));
+    }
+
+    /// @brief Renders an effect to a new target of a level, releasing its input
+    RenderTarget *runPass(PostProcessEffect *effect, const QString &name, RenderTarget *input, int level);
+
+    /// @brief Gives the output of the last render back to the pool
+    void releaseOutput();
+
+    /// @brief Returns a counter that changes whenever the effects, their parameters or the textures change
+    unsigned int getRevision() const;
+
+    /// @brief The framebuffer object the scene is rendered to, with the ''original'' and ''depth'' targets
+    GLuint sceneFbo;
 
     /// @brief The previous framebuffer object, removed at beginScene() and restored at endScene()
     GLint oldFbo;
 
-    /// @brief The textures that are stored in the FBO
-    GLuint textures[4];
+    RenderTargetPool targetPool;
+
+    RenderTarget *sceneColor;
+    RenderTarget *sceneDepth;
 
-    /// @brief The size of the FBO textures
-    int fboSize;
+    /// @brief The output of the last render, kept until the next one; the scene itself when there are no effects
+    RenderTarget *output;
 
-    /// @brief The fbo attachment index that will be used for ''input''
-    unsigned int currentFbo;
+    /// @brief The size of the scene targets
+    QSize renderSize;
+    float renderScale;
 
     /// @brief The effects on this chain
     std::deque<PostProcessEffect*> activeEffects;
 
+    /// @brief The effects run by render, each in a pass: either an active effect or a fused run of them
+    std::vector<PostProcessEffect*> passes;
+
+    /// @brief The fused effects in passes, owned by the chain
+    std::vector<FusedEffect*> fusedEffects;
+
+    /// @brief The downsampling of each active effect when the passes were planned
+    std::vector<int> plannedDownsample;
+
+    /// @brief Whether passes match the active effects
+    bool passesPlanned;
+    bool fusionEnabled;
+    bool computeEnabled;
+
     /// @brief The passthrough effect, used to display the chain
     PassthroughEffect *final;
 
+    DownsampleEffect *downsampleEffect;
+    BilateralUpsampleEffect *upsampleEffect;
+
     QVector2D screenDimentions;
+
+    FrameProfiler *profiler;
+
+    /// @brief Incremented when effects are added or removed, or the textures are recreated
+    unsigned int structureRevision;
+    /// @brief The revision of the last render
+    unsigned int renderedRevision;
+    bool outputValid;
 };
 
 #endif // POSTPROCESSEFFECTCHAIN_H
@@ -0,0 +1,137 @@
+#include "rendertargetpool.h"
+
+#include <QDebug>
+
+#include <cassert>
+
+static bool isDepthFormat(GLenum format)
+{
+    return format == GL_DEPTH_COMPONENT || format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F;
+}
+
+static int bytesPerTexel(GLenum format)
+{
+    switch (format) {
+    case GL_R8:
+        return 1;
+    case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RGBA16F:
+        return 8;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+RenderTargetPool::RenderTargetPool()
+{
+    frame = 0;
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    clear();
+}
+
+void RenderTargetPool::initializeGL()
+{
+    initializeOpenGLFunctions();
+}
+
+RenderTarget *RenderTargetPool::acquire(int width, int height, GLenum format)
+{
+    for (auto i = targets.begin(); i != targets.end(); ++i) {
+        RenderTarget *target = *i;
+        if (!target->inUse && target->width == width && target->height == height && target->format == format) {
+            target->inUse = true;
+            return target;
+        }
+    }
+
+    RenderTarget *target = new RenderTarget;
+    target->width = width;
+    target->height = height;
+    target->format = format;
+    target->inUse = true;
+    target->lastUsed = frame;
+
+    bool depth = isDepthFormat(format);
+
+    glGenTextures(1, &target->texture);
+    glBindTexture(GL_TEXTURE_2D, target->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Depth is never filtered; colors are, so effects can sample between texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+    if (depth)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, depth ? GL_DEPTH_COMPONENT : GL_RGBA, depth ? GL_FLOAT : GL_UNSIGNED_BYTE, NULL);
+
+    glGenFramebuffers(1, &target->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+
+    if (depth) {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        qWarning() << "Incomplete render target" << width << "x" << height << "; status " << status;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    targets.push_back(target);
+    return target;
+}
+
+void RenderTargetPool::release(RenderTarget *target)
+{
+    assert(target->inUse && "Render target released twice");
+
+    target->inUse = false;
+    target->lastUsed = frame;
+}
+
+void RenderTargetPool::endFrame()
+{
+    for (auto i = targets.begin(); i != targets.end();) {
+        RenderTarget *target = *i;
+        if (!target->inUse && frame - target->lastUsed >= IDLE_FRAMES) {
+            destroyTarget(target);
+            i = targets.erase(i);
+        } else {
+            ++i;
+        }
+    }
+
+    ++frame;
+}
+
+void RenderTargetPool::clear()
+{
+    for (auto i = targets.begin(); i != targets.end(); ++i)
+        destroyTarget(*i);
+
+    targets.clear();
+}
+
+qint64 RenderTargetPool::getMemoryUsage() const
+{
+    qint64 bytes = 0;
+    for (auto i = targets.begin(); i != targets.end(); ++i)
+        bytes += (qint64)(*i)->width * (*i)->height * bytesPerTexel((*i)->format);
+
+    return bytes;
+}
+
+void RenderTargetPool::destroyTarget(RenderTarget *target)
+{
+    glDeleteFramebuffers(1, &target->fbo);
+    glDeleteTextures(1, &target->texture);
+    delete target;
+}
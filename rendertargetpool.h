@@ -0,0 +1,79 @@
+#ifndef RENDERTARGETPOOL_H
+#define RENDERTARGETPOOL_H
+
+#include <QOpenGLFunctions_4_0_Core>
+
+#include <vector>
+
+/**
+ * @brief A texture with a framebuffer object that renders to it
+ */
+struct RenderTarget
+{
+    GLuint texture;
+    GLuint fbo;
+
+    int width;
+    int height;
+    GLenum format;
+
+    bool inUse;
+    /// @brief The pool frame in which the target was last released
+    qint64 lastUsed;
+};
+
+/**
+ * @brief Hands out render targets, reusing the released ones with the same size and format
+ *
+ * Passes acquire their output and release their input as soon as it was read, so effects with different resolutions share a few
+ * textures instead of each owning theirs. Targets left unused for a few frames, such as the ones of an old window size, are deleted
+ * by endFrame.
+ */
+class RenderTargetPool : protected QOpenGLFunctions_4_0_Core
+{
+public:
+    RenderTargetPool();
+    ~RenderTargetPool();
+
+    void initializeGL();
+
+    /**
+     * @brief Returns a free target with the size and internal format, creating it if there is none
+     * @remarks Depth formats are attached to the depth attachment of the framebuffer object
+     */
+    RenderTarget *acquire(int width, int height, GLenum format = GL_RGBA8);
+
+    /**
+     * @brief Gives a target back to the pool; its contents may be overwritten by the next acquire
+     */
+    void release(RenderTarget *target);
+
+    /**
+     * @brief Deletes the free targets that were not used in the last IDLE_FRAMES frames
+     */
+    void endFrame();
+
+    /**
+     * @brief Deletes all targets, including the ones in use
+     */
+    void clear();
+
+    int getTargetCount() const { return targets.size(); }
+
+    /// @brief Returns an estimate of the memory used by the textures of all targets, in bytes
+    qint64 getMemoryUsage() const;
+
+private:
+    RenderTargetPool(const RenderTargetPool&);
+    RenderTargetPool& operator=(const RenderTargetPool&);
+
+    static const int IDLE_FRAMES = 3;
+
+    void destroyTarget(RenderTarget *target);
+
+    std::vector<RenderTarget*> targets;
+
+    qint64 frame;
+};
+
+#endif // RENDERTARGETPOOL_H
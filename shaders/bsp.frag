@@ -11,8 +11,18 @@ out vec4 outColor;
 
 uniform sampler2D albedoTexture;
 uniform sampler2D lightmapTexture;
-uniform vec3 lightColor;
-uniform float lightIntensity;
+
+// Updated once per frame; must match BSP::FrameUniforms and the block in bsp.vert
+layout(std140) uniform FrameData
+{
+    mat4 modelView;
+    mat4 projectionMatrix;
+    mat3 normalMatrix;
+    vec3 lightDirection;
+    vec3 lightColor;
+    float lightIntensity;
+    float time;
+};
 
 void main(void)
 {
@@ -13,10 +13,103 @@ out vec2 fTexCoord;
 out vec2 fLightmap;
 out vec4 fColor;
 
-uniform mat4 modelView;
-uniform mat3 normalMatrix;
-uniform mat4 projectionMatrix;
-uniform vec3 lightDirection;
+// Must match BSPTcMod::Type and BSPTcMod::Wave
+#define TCMOD_NONE 0
+#define TCMOD_SCROLL 1
+#define TCMOD_SCALE 2
+#define TCMOD_ROTATE 3
+#define TCMOD_TURBULENT 4
+#define TCMOD_STRETCH 5
+
+#define WAVE_SIN 0
+#define WAVE_TRIANGLE 1
+#define WAVE_SQUARE 2
+#define WAVE_SAWTOOTH 3
+#define WAVE_INVERSE_SAWTOOTH 4
+
+#define MAX_TCMODS 4
+#define TWO_PI 6.28318530718
+
+// Updated once per frame; must match BSP::FrameUniforms and the block in bsp.frag
+layout(std140) uniform FrameData
+{
+    mat4 modelView;
+    mat4 projectionMatrix;
+    mat3 normalMatrix;
+    vec3 lightDirection;
+    vec3 lightColor;
+    float lightIntensity;
+    float time;
+};
+
+// The range of the material of the surface being drawn; must match BSP::MaterialUniforms
+layout(std140) uniform MaterialData
+{
+    ivec4 tcModTypes;
+    vec4 tcModParameters[2 * MAX_TCMODS];
+};
+
+// The depth pre-pass computes the position in bsp_depth.vert, and this pass tests for equal depth
+invariant gl_Position;
+
+float evaluateWave(int wave, float base, float amplitude, float phase, float frequency)
+{
+    float x = fract(phase + time * frequency);
+    float value;
+
+    if (wave == WAVE_TRIANGLE)
+        value = x < 0.25 ? 4.0 * x : (x < 0.75 ? 2.0 - 4.0 * x : 4.0 * x - 4.0);
+    else if (wave == WAVE_SQUARE)
+        value = x < 0.5 ? 1.0 : -1.0;
+    else if (wave == WAVE_SAWTOOTH)
+        value = x;
+    else if (wave == WAVE_INVERSE_SAWTOOTH)
+        value = 1.0 - x;
+    else
+        value = sin(x * TWO_PI);
+
+    return base + amplitude * value;
+}
+
+// Applies the modifiers in order, with the same formulas as the Quake 3 renderer
+vec2 applyTcMods(vec2 st)
+{
+    for (int i = 0; i < MAX_TCMODS; ++i) {
+        int type = tcModTypes[i];
+        if (type == TCMOD_NONE)
+            break;
+
+        vec4 a = tcModParameters[2 * i];
+        vec4 b = tcModParameters[2 * i + 1];
+
+        if (type == TCMOD_SCROLL) {
+            // Wrapped, so the offset keeps its precision however long the map runs
+            st += fract(a.xy * time);
+        }
+        else if (type == TCMOD_SCALE) {
+            st *= a.xy;
+        }
+        else if (type == TCMOD_ROTATE) {
+            float angle = radians(-a.x * time);
+            float s = sin(angle);
+            float c = cos(angle);
+            st = vec2(st.x * c - st.y * s + 0.5 - 0.5 * c + 0.5 * s,
+                      st.x * s + st.y * c + 0.5 - 0.5 * s - 0.5 * c);
+        }
+        else if (type == TCMOD_TURBULENT) {
+            float now = a.z + time * a.w;
+            st += a.y * vec2(sin(((vPosition.x + vPosition.z) / 1024.0 + now) * TWO_PI),
+                             sin((vPosition.y / 1024.0 + now) * TWO_PI));
+        }
+        else if (type == TCMOD_STRETCH) {
+            float wave = evaluateWave(int(a.x), a.y, a.z, a.w, b.x);
+            float p = abs(wave) > 0.0001 ? 1.0 / wave : 1.0;
+            st = (st - 0.5) * p + 0.5;
+        }
+    }
+
+    return st;
+}
 
 void main(void)
 {
@@ -25,10 +118,9 @@ void main(void)
     fN = normalMatrix * vNormal;
     fL = lightDirection;
     fE = -eyePosition.xyz;
-    fTexCoord = vTexCoord;
+    fTexCoord = applyTcMods(vTexCoord);
     fLightmap = vLightmapCoord;
     fColor = vColor;
 
     gl_Position = projectionMatrix * eyePosition;
 }
-
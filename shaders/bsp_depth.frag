@@ -0,0 +1,6 @@
+#version 400
+
+// Only the depth is written; the color writes are masked by the pre-pass
+void main(void)
+{
+}
@@ -0,0 +1,23 @@
+#version 400
+
+in vec3 vPosition;
+
+// Must match BSP::FrameUniforms and the block in bsp.vert
+layout(std140) uniform FrameData
+{
+    mat4 modelView;
+    mat4 projectionMatrix;
+    mat3 normalMatrix;
+    vec3 lightDirection;
+    vec3 lightColor;
+    float lightIntensity;
+    float time;
+};
+
+// The shading pass tests for equal depth, so the position must be computed exactly as in bsp.vert
+invariant gl_Position;
+
+void main(void)
+{
+    gl_Position = projectionMatrix * (modelView * vec4(vPosition, 1.0));
+}
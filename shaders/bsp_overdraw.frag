@@ -0,0 +1,9 @@
+#version 400
+
+out vec4 outColor;
+
+// Added once per fragment: the channels saturate one after the other, from red through yellow to white
+void main(void)
+{
+    outColor = vec4(0.25, 0.125, 0.0625, 1.0);
+}
@@ -0,0 +1,48 @@
+#version 400
+
+uniform sampler2D chainedTexture;
+uniform sampler2D depthTexture;
+
+// Size in texels of the reduced resolution texture
+uniform vec2 sourceSize;
+
+in vec2 texCoord;
+out vec4 myfragcolor;
+
+float znear = 0.1;
+float zfar = 2000.0;
+
+float linearize(float depth)
+{
+    return -zfar * znear / (depth * (zfar - znear) - zfar);
+}
+
+void main(void)
+{
+    // The four reduced texels around this pixel, as for linear filtering
+    vec2 position = texCoord * sourceSize - 0.5;
+    vec2 base = floor(position);
+    vec2 fraction = position - base;
+
+    float depth = linearize(texture2D(depthTexture, texCoord).r);
+
+    vec4 color = vec4(0.0);
+    float weightSum = 0.0;
+
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            vec2 texel = clamp(base + vec2(x, y), vec2(0.0), sourceSize - 1.0);
+
+            // The depth at the center of the reduced texel stands for the depth it was computed at
+            float sampleDepth = linearize(texture2D(depthTexture, (texel + 0.5) / sourceSize).r);
+
+            float bilinear = (x == 0 ? 1.0 - fraction.x : fraction.x) * (y == 0 ? 1.0 - fraction.y : fraction.y);
+            float weight = bilinear / (0.001 + abs(depth - sampleDepth) / depth);
+
+            color += texelFetch(chainedTexture, ivec2(texel), 0) * weight;
+            weightSum += weight;
+        }
+    }
+
+    myfragcolor = color / weightSum;
+}
@@ -0,0 +1,25 @@
+#version 400
+
+uniform sampler2D chainedTexture;
+
+// Texel size of the full resolution texture
+uniform vec2 sourceTexelSize;
+// 2 or 4
+uniform int factor;
+
+in vec2 texCoord;
+out vec4 myfragcolor;
+
+void main(void)
+{
+    // The center of a target texel is the corner between 2x2 source texels, so one linear fetch averages them;
+    // at a quarter, four fetches one texel away from the center average the 4x4 block
+    if (factor == 2) {
+        myfragcolor = texture2D(chainedTexture, texCoord);
+    } else {
+        myfragcolor = 0.25 * (texture2D(chainedTexture, texCoord + vec2(-1.0, -1.0) * sourceTexelSize)
+                            + texture2D(chainedTexture, texCoord + vec2( 1.0, -1.0) * sourceTexelSize)
+                            + texture2D(chainedTexture, texCoord + vec2(-1.0,  1.0) * sourceTexelSize)
+                            + texture2D(chainedTexture, texCoord + vec2( 1.0,  1.0) * sourceTexelSize));
+    }
+}
@@ -1,18 +1,8 @@
-#version 400
-
-uniform sampler2D originalTexture;
-uniform sampler2D chainedTexture;
-
-uniform vec2 screenDimentions;
-uniform vec2 texelSize;
-uniform float intensity;
-uniform bool addOriginal;
-
-in vec2 texCoord;
-out vec4 myfragcolor;
+uniform float $intensity;
+uniform bool $addOriginal;
 
 // Constantes pré-definidas pelo algoritmo Frei-Chen
-const mat3 G[] = mat3[9](
+const mat3 $G[] = mat3[9](
     1.0 / (2.0*sqrt(2.0)) * mat3(1.0, sqrt(2.0), 1.0, 0.0, 0.0, 0.0, -1.0, -sqrt(2.0), -1.0),
     1.0 / (2.0*sqrt(2.0)) * mat3(1.0, 0.0, -1.0, sqrt(2.0), 0.0, -sqrt(2.0), 1.0, 0.0, -1.0),
     1.0 / (2.0*sqrt(2.0)) * mat3(0.0, -1.0, sqrt(2.0), 1.0, 0.0, -1.0, -sqrt(2.0), 1.0, 0.0),
@@ -24,7 +14,7 @@ const mat3 G[] = mat3[9](
     1.0 / 3.0 * mat3(1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0)
 );
 
-void main(void)
+vec4 $apply(vec4 chainedColor)
 {
     int i, j;
     mat3 I;
@@ -40,7 +30,7 @@ void main(void)
     }
 
     for (i = 0; i < 9; i++) {
-        mat3 G2 = G[i];
+        mat3 G2 = $G[i];
         float dp3 = dot(G2[0], I[0]) + dot(G2[1], I[1]) + dot(G2[2], I[2]);
         cnv[i] = dp3 * dp3;
     }
@@ -48,8 +38,8 @@ void main(void)
     float M = (cnv[0] + cnv[1]) + (cnv[2] + cnv[3]);
     float S = (cnv[4] + cnv[5]) + (cnv[6] + cnv[7]) + cnv[8] + M;
 
-    myfragcolor = addOriginal ?
-                texture2D(chainedTexture, texCoord) - vec4(vec3(sqrt(M / S) * intensity), 0.0) :
-                vec4(vec3(sqrt(M / S) * intensity), texture2D(originalTexture, texCoord).a);
+    return $addOriginal ?
+                chainedColor - vec4(vec3(sqrt(M / S) * $intensity), 0.0) :
+                vec4(vec3(sqrt(M / S) * $intensity), texture2D(originalTexture, texCoord).a);
 }
 
@@ -0,0 +1,75 @@
+#version 430
+
+// Each work group loads the intensity of its tile and a one texel border once; the 3x3 neighbourhood of every pixel then comes
+// from shared memory
+
+#define TILE_SIZE 16
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+uniform sampler2D originalTexture;
+uniform sampler2D chainedTexture;
+layout(rgba8) uniform writeonly image2D outputImage;
+
+uniform float intensity;
+uniform bool addOriginal;
+
+// Constantes pré-definidas pelo algoritmo Frei-Chen
+const mat3 G[] = mat3[9](
+    1.0 / (2.0*sqrt(2.0)) * mat3(1.0, sqrt(2.0), 1.0, 0.0, 0.0, 0.0, -1.0, -sqrt(2.0), -1.0),
+    1.0 / (2.0*sqrt(2.0)) * mat3(1.0, 0.0, -1.0, sqrt(2.0), 0.0, -sqrt(2.0), 1.0, 0.0, -1.0),
+    1.0 / (2.0*sqrt(2.0)) * mat3(0.0, -1.0, sqrt(2.0), 1.0, 0.0, -1.0, -sqrt(2.0), 1.0, 0.0),
+    1.0 / (2.0*sqrt(2.0)) * mat3(sqrt(2.0), -1.0, 0.0, -1.0, 0.0, 1.0, 0.0, 1.0, -sqrt(2.0)),
+    1.0 / 2.0 * mat3(0.0, 1.0, 0.0, -1.0, 0.0, -1.0, 0.0, 1.0, 0.0),
+    1.0 / 2.0 * mat3(-1.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, -1.0),
+    1.0 / 6.0 * mat3(1.0, -2.0, 1.0, -2.0, 4.0, -2.0, 1.0, -2.0, 1.0),
+    1.0 / 6.0 * mat3(-2.0, 1.0, -2.0, 1.0, 4.0, 1.0, -2.0, 1.0, -2.0),
+    1.0 / 3.0 * mat3(1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0)
+);
+
+// Indexed by row, then column
+shared float tile[TILE_SIZE + 2][TILE_SIZE + 2];
+
+void main(void)
+{
+    ivec2 size = imageSize(outputImage);
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE_SIZE - 1;
+
+    // The tile has more texels than the group has invocations, so some load two
+    for (int i = int(gl_LocalInvocationIndex); i < (TILE_SIZE + 2) * (TILE_SIZE + 2); i += TILE_SIZE * TILE_SIZE) {
+        ivec2 offset = ivec2(i % (TILE_SIZE + 2), i / (TILE_SIZE + 2));
+        ivec2 texel = clamp(origin + offset, ivec2(0), size - 1);
+        tile[offset.y][offset.x] = length(texelFetch(originalTexture, texel, 0).rgb);
+    }
+
+    barrier();
+
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    int i, j;
+    mat3 I;
+    float cnv[9];
+    ivec2 local = ivec2(gl_LocalInvocationID.xy) + 1;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++)
+            I[i][j] = tile[local.y + j - 1][local.x + i - 1];
+    }
+
+    for (i = 0; i < 9; i++) {
+        mat3 G2 = G[i];
+        float dp3 = dot(G2[0], I[0]) + dot(G2[1], I[1]) + dot(G2[2], I[2]);
+        cnv[i] = dp3 * dp3;
+    }
+
+    float M = (cnv[0] + cnv[1]) + (cnv[2] + cnv[3]);
+    float S = (cnv[4] + cnv[5]) + (cnv[6] + cnv[7]) + cnv[8] + M;
+
+    vec4 color = addOriginal ?
+                texelFetch(chainedTexture, pixel, 0) - vec4(vec3(sqrt(M / S) * intensity), 0.0) :
+                vec4(vec3(sqrt(M / S) * intensity), texelFetch(originalTexture, pixel, 0).a);
+
+    imageStore(outputImage, pixel, color);
+}
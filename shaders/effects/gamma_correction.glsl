@@ -1,18 +1,6 @@
-#version 400
+uniform vec3 $gammaFactor;
 
-uniform sampler2D originalTexture;
-uniform sampler2D chainedTexture;
-
-uniform vec3 gammaFactor;
-
-in vec2 texCoord;
-out vec4 myfragcolor;
-
-void main(void)
+vec4 $apply(vec4 color)
 {
-    vec3 color = texture2D(chainedTexture, texCoord).rgb;
-
-    myfragcolor.rgb = pow(color, 1.0 / gammaFactor);
-    myfragcolor.a = 1.0;
+    return vec4(pow(color.rgb, 1.0 / $gammaFactor), 1.0);
 }
-
@@ -0,0 +1,49 @@
+#version 430
+
+// One work group blurs a segment of a row or column; the segment and its apron are fetched once into shared memory,
+// and each of the 15 taps then reads from there
+
+#define GROUP_SIZE 128
+#define RADIUS 7
+
+layout(local_size_x = GROUP_SIZE) in;
+
+uniform sampler2D chainedTexture;
+layout(rgba8) uniform writeonly image2D outputImage;
+
+// (1, 0) for a horizontal blur, (0, 1) for a vertical one
+uniform ivec2 blurAxis;
+// The center tap is at index 0; the others are used on both sides
+uniform float gaussianWeights[RADIUS + 1];
+
+shared vec4 tile[GROUP_SIZE + 2 * RADIUS];
+
+void main(void)
+{
+    ivec2 size = imageSize(outputImage);
+    ivec2 crossAxis = ivec2(1) - blurAxis;
+
+    int lineLength = size.x * blurAxis.x + size.y * blurAxis.y;
+    int line = int(gl_WorkGroupID.y);
+    int start = int(gl_WorkGroupID.x) * GROUP_SIZE;
+
+    // Texels past the edges repeat the edge, as clamped sampling would
+    for (int i = int(gl_LocalInvocationID.x); i < GROUP_SIZE + 2 * RADIUS; i += GROUP_SIZE) {
+        int position = clamp(start + i - RADIUS, 0, lineLength - 1);
+        tile[i] = texelFetch(chainedTexture, blurAxis * position + crossAxis * line, 0);
+    }
+
+    barrier();
+
+    int position = start + int(gl_LocalInvocationID.x);
+    if (position >= lineLength)
+        return;
+
+    int center = int(gl_LocalInvocationID.x) + RADIUS;
+    vec4 color = tile[center] * gaussianWeights[0];
+
+    for (int i = 1; i <= RADIUS; ++i)
+        color += (tile[center - i] + tile[center + i]) * gaussianWeights[i];
+
+    imageStore(outputImage, blurAxis * position + crossAxis * line, color);
+}
@@ -0,0 +1,146 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threadCount)
+    : remaining(0), steals(0)
+{
+    if (threadCount <= 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    this->threadCount = threadCount;
+    function = nullptr;
+    body = nullptr;
+    count = 0;
+    grain = 1;
+    generation = 0;
+    quit = false;
+
+    for (int i = 0; i < threadCount; ++i) {
+        Queue *queue = new Queue;
+        queue->head = 0;
+        queue->tail = 0;
+        queues.push_back(queue);
+    }
+
+    // The caller is thread 0
+    for (int i = 1; i < threadCount; ++i)
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        quit = true;
+    }
+    wake.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (auto queue = queues.begin(); queue != queues.end(); ++queue)
+        delete *queue;
+}
+
+void ThreadPool::run(int count, int grain, RangeFunction function, void *body)
+{
+    grain = std::max(1, grain);
+    int chunks = (count + grain - 1) / grain;
+
+    // Not worth waking anyone
+    if (threadCount == 1 || chunks <= 1) {
+        for (int begin = 0; begin < count; begin += grain)
+            function(body, begin, std::min(count, begin + grain), 0);
+        return;
+    }
+
+    this->function = function;
+    this->body = body;
+    this->count = count;
+    this->grain = grain;
+
+    // Set before queueing, so a worker still looking for work from the last loop counts the chunk it takes
+    remaining.store(chunks, std::memory_order_relaxed);
+
+    // Contiguous runs keep each thread on neighbouring items
+    int perThread = (chunks + threadCount - 1) / threadCount;
+    for (int i = 0; i < threadCount; ++i) {
+        Queue *queue = queues[i];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+
+        int first = std::min(chunks, i * perThread);
+        int last = std::min(chunks, first + perThread);
+
+        if ((int)queue->chunks.size() < last - first)
+            queue->chunks.resize(last - first);
+        for (int chunk = first; chunk < last; ++chunk)
+            queue->chunks[chunk - first] = chunk;
+
+        queue->head = 0;
+        queue->tail = last - first;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        ++generation;
+    }
+    wake.notify_all();
+
+    while (execute(0)) {
+    }
+
+    // The last chunks may still be running on other threads
+    while (remaining.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+bool ThreadPool::execute(int thread)
+{
+    int chunk = -1;
+
+    {
+        Queue *queue = queues[thread];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->head < queue->tail)
+            chunk = queue->chunks[queue->head++];
+    }
+
+    // Steal from the next threads first, so thieves spread over the victims
+    for (int i = 1; chunk < 0 && i < threadCount; ++i) {
+        Queue *victim = queues[(thread + i) % threadCount];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (victim->head < victim->tail) {
+            chunk = victim->chunks[--victim->tail];
+            steals.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (chunk < 0)
+        return false;
+
+    int begin = chunk * grain;
+    function(body, begin, std::min(count, begin + grain), thread);
+
+    remaining.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void ThreadPool::workerLoop(int thread)
+{
+    unsigned seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            while (!quit && generation == seen)
+                wake.wait(lock);
+
+            if (quit)
+                return;
+
+            seen = generation;
+        }
+
+        while (execute(thread)) {
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QtGlobal>
+
+/**
+ * @brief A fixed set of threads running data parallel loops, balanced by work stealing
+ *
+ * parallelFor splits a range in chunks and gives each thread a contiguous run of them in its own queue. A thread takes its chunks
+ * from the front of its queue, in order, and when it runs out steals from the back of the others, so threads that get cheap chunks
+ * pick up the work of the slow ones. The calling thread works as well, and the call returns once every chunk ran.
+ *
+ * The queues are only ever grown, so a loop allocates nothing once the pool has seen as many chunks. Only one thread may call
+ * parallelFor at a time.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @param threadCount Threads running the loops, counting the caller; 0 uses one per core
+     */
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    int getThreadCount() const { return threadCount; }
+
+    /**
+     * @brief Calls ''body(begin, end, thread)'' for every chunk of ''grain'' items of [0, count), in parallel
+     *
+     * ''thread'' is in [0, getThreadCount()) and identifies the thread running the chunk, for per-thread scratch data;
+     * the chunk itself is ''begin / grain''.
+     */
+    template<typename Body>
+    void parallelFor(int count, int grain, Body &body)
+    {
+        run(count, grain, &invoke<Body>, &body);
+    }
+
+    /**
+     * @brief Returns the number of chunks run by a thread other than the one they were given to
+     */
+    qint64 getSteals() const { return steals.load(std::memory_order_relaxed); }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    typedef void (*RangeFunction)(void *body, int begin, int end, int thread);
+
+    template<typename Body>
+    static void invoke(void *body, int begin, int end, int thread)
+    {
+        (*static_cast<Body*>(body))(begin, end, thread);
+    }
+
+    /**
+     * @brief The chunks given to one thread; the owner takes from ''head'', thieves from ''tail''
+     */
+    struct Queue {
+        std::mutex mutex;
+        std::vector<int> chunks;
+        int head;
+        int tail;
+    };
+
+    void run(int count, int grain, RangeFunction function, void *body);
+
+    /**
+     * @brief Runs one chunk from the queue of ''thread'', or stolen from another one
+     * @return false if every queue is empty
+     */
+    bool execute(int thread);
+
+    void workerLoop(int thread);
+
+    int threadCount;
+    std::vector<Queue*> queues;
+    std::vector<std::thread> threads;
+
+    /// @brief The loop being run; written before the chunks are queued, and read after one is taken
+    RangeFunction function;
+    void *body;
+    int count;
+    int grain;
+
+    /// @brief Chunks of the loop that have not finished yet
+    std::atomic<int> remaining;
+    std::atomic<qint64> steals;
+
+    /// @brief Incremented for every loop, to wake the workers
+    unsigned generation;
+    bool quit;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,15 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = bspgen
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../../bspcore.pri)
+
+SOURCES += main.cpp \
+    bspgenerator.cpp
+
+HEADERS += bspgenerator.h
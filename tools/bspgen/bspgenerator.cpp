@@ -0,0 +1,409 @@
+#include "bspgenerator.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <QFile>
+#include <QStringList>
+
+// Side of a leaf, and height of the world, in map units
+static const int CELL_SIZE = 512;
+static const int WORLD_HEIGHT = 256;
+
+BSPGenerator::BSPGenerator(const BSPGeneratorOptions &options)
+    : options(options), random(options.seed)
+{
+    // The leafs fill a rectangular grid, as square as possible. When the count has no divisor close to its square root, it is
+    // rounded up to fill the last row
+    int leafCount = qMax(1, options.leafs);
+    int side = (int)std::ceil(std::sqrt((double)leafCount));
+    gridWidth = side;
+    for (int width = side; width >= qMax(1, side / 2); --width) {
+        if (leafCount % width == 0) {
+            gridWidth = leafCount / width;
+            break;
+        }
+    }
+    gridHeight = (leafCount + gridWidth - 1) / gridWidth;
+    this->options.leafs = gridWidth * gridHeight;
+    this->options.clusters = qBound(1, options.clusters, this->options.leafs);
+    this->options.shaders = qMax(1, options.shaders);
+    this->options.lightmaps = qMax(1, options.lightmaps);
+    this->options.entities = qMax(2, options.entities);
+}
+
+QStringList BSPGenerator::checkLimits() const
+{
+    QStringList exceeded;
+
+    int clusterSize = ((options.clusters + 63) & ~63) >> 3;
+    qint64 surfaceCount = (qint64)options.surfaces + options.patches;
+    qint64 vertexCount = (qint64)options.surfaces * 4 + (qint64)options.patches * 9;
+    qint64 leafSurfaceCount = (qint64)(surfaceCount * (1.0f + options.sharedSurfaces));
+
+    struct Limit {
+        const char *name;
+        qint64 value;
+        qint64 limit;
+    } limits[] = {
+        { "MAX_MAP_LEAFS", options.leafs, MAX_MAP_LEAFS },
+        { "MAX_MAP_NODES", options.leafs - 1, MAX_MAP_NODES },
+        { "MAX_MAP_DRAW_SURFS", surfaceCount, MAX_MAP_DRAW_SURFS },
+        { "MAX_MAP_DRAW_VERTS", vertexCount, MAX_MAP_DRAW_VERTS },
+        { "MAX_MAP_DRAW_INDEXES", (qint64)options.surfaces * 6, MAX_MAP_DRAW_INDEXES },
+        { "MAX_MAP_LEAFFACES", leafSurfaceCount, MAX_MAP_LEAFFACES },
+        { "MAX_MAP_SHADERS", options.shaders, MAX_MAP_SHADERS },
+        { "MAX_MAP_ENTITIES", options.entities, MAX_MAP_ENTITIES },
+        { "MAX_MAP_LIGHTING", (qint64)options.lightmaps * sizeof (dlightmap_t), MAX_MAP_LIGHTING },
+        { "MAX_MAP_VISIBILITY", 8 + (qint64)options.clusters * clusterSize, MAX_MAP_VISIBILITY }
+    };
+
+    for (auto limit = std::begin(limits); limit != std::end(limits); ++limit) {
+        if (limit->value > limit->limit)
+            exceeded << QString("%1: %2 > %3").arg(limit->name).arg(limit->value).arg(limit->limit);
+    }
+
+    return exceeded;
+}
+
+QVector3D BSPGenerator::getLeafCenter(int leaf) const
+{
+    return QVector3D((leaf % gridWidth + 0.5f) * CELL_SIZE, (leaf / gridWidth + 0.5f) * CELL_SIZE, WORLD_HEIGHT / 2);
+}
+
+bool BSPGenerator::write(const QString &fileName)
+{
+    shaders.clear();
+    planes.clear();
+    nodes.clear();
+    leafs.clear();
+    leafSurfaces.clear();
+    models.clear();
+    surfaces.clear();
+    vertices.clear();
+    indexes.clear();
+    lightmaps.clear();
+
+    for (int i = 0; i < options.shaders; ++i) {
+        dshader_t shader;
+        memset(&shader, 0, sizeof (shader));
+        qsnprintf(shader.shader, MAX_QPATH, "textures/synthetic/shader%d", i);
+        shader.contentFlags = 1; // CONTENTS_SOLID
+        shaders.push_back(shader);
+    }
+
+    createLeafs();
+
+    if (buildTree(0, 0, gridWidth, gridHeight) < 0) {
+        // A single leaf still needs a root node; both sides lead to it
+        dnode_t node;
+        memset(&node, 0, sizeof (node));
+        node.planeNum = findPlane(0, 0);
+        node.children[0] = node.children[1] = -1;
+        node.maxs[0] = node.maxs[1] = CELL_SIZE;
+        node.maxs[2] = WORLD_HEIGHT;
+        nodes.push_back(node);
+    }
+
+    createSurfaces();
+    createVisibility();
+    createLightmaps();
+    createEntities();
+
+    dmodel_t world;
+    memset(&world, 0, sizeof (world));
+    world.maxs[0] = gridWidth * CELL_SIZE;
+    world.maxs[1] = gridHeight * CELL_SIZE;
+    world.maxs[2] = WORLD_HEIGHT;
+    world.numSurfaces = surfaces.size();
+    models.push_back(world);
+
+    dheader_t header;
+    memset(&header, 0, sizeof (header));
+    header.ident = BSP_IDENT;
+    header.version = BSP_VERSION;
+
+    QByteArray file(sizeof (header), 0);
+    addLump(file, header, LUMP_ENTITIES, entityString.constData(), entityString.size());
+    addLump(file, header, LUMP_SHADERS, shaders.data(), shaders.size() * sizeof (dshader_t));
+    addLump(file, header, LUMP_PLANES, planes.data(), planes.size() * sizeof (dplane_t));
+    addLump(file, header, LUMP_NODES, nodes.data(), nodes.size() * sizeof (dnode_t));
+    addLump(file, header, LUMP_LEAFS, leafs.data(), leafs.size() * sizeof (dleaf_t));
+    addLump(file, header, LUMP_LEAFSURFACES, leafSurfaces.data(), leafSurfaces.size() * sizeof (int));
+    addLump(file, header, LUMP_LEAFBRUSHES, nullptr, 0);
+    addLump(file, header, LUMP_MODELS, models.data(), models.size() * sizeof (dmodel_t));
+    addLump(file, header, LUMP_BRUSHES, nullptr, 0);
+    addLump(file, header, LUMP_BRUSHSIDES, nullptr, 0);
+    addLump(file, header, LUMP_DRAWVERTS, vertices.data(), vertices.size() * sizeof (dvert_t));
+    addLump(file, header, LUMP_DRAWINDEXES, indexes.data(), indexes.size() * sizeof (int));
+    addLump(file, header, LUMP_FOGS, nullptr, 0);
+    addLump(file, header, LUMP_SURFACES, surfaces.data(), surfaces.size() * sizeof (dsurface_t));
+    addLump(file, header, LUMP_LIGHTMAPS, lightmaps.data(), lightmaps.size() * sizeof (dlightmap_t));
+    addLump(file, header, LUMP_LIGHTGRID, nullptr, 0);
+    addLump(file, header, LUMP_VISIBILITY, visibility.constData(), visibility.size());
+
+    memcpy(file.data(), &header, sizeof (header));
+
+    QFile output(fileName);
+    if (!output.open(QFile::WriteOnly | QFile::Truncate)) {
+        error = output.errorString();
+        return false;
+    }
+
+    if (output.write(file) != file.size()) {
+        error = output.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+int BSPGenerator::buildTree(int x0, int y0, int x1, int y1)
+{
+    if (x1 - x0 == 1 && y1 - y0 == 1)
+        return -(y0 * gridWidth + x0 + 1);
+
+    int index = nodes.size();
+    nodes.push_back(dnode_t());
+
+    // Split along the longer side; children[0] is the front of the plane, where the coordinate is larger
+    int axis = (x1 - x0) >= (y1 - y0) ? 0 : 1;
+    int front, back;
+    float dist;
+
+    if (axis == 0) {
+        int middle = (x0 + x1) / 2;
+        dist = middle * CELL_SIZE;
+        front = buildTree(middle, y0, x1, y1);
+        back = buildTree(x0, y0, middle, y1);
+    }
+    else {
+        int middle = (y0 + y1) / 2;
+        dist = middle * CELL_SIZE;
+        front = buildTree(x0, middle, x1, y1);
+        back = buildTree(x0, y0, x1, middle);
+    }
+
+    dnode_t &node = nodes[index];
+    node.planeNum = findPlane(axis, dist);
+    node.children[0] = front;
+    node.children[1] = back;
+    node.mins[0] = x0 * CELL_SIZE;
+    node.mins[1] = y0 * CELL_SIZE;
+    node.mins[2] = 0;
+    node.maxs[0] = x1 * CELL_SIZE;
+    node.maxs[1] = y1 * CELL_SIZE;
+    node.maxs[2] = WORLD_HEIGHT;
+
+    return index;
+}
+
+int BSPGenerator::findPlane(int axis, float dist)
+{
+    for (int i = 0; i < (int)planes.size(); i += 2) {
+        if (planes[i].normal[axis] == 1.0f && planes[i].dist == dist)
+            return i;
+    }
+
+    // Planes are stored in pairs, with plane x^1 facing the opposite way
+    dplane_t plane;
+    memset(&plane, 0, sizeof (plane));
+    plane.normal[axis] = 1.0f;
+    plane.dist = dist;
+    planes.push_back(plane);
+
+    plane.normal[axis] = -1.0f;
+    plane.dist = -dist;
+    planes.push_back(plane);
+
+    return planes.size() - 2;
+}
+
+void BSPGenerator::createLeafs()
+{
+    leafs.resize(options.leafs);
+
+    for (int i = 0; i < options.leafs; ++i) {
+        dleaf_t &leaf = leafs[i];
+        memset(&leaf, 0, sizeof (leaf));
+
+        int x = i % gridWidth;
+        int y = i / gridWidth;
+
+        // Row-major runs of leafs form each cluster
+        leaf.cluster = (int)((qint64)i * options.clusters / options.leafs);
+        leaf.mins[0] = x * CELL_SIZE;
+        leaf.mins[1] = y * CELL_SIZE;
+        leaf.mins[2] = 0;
+        leaf.maxs[0] = (x + 1) * CELL_SIZE;
+        leaf.maxs[1] = (y + 1) * CELL_SIZE;
+        leaf.maxs[2] = WORLD_HEIGHT;
+    }
+}
+
+void BSPGenerator::createSurfaces()
+{
+    std::uniform_int_distribution<int> leafDistribution(0, options.leafs - 1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<std::vector<int> > surfacesByLeaf(options.leafs);
+
+    int total = options.surfaces + options.patches;
+    for (int i = 0; i < total; ++i) {
+        bool patch = i >= options.surfaces;
+        int leaf = leafDistribution(random);
+
+        float x = (leaf % gridWidth) * CELL_SIZE;
+        float y = (leaf / gridWidth) * CELL_SIZE;
+        float z = unit(random) * 64.0f;
+
+        // A random rectangle inside the cell
+        float x0 = x + unit(random) * CELL_SIZE * 0.5f;
+        float y0 = y + unit(random) * CELL_SIZE * 0.5f;
+        float x1 = x0 + (0.1f + unit(random) * 0.4f) * CELL_SIZE;
+        float y1 = y0 + (0.1f + unit(random) * 0.4f) * CELL_SIZE;
+
+        dsurface_t surface;
+        memset(&surface, 0, sizeof (surface));
+        surface.shaderNum = i % options.shaders;
+        surface.fogNum = -1;
+        surface.surfaceType = patch ? MST_PATCH : MST_PLANAR;
+        surface.firstVert = vertices.size();
+        surface.firstIndex = indexes.size();
+        surface.lightmapNum = i % options.lightmaps;
+        surface.lightmapWidth = surface.lightmapHeight = 16;
+        surface.lightmapX = (i / options.lightmaps) % (LIGHTMAP_WIDTH / 16) * 16;
+        surface.lightmapY = (i / options.lightmaps / (LIGHTMAP_WIDTH / 16)) % (LIGHTMAP_HEIGHT / 16) * 16;
+        surface.lightmapOrigin[0] = x0;
+        surface.lightmapOrigin[1] = y0;
+        surface.lightmapOrigin[2] = z;
+        surface.normal[2] = 1.0f;
+
+        int side = patch ? 3 : 2;
+        for (int row = 0; row < side; ++row) {
+            for (int column = 0; column < side; ++column) {
+                float s = (float)column / (side - 1);
+                float t = (float)row / (side - 1);
+
+                dvert_t vertex;
+                memset(&vertex, 0, sizeof (vertex));
+                vertex.position[0] = x0 + (x1 - x0) * s;
+                vertex.position[1] = y0 + (y1 - y0) * t;
+                // Patches bulge upwards in the middle
+                vertex.position[2] = z + (patch && row == 1 && column == 1 ? 32.0f : 0.0f);
+                vertex.textureCoords[0] = s;
+                vertex.textureCoords[1] = t;
+                vertex.lightmap[0] = (surface.lightmapX + s * 15.0f + 0.5f) / LIGHTMAP_WIDTH;
+                vertex.lightmap[1] = (surface.lightmapY + t * 15.0f + 0.5f) / LIGHTMAP_HEIGHT;
+                vertex.normal[2] = 1.0f;
+                vertex.color[0] = vertex.color[1] = vertex.color[2] = vertex.color[3] = 255;
+                vertices.push_back(vertex);
+            }
+        }
+
+        if (patch) {
+            // Patches are tessellated at load time by the engine, so they carry control points only
+            surface.numVerts = 9;
+            surface.patchWidth = 3;
+            surface.patchHeight = 3;
+        }
+        else {
+            surface.numVerts = 4;
+            // Quads are stored row by row: 0 1 / 2 3
+            static const int quad[] = { 0, 2, 1, 1, 2, 3 };
+            indexes.insert(indexes.end(), quad, quad + 6);
+            surface.numIndexes = 6;
+        }
+
+        surfaces.push_back(surface);
+        surfacesByLeaf[leaf].push_back(i);
+
+        // Some faces cross into a neighbouring leaf, which then references the same surface
+        if (unit(random) < options.sharedSurfaces) {
+            int neighbour = (leaf % gridWidth + 1 < gridWidth) ? leaf + 1 : (leaf + gridWidth < options.leafs ? leaf + gridWidth : -1);
+            if (neighbour >= 0)
+                surfacesByLeaf[neighbour].push_back(i);
+        }
+    }
+
+    for (int i = 0; i < options.leafs; ++i) {
+        leafs[i].firstLeafSurface = leafSurfaces.size();
+        leafs[i].numLeafSurfaces = surfacesByLeaf[i].size();
+        leafSurfaces.insert(leafSurfaces.end(), surfacesByLeaf[i].begin(), surfacesByLeaf[i].end());
+    }
+}
+
+void BSPGenerator::createVisibility()
+{
+    int clusters = options.clusters;
+    // Rows are padded to 64 bits, as q3map does
+    int clusterSize = ((clusters + 63) & ~63) >> 3;
+
+    visibility = QByteArray(8 + clusters * clusterSize, 0);
+    int header[2] = { clusters, clusterSize };
+    memcpy(visibility.data(), header, sizeof (header));
+
+    int reach = (int)(clusters * qBound(0.0f, options.visibilityDensity, 1.0f) / 2);
+    unsigned char *rows = (unsigned char*)visibility.data() + 8;
+
+    for (int cluster = 0; cluster < clusters; ++cluster) {
+        unsigned char *row = rows + cluster * clusterSize;
+        for (int other = qMax(0, cluster - reach); other < qMin(clusters, cluster + reach + 1); ++other)
+            row[other >> 3] |= 1 << (other & 7);
+    }
+}
+
+void BSPGenerator::createLightmaps()
+{
+    lightmaps.resize(options.lightmaps);
+
+    for (int i = 0; i < options.lightmaps; ++i) {
+        // A gradient tinted differently for each lightmap, so they can be told apart
+        unsigned char tint = (unsigned char)(64 + (i * 37) % 192);
+        for (int y = 0; y < LIGHTMAP_HEIGHT; ++y) {
+            for (int x = 0; x < LIGHTMAP_WIDTH; ++x) {
+                lightmaps[i].data[y][x][0] = (unsigned char)(x * 2);
+                lightmaps[i].data[y][x][1] = (unsigned char)(y * 2);
+                lightmaps[i].data[y][x][2] = tint;
+            }
+        }
+    }
+}
+
+void BSPGenerator::createEntities()
+{
+    std::uniform_real_distribution<float> x(0.0f, gridWidth * CELL_SIZE);
+    std::uniform_real_distribution<float> y(0.0f, gridHeight * CELL_SIZE);
+    std::uniform_int_distribution<int> angle(0, 359);
+
+    QString text;
+    text += "{\n\"classname\" \"worldspawn\"\n\"message\" \"Synthetic map\"\n}\n";
+    text += QString("{\n\"classname\" \"info_player_intermission\"\n\"origin\" \"%1 %2 128\"\n\"angles\" \"0 45 0\"\n}\n")
+            .arg(gridWidth * CELL_SIZE / 2).arg(gridHeight * CELL_SIZE / 2);
+
+    for (int i = 2; i < options.entities; ++i) {
+        const char *classname = (i % 4 == 0) ? "info_player_deathmatch" : "light";
+        text += QString("{\n\"classname\" \"%1\"\n\"origin\" \"%2 %3 %4\"\n")
+                .arg(classname).arg(x(random), 0, 'f', 0).arg(y(random), 0, 'f', 0).arg(WORLD_HEIGHT / 2);
+        if (i % 4 == 0)
+            text += QString("\"angle\" \"%1\"\n").arg(angle(random));
+        else
+            text += "\"light\" \"300\"\n";
+        text += "}\n";
+    }
+
+    entityString = text.toLatin1();
+    entityString.append('\0');
+}
+
+void BSPGenerator::addLump(QByteArray &file, dheader_t &header, int lump, const void *data, int length)
+{
+    while (file.size() % 4)
+        file.append('\0');
+
+    header.lumps[lump].fileofs = file.size();
+    header.lumps[lump].filelen = length;
+
+    if (length > 0)
+        file.append((const char*)data, length);
+}
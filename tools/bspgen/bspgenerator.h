@@ -0,0 +1,108 @@
+#ifndef BSPGENERATOR_H
+#define BSPGENERATOR_H
+
+#include "bspdefs.h"
+
+#include <random>
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief Parameters of a generated map
+ */
+struct BSPGeneratorOptions
+{
+    int leafs;
+    int clusters;
+    /// @brief Planar surfaces, each a quad on the floor of a leaf
+    int surfaces;
+    /// @brief 3x3 bezier patches, spread among the leafs like the surfaces
+    int patches;
+    int lightmaps;
+    int shaders;
+    int entities;
+    /// @brief Fraction of the clusters visible from each cluster, from 0 to 1
+    float visibilityDensity;
+    /// @brief Fraction of the surfaces also referenced by a neighbouring leaf, as brush faces that cross leafs are
+    float sharedSurfaces;
+    unsigned seed;
+};
+
+/**
+ * @brief Writes synthetic version 46 BSP files
+ *
+ * The world is a flat grid of square leafs, split by a balanced tree of axial planes. Clusters are contiguous runs of leafs, and
+ * each cluster sees a band of the clusters around it, so visibility stays local as in real maps.
+ */
+class BSPGenerator
+{
+public:
+    BSPGenerator(const BSPGeneratorOptions &options);
+
+    /**
+     * @brief Checks the options against the MAX_MAP_* limits of the engine
+     * @return An empty list if every limit is respected, otherwise one message per exceeded limit
+     */
+    QStringList checkLimits() const;
+
+    /**
+     * @brief Generates the map and writes it to a file
+     */
+    bool write(const QString &fileName);
+
+    QString errorString() const { return error; }
+
+    /**
+     * @brief Returns the options after rounding, such as the leaf count filling the grid
+     */
+    const BSPGeneratorOptions& getOptions() const { return options; }
+
+    /**
+     * @brief Returns the center of a leaf, at half the world height
+     */
+    QVector3D getLeafCenter(int leaf) const;
+
+private:
+    /**
+     * @brief Builds the node for the leafs in the rectangle [x0, x1) x [y0, y1) of the grid
+     * @return The child reference: a node index, or -(leaf + 1)
+     */
+    int buildTree(int x0, int y0, int x1, int y1);
+
+    void createLeafs();
+    void createSurfaces();
+    void createVisibility();
+    void createLightmaps();
+    void createEntities();
+
+    int findPlane(int axis, float dist);
+
+    /**
+     * @brief Appends a lump to the file contents, aligned to 4 bytes
+     */
+    void addLump(QByteArray &file, dheader_t &header, int lump, const void *data, int length);
+
+    BSPGeneratorOptions options;
+    std::mt19937 random;
+    QString error;
+
+    int gridWidth, gridHeight;
+
+    std::vector<dshader_t> shaders;
+    std::vector<dplane_t> planes;
+    std::vector<dnode_t> nodes;
+    std::vector<dleaf_t> leafs;
+    std::vector<int> leafSurfaces;
+    std::vector<dmodel_t> models;
+    std::vector<dsurface_t> surfaces;
+    std::vector<dvert_t> vertices;
+    std::vector<int> indexes;
+    std::vector<dlightmap_t> lightmaps;
+    QByteArray visibility;
+    QByteArray entityString;
+};
+
+#endif // BSPGENERATOR_H
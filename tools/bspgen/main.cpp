@@ -0,0 +1,167 @@
+#include "bspgenerator.h"
+#include "bspworld.h"
+
+#include <iostream>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+struct Preset
+{
+    const char *name;
+    BSPGeneratorOptions options;
+};
+
+// From a map that loads instantly up to one at the engine limits
+static const Preset presets[] = {
+    //                leafs  clusters  surfaces  patches  lightmaps  shaders  entities  density  shared  seed
+    { "tiny",   {       64,       16,      256,       8,         2,       8,       16,   0.50f,  0.10f,   1 } },
+    { "small",  {     1024,      256,     4096,      64,         8,      32,       64,   0.25f,  0.10f,   1 } },
+    { "medium", {     8192,     1024,    32768,     512,        32,     128,      256,   0.10f,  0.15f,   1 } },
+    { "large",  {    32768,     2048,    65536,    2048,        96,     512,     1024,   0.05f,  0.20f,   1 } },
+    { "limit",  { MAX_MAP_LEAFS, 4032,   80000,   20000,       170, MAX_MAP_SHADERS, MAX_MAP_ENTITIES, 0.02f, 0.20f, 1 } }
+};
+
+/**
+ * @brief Loads the generated map and checks that every leaf center leads back to its leaf
+ */
+static bool verify(const QString &fileName, const BSPGenerator &generator)
+{
+    BSPWorld world;
+    QObject::connect(&world, &BSPWorld::loadError, [](QString error) {
+        std::cerr << error.toLocal8Bit().data() << std::endl;
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!world.loadMap(fileName))
+        return false;
+
+    std::cout << "Loaded in " << timer.elapsed() << " ms: "
+              << world.getLeafs().size() << " leafs, "
+              << world.getVisibility().getClusterCount() << " clusters, "
+              << world.getSurfaces().size() << " surfaces, "
+              << world.getVertices().size() << " vertices, "
+              << world.getEntities().size() << " entities" << std::endl;
+
+    int leafCount = generator.getOptions().leafs;
+    for (int leaf = 0; leaf < leafCount; ++leaf) {
+        int found = world.findNodeForPosition(generator.getLeafCenter(leaf));
+        if (found != leaf) {
+            std::cerr << "Leaf " << leaf << " center is in leaf " << found << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("bspgen");
+
+    QStringList presetNames;
+    for (auto preset = std::begin(presets); preset != std::end(presets); ++preset)
+        presetNames << preset->name;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Writes synthetic version 46 BSP maps for scaling tests");
+    parser.addHelpOption();
+    parser.addPositionalArgument("output", "The BSP file to write");
+    QCommandLineOption presetOption(QStringList() << "p" << "preset", "Starting point for the sizes: " + presetNames.join(", ") + " (default: small)", "name", "small");
+    QCommandLineOption leafsOption("leafs", "Number of leafs", "count");
+    QCommandLineOption clustersOption("clusters", "Number of visibility clusters", "count");
+    QCommandLineOption surfacesOption("surfaces", "Number of planar surfaces", "count");
+    QCommandLineOption patchesOption("patches", "Number of bezier patches", "count");
+    QCommandLineOption lightmapsOption("lightmaps", "Number of lightmaps", "count");
+    QCommandLineOption shadersOption("shaders", "Number of shaders", "count");
+    QCommandLineOption entitiesOption("entities", "Number of entities", "count");
+    QCommandLineOption densityOption("pvs-density", "Fraction of the clusters visible from each cluster, 0 to 1", "fraction");
+    QCommandLineOption sharedOption("shared", "Fraction of the surfaces also referenced by a neighbouring leaf, 0 to 1", "fraction");
+    QCommandLineOption seedOption("seed", "Random seed", "value");
+    QCommandLineOption forceOption(QStringList() << "f" << "force", "Write the map even if it exceeds the MAX_MAP_* limits");
+    QCommandLineOption verifyOption("verify", "Load the written map and check its tree");
+    parser.addOption(presetOption);
+    parser.addOption(leafsOption);
+    parser.addOption(clustersOption);
+    parser.addOption(surfacesOption);
+    parser.addOption(patchesOption);
+    parser.addOption(lightmapsOption);
+    parser.addOption(shadersOption);
+    parser.addOption(entitiesOption);
+    parser.addOption(densityOption);
+    parser.addOption(sharedOption);
+    parser.addOption(seedOption);
+    parser.addOption(forceOption);
+    parser.addOption(verifyOption);
+    parser.process(a);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1)
+        parser.showHelp(1);
+
+    const Preset *preset = nullptr;
+    for (auto i = std::begin(presets); i != std::end(presets); ++i) {
+        if (parser.value(presetOption) == i->name)
+            preset = i;
+    }
+
+    if (!preset) {
+        std::cerr << "Unknown preset " << parser.value(presetOption).toLocal8Bit().data() << std::endl;
+        return 1;
+    }
+
+    BSPGeneratorOptions options = preset->options;
+    if (parser.isSet(leafsOption))
+        options.leafs = parser.value(leafsOption).toInt();
+    if (parser.isSet(clustersOption))
+        options.clusters = parser.value(clustersOption).toInt();
+    if (parser.isSet(surfacesOption))
+        options.surfaces = qMax(0, parser.value(surfacesOption).toInt());
+    if (parser.isSet(patchesOption))
+        options.patches = qMax(0, parser.value(patchesOption).toInt());
+    if (parser.isSet(lightmapsOption))
+        options.lightmaps = parser.value(lightmapsOption).toInt();
+    if (parser.isSet(shadersOption))
+        options.shaders = parser.value(shadersOption).toInt();
+    if (parser.isSet(entitiesOption))
+        options.entities = parser.value(entitiesOption).toInt();
+    if (parser.isSet(densityOption))
+        options.visibilityDensity = parser.value(densityOption).toFloat();
+    if (parser.isSet(sharedOption))
+        options.sharedSurfaces = qBound(0.0f, parser.value(sharedOption).toFloat(), 1.0f);
+    if (parser.isSet(seedOption))
+        options.seed = parser.value(seedOption).toUInt();
+
+    BSPGenerator generator(options);
+
+    QStringList exceeded = generator.checkLimits();
+    for (auto limit = exceeded.begin(); limit != exceeded.end(); ++limit)
+        std::cerr << "Exceeds " << limit->toLocal8Bit().data() << std::endl;
+
+    if (!exceeded.isEmpty() && !parser.isSet(forceOption)) {
+        std::cerr << "Use --force to write it anyway; the engine will not load it" << std::endl;
+        return 1;
+    }
+
+    const BSPGeneratorOptions &actual = generator.getOptions();
+    std::cout << "Generating " << actual.leafs << " leafs, " << actual.clusters << " clusters, "
+              << actual.surfaces << " surfaces, " << actual.patches << " patches, "
+              << actual.lightmaps << " lightmaps, " << actual.entities << " entities" << std::endl;
+
+    if (!generator.write(args[0])) {
+        std::cerr << "Unable to write " << args[0].toLocal8Bit().data() << ": " << generator.errorString().toLocal8Bit().data() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << QFileInfo(args[0]).size() << " bytes to " << args[0].toLocal8Bit().data() << std::endl;
+
+    if (parser.isSet(verifyOption) && !verify(args[0], generator))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,16 @@
+QT       += core gui network
+QT       -= widgets
+
+TARGET = bspqueryd
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(../../bspcore.pri)
+
+SOURCES += main.cpp \
+    bspqueryserver.cpp
+
+HEADERS += bspqueryprotocol.h \
+    bspqueryserver.h
@@ -0,0 +1,93 @@
+#ifndef BSPQUERYPROTOCOL_H
+#define BSPQUERYPROTOCOL_H
+
+#include <QtGlobal>
+
+/*
+ * Wire format used by bspqueryd over a local socket.
+ *
+ * Every message (in both directions) starts with a BSPQueryMessageHeader, followed by ''count'' records.
+ * A request record starts with a BSPQueryRecordHeader, followed by the payload for its type.
+ * The server answers each request message with exactly one reply message, holding one reply record per request record, in the same order.
+ *
+ * All values use the host byte order, since both ends always run on the same machine.
+ */
+
+#define BSPQUERY_MAGIC (('Q'<<24)+('P'<<16)+('S'<<8)+'B')
+
+#define BSPQUERY_DEFAULT_SOCKET "bspqueryd"
+
+// Upper limit for a single message, so a misbehaving client cannot make the server buffer without bound
+#define BSPQUERY_MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+
+#define BSPQUERY_MAX_CLASSNAME 256
+
+typedef enum {
+    BSPQUERY_MAP_INFO,
+    BSPQUERY_POINT_TO_LEAF,
+    BSPQUERY_CAN_SEE,
+    BSPQUERY_ENTITIES_BY_CLASSNAME,
+    BSPQUERY_CAN_HEAR,
+    BSPQUERY_INVALID
+} bspQueryType_t;
+
+#pragma pack(push, 1)
+
+typedef struct {
+    quint32     magic;
+    quint32     length;     // size of the records, in bytes, not including this header
+    quint32     count;
+} BSPQueryMessageHeader;
+
+typedef struct {
+    quint32     type;
+} BSPQueryRecordHeader;
+
+// BSPQUERY_MAP_INFO has no request payload
+
+typedef struct {
+    qint32      leafCount;
+    qint32      clusterCount;
+    qint32      entityCount;
+    float       mins[3];
+    float       maxs[3];
+    quint32     checksum;
+} BSPQueryMapInfoReply;
+
+typedef struct {
+    float       position[3];
+} BSPQueryPointRequest;
+
+typedef struct {
+    qint32      leaf;
+    qint32      cluster;
+    qint32      area;
+} BSPQueryPointReply;
+
+typedef struct {
+    qint32      fromCluster;
+    qint32      toCluster;
+} BSPQueryCanSeeRequest;
+
+typedef struct {
+    quint32     visible;
+} BSPQueryCanSeeReply;
+
+// BSPQUERY_CAN_HEAR uses the same request and reply as BSPQUERY_CAN_SEE; without a PHS everything is hearable
+
+typedef struct {
+    quint32     length;     // followed by ''length'' bytes of the classname, without terminator
+} BSPQueryClassnameRequest;
+
+typedef struct {
+    quint32     count;      // followed by ''count'' BSPQueryEntityRecord
+} BSPQueryClassnameReply;
+
+typedef struct {
+    qint32      entity;     // index of the entity in the entity lump
+    float       origin[3];
+} BSPQueryEntityRecord;
+
+#pragma pack(pop)
+
+#endif // BSPQUERYPROTOCOL_H
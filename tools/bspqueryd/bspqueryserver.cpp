@@ -0,0 +1,237 @@
+#include "bspqueryserver.h"
+
+#include "bspqueryprotocol.h"
+
+#include <cstring>
+#include <sstream>
+
+#include <QDebug>
+
+BSPQueryServer::BSPQueryServer(const BSPWorld *world, QObject *parent)
+    : QObject(parent), world(world)
+{
+    indexEntities();
+
+    connect(&server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+BSPQueryServer::~BSPQueryServer()
+{
+    server.close();
+}
+
+bool BSPQueryServer::listen(const QString &name)
+{
+    // Remove a stale socket left by a previous instance that did not shut down cleanly
+    QLocalServer::removeServer(name);
+
+    return server.listen(name);
+}
+
+void BSPQueryServer::indexEntities()
+{
+    const std::vector<BSPEntity*> &entities = world->getEntities();
+
+    for (int i = 0; i < (int)entities.size(); ++i) {
+        QString classname = entities[i]->getSetting("classname");
+        if (classname.isNull())
+            continue;
+
+        entitiesByClassname[classname.toLower()].push_back(i);
+    }
+}
+
+void BSPQueryServer::newConnection()
+{
+    while (QLocalSocket *socket = server.nextPendingConnection()) {
+        buffers[socket] = QByteArray();
+
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+    }
+}
+
+void BSPQueryServer::readClient()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    if (!socket)
+        return;
+
+    QByteArray &buffer = buffers[socket];
+    buffer.append(socket->readAll());
+
+    if (!processMessages(socket, buffer)) {
+        qWarning() << "Malformed query message, dropping client" << endl;
+        buffer.clear();
+        socket->disconnectFromServer();
+    }
+}
+
+void BSPQueryServer::clientDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    if (!socket)
+        return;
+
+    buffers.erase(socket);
+    socket->deleteLater();
+}
+
+bool BSPQueryServer::processMessages(QLocalSocket *socket, QByteArray &buffer)
+{
+    int offset = 0;
+    QByteArray reply;
+
+    while (buffer.size() - offset >= (int)sizeof (BSPQueryMessageHeader)) {
+        BSPQueryMessageHeader header;
+        memcpy(&header, buffer.constData() + offset, sizeof (header));
+
+        if (header.magic != BSPQUERY_MAGIC || header.length > BSPQUERY_MAX_MESSAGE_SIZE)
+            return false;
+
+        // Wait for the rest of the message
+        if ((quint32)(buffer.size() - offset) - sizeof (header) < header.length)
+            break;
+
+        BSPQueryMessageHeader replyHeader;
+        replyHeader.magic = BSPQUERY_MAGIC;
+        replyHeader.count = header.count;
+        replyHeader.length = 0;
+
+        int replyHeaderOffset = reply.size();
+        reply.append((const char*)&replyHeader, sizeof (replyHeader));
+
+        if (!processRecords(buffer.constData() + offset + sizeof (header), header.length, header.count, reply))
+            return false;
+
+        // Now that the records were written, patch the reply length
+        replyHeader.length = reply.size() - replyHeaderOffset - sizeof (replyHeader);
+        memcpy(reply.data() + replyHeaderOffset, &replyHeader, sizeof (replyHeader));
+
+        offset += sizeof (header) + header.length;
+    }
+
+    buffer.remove(0, offset);
+
+    if (!reply.isEmpty())
+        socket->write(reply);
+
+    return true;
+}
+
+bool BSPQueryServer::processRecords(const char *data, quint32 length, quint32 count, QByteArray &reply)
+{
+    const char *end = data + length;
+
+    const std::vector<dleaf_t> &leafs = world->getLeafs();
+    const BSPVisibility &visibility = world->getVisibility();
+    int clusterCount = visibility.getClusterCount();
+
+    while (count --> 0) {
+        BSPQueryRecordHeader record;
+        if (end - data < (int)sizeof (record))
+            return false;
+        memcpy(&record, data, sizeof (record));
+        data += sizeof (record);
+
+        reply.append((const char*)&record, sizeof (record));
+
+        switch (record.type) {
+        case BSPQUERY_MAP_INFO: {
+            BSPQueryMapInfoReply info;
+            const dmodel_t &worldModel = world->getModels()[0];
+
+            info.leafCount = leafs.size();
+            info.clusterCount = clusterCount;
+            info.entityCount = world->getEntities().size();
+            memcpy(info.mins, worldModel.mins, sizeof (info.mins));
+            memcpy(info.maxs, worldModel.maxs, sizeof (info.maxs));
+            info.checksum = world->getChecksum();
+
+            reply.append((const char*)&info, sizeof (info));
+            break;
+        }
+
+        case BSPQUERY_POINT_TO_LEAF: {
+            BSPQueryPointRequest request;
+            if (end - data < (int)sizeof (request))
+                return false;
+            memcpy(&request, data, sizeof (request));
+            data += sizeof (request);
+
+            BSPQueryPointReply point;
+            point.leaf = world->findNodeForPosition(QVector3D(request.position[0], request.position[1], request.position[2]));
+            point.cluster = leafs[point.leaf].cluster;
+            point.area = leafs[point.leaf].area;
+
+            reply.append((const char*)&point, sizeof (point));
+            break;
+        }
+
+        case BSPQUERY_CAN_SEE:
+        case BSPQUERY_CAN_HEAR: {
+            BSPQueryCanSeeRequest request;
+            if (end - data < (int)sizeof (request))
+                return false;
+            memcpy(&request, data, sizeof (request));
+            data += sizeof (request);
+
+            BSPQueryCanSeeReply visible;
+            if (record.type == BSPQUERY_CAN_SEE)
+                visible.visible = rowCache.canSee(visibility, request.fromCluster, request.toCluster) ? 1 : 0;
+            else
+                visible.visible = hearingCache.canSee(world->getHearability(), request.fromCluster, request.toCluster) ? 1 : 0;
+
+            reply.append((const char*)&visible, sizeof (visible));
+            break;
+        }
+
+        case BSPQUERY_ENTITIES_BY_CLASSNAME: {
+            BSPQueryClassnameRequest request;
+            if (end - data < (int)sizeof (request))
+                return false;
+            memcpy(&request, data, sizeof (request));
+            data += sizeof (request);
+
+            if (request.length > BSPQUERY_MAX_CLASSNAME || end - data < (int)request.length)
+                return false;
+            QString classname = QString::fromLatin1(data, request.length).toLower();
+            data += request.length;
+
+            BSPQueryClassnameReply result;
+            result.count = 0;
+
+            auto found = entitiesByClassname.find(classname);
+            if (found != entitiesByClassname.end())
+                result.count = found->second.size();
+
+            reply.append((const char*)&result, sizeof (result));
+
+            if (result.count == 0)
+                break;
+
+            const std::vector<BSPEntity*> &entities = world->getEntities();
+            for (auto index = found->second.begin(); index != found->second.end(); ++index) {
+                float x = 0.0f, y = 0.0f, z = 0.0f;
+                std::istringstream iss(entities[*index]->getSetting("origin").toLatin1().data());
+                iss >> x >> y >> z;
+
+                BSPQueryEntityRecord entity;
+                entity.entity = *index;
+                entity.origin[0] = x;
+                entity.origin[1] = y;
+                entity.origin[2] = z;
+
+                reply.append((const char*)&entity, sizeof (entity));
+            }
+            break;
+        }
+
+        default:
+            // The payload size of an unknown type is unknown too, so the rest of the message cannot be parsed
+            return false;
+        }
+    }
+
+    return data == end;
+}
@@ -0,0 +1,77 @@
+#ifndef BSPQUERYSERVER_H
+#define BSPQUERYSERVER_H
+
+#include "bspworld.h"
+
+#include <map>
+#include <vector>
+
+#include <QByteArray>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QString>
+
+/**
+ * @brief Answers batched map queries from local clients
+ *
+ * The world is loaded once and shared by every connection. See bspqueryprotocol.h for the wire format.
+ */
+class BSPQueryServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructs the server for an already loaded world
+     * @remarks The server does not take the ownership of the world
+     */
+    BSPQueryServer(const BSPWorld *world, QObject *parent = 0);
+    ~BSPQueryServer();
+
+    /**
+     * @brief Starts listening on the specified local socket name
+     */
+    bool listen(const QString &name);
+
+    QString errorString() const { return server.errorString(); }
+
+private slots:
+    void newConnection();
+    void readClient();
+    void clientDisconnected();
+
+private:
+    /**
+     * @brief Builds the classname index used by the entity queries
+     */
+    void indexEntities();
+
+    /**
+     * @brief Processes every complete message in the buffer, writing the replies to the socket
+     * @return false if the client sent a malformed message
+     */
+    bool processMessages(QLocalSocket *socket, QByteArray &buffer);
+
+    /**
+     * @brief Answers all records of a single message
+     * @return false if the message is malformed
+     */
+    bool processRecords(const char *data, quint32 length, quint32 count, QByteArray &reply);
+
+    const BSPWorld *world;
+
+    QLocalServer server;
+
+    /// @brief Pending incoming bytes of each client
+    std::map<QLocalSocket*, QByteArray> buffers;
+
+    /// @brief Decompressed PVS and PHS rows, used when the world keeps them compressed
+    PVSRowCache rowCache;
+    PVSRowCache hearingCache;
+
+    /// @brief Entity indices by lower case classname
+    std::map<QString, std::vector<int> > entitiesByClassname;
+};
+
+#endif // BSPQUERYSERVER_H
@@ -0,0 +1,58 @@
+#include "bspqueryprotocol.h"
+#include "bspqueryserver.h"
+#include "bspworld.h"
+
+#include <iostream>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("bspqueryd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Loads a BSP map once and answers leaf, visibility and entity queries over a local socket");
+    parser.addHelpOption();
+    parser.addPositionalArgument("map", "The BSP file to serve");
+    QCommandLineOption socketOption(QStringList() << "s" << "socket", "Local socket name (default: " BSPQUERY_DEFAULT_SOCKET ")", "name", BSPQUERY_DEFAULT_SOCKET);
+    parser.addOption(socketOption);
+    QCommandLineOption compressOption(QStringList() << "c" << "compress-pvs", "Keep the PVS run-length encoded in memory");
+    parser.addOption(compressOption);
+    QCommandLineOption phsOption(QStringList() << "p" << "phs", "Build the potentially hearable set, enabling the hearing queries");
+    parser.addOption(phsOption);
+    parser.process(a);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1)
+        parser.showHelp(1);
+
+    BSPWorld world;
+    QObject::connect(&world, &BSPWorld::loadError, [](QString error) {
+        std::cerr << error.toLocal8Bit().data() << std::endl;
+    });
+
+    if (parser.isSet(compressOption))
+        world.setVisibilityStorage(BSPVisibility::Compressed);
+    world.setBuildHearability(parser.isSet(phsOption));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!world.loadMap(args[0]))
+        return 1;
+
+    std::cout << "Loaded " << args[0].toLocal8Bit().data() << " in " << timer.elapsed() << " ms" << std::endl;
+
+    BSPQueryServer server(&world);
+    if (!server.listen(parser.value(socketOption))) {
+        std::cerr << "Unable to listen: " << server.errorString().toLocal8Bit().data() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Listening on " << parser.value(socketOption).toLocal8Bit().data() << std::endl;
+
+    return a.exec();
+}
@@ -0,0 +1,14 @@
+QT       += core network
+QT       -= gui
+
+TARGET = bspqueryload
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../bspqueryd
+
+SOURCES += main.cpp
+
+HEADERS += ../bspqueryd/bspqueryprotocol.h
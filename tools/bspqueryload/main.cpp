@@ -0,0 +1,273 @@
+#include "bspqueryprotocol.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <QByteArray>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+
+// Classnames used by the entity queries; most maps have at least some of them
+static const char *classnames[] = {
+    "worldspawn",
+    "info_player_deathmatch",
+    "info_player_intermission",
+    "light",
+    "target_position"
+};
+
+struct LoadOptions
+{
+    QString socketName;
+    int clients;
+    int batchSize;
+    int duration;
+    int entityPercent;
+};
+
+struct ClientResult
+{
+    bool ok;
+    qint64 queries;
+    std::vector<qint64> latencies; // in nanoseconds, one per batch
+};
+
+/**
+ * @brief Reads exactly ''length'' bytes from the socket, blocking as needed
+ */
+static bool readExactly(QLocalSocket &socket, char *data, qint64 length)
+{
+    while (length > 0) {
+        if (socket.bytesAvailable() == 0 && !socket.waitForReadyRead(5000))
+            return false;
+
+        qint64 read = socket.read(data, length);
+        if (read < 0)
+            return false;
+
+        data += read;
+        length -= read;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sends a message and waits for the whole reply
+ */
+static bool roundTrip(QLocalSocket &socket, const QByteArray &message, QByteArray &reply)
+{
+    socket.write(message);
+    if (!socket.waitForBytesWritten(5000))
+        return false;
+
+    BSPQueryMessageHeader header;
+    if (!readExactly(socket, (char*)&header, sizeof (header)))
+        return false;
+
+    if (header.magic != BSPQUERY_MAGIC || header.length > BSPQUERY_MAX_MESSAGE_SIZE)
+        return false;
+
+    reply.resize(header.length);
+    return readExactly(socket, reply.data(), header.length);
+}
+
+static void beginMessage(QByteArray &message, quint32 count)
+{
+    BSPQueryMessageHeader header;
+    header.magic = BSPQUERY_MAGIC;
+    header.length = 0;
+    header.count = count;
+
+    message.clear();
+    message.append((const char*)&header, sizeof (header));
+}
+
+static void endMessage(QByteArray &message)
+{
+    quint32 length = message.size() - sizeof (BSPQueryMessageHeader);
+    memcpy(message.data() + offsetof(BSPQueryMessageHeader, length), &length, sizeof (length));
+}
+
+static void appendRecord(QByteArray &message, bspQueryType_t type, const void *payload, int size)
+{
+    BSPQueryRecordHeader record;
+    record.type = type;
+    message.append((const char*)&record, sizeof (record));
+    if (size > 0)
+        message.append((const char*)payload, size);
+}
+
+static bool queryMapInfo(const QString &socketName, BSPQueryMapInfoReply &info)
+{
+    QLocalSocket socket;
+    socket.connectToServer(socketName);
+    if (!socket.waitForConnected(5000))
+        return false;
+
+    QByteArray message, reply;
+    beginMessage(message, 1);
+    appendRecord(message, BSPQUERY_MAP_INFO, nullptr, 0);
+    endMessage(message);
+
+    if (!roundTrip(socket, message, reply))
+        return false;
+
+    if (reply.size() != sizeof (BSPQueryRecordHeader) + sizeof (BSPQueryMapInfoReply))
+        return false;
+
+    memcpy(&info, reply.constData() + sizeof (BSPQueryRecordHeader), sizeof (info));
+    return true;
+}
+
+static void runClient(int index, const LoadOptions &options, const BSPQueryMapInfoReply &info, ClientResult &result)
+{
+    result.ok = false;
+    result.queries = 0;
+
+    QLocalSocket socket;
+    socket.connectToServer(options.socketName);
+    if (!socket.waitForConnected(5000))
+        return;
+
+    // Seed with the client index, so runs are repeatable
+    std::mt19937 random(index + 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> cluster(0, std::max(info.clusterCount - 1, 0));
+    std::uniform_int_distribution<int> classname(0, sizeof (classnames) / sizeof (classnames[0]) - 1);
+    std::uniform_real_distribution<float> axis[3] = {
+        std::uniform_real_distribution<float>(info.mins[0], info.maxs[0]),
+        std::uniform_real_distribution<float>(info.mins[1], info.maxs[1]),
+        std::uniform_real_distribution<float>(info.mins[2], info.maxs[2])
+    };
+
+    QByteArray message, reply;
+    QElapsedTimer total, batch;
+    total.start();
+
+    while (total.elapsed() < options.duration * 1000) {
+        beginMessage(message, options.batchSize);
+
+        for (int i = 0; i < options.batchSize; ++i) {
+            int kind = percent(random);
+
+            if (kind < options.entityPercent) {
+                const char *name = classnames[classname(random)];
+                BSPQueryClassnameRequest request;
+                request.length = strlen(name);
+                appendRecord(message, BSPQUERY_ENTITIES_BY_CLASSNAME, &request, sizeof (request));
+                message.append(name, request.length);
+            }
+            else if (kind % 2 == 0) {
+                BSPQueryPointRequest request;
+                for (int j = 0; j < 3; ++j)
+                    request.position[j] = axis[j](random);
+                appendRecord(message, BSPQUERY_POINT_TO_LEAF, &request, sizeof (request));
+            }
+            else {
+                BSPQueryCanSeeRequest request;
+                request.fromCluster = cluster(random);
+                request.toCluster = cluster(random);
+                appendRecord(message, BSPQUERY_CAN_SEE, &request, sizeof (request));
+            }
+        }
+
+        endMessage(message);
+
+        batch.start();
+        if (!roundTrip(socket, message, reply))
+            return;
+        result.latencies.push_back(batch.nsecsElapsed());
+        result.queries += options.batchSize;
+    }
+
+    result.ok = true;
+}
+
+static double percentile(const std::vector<qint64> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    size_t index = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("bspqueryload");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for bspqueryd; reports queries per second and batch latency percentiles");
+    parser.addHelpOption();
+    QCommandLineOption socketOption(QStringList() << "s" << "socket", "Local socket name (default: " BSPQUERY_DEFAULT_SOCKET ")", "name", BSPQUERY_DEFAULT_SOCKET);
+    QCommandLineOption clientsOption(QStringList() << "c" << "clients", "Concurrent clients (default: 4)", "count", "4");
+    QCommandLineOption batchOption(QStringList() << "b" << "batch", "Queries per message (default: 64)", "count", "64");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration", "Duration in seconds (default: 10)", "seconds", "10");
+    QCommandLineOption entityOption(QStringList() << "e" << "entity-percent", "Share of entity queries; the rest is split between leaf and visibility queries (default: 10)", "percent", "10");
+    parser.addOption(socketOption);
+    parser.addOption(clientsOption);
+    parser.addOption(batchOption);
+    parser.addOption(durationOption);
+    parser.addOption(entityOption);
+    parser.process(a);
+
+    LoadOptions options;
+    options.socketName = parser.value(socketOption);
+    options.clients = qMax(1, parser.value(clientsOption).toInt());
+    options.batchSize = qMax(1, parser.value(batchOption).toInt());
+    options.duration = qMax(1, parser.value(durationOption).toInt());
+    options.entityPercent = qBound(0, parser.value(entityOption).toInt(), 100);
+
+    BSPQueryMapInfoReply info;
+    if (!queryMapInfo(options.socketName, info)) {
+        std::cerr << "Unable to query " << options.socketName.toLocal8Bit().data() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Map: " << info.leafCount << " leafs, " << info.clusterCount << " clusters, " << info.entityCount << " entities" << std::endl;
+
+    std::vector<ClientResult> results(options.clients);
+    std::vector<std::thread> threads;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < options.clients; ++i)
+        threads.push_back(std::thread(runClient, i, std::cref(options), std::cref(info), std::ref(results[i])));
+
+    for (auto &thread : threads)
+        thread.join();
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    qint64 queries = 0;
+    std::vector<qint64> latencies;
+    for (auto &result : results) {
+        if (!result.ok)
+            std::cerr << "A client failed before the end of the run" << std::endl;
+
+        queries += result.queries;
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "Clients: " << options.clients << ", batch: " << options.batchSize << ", duration: " << seconds << " s" << std::endl;
+    std::cout << "Queries: " << queries << " (" << (qint64)(queries / seconds) << " queries/s)" << std::endl;
+    std::cout << "Batch latency (us): p50 " << percentile(latencies, 0.50)
+              << ", p90 " << percentile(latencies, 0.90)
+              << ", p99 " << percentile(latencies, 0.99)
+              << ", p99.9 " << percentile(latencies, 0.999)
+              << ", max " << (latencies.empty() ? 0.0 : latencies.back() / 1000.0) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+QT       += core
+QT       -= gui
+
+TARGET = bspstats
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+
+HEADERS += ../../framestatsprotocol.h
@@ -0,0 +1,271 @@
+#include "framestatsprotocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QSharedMemory>
+
+/**
+ * @brief Follows the frame statistics ring of a running viewer
+ *
+ * The segment is only attached while polling: on Unix an attached segment outlives the viewer, and would keep a restarted viewer
+ * from creating it again.
+ */
+class StatsReader
+{
+public:
+    StatsReader() : header(nullptr), ring(nullptr), next(0), dropped(0), publisherPid(0) {}
+
+    /**
+     * @brief Attaches to the segment, if the viewer created it
+     *
+     * Reading continues where the previous attachment stopped, unless the segment now belongs to another viewer.
+     */
+    bool attach(const QString &key)
+    {
+        memory.setKey(key);
+        if (!memory.attach(QSharedMemory::ReadOnly))
+            return false;
+
+        if ((size_t)memory.size() < sizeof (FrameStatsHeader)) {
+            memory.detach();
+            return false;
+        }
+
+        const FrameStatsHeader *candidate = static_cast<const FrameStatsHeader*>(memory.constData());
+        if (candidate->magic != FRAMESTATS_MAGIC || candidate->version != FRAMESTATS_VERSION
+                || candidate->headerSize != sizeof (FrameStatsHeader) || candidate->slotSize != sizeof (FrameStatsSlot)
+                || candidate->capacity != FRAMESTATS_CAPACITY || (size_t)memory.size() < FRAMESTATS_SEGMENT_SIZE) {
+            std::cerr << "Unsupported frame statistics segment" << std::endl;
+            memory.detach();
+            return false;
+        }
+
+        header = candidate;
+        ring = reinterpret_cast<const FrameStatsSlot*>(static_cast<const char*>(memory.constData()) + header->headerSize);
+
+        if (header->publisherPid != publisherPid) {
+            publisherPid = header->publisherPid;
+
+            // Start with what is still in the ring
+            quint64 published = header->published.load(std::memory_order_acquire);
+            next = published > FRAMESTATS_CAPACITY ? published - FRAMESTATS_CAPACITY : 0;
+            dropped = 0;
+        }
+
+        return true;
+    }
+
+    void detach()
+    {
+        header = nullptr;
+        ring = nullptr;
+        memory.detach();
+    }
+
+    qint64 getPublisherPid() const { return publisherPid; }
+
+    /**
+     * @brief Copies the next published record
+     * @return false if there is no new record
+     */
+    bool read(FrameStatsRecord &record)
+    {
+        for (;;) {
+            quint64 published = header->published.load(std::memory_order_acquire);
+            if (next >= published)
+                return false;
+
+            // Fell behind the writer: skip what was overwritten
+            if (published - next > FRAMESTATS_CAPACITY) {
+                dropped += published - FRAMESTATS_CAPACITY - next;
+                next = published - FRAMESTATS_CAPACITY;
+            }
+
+            const FrameStatsSlot &slot = ring[next % FRAMESTATS_CAPACITY];
+            quint64 expected = 2 * (next + 1);
+
+            quint64 before = slot.sequence.load(std::memory_order_acquire);
+            if (before == expected) {
+                memcpy(&record, &slot.record, sizeof (record));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == before) {
+                    ++next;
+                    return true;
+                }
+            }
+
+            // The writer lapped us while copying; the next iteration skips ahead
+            ++dropped;
+            ++next;
+        }
+    }
+
+    quint64 getDropped() const { return dropped; }
+
+private:
+    QSharedMemory memory;
+
+    const FrameStatsHeader *header;
+    const FrameStatsSlot *ring;
+
+    /// @brief Number of the next record to read
+    quint64 next;
+    quint64 dropped;
+    qint64 publisherPid;
+};
+
+/**
+ * @brief Accumulates the records read during an interval
+ */
+struct IntervalSummary
+{
+    int frames;
+    double cpuTotal, gpuTotal;
+    float gpuMax;
+    FrameStatsRecord last;
+
+    void clear()
+    {
+        frames = 0;
+        cpuTotal = gpuTotal = 0.0;
+        gpuMax = 0.0f;
+    }
+
+    void add(const FrameStatsRecord &record)
+    {
+        ++frames;
+        cpuTotal += record.cpuTime;
+        gpuTotal += record.gpuTime;
+        gpuMax = std::max(gpuMax, record.gpuTime);
+        last = record;
+    }
+};
+
+static void printCsvHeader()
+{
+    std::cout << "frame,timestamp,cpu_ms,gpu_ms,visible_clusters,visible_leafs,visible_surfaces,draw_calls,texture_binds,triangles,effects" << std::endl;
+}
+
+static void printCsv(const FrameStatsRecord &record)
+{
+    std::cout << record.frame << ',' << record.timestamp << ',' << record.cpuTime << ',' << record.gpuTime << ','
+              << record.visibleClusters << ',' << record.visibleLeafs << ',' << record.visibleSurfaces << ','
+              << record.drawCalls << ',' << record.textureBinds << ',' << record.triangles << ',';
+
+    // Effects as name=gpu_ms pairs separated by spaces, so the column count is fixed
+    for (quint32 i = 0; i < std::min(record.effectCount, (quint32)FRAMESTATS_MAX_EFFECTS); ++i) {
+        const FrameStatsEffect &effect = record.effects[i];
+        std::cout << (i ? " " : "") << std::string(effect.name, strnlen(effect.name, FRAMESTATS_MAX_NAME)) << '=' << effect.gpuTime;
+    }
+
+    std::cout << '\n';
+}
+
+static void printSummary(const IntervalSummary &summary, double seconds)
+{
+    std::cout << std::fixed << std::setprecision(2);
+
+    if (summary.frames == 0) {
+        std::cout << "no frames" << std::endl;
+        return;
+    }
+
+    const FrameStatsRecord &last = summary.last;
+    std::cout << std::setw(7) << summary.frames / seconds << " fps"
+              << "  cpu " << std::setw(6) << summary.cpuTotal / summary.frames
+              << "  gpu " << std::setw(6) << summary.gpuTotal / summary.frames << " (max " << summary.gpuMax << ") ms"
+              << "  clusters " << last.visibleClusters
+              << "  surfaces " << last.visibleSurfaces
+              << "  draws " << last.drawCalls
+              << "  binds " << last.textureBinds;
+
+    for (quint32 i = 0; i < std::min(last.effectCount, (quint32)FRAMESTATS_MAX_EFFECTS); ++i)
+        std::cout << "  " << std::string(last.effects[i].name, strnlen(last.effects[i].name, FRAMESTATS_MAX_NAME)) << ' ' << last.effects[i].gpuTime;
+
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("bspstats");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Reads the frame statistics a viewer started with --publish-stats writes to shared memory");
+    parser.addHelpOption();
+    QCommandLineOption keyOption(QStringList() << "k" << "key", "Shared memory key (default: " FRAMESTATS_DEFAULT_KEY ")", "key", FRAMESTATS_DEFAULT_KEY);
+    parser.addOption(keyOption);
+    QCommandLineOption intervalOption(QStringList() << "i" << "interval", "Milliseconds between polls (default: 500)", "ms", "500");
+    parser.addOption(intervalOption);
+    QCommandLineOption countOption(QStringList() << "n" << "count", "Number of polls before exiting; 0 runs until interrupted (default: 0)", "count", "0");
+    parser.addOption(countOption);
+    QCommandLineOption csvOption("csv", "Prints every frame as CSV instead of a summary per poll");
+    parser.addOption(csvOption);
+    parser.process(a);
+
+    QString key = parser.value(keyOption);
+    int interval = std::max(1, parser.value(intervalOption).toInt());
+    int count = std::max(0, parser.value(countOption).toInt());
+    bool csv = parser.isSet(csvOption);
+
+    StatsReader reader;
+    IntervalSummary summary;
+    quint64 reportedDrops = 0;
+    qint64 publisherPid = 0;
+    bool waiting = false;
+
+    if (csv)
+        printCsvHeader();
+
+    for (int poll = 0; count == 0 || poll < count; ++poll) {
+        if (poll > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+
+        if (!reader.attach(key)) {
+            if (!waiting)
+                std::cerr << "Waiting for a viewer publishing to " << key.toLocal8Bit().data() << std::endl;
+            waiting = true;
+            continue;
+        }
+
+        waiting = false;
+
+        if (reader.getPublisherPid() != publisherPid) {
+            std::cerr << "Reading from process " << reader.getPublisherPid() << std::endl;
+            publisherPid = reader.getPublisherPid();
+            reportedDrops = 0;
+        }
+
+        summary.clear();
+
+        FrameStatsRecord record;
+        while (reader.read(record)) {
+            if (csv)
+                printCsv(record);
+            else
+                summary.add(record);
+        }
+
+        reader.detach();
+
+        if (csv)
+            std::cout << std::flush;
+        else
+            printSummary(summary, interval / 1000.0);
+
+        if (reader.getDropped() != reportedDrops) {
+            std::cerr << reader.getDropped() - reportedDrops << " records were overwritten before being read; poll more often" << std::endl;
+            reportedDrops = reader.getDropped();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+TEMPLATE = subdirs
+
+SUBDIRS += bspqueryd \
+    bspqueryload \
+    bspgen \
+    bspstats
@@ -0,0 +1,144 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+Tracer::Tracer()
+    : enabled(false), nextThread(1)
+{
+    clock.start();
+}
+
+Tracer& Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+int Tracer::currentThread()
+{
+    thread_local int thread = 0;
+    if (thread == 0)
+        thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+
+    return thread;
+}
+
+void Tracer::setThreadName(const QString &name)
+{
+    int thread = currentThread();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto i = threadNames.begin(); i != threadNames.end(); ++i) {
+        if (i->first == thread) {
+            i->second = name;
+            return;
+        }
+    }
+
+    threadNames.push_back(std::make_pair(thread, name));
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+}
+
+void Tracer::add(Event &event)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(std::move(event));
+}
+
+bool Tracer::writeChromeTrace(const QString &fileName) const
+{
+    qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray traceEvents;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto name = threadNames.begin(); name != threadNames.end(); ++name) {
+        QJsonObject args;
+        args["name"] = name->second;
+
+        QJsonObject metadata;
+        metadata["name"] = QStringLiteral("thread_name");
+        metadata["ph"] = QStringLiteral("M");
+        metadata["pid"] = pid;
+        metadata["tid"] = name->first;
+        metadata["args"] = args;
+        traceEvents.append(metadata);
+    }
+
+    for (auto event = events.begin(); event != events.end(); ++event) {
+        QJsonObject args;
+        for (auto number = event->numbers.begin(); number != event->numbers.end(); ++number)
+            args[number->first] = number->second;
+        for (auto string = event->strings.begin(); string != event->strings.end(); ++string)
+            args[string->first] = string->second;
+
+        // Complete events ("X") carry their own duration, so no begin/end pairing is needed
+        QJsonObject object;
+        object["name"] = event->name;
+        object["cat"] = event->category;
+        object["ph"] = QStringLiteral("X");
+        object["ts"] = event->begin;
+        object["dur"] = event->duration;
+        object["pid"] = pid;
+        object["tid"] = event->thread;
+        if (!args.isEmpty())
+            object["args"] = args;
+        traceEvents.append(object);
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = traceEvents;
+    root["displayTimeUnit"] = QStringLiteral("ms");
+
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    return file.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) > 0;
+}
+
+TraceScope::TraceScope(const char *category, const char *name)
+{
+    Tracer &tracer = Tracer::instance();
+
+    active = tracer.isEnabled();
+    if (!active)
+        return;
+
+    event.name = name;
+    event.category = category;
+    event.thread = tracer.currentThread();
+    event.begin = tracer.now();
+}
+
+TraceScope::~TraceScope()
+{
+    if (!active)
+        return;
+
+    Tracer &tracer = Tracer::instance();
+    event.duration = tracer.now() - event.begin;
+    tracer.add(event);
+}
+
+void TraceScope::addArgument(const char *key, qint64 value)
+{
+    if (active)
+        event.numbers.push_back(std::make_pair(key, value));
+}
+
+void TraceScope::addArgument(const char *key, const QString &value)
+{
+    if (active)
+        event.strings.push_back(std::make_pair(key, value));
+}
@@ -0,0 +1,106 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QString>
+
+/**
+ * @brief Records timed events from any thread and exports them in the Chrome trace format
+ *
+ * The JSON written by writeChromeTrace() opens in chrome://tracing and in Perfetto. Recording is off by default, and a disabled
+ * TraceScope costs a single atomic load, so scopes can stay in the loading code permanently.
+ * GL calls are recorded on the CPU side only; the driver may still be doing the work after the scope ends.
+ */
+class Tracer
+{
+public:
+    static Tracer& instance();
+
+    void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Names the calling thread in the exported trace
+     */
+    void setThreadName(const QString &name);
+
+    /**
+     * @brief Discards all recorded events
+     */
+    void clear();
+
+    /**
+     * @brief Writes every recorded event as a Chrome trace JSON file
+     */
+    bool writeChromeTrace(const QString &fileName) const;
+
+    /**
+     * @brief Returns the time since the tracer was created, in microseconds
+     */
+    qint64 now() const { return clock.nsecsElapsed() / 1000; }
+
+private:
+    friend class TraceScope;
+
+    struct Event {
+        const char *name;
+        const char *category;
+        int thread;
+        qint64 begin;
+        qint64 duration;
+        std::vector<std::pair<const char*, qint64> > numbers;
+        std::vector<std::pair<const char*, QString> > strings;
+    };
+
+    Tracer();
+    Tracer(const Tracer&);
+    Tracer& operator=(const Tracer&);
+
+    /**
+     * @brief Returns a small sequential ID for the calling thread
+     */
+    int currentThread();
+
+    void add(Event &event);
+
+    std::atomic<bool> enabled;
+    std::atomic<int> nextThread;
+    QElapsedTimer clock;
+
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+    std::vector<std::pair<int, QString> > threadNames;
+};
+
+/**
+ * @brief Records an event covering its lifetime
+ * @remarks ''name'' and ''category'' must be string literals, or otherwise outlive the tracer
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name);
+    ~TraceScope();
+
+    /**
+     * @brief Sets the number of bytes processed, shown as the "bytes" argument
+     */
+    void setBytes(qint64 bytes) { addArgument("bytes", bytes); }
+
+    void addArgument(const char *key, qint64 value);
+    void addArgument(const char *key, const QString &value);
+
+private:
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+
+    bool active;
+    Tracer::Event event;
+};
+
+#endif // TRACER_H
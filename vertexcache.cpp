@@ -0,0 +1,201 @@
+#include "vertexcache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+struct VertexState {
+    /// @brief Position in the simulated LRU cache, or -1 if not in it
+    int cachePosition;
+    /// @brief Triangles using the vertex that are not emitted yet
+    int remaining;
+    /// @brief Start of the triangles of the vertex in the adjacency array
+    int firstTriangle;
+    float score;
+};
+
+float vertexScore(const VertexState &vertex)
+{
+    // Nothing left to draw with it
+    if (vertex.remaining == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+
+    if (vertex.cachePosition >= 0) {
+        if (vertex.cachePosition < 3) {
+            // Used by the last triangle; a fixed score, so the next triangle does not just reuse its edge in a strip
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (vertex.cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+
+    // Vertices with few triangles left are finished first, instead of leaving lone triangles behind
+    score += VALENCE_BOOST_SCALE * std::pow((float)vertex.remaining, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+}
+
+void optimizeVertexCache(int *indexes, int indexCount, int vertexCount)
+{
+    int triangleCount = indexCount / 3;
+    if (triangleCount < 2 || vertexCount <= 0)
+        return;
+
+    std::vector<VertexState> vertices(vertexCount);
+    for (auto &vertex : vertices) {
+        vertex.cachePosition = -1;
+        vertex.remaining = 0;
+        vertex.firstTriangle = 0;
+        vertex.score = 0.0f;
+    }
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        ++vertices[indexes[i]].remaining;
+
+    // Triangles of each vertex, as one array with an offset per vertex
+    int offset = 0;
+    for (auto &vertex : vertices) {
+        vertex.firstTriangle = offset;
+        offset += vertex.remaining;
+    }
+
+    std::vector<int> adjacency(offset);
+    std::vector<int> filled(vertexCount, 0);
+    for (int triangle = 0; triangle < triangleCount; ++triangle) {
+        for (int corner = 0; corner < 3; ++corner) {
+            int vertex = indexes[triangle * 3 + corner];
+            adjacency[vertices[vertex].firstTriangle + filled[vertex]++] = triangle;
+        }
+    }
+
+    for (auto &vertex : vertices)
+        vertex.score = vertexScore(vertex);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (int triangle = 0; triangle < triangleCount; ++triangle) {
+        triangleScores[triangle] = vertices[indexes[triangle * 3]].score + vertices[indexes[triangle * 3 + 1]].score
+                + vertices[indexes[triangle * 3 + 2]].score;
+    }
+
+    std::vector<int> output;
+    output.reserve(triangleCount * 3);
+
+    // Three more entries than the cache, for the vertices pushed out by the triangle being added
+    std::vector<int> cache, nextCache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+    int bestTriangle = -1;
+    int scanPosition = 0;
+
+    for (int added = 0; added < triangleCount; ++added) {
+        // Nothing in the cache has triangles left: start again from the first triangle not drawn yet
+        if (bestTriangle < 0) {
+            while (emitted[scanPosition])
+                ++scanPosition;
+
+            bestTriangle = scanPosition;
+            for (int triangle = scanPosition + 1; triangle < triangleCount; ++triangle) {
+                if (!emitted[triangle] && triangleScores[triangle] > triangleScores[bestTriangle])
+                    bestTriangle = triangle;
+            }
+        }
+
+        const int *corners = indexes + bestTriangle * 3;
+        output.insert(output.end(), corners, corners + 3);
+        emitted[bestTriangle] = true;
+
+        // The vertices of the triangle move to the front of the cache
+        nextCache.clear();
+        for (int corner = 0; corner < 3; ++corner) {
+            int vertex = corners[corner];
+            nextCache.push_back(vertex);
+
+            // Remove the triangle from the ones left for the vertex
+            VertexState &state = vertices[vertex];
+            int *triangles = adjacency.data() + state.firstTriangle;
+            for (int i = 0; i < state.remaining; ++i) {
+                if (triangles[i] == bestTriangle) {
+                    std::swap(triangles[i], triangles[state.remaining - 1]);
+                    break;
+                }
+            }
+            --state.remaining;
+        }
+
+        for (int vertex : cache) {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+                nextCache.push_back(vertex);
+        }
+        cache.swap(nextCache);
+
+        // Rescore what is in the cache, and what falls out of it
+        for (int i = 0; i < (int)cache.size(); ++i) {
+            VertexState &state = vertices[cache[i]];
+            state.cachePosition = i < VERTEX_CACHE_SIZE ? i : -1;
+
+            float score = vertexScore(state);
+            float delta = score - state.score;
+            state.score = score;
+
+            const int *triangles = adjacency.data() + state.firstTriangle;
+            for (int j = 0; j < state.remaining; ++j)
+                triangleScores[triangles[j]] += delta;
+        }
+
+        if ((int)cache.size() > VERTEX_CACHE_SIZE)
+            cache.resize(VERTEX_CACHE_SIZE);
+
+        // The next triangle is the best one touching the cache
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (int vertex : cache) {
+            const VertexState &state = vertices[vertex];
+            const int *triangles = adjacency.data() + state.firstTriangle;
+            for (int j = 0; j < state.remaining; ++j) {
+                if (triangleScores[triangles[j]] > bestScore) {
+                    bestScore = triangleScores[triangles[j]];
+                    bestTriangle = triangles[j];
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indexes);
+}
+
+float averageCacheMissRatio(const int *indexes, int indexCount, int vertexCount, int cacheSize)
+{
+    int triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return 0.0f;
+
+    // The time each vertex entered the FIFO; it is still in it if fewer than cacheSize misses happened since
+    std::vector<int> entered(std::max(vertexCount, 0), -1);
+    int misses = 0;
+
+    for (int i = 0; i < triangleCount * 3; ++i) {
+        int vertex = indexes[i];
+        if (vertex < 0 || vertex >= vertexCount)
+            continue;
+
+        if (entered[vertex] < 0 || misses - entered[vertex] >= cacheSize) {
+            entered[vertex] = misses;
+            ++misses;
+        }
+    }
+
+    return (float)misses / triangleCount;
+}
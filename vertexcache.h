@@ -0,0 +1,28 @@
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+/**
+ * @brief Size of the post-transform cache the triangles are ordered for, and that the miss ratio simulates
+ */
+const int VERTEX_CACHE_SIZE = 32;
+
+/**
+ * @brief Reorders the triangles of an indexed triangle list for the post-transform vertex cache
+ *
+ * Uses Tom Forsyth's linear-speed algorithm: the next triangle is always the one whose vertices score best, where a vertex scores
+ * higher the more recently it was used and the fewer triangles it has left, so fans are finished instead of being left for later.
+ * Only the order of the triangles changes, and the winding of each one is kept.
+ *
+ * @param indexes The triangle list, rewritten in place
+ * @param vertexCount One more than the largest index
+ */
+void optimizeVertexCache(int *indexes, int indexCount, int vertexCount);
+
+/**
+ * @brief Returns the average number of vertices transformed per triangle with a FIFO cache of ''cacheSize'' entries
+ *
+ * 3 means no reuse at all; a regular grid approaches 0.5.
+ */
+float averageCacheMissRatio(const int *indexes, int indexCount, int vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+#endif // VERTEXCACHE_H
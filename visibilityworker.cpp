@@ -0,0 +1,159 @@
+#include "visibilityworker.h"
+
+#include "tracer.h"
+
+VisibilityWorker::VisibilityWorker()
+    : state(Idle), quit(false)
+{
+    pool = nullptr;
+    front = 0;
+    primed = false;
+    latency = 0;
+    stalls = 0;
+    requestedFrontToBack = false;
+    requestedClusterBatches = false;
+}
+
+VisibilityWorker::~VisibilityWorker()
+{
+    stopThread();
+    delete pool;
+}
+
+void VisibilityWorker::setWorld(const BSPWorld *world, const BSPSurfaceGroups *groups)
+{
+    collect();
+
+    culler.setWorld(world, groups);
+
+    for (int i = 0; i < 2; ++i) {
+        lists[i].clear();
+        lists[i].surfaces.shrink_to_fit();
+        lists[i].groups.shrink_to_fit();
+        if (world)
+            lists[i].surfaces.reserve(world->getSurfaces().size());
+        if (groups)
+            lists[i].groups.reserve(groups->groups.size());
+    }
+
+    primed = false;
+}
+
+void VisibilityWorker::setLatency(int frames)
+{
+    frames = qBound(0, frames, 1);
+    if (frames == latency)
+        return;
+
+    collect();
+    latency = frames;
+
+    if (latency > 0)
+        startThread();
+    else
+        stopThread();
+}
+
+void VisibilityWorker::setThreadCount(int threads)
+{
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads == getThreadCount())
+        return;
+
+    collect();
+
+    delete pool;
+    pool = threads > 1 ? new ThreadPool(threads) : nullptr;
+    culler.setThreadPool(pool);
+}
+
+const BSPDrawList& VisibilityWorker::update(const QVector3D &cameraPosition, const QMatrix4x4 &viewProjection, bool frontToBack, bool clusterBatches)
+{
+    if (latency == 0) {
+        culler.build(cameraPosition, viewProjection, frontToBack, clusterBatches, lists[front]);
+        return lists[front];
+    }
+
+    // The list the worker built from the previous camera becomes the one to draw
+    if (collect())
+        front = 1 - front;
+    else if (!primed)
+        culler.build(cameraPosition, viewProjection, frontToBack, clusterBatches, lists[front]);
+
+    primed = true;
+
+    requestedPosition = cameraPosition;
+    requestedViewProjection = viewProjection;
+    requestedFrontToBack = frontToBack;
+    requestedClusterBatches = clusterBatches;
+
+    {
+        // Publishing under the mutex keeps the worker from missing the wake up between its check and its wait
+        std::lock_guard<std::mutex> lock(mutex);
+        state.store(Requested, std::memory_order_release);
+    }
+    wake.notify_one();
+
+    return lists[front];
+}
+
+bool VisibilityWorker::collect()
+{
+    if (state.load(std::memory_order_acquire) == Idle)
+        return false;
+
+    if (state.load(std::memory_order_acquire) != Done) {
+        ++stalls;
+        while (state.load(std::memory_order_acquire) != Done)
+            std::this_thread::yield();
+    }
+
+    state.store(Idle, std::memory_order_relaxed);
+    return true;
+}
+
+void VisibilityWorker::run()
+{
+    Tracer::instance().setThreadName("visibility");
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (state.load(std::memory_order_acquire) != Requested && !quit.load(std::memory_order_relaxed))
+                wake.wait(lock);
+        }
+
+        if (quit.load(std::memory_order_relaxed))
+            return;
+
+        culler.build(requestedPosition, requestedViewProjection, requestedFrontToBack, requestedClusterBatches, lists[1 - front]);
+
+        state.store(Done, std::memory_order_release);
+    }
+}
+
+void VisibilityWorker::startThread()
+{
+    if (thread.joinable())
+        return;
+
+    quit.store(false, std::memory_order_relaxed);
+    thread = std::thread(&VisibilityWorker::run, this);
+}
+
+void VisibilityWorker::stopThread()
+{
+    if (!thread.joinable())
+        return;
+
+    collect();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit.store(true, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+
+    thread.join();
+}
@@ -0,0 +1,108 @@
+#ifndef VISIBILITYWORKER_H
+#define VISIBILITYWORKER_H
+
+#include "bspculler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Builds the draw lists on a worker thread, one frame ahead of the render thread
+ *
+ * With a latency of one frame, each call to update returns the list built from the camera of the previous call, and hands the
+ * current camera to the worker, which builds the next list while the returned one is submitted. The two lists are double buffered:
+ * the render thread only swaps them once the worker has published its list, so neither side ever locks one. The mutex only parks
+ * the worker while it has nothing to do.
+ *
+ * With a latency of 0 the list is built on the calling thread, as before, and the worker is never started.
+ *
+ * Either way, the culling itself can be split over a thread pool, which the thread building the list joins.
+ */
+class VisibilityWorker
+{
+public:
+    VisibilityWorker();
+    ~VisibilityWorker();
+
+    /**
+     * @brief Sets the world to cull and its surface groups, waiting for the list in progress and discarding both lists
+     * @remarks The worker does not take the ownership of the world or of the groups
+     */
+    void setWorld(const BSPWorld *world, const BSPSurfaceGroups *groups);
+
+    /**
+     * @brief Sets how many frames the draw list trails the camera, 0 or 1
+     */
+    void setLatency(int frames);
+    int getLatency() const { return latency; }
+
+    /**
+     * @brief Sets the threads the culling of one list is split over, counting the one building it; 0 uses one per core
+     */
+    void setThreadCount(int threads);
+    int getThreadCount() const { return pool ? pool->getThreadCount() : 1; }
+
+    /**
+     * @brief Returns the list to draw this frame, and with a latency of one frame starts building the next one from this camera
+     * @remarks The list stays valid until the next call to update or setWorld
+     */
+    const BSPDrawList& update(const QVector3D &cameraPosition, const QMatrix4x4 &viewProjection, bool frontToBack, bool clusterBatches);
+
+    /**
+     * @brief Returns the number of updates that had to wait for the worker to finish
+     */
+    qint64 getStalls() const { return stalls; }
+
+private:
+    VisibilityWorker(const VisibilityWorker&);
+    VisibilityWorker& operator=(const VisibilityWorker&);
+
+    enum State {
+        /// @brief The worker has no request; only the render thread touches the lists and the culler
+        Idle,
+        /// @brief The worker owns the back list and the culler until it publishes Done
+        Requested,
+        Done
+    };
+
+    void run();
+
+    /**
+     * @brief Waits until the request in progress, if any, is done, and takes back the lists
+     * @return Whether there was a request
+     */
+    bool collect();
+
+    void startThread();
+    void stopThread();
+
+    BSPCuller culler;
+    /// @brief nullptr when culling on one thread
+    ThreadPool *pool;
+
+    BSPDrawList lists[2];
+    /// @brief The list returned by the last update; the other one is the one the worker builds
+    int front;
+    /// @brief Whether the front list was built for the current world
+    bool primed;
+
+    int latency;
+    qint64 stalls;
+
+    /// @brief The request; written by the render thread before publishing Requested, and only read by the worker after seeing it
+    QVector3D requestedPosition;
+    QMatrix4x4 requestedViewProjection;
+    bool requestedFrontToBack;
+    bool requestedClusterBatches;
+
+    std::atomic<int> state;
+    std::atomic<bool> quit;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+};
+
+#endif // VISIBILITYWORKER_H